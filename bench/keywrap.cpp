@@ -0,0 +1,144 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/random.h"
+#include "Zway/crypto/rsa.h"
+#include "Zway/thread.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Zway;
+
+// ============================================================ //
+
+//! Message key wrapping for 1 to 256 recipients
+/*!
+ *  Compares one RSA::encrypt call per recipient against the
+ *  batch API. A few key pairs are generated and reused, the
+ *  cost of a wrap does not depend on which key is used.
+ */
+
+static const uint32_t NUM_KEYS = 8;
+
+static const uint32_t NUM_ROUNDS = 3;
+
+// ============================================================ //
+
+double elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint32_t bits = argc > 1 ? atoi(argv[1]) : 2048;
+
+    if (!Crypto::Random::setup()) {
+
+        fprintf(stderr, "failed to seed random generator\n");
+
+        return 1;
+    }
+
+    std::vector<UBJ::Value> keys;
+
+    for (uint32_t i=0; i<NUM_KEYS; ++i) {
+
+        UBJ::Value publicKey;
+
+        UBJ::Value privateKey;
+
+        if (!Crypto::RSA::createKeyPair(publicKey, privateKey, bits)) {
+
+            fprintf(stderr, "failed to create key pair\n");
+
+            return 1;
+        }
+
+        keys.push_back(publicKey);
+    }
+
+    BUFFER messageKey = Buffer::create(nullptr, 32);
+
+    Crypto::Random::random(messageKey->data(), messageKey->size());
+
+    printf("rsa-%u, %u threads\n", bits, ThreadPool::instance().numThreads());
+
+    printf("%10s %14s %14s %9s\n", "recipients", "serial ms", "batch ms", "speedup");
+
+    for (uint32_t n=1; n<=256; n*=2) {
+
+        std::map<uint32_t, UBJ::Value> publicKeys;
+
+        for (uint32_t i=0; i<n; ++i) {
+
+            publicKeys[i] = keys[i % NUM_KEYS];
+        }
+
+        double serial = 0;
+
+        double batch = 0;
+
+        for (uint32_t round=0; round<NUM_ROUNDS; ++round) {
+
+            std::map<uint32_t, BUFFER> res;
+
+            auto start = std::chrono::steady_clock::now();
+
+            for (auto &it : publicKeys) {
+
+                res[it.first] = Crypto::RSA::encrypt(it.second, messageKey);
+            }
+
+            serial += elapsed(start);
+
+            res.clear();
+
+            start = std::chrono::steady_clock::now();
+
+            if (!Crypto::RSA::encrypt(publicKeys, messageKey, res)) {
+
+                fprintf(stderr, "batch encryption failed\n");
+
+                return 1;
+            }
+
+            batch += elapsed(start);
+        }
+
+        serial /= NUM_ROUNDS;
+
+        batch /= NUM_ROUNDS;
+
+        printf("%10u %14.2f %14.2f %8.2fx\n", n, serial, batch, serial / batch);
+    }
+
+    return 0;
+}
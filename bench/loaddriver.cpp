@@ -0,0 +1,750 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "mockserver.h"
+#include "Zway/client.h"
+#include "Zway/crypto/crypto.h"
+#include "Zway/crypto/kdf.h"
+#include "Zway/crypto/key.h"
+#include "Zway/crypto/keypool.h"
+#include "Zway/crypto/random.h"
+#include "Zway/message/messageevent.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace Zway;
+
+// ============================================================ //
+
+//! Message load against the mock server
+/*!
+ *  bench_load [clients] [size] [messages] [window] [loops] [inbox]
+ *
+ *  Runs clients on one ClientPool, paired up as contacts. Each
+ *  sends "messages" messages of "size" bytes to its partner and
+ *  keeps up to "window" of them on the way. Latency is the time
+ *  from postMessage() to MessageRecv on the partner.
+ *
+ *  With "inbox", every second client then goes offline and is
+ *  sent that many messages, which the server holds. The time
+ *  from logging in again until the inbox sync has fetched all
+ *  of them is reported as well.
+ *
+ *  Storages are made directly with a few shared key pairs and
+ *  a cheap KDF, so setup does not dominate. CPU time and RSS
+ *  are the process, the mock server included.
+ */
+
+static const uint32_t NUM_KEYS = 8;
+
+static const uint32_t IDLE_TIMEOUT = 30000;
+
+// ============================================================ //
+
+class LoadClient : public Client
+{
+public:
+
+    LoadClient(CLIENT_POOL pool)
+        : Client(pool)
+    {
+    }
+};
+
+// ============================================================ //
+
+struct Peer
+{
+    LoadClient *client;
+
+    STORAGE storage;
+
+    uint32_t id;
+
+    uint32_t contactId;
+
+    std::atomic<uint32_t> sent;
+};
+
+// ============================================================ //
+
+static uint32_t g_size = 0;
+
+static uint32_t g_messages = 0;
+
+static BUFFER g_payload;
+
+static std::mutex g_mutex;
+
+static std::condition_variable g_cond;
+
+static std::map<uint32_t, std::chrono::steady_clock::time_point> g_pending;
+
+static std::vector<double> g_latencies;
+
+static uint32_t g_connected = 0;
+
+static uint32_t g_failed = 0;
+
+static std::set<uint32_t> g_inboxIds;
+
+static uint32_t g_synced = 0;
+
+// ============================================================ //
+
+double elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============================================================ //
+
+double cpuTime()
+{
+    rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+           usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+// ============================================================ //
+
+double rssMiB()
+{
+    long pages = 0;
+
+    FILE *pf = fopen("/proc/self/statm", "r");
+
+    if (pf) {
+
+        if (fscanf(pf, "%*s %ld", &pages) != 1) {
+
+            pages = 0;
+        }
+
+        fclose(pf);
+    }
+
+    return pages * (double)sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+// ============================================================ //
+
+double peakRssMiB()
+{
+    rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss / 1024.0;
+}
+
+// ============================================================ //
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) {
+
+        return 0;
+    }
+
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+// ============================================================ //
+
+void sendNext(Peer *peer)
+{
+    if (peer->sent.fetch_add(1) >= g_messages) {
+
+        return;
+    }
+
+    MESSAGE msg = Message::create();
+
+    msg->setId(Crypto::mkId());
+
+    msg->setSrc(peer->id);
+
+    msg->setDst(peer->contactId);
+
+    msg->setTime(time(nullptr));
+
+    msg->addResource(Resource::createFromData("load", g_payload->data(), g_size, Resource::FileType));
+
+    {
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_pending[msg->id()] = std::chrono::steady_clock::now();
+    }
+
+    if (!peer->client->postMessage(msg)) {
+
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_pending.erase(msg->id());
+
+        g_failed++;
+
+        g_cond.notify_all();
+    }
+}
+
+// ============================================================ //
+
+//! Send a message the partner fetches from its inbox
+
+void sendToInbox(Peer *peer)
+{
+    MESSAGE msg = Message::create();
+
+    msg->setId(Crypto::mkId());
+
+    msg->setSrc(peer->id);
+
+    msg->setDst(peer->contactId);
+
+    msg->setTime(time(nullptr));
+
+    msg->addResource(Resource::createFromData("inbox", g_payload->data(), g_size, Resource::FileType));
+
+    {
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_inboxIds.insert(msg->id());
+    }
+
+    if (!peer->client->postMessage(msg)) {
+
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_inboxIds.erase(msg->id());
+
+        g_failed++;
+    }
+}
+
+// ============================================================ //
+
+void onEvent(std::vector<Peer*> &peers, Peer *peer, EVENT event)
+{
+    switch (event->id()) {
+
+    case Event::ConnectionSuccess: {
+
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_connected++;
+
+        g_cond.notify_all();
+
+        break;
+    }
+
+    case Event::MessageRecv: {
+
+        MESSAGE msg = MessageEvent::cast(event)->getMessage();
+
+        {
+            std::unique_lock<std::mutex> locker(g_mutex);
+
+            auto it = g_pending.find(msg->id());
+
+            if (it == g_pending.end()) {
+
+                if (g_inboxIds.erase(msg->id())) {
+
+                    g_cond.notify_all();
+                }
+
+                break;
+            }
+
+            g_latencies.push_back(elapsed(it->second));
+
+            g_pending.erase(it);
+
+            g_cond.notify_all();
+        }
+
+        // the partner has room for one more
+
+        sendNext(peers[peer->contactId - 1]);
+
+        break;
+    }
+
+    case Event::InboxSynced: {
+
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_synced++;
+
+        g_cond.notify_all();
+
+        break;
+    }
+
+    case Event::ResourceFailure: {
+
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        g_failed++;
+
+        g_cond.notify_all();
+
+        break;
+    }
+    }
+}
+
+// ============================================================ //
+
+//! Make a client for a peer and connect it
+
+void startClient(std::vector<Peer*> &peers, Peer *peer, CLIENT_POOL pool, const std::string &dir, uint32_t port)
+{
+    peer->client = new LoadClient(pool);
+
+    peer->client->setStorageDir(dir + "/");
+
+    peer->client->setEventHandler([&peers, peer] (EVENT event) {
+        onEvent(peers, peer, event);
+    });
+
+    peer->client->start("127.0.0.1", port);
+}
+
+// ============================================================ //
+
+//! Log clients in, false if one of them fails
+
+bool login(std::vector<Peer*> &peers)
+{
+    std::vector<RequestFuture> logins;
+
+    for (auto peer : peers) {
+
+        logins.push_back(peer->client->loginAsync(peer->storage));
+    }
+
+    for (auto &login : logins) {
+
+        if (!login.waitFor(IDLE_TIMEOUT)) {
+
+            fprintf(stderr, "login timed out\n");
+
+            return false;
+        }
+
+        EVENT event = login.get();
+
+        if (event->error().hasField("message")) {
+
+            fprintf(stderr, "login failed: %s\n", event->error()["message"].toString().c_str());
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint32_t numClients = argc > 1 ? atoi(argv[1]) : 100;
+
+    g_size = argc > 2 ? atoi(argv[2]) : 4096;
+
+    g_messages = argc > 3 ? atoi(argv[3]) : 20;
+
+    uint32_t window = argc > 4 ? atoi(argv[4]) : 4;
+
+    uint32_t numLoops = argc > 5 ? atoi(argv[5]) : 0;
+
+    uint32_t numInbox = argc > 6 ? atoi(argv[6]) : 0;
+
+    // clients talk in pairs
+
+    numClients += numClients % 2;
+
+    if (!numClients || !g_size || !window) {
+
+        fprintf(stderr, "usage: %s [clients] [size] [messages] [window] [loops] [inbox]\n", argv[0]);
+
+        return 1;
+    }
+
+    if (!Crypto::setup()) {
+
+        fprintf(stderr, "failed to seed random generator\n");
+
+        return 1;
+    }
+
+    // no key pairs are generated in the background while we measure
+
+    Crypto::KeyPool::instance().setSize(0);
+
+    g_payload = Buffer::create(nullptr, g_size);
+
+    Crypto::Random::random(g_payload->data(), g_payload->size());
+
+    auto start = std::chrono::steady_clock::now();
+
+    MockServer server;
+
+    if (!server.start()) {
+
+        fprintf(stderr, "failed to start mock server\n");
+
+        return 1;
+    }
+
+    std::vector<UBJ::Object> publicKeys(NUM_KEYS);
+
+    std::vector<UBJ::Object> privateKeys(NUM_KEYS);
+
+    for (uint32_t i=0; i<NUM_KEYS; ++i) {
+
+        if (!Crypto::Key::createKeyPair(publicKeys[i], privateKeys[i], Crypto::KeyPool::KEY_BITS)) {
+
+            fprintf(stderr, "failed to create key pair\n");
+
+            return 1;
+        }
+    }
+
+    char dirTemplate[] = "/tmp/zway-load-XXXXXX";
+
+    std::string dir = mkdtemp(dirTemplate) ? dirTemplate : "";
+
+    if (dir.empty()) {
+
+        fprintf(stderr, "failed to create storage directory\n");
+
+        return 1;
+    }
+
+    UBJ::Object kdf = UBJ_OBJ(
+            "alg"  << Crypto::Kdf::Pbkdf2Sha256 <<
+            "iter" << 1 <<
+            "salt" << Buffer::create(nullptr, Crypto::Kdf::SALT_SIZE));
+
+    // account ids are the index plus one, partners are 1-2, 3-4, ...
+
+    std::vector<Peer*> peers;
+
+    for (uint32_t i=0; i<numClients; ++i) {
+
+        uint32_t id = i + 1;
+
+        uint32_t contactId = (i ^ 1) + 1;
+
+        uint32_t pw = Crypto::mkId();
+
+        STORAGE storage = Storage::init(
+                dir + "/" + std::to_string(id) + ".store",
+                "load",
+                UBJ_OBJ(
+                    "label"      << "user" + std::to_string(id) <<
+                    "id"         << id <<
+                    "pw"         << pw <<
+                    "publicKey"  << publicKeys[i % NUM_KEYS] <<
+                    "privateKey" << privateKeys[i % NUM_KEYS]),
+                kdf);
+
+        if (!storage || !storage->addContact(UBJ_OBJ(
+                "contactId" << contactId <<
+                "label"     << "user" + std::to_string(contactId) <<
+                "phone"     << "" <<
+                "publicKey" << publicKeys[(i ^ 1) % NUM_KEYS]))) {
+
+            fprintf(stderr, "failed to create storage\n");
+
+            return 1;
+        }
+
+        server.addAccount(id, pw, "user" + std::to_string(id));
+
+        Peer *peer = new Peer;
+
+        peer->storage = storage;
+
+        peer->id = id;
+
+        peer->contactId = contactId;
+
+        peer->sent = 0;
+
+        peers.push_back(peer);
+    }
+
+    CLIENT_POOL pool = ClientPool::create(numLoops, 2);
+
+    for (auto peer : peers) {
+
+        startClient(peers, peer, pool, dir, server.port());
+    }
+
+    {
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        if (!g_cond.wait_for(locker, std::chrono::milliseconds(IDLE_TIMEOUT), [numClients] () {
+                return g_connected == numClients;
+            })) {
+
+            fprintf(stderr, "%u of %u clients connected\n", g_connected, numClients);
+
+            return 1;
+        }
+    }
+
+    if (!login(peers)) {
+
+        return 1;
+    }
+
+    double setupMs = elapsed(start);
+
+    // run
+
+    uint32_t total = numClients * g_messages;
+
+    double cpuStart = cpuTime();
+
+    start = std::chrono::steady_clock::now();
+
+    for (auto peer : peers) {
+
+        for (uint32_t i=0; i<window; ++i) {
+
+            sendNext(peer);
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        size_t done = 0;
+
+        while (g_latencies.size() + g_failed < total) {
+
+            std::cv_status res = g_cond.wait_for(locker, std::chrono::milliseconds(IDLE_TIMEOUT));
+
+            if (res == std::cv_status::timeout && g_latencies.size() + g_failed == done) {
+
+                fprintf(stderr, "no progress for %u ms\n", IDLE_TIMEOUT);
+
+                break;
+            }
+
+            done = g_latencies.size() + g_failed;
+        }
+    }
+
+    double runMs = elapsed(start);
+
+    double cpuMs = cpuTime() - cpuStart;
+
+    double rss = rssMiB();
+
+    MockServer::Stats stats = server.stats();
+
+    std::vector<double> latencies;
+
+    uint32_t failed;
+
+    {
+        std::unique_lock<std::mutex> locker(g_mutex);
+
+        latencies = g_latencies;
+
+        failed = g_failed;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("%u clients, %u loops, %u x %u bytes per client, window %u\n",
+           numClients, pool->reactor().numLoops(), g_messages, g_size, window);
+
+    printf("%-10s %10.1f ms\n", "setup", setupMs);
+
+    printf("%-10s %10zu of %u received, %u failed, in %.1f ms\n", "messages", latencies.size(), total, failed, runMs);
+
+    printf("%-10s %10.1f msg/s %10.2f MiB/s\n", "throughput",
+           latencies.size() * 1000.0 / runMs,
+           latencies.size() * (double)g_size * 1000.0 / runMs / (1024 * 1024));
+
+    printf("%-10s %10.2f ms p50 %8.2f ms p99 %8.2f ms max\n", "latency",
+           percentile(latencies, 0.5),
+           percentile(latencies, 0.99),
+           latencies.empty() ? 0 : latencies.back());
+
+    printf("%-10s %10.1f ms %9.0f%% of one core\n", "cpu", cpuMs, cpuMs * 100 / runMs);
+
+    printf("%-10s %10.1f MiB %8.1f MiB peak\n", "rss", rss, peakRssMiB());
+
+    printf("%-10s %10llu in %10llu out %8llu relayed %6llu dropped\n", "packets",
+           (unsigned long long)stats.packetsIn,
+           (unsigned long long)stats.packetsOut,
+           (unsigned long long)stats.relayed,
+           (unsigned long long)stats.dropped);
+
+    // every second client goes offline, gets messages held by the
+    // server and fetches them with the inbox sync after login
+
+    uint32_t inboxMissing = 0;
+
+    if (numInbox) {
+
+        std::vector<Peer*> offline;
+
+        for (auto peer : peers) {
+
+            if (peer->id % 2 == 0) {
+
+                peer->client->close();
+
+                delete peer->client;
+
+                offline.push_back(peer);
+            }
+        }
+
+        uint32_t inboxTotal = offline.size() * numInbox;
+
+        uint64_t inboxed = server.stats().inboxed + inboxTotal;
+
+        for (auto peer : peers) {
+
+            if (peer->id % 2 == 1) {
+
+                for (uint32_t i=0; i<numInbox; ++i) {
+
+                    sendToInbox(peer);
+                }
+            }
+        }
+
+        auto sendStart = std::chrono::steady_clock::now();
+
+        while (server.stats().inboxed < inboxed && elapsed(sendStart) < IDLE_TIMEOUT) {
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        {
+            std::unique_lock<std::mutex> locker(g_mutex);
+
+            g_connected -= offline.size();
+
+            g_synced = 0;
+        }
+
+        start = std::chrono::steady_clock::now();
+
+        for (auto peer : offline) {
+
+            startClient(peers, peer, pool, dir, server.port());
+        }
+
+        {
+            std::unique_lock<std::mutex> locker(g_mutex);
+
+            g_cond.wait_for(locker, std::chrono::milliseconds(IDLE_TIMEOUT), [numClients] () {
+                return g_connected == numClients;
+            });
+        }
+
+        if (!login(offline)) {
+
+            return 1;
+        }
+
+        {
+            std::unique_lock<std::mutex> locker(g_mutex);
+
+            size_t done = 0;
+
+            while (g_synced < offline.size() || !g_inboxIds.empty()) {
+
+                std::cv_status res = g_cond.wait_for(locker, std::chrono::milliseconds(IDLE_TIMEOUT));
+
+                size_t progress = g_synced + inboxTotal - g_inboxIds.size();
+
+                if (res == std::cv_status::timeout && progress == done) {
+
+                    fprintf(stderr, "no progress for %u ms\n", IDLE_TIMEOUT);
+
+                    break;
+                }
+
+                done = progress;
+            }
+
+            inboxMissing = g_inboxIds.size();
+        }
+
+        printf("%-10s %10u of %u fetched in %.1f ms\n", "inbox", inboxTotal - inboxMissing, inboxTotal, elapsed(start));
+    }
+
+    for (auto peer : peers) {
+
+        peer->client->close();
+
+        delete peer->client;
+
+        peer->storage.reset();
+
+        unlink((dir + "/" + std::to_string(peer->id) + ".store").c_str());
+
+        delete peer;
+    }
+
+    pool.reset();
+
+    server.stop();
+
+    rmdir(dir.c_str());
+
+    return latencies.size() == total && !inboxMissing ? 0 : 1;
+}
@@ -0,0 +1,535 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/aes.h"
+#include "Zway/crypto/crypto.h"
+#include "Zway/crypto/digest.h"
+#include "Zway/crypto/kdf.h"
+#include "Zway/crypto/random.h"
+#include "Zway/crypto/rsa.h"
+#include "Zway/storage/storage.h"
+#include "Zway/thread.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <vector>
+
+using namespace Zway;
+
+// ============================================================ //
+
+//! Micro benchmarks of the hot paths
+/*!
+ *  bench [max nodes] [filter]
+ *
+ *  Every benchmark runs its body in a loop until MIN_TIME has
+ *  passed to find an iteration count, then takes the median of
+ *  NUM_REPS timed runs of that count. Progress goes to stderr,
+ *  the results to stdout as JSON, in the layout of Google
+ *  Benchmark so the usual tools can compare two runs.
+ *
+ *  Storage benchmarks run on stores of 1k, 100k and 1M nodes,
+ *  up to "max nodes". Only benchmarks whose name contains
+ *  "filter" run.
+ */
+
+static const double MIN_TIME = 200;
+
+static const uint32_t NUM_REPS = 3;
+
+// ============================================================ //
+
+struct Result
+{
+    std::string name;
+
+    uint64_t iterations;
+
+    double ns;
+
+    uint64_t bytes;
+};
+
+static std::vector<Result> g_results;
+
+static std::string g_filter;
+
+static volatile uint64_t g_sink = 0;
+
+// ============================================================ //
+
+double elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============================================================ //
+
+//! Time fn, bytes is what one call processes, if anything
+
+void bench(const std::string &name, uint64_t bytes, std::function<void ()> fn)
+{
+    if (name.find(g_filter) == std::string::npos) {
+
+        return;
+    }
+
+    uint64_t iterations = 1;
+
+    for (;;) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint64_t i=0; i<iterations; ++i) {
+
+            fn();
+        }
+
+        double ms = elapsed(start);
+
+        if (ms >= MIN_TIME) {
+
+            break;
+        }
+
+        // aim a bit past MIN_TIME, at most ten times more per step
+
+        uint64_t next = ms > 0 ? (uint64_t)(iterations * MIN_TIME * 1.2 / ms) : iterations * 10;
+
+        iterations = std::max(iterations + 1, std::min(next, iterations * 10));
+    }
+
+    std::vector<double> runs;
+
+    for (uint32_t rep=0; rep<NUM_REPS; ++rep) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint64_t i=0; i<iterations; ++i) {
+
+            fn();
+        }
+
+        runs.push_back(elapsed(start) * 1e6 / iterations);
+    }
+
+    std::sort(runs.begin(), runs.end());
+
+    Result res = {name, iterations, runs[NUM_REPS / 2], bytes};
+
+    fprintf(stderr, "%-40s %14.1f ns %12llu iterations\n", name.c_str(), res.ns, (unsigned long long)iterations);
+
+    g_results.push_back(res);
+}
+
+// ============================================================ //
+
+BUFFER randomBuffer(uint32_t size)
+{
+    BUFFER buf = Buffer::create(nullptr, size);
+
+    Crypto::Random::random(buf->data(), buf->size());
+
+    return buf;
+}
+
+// ============================================================ //
+
+//! Head of the first part of a message to one contact
+
+UBJ::Object messageHead()
+{
+    UBJ::Array keys;
+
+    keys << UBJ_OBJ("dst" << 1001 << "key" << randomBuffer(256));
+
+    keys << UBJ_OBJ("dst" << 1002 << "key" << randomBuffer(256));
+
+    return UBJ_OBJ(
+            "signature"     << randomBuffer(256) <<
+            "salt"          << randomBuffer(16) <<
+            "meta"          << randomBuffer(160) <<
+            "keys"          << keys <<
+            "messageId"     << 123456789 <<
+            "messageTime"   << 1500000000 <<
+            "messageSrc"    << 1001 <<
+            "messageDst"    << 1002 <<
+            "messagePart"   << 0 <<
+            "messageParts"  << 16 <<
+            "resourceId"    << 987654321 <<
+            "resourceType"  << 2 <<
+            "resourceSize"  << 1000000 <<
+            "resourcePart"  << 0 <<
+            "resourceParts" << 16 <<
+            "proof"         << randomBuffer(128));
+}
+
+// ============================================================ //
+
+void benchUbj(UBJ::Value &privateKey)
+{
+    UBJ::Object request = UBJ_OBJ(
+            "requestId"   << 123456789 <<
+            "requestType" << 1010 <<
+            "accountId"   << 1001 <<
+            "accountPw"   << 987654321);
+
+    UBJ::Object message = messageHead();
+
+    struct {
+        const char *name;
+        UBJ::Value value;
+    } values[] = {
+        {"request_head", request},
+        {"message_head", message},
+        {"rsa_private_key", privateKey}
+    };
+
+    for (auto &it : values) {
+
+        UBJ::Value &value = it.value;
+
+        BUFFER buf = UBJ::Value::Writer::write(value);
+
+        bench(std::string("ubj/write/") + it.name, buf->size(), [&value] () {
+            g_sink += UBJ::Value::Writer::write(value)->size();
+        });
+
+        bench(std::string("ubj/read/") + it.name, buf->size(), [buf] () {
+            UBJ::Value res;
+            UBJ::Value::Reader::read(res, buf);
+            g_sink += res.numValues();
+        });
+    }
+}
+
+// ============================================================ //
+
+void benchBuffer()
+{
+    for (uint32_t size : {64, 4096, 65536}) {
+
+        BUFFER buf = randomBuffer(size);
+
+        bench("buffer/create/" + std::to_string(size), size, [size] () {
+            g_sink += Buffer::create(nullptr, size)->size();
+        });
+
+        bench("buffer/copy/" + std::to_string(size), size, [buf] () {
+            g_sink += buf->copy()->size();
+        });
+    }
+}
+
+// ============================================================ //
+
+void benchCrypto(UBJ::Value &publicKey, UBJ::Value &privateKey)
+{
+    for (uint32_t size : {64, 1024, 16384, 65536}) {
+
+        BUFFER buf = randomBuffer(size);
+
+        BUFFER ctr = randomBuffer(16);
+
+        std::shared_ptr<Crypto::AES> aes = std::make_shared<Crypto::AES>();
+
+        aes->setKey(randomBuffer(32));
+
+        bench("aes/encrypt/" + std::to_string(size), size, [aes, buf, ctr] () {
+            aes->setCtr(ctr);
+            aes->encrypt(buf, buf, buf->size());
+        });
+    }
+
+    for (uint32_t size : {64, 4096, 65536}) {
+
+        BUFFER buf = randomBuffer(size);
+
+        bench("digest/md5/" + std::to_string(size), size, [buf] () {
+            g_sink += Crypto::Digest::digest(buf, Crypto::Digest::DIGEST_MD5)->size();
+        });
+
+        bench("digest/sha256/" + std::to_string(size), size, [buf] () {
+            g_sink += Crypto::Digest::digest(buf, Crypto::Digest::DIGEST_SHA256)->size();
+        });
+    }
+
+    // a message key and the digest of a message's meta data
+
+    BUFFER messageKey = randomBuffer(32);
+
+    BUFFER digest = Crypto::Digest::digest(randomBuffer(160), Crypto::Digest::DIGEST_SHA256);
+
+    BUFFER signature = Crypto::RSA::sign(privateKey, digest);
+
+    bench("rsa/encrypt", 0, [&publicKey, messageKey] () {
+        g_sink += Crypto::RSA::encrypt(publicKey, messageKey)->size();
+    });
+
+    bench("rsa/sign", 0, [&privateKey, digest] () {
+        g_sink += Crypto::RSA::sign(privateKey, digest)->size();
+    });
+
+    bench("rsa/verify", 0, [&publicKey, digest, signature] () {
+        g_sink += Crypto::RSA::verify(publicKey, digest, signature);
+    });
+}
+
+// ============================================================ //
+
+//! Storage operations on a store of numNodes nodes
+/*!
+ *  The store holds one contact per thousand nodes, each with a
+ *  history, and messages spread over the histories for the rest.
+ *  It is filled in a single transaction.
+ */
+
+bool benchStorage(const std::string &dir, uint32_t numNodes)
+{
+    std::string suffix = "/" + std::to_string(numNodes);
+
+    if (("storage/addNode" + suffix).find(g_filter) == std::string::npos &&
+            ("storage/getNode" + suffix).find(g_filter) == std::string::npos &&
+            ("storage/getContact" + suffix).find(g_filter) == std::string::npos &&
+            ("storage/getMessages" + suffix).find(g_filter) == std::string::npos) {
+
+        return true;
+    }
+
+    std::string filename = dir + suffix + ".store";
+
+    STORAGE storage = Storage::init(
+            filename,
+            "bench",
+            UBJ_OBJ("label" << "bench" << "id" << 1 << "pw" << 1),
+            UBJ_OBJ(
+                "alg"  << Crypto::Kdf::Pbkdf2Sha256 <<
+                "iter" << 1 <<
+                "salt" << Buffer::create(nullptr, Crypto::Kdf::SALT_SIZE)));
+
+    if (!storage) {
+
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t numContacts = std::max(numNodes / 1000, 1u);
+
+    std::vector<uint32_t> contactIds;
+
+    std::vector<uint32_t> historyIds;
+
+    std::vector<uint32_t> messageIds;
+
+    storage->beginTransaction();
+
+    for (uint32_t i=0; i<numContacts; ++i) {
+
+        uint32_t contactId = i + 2;
+
+        storage->addContact(UBJ_OBJ(
+                "contactId" << contactId <<
+                "label"     << "contact" + std::to_string(contactId) <<
+                "phone"     << "" <<
+                "publicKey" << UBJ::Object()));
+
+        contactIds.push_back(contactId);
+
+        historyIds.push_back(storage->createHistory(contactId));
+    }
+
+    for (uint32_t i=numContacts*2; i<numNodes; ++i) {
+
+        Storage::NODE node = Storage::Node::create(Storage::Node::MessageType, historyIds[i % numContacts]);
+
+        node->setUser1(1);
+
+        node->setUser2(contactIds[i % numContacts]);
+
+        node->setHeadUbj(UBJ_OBJ("status" << 2 << "time" << 1500000000 + i));
+
+        node->setBodyUbj(UBJ_OBJ("text" << "The quick brown fox jumps over the lazy dog"));
+
+        if (storage->addNode(node) && i % 100 == 0) {
+
+            messageIds.push_back(node->id());
+        }
+    }
+
+    storage->commitTransaction();
+
+    fprintf(stderr, "store of %u nodes filled in %.1f ms\n", numNodes, elapsed(start));
+
+    if (messageIds.empty()) {
+
+        messageIds.push_back(historyIds[0]);
+    }
+
+    uint32_t n = 0;
+
+    bench("storage/addNode" + suffix, 0, [storage, &historyIds, &n] () {
+        Storage::NODE node = Storage::Node::create(Storage::Node::MessageType, historyIds[n++ % historyIds.size()]);
+        node->setBodyUbj(UBJ_OBJ("text" << "The quick brown fox jumps over the lazy dog"));
+        storage->addNode(node);
+    });
+
+    bench("storage/getNode" + suffix, 0, [storage, &messageIds, &n] () {
+        g_sink += storage->getNode(UBJ_OBJ("id" << messageIds[n++ % messageIds.size()])) ? 1 : 0;
+    });
+
+    bench("storage/getContact" + suffix, 0, [storage, &contactIds, &n] () {
+        UBJ::Object contact;
+        g_sink += storage->getContact(contactIds[n++ % contactIds.size()], contact);
+    });
+
+    bench("storage/getMessages" + suffix, 0, [storage, &historyIds, &n] () {
+        g_sink += storage->getMessages(historyIds[n++ % historyIds.size()]).size();
+    });
+
+    storage->close();
+
+    unlink(filename.c_str());
+
+    return true;
+}
+
+// ============================================================ //
+
+void printJson()
+{
+    char date[32];
+
+    time_t now = time(nullptr);
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    printf("{\n");
+
+    printf("  \"context\": {\n");
+
+    printf("    \"date\": \"%s\",\n", date);
+
+    printf("    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+
+    printf("    \"min_time_ms\": %.0f,\n", MIN_TIME);
+
+    printf("    \"repetitions\": %u\n", NUM_REPS);
+
+    printf("  },\n");
+
+    printf("  \"benchmarks\": [\n");
+
+    for (size_t i=0; i<g_results.size(); ++i) {
+
+        Result &res = g_results[i];
+
+        printf("    {\n");
+
+        printf("      \"name\": \"%s\",\n", res.name.c_str());
+
+        printf("      \"iterations\": %llu,\n", (unsigned long long)res.iterations);
+
+        printf("      \"real_time\": %.3f,\n", res.ns);
+
+        if (res.bytes) {
+
+            printf("      \"bytes_per_second\": %.0f,\n", res.bytes * 1e9 / res.ns);
+        }
+
+        printf("      \"time_unit\": \"ns\"\n");
+
+        printf("    }%s\n", i + 1 < g_results.size() ? "," : "");
+    }
+
+    printf("  ]\n");
+
+    printf("}\n");
+}
+
+// ============================================================ //
+
+int main(int argc, char *argv[])
+{
+    uint32_t maxNodes = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    g_filter = argc > 2 ? argv[2] : "";
+
+    if (!Crypto::setup()) {
+
+        fprintf(stderr, "failed to seed random generator\n");
+
+        return 1;
+    }
+
+    UBJ::Value publicKey;
+
+    UBJ::Value privateKey;
+
+    if (!Crypto::RSA::createKeyPair(publicKey, privateKey, 2048)) {
+
+        fprintf(stderr, "failed to create key pair\n");
+
+        return 1;
+    }
+
+    benchUbj(privateKey);
+
+    benchBuffer();
+
+    benchCrypto(publicKey, privateKey);
+
+    char dirTemplate[] = "/tmp/zway-bench-XXXXXX";
+
+    if (!mkdtemp(dirTemplate)) {
+
+        fprintf(stderr, "failed to create storage directory\n");
+
+        return 1;
+    }
+
+    for (uint32_t numNodes : {1000, 100000, 1000000}) {
+
+        if (numNodes <= maxNodes && !benchStorage(dirTemplate, numNodes)) {
+
+            fprintf(stderr, "failed to create storage\n");
+
+            return 1;
+        }
+    }
+
+    rmdir(dirTemplate);
+
+    printJson();
+
+    return 0;
+}
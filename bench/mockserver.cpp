@@ -0,0 +1,1100 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "mockserver.h"
+#include "Zway/contactstatusmap.h"
+#include "Zway/crypto/crypto.h"
+#include "Zway/request/request.h"
+
+#include <gnutls/gnutls.h>
+#include <gnutls/x509.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <ctime>
+
+namespace Zway {
+
+// ============================================================ //
+// MockServer
+// ============================================================ //
+
+MockServer::MockServer()
+    : Thread(),
+      m_socket(-1),
+      m_port(0),
+      m_cred(nullptr),
+      m_nextAccountId(1000000),
+      m_packetsIn(0),
+      m_packetsOut(0),
+      m_bytesIn(0),
+      m_bytesOut(0),
+      m_relayed(0),
+      m_dropped(0),
+      m_inboxed(0)
+{
+    gnutls_global_init();
+}
+
+// ============================================================ //
+
+MockServer::~MockServer()
+{
+    stop();
+
+    if (m_cred) {
+
+        gnutls_certificate_free_credentials((gnutls_certificate_credentials_t)m_cred);
+    }
+
+    gnutls_global_deinit();
+}
+
+// ============================================================ //
+
+//! Make a certificate and start listening on loopback
+/*!
+ *  With port 0 the system picks a free one, see port().
+ */
+
+bool MockServer::start(uint32_t port)
+{
+    if (m_socket >= 0) {
+
+        return false;
+    }
+
+    if (!m_cred) {
+
+        gnutls_x509_privkey_t key;
+
+        gnutls_x509_crt_t crt;
+
+        gnutls_x509_privkey_init(&key);
+
+        gnutls_x509_crt_init(&crt);
+
+        uint8_t serial = 1;
+
+        bool res =
+                gnutls_x509_privkey_generate(key, GNUTLS_PK_EC, GNUTLS_CURVE_TO_BITS(GNUTLS_ECC_CURVE_SECP256R1), 0) == 0 &&
+                gnutls_x509_crt_set_version(crt, 3) == 0 &&
+                gnutls_x509_crt_set_serial(crt, &serial, sizeof(serial)) == 0 &&
+                gnutls_x509_crt_set_activation_time(crt, time(nullptr) - 3600) == 0 &&
+                gnutls_x509_crt_set_expiration_time(crt, time(nullptr) + 86400) == 0 &&
+                gnutls_x509_crt_set_dn_by_oid(crt, GNUTLS_OID_X520_COMMON_NAME, 0, "localhost", 9) == 0 &&
+                gnutls_x509_crt_set_key(crt, key) == 0 &&
+                gnutls_x509_crt_sign2(crt, crt, key, GNUTLS_DIG_SHA256, 0) == 0 &&
+                gnutls_certificate_allocate_credentials((gnutls_certificate_credentials_t*)&m_cred) == 0;
+
+        if (res && gnutls_certificate_set_x509_key((gnutls_certificate_credentials_t)m_cred, &crt, 1, key) != 0) {
+
+            res = false;
+        }
+
+        gnutls_x509_crt_deinit(crt);
+
+        gnutls_x509_privkey_deinit(key);
+
+        if (!res) {
+
+            return false;
+        }
+    }
+
+    m_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (m_socket < 0) {
+
+        return false;
+    }
+
+    int one = 1;
+
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+
+    addr.sin_family = AF_INET;
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    addr.sin_port = htons(port);
+
+    socklen_t addrSize = sizeof(addr);
+
+    if (bind(m_socket, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(m_socket, SOMAXCONN) != 0 ||
+            getsockname(m_socket, (sockaddr*)&addr, &addrSize) != 0) {
+
+        ::close(m_socket);
+
+        m_socket = -1;
+
+        return false;
+    }
+
+    m_port = ntohs(addr.sin_port);
+
+    return run();
+}
+
+// ============================================================ //
+
+//! Close all connections and stop listening
+
+void MockServer::stop()
+{
+    if (m_socket < 0) {
+
+        return;
+    }
+
+    cancelAndJoin();
+
+    ::close(m_socket);
+
+    m_socket = -1;
+
+    std::list<CONNECTION> connections;
+
+    {
+        std::unique_lock<std::mutex> locker(m_mutex);
+
+        connections.swap(m_connections);
+    }
+
+    for (auto &connection : connections) {
+
+        connection->close();
+
+        connection->join();
+    }
+
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    m_online.clear();
+}
+
+// ============================================================ //
+
+uint32_t MockServer::port()
+{
+    return m_port;
+}
+
+// ============================================================ //
+
+MockServer::Stats MockServer::stats()
+{
+    return Stats{m_packetsIn, m_packetsOut, m_bytesIn, m_bytesOut, m_relayed, m_dropped, m_inboxed};
+}
+
+// ============================================================ //
+
+//! Make an account known without a CreateAccount request
+/*!
+ *  Load tests set up their storages directly, this is the
+ *  server side of it.
+ */
+
+void MockServer::addAccount(uint32_t id, uint32_t pw, const std::string &label)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    m_accounts[id] = Account{pw, label, UBJ::Value()};
+}
+
+// ============================================================ //
+
+//! Accept connections
+/*!
+ *  Finished connections are joined and dropped on the way.
+ */
+
+void MockServer::onRun()
+{
+    while (!testCancel()) {
+
+        pollfd fds = {m_socket, POLLIN, 0};
+
+        if (poll(&fds, 1, 100) > 0) {
+
+            int32_t socket = accept(m_socket, nullptr, nullptr);
+
+            if (socket >= 0) {
+
+                CONNECTION connection = std::make_shared<Connection>(this, socket);
+
+                std::unique_lock<std::mutex> locker(m_mutex);
+
+                m_connections.push_back(connection);
+
+                connection->run();
+            }
+        }
+
+        std::list<CONNECTION> finished;
+
+        {
+            std::unique_lock<std::mutex> locker(m_mutex);
+
+            for (auto it = m_connections.begin(); it != m_connections.end();) {
+
+                if ((*it)->finished()) {
+
+                    finished.push_back(*it);
+
+                    it = m_connections.erase(it);
+                }
+                else {
+
+                    ++it;
+                }
+            }
+        }
+
+        for (auto &connection : finished) {
+
+            connection->join();
+        }
+    }
+}
+
+// ============================================================ //
+
+bool MockServer::login(CONNECTION connection, uint32_t id, uint32_t pw)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    auto it = m_accounts.find(id);
+
+    if (it == m_accounts.end() || it->second.pw != pw) {
+
+        return false;
+    }
+
+    // a second login takes over
+
+    CONNECTION &online = m_online[id];
+
+    if (online && online != connection) {
+
+        online->close();
+    }
+
+    online = connection;
+
+    return true;
+}
+
+// ============================================================ //
+
+void MockServer::logout(Connection *connection)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    auto it = m_online.find(connection->accountId());
+
+    if (it != m_online.end() && it->second.get() == connection) {
+
+        m_online.erase(it);
+    }
+}
+
+// ============================================================ //
+
+MockServer::CONNECTION MockServer::online(uint32_t id)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    auto it = m_online.find(id);
+
+    if (it != m_online.end()) {
+
+        return it->second;
+    }
+
+    return nullptr;
+}
+
+// ============================================================ //
+
+//! Whether parts of a message are held for an account
+
+bool MockServer::inboxed(uint32_t dst, uint32_t messageId)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    auto it = m_inboxes.find(dst);
+
+    return it != m_inboxes.end() && it->second.messages.count(messageId);
+}
+
+// ============================================================ //
+
+//! Hold a message part for an account
+/*!
+ *  A message is listed in the inbox, under the next sequence
+ *  number, once all of its parts are in. Returns false for
+ *  unknown accounts.
+ */
+
+bool MockServer::store(uint32_t dst, uint32_t messageId, uint32_t numParts, PACKET pkt)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    if (!m_accounts.count(dst)) {
+
+        return false;
+    }
+
+    Inbox &inbox = m_inboxes[dst];
+
+    InboxMessage &msg = inbox.messages[messageId];
+
+    msg.parts.push_back(pkt);
+
+    msg.numParts = numParts;
+
+    msg.size += pkt->getBodySize();
+
+    if (!msg.seq && msg.parts.size() >= numParts) {
+
+        msg.seq = ++inbox.seq;
+
+        inbox.listed[msg.seq] = messageId;
+
+        m_inboxed++;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void MockServer::countIn(PACKET pkt)
+{
+    m_packetsIn++;
+
+    m_bytesIn += PACKET_BASE_SIZE + pkt->getHeadSize() + pkt->getBodySize();
+}
+
+// ============================================================ //
+
+void MockServer::countOut(PACKET pkt)
+{
+    m_packetsOut++;
+
+    m_bytesOut += PACKET_BASE_SIZE + pkt->getHeadSize() + pkt->getBodySize();
+}
+
+// ============================================================ //
+// Connection
+// ============================================================ //
+
+MockServer::Connection::Connection(MockServer *server, int32_t socket)
+    : Thread(),
+      m_server(server),
+      m_socket(socket),
+      m_session(nullptr),
+      m_finished(false),
+      m_accountId(0)
+{
+}
+
+// ============================================================ //
+
+MockServer::Connection::~Connection()
+{
+    if (m_session) {
+
+        gnutls_deinit((gnutls_session_t)m_session);
+    }
+
+    ::close(m_socket);
+}
+
+// ============================================================ //
+
+//! Send a packet, from any thread
+
+bool MockServer::Connection::send(PACKET pkt)
+{
+    std::unique_lock<std::mutex> locker(m_sendMutex);
+
+    if (!sendAll(&pkt->getId(), PACKET_BASE_SIZE)) {
+
+        return false;
+    }
+
+    if (pkt->getHeadSize() > 0 && !sendAll(pkt->getHead()->data(), pkt->getHeadSize())) {
+
+        return false;
+    }
+
+    if (pkt->getBodySize() > 0 && !sendAll(pkt->getBody()->data(), pkt->getBodySize())) {
+
+        return false;
+    }
+
+    m_server->countOut(pkt);
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Make the connection thread return
+
+void MockServer::Connection::close()
+{
+    shutdown(m_socket, SHUT_RDWR);
+}
+
+// ============================================================ //
+
+bool MockServer::Connection::finished()
+{
+    return m_finished;
+}
+
+// ============================================================ //
+
+uint32_t MockServer::Connection::accountId()
+{
+    return m_accountId;
+}
+
+// ============================================================ //
+
+void MockServer::Connection::onRun()
+{
+    if (handshake()) {
+
+        for (;;) {
+
+            PACKET pkt = recv();
+
+            if (!pkt) {
+
+                break;
+            }
+
+            m_server->countIn(pkt);
+
+            switch (pkt->getId()) {
+
+            case Packet::Heartbeat:
+
+                send(Packet::create(Packet::Heartbeat));
+
+                break;
+
+            case Packet::Request:
+
+                processRequest(pkt);
+
+                break;
+
+            case Packet::Message:
+
+                processMessage(pkt);
+
+                break;
+            }
+        }
+    }
+
+    m_server->logout(this);
+
+    m_finished = true;
+}
+
+// ============================================================ //
+
+bool MockServer::Connection::handshake()
+{
+    gnutls_session_t session;
+
+    if (gnutls_init(&session, GNUTLS_SERVER) != 0) {
+
+        return false;
+    }
+
+    m_session = session;
+
+    if (gnutls_priority_set_direct(session, "NORMAL:+VERS-TLS1.2", nullptr) != 0 ||
+            gnutls_credentials_set(session, GNUTLS_CRD_CERTIFICATE, (gnutls_certificate_credentials_t)m_server->m_cred) != 0) {
+
+        return false;
+    }
+
+    gnutls_transport_set_int(session, m_socket);
+
+    int res;
+
+    do {
+
+        res = gnutls_handshake(session);
+    }
+    while (res < 0 && !gnutls_error_is_fatal(res));
+
+    return res == 0;
+}
+
+// ============================================================ //
+
+//! Read the next packet, nullptr when the connection is gone
+
+PACKET MockServer::Connection::recv()
+{
+    uint32_t base[3];
+
+    if (!recvAll(base, PACKET_BASE_SIZE)) {
+
+        return nullptr;
+    }
+
+    if (base[1] > MAX_PACKET_HEAD || base[2] > MAX_PACKET_BODY) {
+
+        return nullptr;
+    }
+
+    BUFFER head = base[1] ? Buffer::create(nullptr, base[1]) : nullptr;
+
+    BUFFER body = base[2] ? Buffer::create(nullptr, base[2]) : nullptr;
+
+    if ((head && !recvAll(head->data(), head->size())) ||
+            (body && !recvAll(body->data(), body->size()))) {
+
+        return nullptr;
+    }
+
+    return Packet::create(base[0], head, body);
+}
+
+// ============================================================ //
+
+bool MockServer::Connection::recvAll(void *data, size_t size)
+{
+    size_t offset = 0;
+
+    while (offset < size) {
+
+        ssize_t res = gnutls_record_recv((gnutls_session_t)m_session, (uint8_t*)data + offset, size - offset);
+
+        if (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) {
+
+            continue;
+        }
+
+        if (res <= 0) {
+
+            return false;
+        }
+
+        offset += res;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MockServer::Connection::sendAll(const void *data, size_t size)
+{
+    size_t offset = 0;
+
+    while (offset < size) {
+
+        ssize_t res = gnutls_record_send((gnutls_session_t)m_session, (const uint8_t*)data + offset, size - offset);
+
+        if (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) {
+
+            continue;
+        }
+
+        if (res <= 0) {
+
+            return false;
+        }
+
+        offset += res;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Answer a request the way the server does
+/*!
+ *  Contact requests are passed on to the other account if it
+ *  is online. Inbox pages list the held messages after the
+ *  cursor, GetMessage sends their parts and forgets them.
+ *  Requests the mock has nothing for, like cancellations,
+ *  succeed with an empty answer.
+ */
+
+void MockServer::Connection::processRequest(PACKET pkt)
+{
+    UBJ::Object head;
+
+    if (!pkt->getHeadUbj(head)) {
+
+        return;
+    }
+
+    uint32_t accountId = m_accountId;
+
+    switch (head["requestType"].toInt()) {
+
+    case Request::CreateAccount: {
+
+        uint32_t id;
+
+        uint32_t pw = Crypto::mkId();
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            id = m_server->m_nextAccountId++;
+
+            m_server->m_accounts[id] = Account{pw, head["label"].toString(), UBJ::Value()};
+        }
+
+        respond(head, UBJ_OBJ("accountId" << id << "accountPw" << pw));
+
+        break;
+    }
+
+    case Request::Login: {
+
+        uint32_t id = head["accountId"].toInt();
+
+        if (m_server->login(shared_from_this(), id, head["accountPw"].toInt())) {
+
+            m_accountId = id;
+
+            respond(head, UBJ::Object());
+        }
+        else {
+
+            respond(head, UBJ_OBJ("message" << "Login failed"), 0);
+        }
+
+        break;
+    }
+
+    case Request::CreateAddCode: {
+
+        std::string addCode = std::to_string(Crypto::mkId() % 100000000);
+
+        uint32_t requestId = Crypto::mkId();
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            m_server->m_accounts[accountId].publicKey = head["publicKey"];
+
+            m_server->m_addCodes[addCode] = requestId;
+
+            m_server->m_contactRequests[requestId] = ContactRequest{accountId, 0};
+        }
+
+        respond(head, UBJ_OBJ(
+                "addCode"      << addCode <<
+                "requestNewId" << requestId <<
+                "label"        << head["label"] <<
+                "phone"        << head["phone"]));
+
+        break;
+    }
+
+    case Request::AddContact: {
+
+        uint32_t requestId = 0;
+
+        uint32_t srcId = 0;
+
+        std::string label;
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            auto it = m_server->m_addCodes.find(head["addCode"].toString());
+
+            if (it != m_server->m_addCodes.end()) {
+
+                requestId = it->second;
+
+                m_server->m_addCodes.erase(it);
+
+                ContactRequest &request = m_server->m_contactRequests[requestId];
+
+                request.dst = accountId;
+
+                srcId = request.src;
+
+                m_server->m_accounts[accountId].publicKey = head["publicKey"];
+
+                label = m_server->m_accounts[accountId].label;
+            }
+        }
+
+        if (!requestId) {
+
+            respond(head, UBJ_OBJ("message" << "Invalid add code"), 0);
+
+            break;
+        }
+
+        respond(head, UBJ_OBJ(
+                "addCode"      << head["addCode"] <<
+                "requestNewId" << requestId <<
+                "label"        << head["label"] <<
+                "phone"        << head["phone"]));
+
+        CONNECTION src = m_server->online(srcId);
+
+        if (src) {
+
+            src->send(Packet::createFromUbj(Packet::Request, UBJ_OBJ(
+                    "requestType" << Request::AddContact <<
+                    "requestId"   << requestId <<
+                    "src"         << accountId <<
+                    "addCode"     << head["addCode"] <<
+                    "label"       << label <<
+                    "phone"       << "" <<
+                    "publicKey"   << head["publicKey"])));
+        }
+
+        break;
+    }
+
+    case Request::AcceptContact:
+    case Request::RejectContact: {
+
+        bool accept = head["requestType"].toInt() == Request::AcceptContact;
+
+        uint32_t requestId = head["requestOrigId"].toInt();
+
+        ContactRequest request = {0, 0};
+
+        Account src;
+
+        Account dst;
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            auto it = m_server->m_contactRequests.find(requestId);
+
+            if (it != m_server->m_contactRequests.end() && it->second.src == accountId && it->second.dst) {
+
+                request = it->second;
+
+                m_server->m_contactRequests.erase(it);
+
+                m_server->m_accounts[accountId].publicKey = head["publicKey"];
+
+                src = m_server->m_accounts[request.src];
+
+                dst = m_server->m_accounts[request.dst];
+            }
+        }
+
+        if (!request.dst) {
+
+            respond(head, UBJ_OBJ("message" << "Unknown contact request"), 0);
+
+            break;
+        }
+
+        CONNECTION other = m_server->online(request.dst);
+
+        if (accept) {
+
+            respond(head, UBJ_OBJ(
+                    "contactId"     << request.dst <<
+                    "label"         << dst.label <<
+                    "phone"         << "" <<
+                    "publicKey"     << dst.publicKey <<
+                    "contactStatus" << (other ? 1 : 0)));
+        }
+        else {
+
+            respond(head, UBJ::Object());
+        }
+
+        if (other) {
+
+            UBJ::Object push = UBJ_OBJ(
+                    "requestType"   << head["requestType"] <<
+                    "requestId"     << Crypto::mkId() <<
+                    "requestOrigId" << requestId);
+
+            if (accept) {
+
+                push["contactId"] = request.src;
+
+                push["label"] = src.label;
+
+                push["phone"] = "";
+
+                push["publicKey"] = src.publicKey;
+
+                push["contactStatus"] = 1;
+            }
+
+            other->send(Packet::createFromUbj(Packet::Request, push));
+        }
+
+        break;
+    }
+
+    case Request::ContactStatus: {
+
+        respond(head, UBJ::Object());
+
+        // full set, 1 for contacts which are online
+
+        std::vector<uint32_t> ids;
+
+        ContactStatusMap::unpackIds(head["contactsPacked"].buffer(), ids);
+
+        ContactStatusMap::ENTRY_LIST entries;
+
+        for (uint32_t id : ids) {
+
+            entries.push_back(ContactStatusMap::Entry{id, m_server->online(id) ? 1u : 0u});
+        }
+
+        send(Packet::createFromUbj(Packet::Request, UBJ_OBJ(
+                "requestType"  << Request::ContactStatus <<
+                "statusPacked" << ContactStatusMap::pack(entries) <<
+                "epoch"        << 1 <<
+                "version"      << 1 <<
+                "full"         << 1)));
+
+        break;
+    }
+
+    case Request::FindContact:
+
+        respond(head, UBJ_OBJ("results" << UBJ::Array()));
+
+        break;
+
+    case Request::GetInbox: {
+
+        uint32_t cursor = head["cursor"].toInt();
+
+        uint32_t limit = head["limit"].toInt();
+
+        // the listing travels in the response head, an id and a
+        // size take at most ten bytes there
+
+        uint32_t maxListed = (MAX_PACKET_HEAD - 128) / 10;
+
+        if (!limit || limit > maxListed) {
+
+            limit = maxListed;
+        }
+
+        UBJ::Array ids;
+
+        UBJ::Array sizes;
+
+        uint32_t numListed = 0;
+
+        bool more = false;
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            Inbox &inbox = m_server->m_inboxes[accountId];
+
+            for (auto it = inbox.listed.upper_bound(cursor); it != inbox.listed.end(); ++it) {
+
+                if (numListed == limit) {
+
+                    more = true;
+
+                    break;
+                }
+
+                ids << it->second;
+
+                sizes << inbox.messages[it->second].size;
+
+                cursor = it->first;
+
+                numListed++;
+            }
+        }
+
+        respond(head, UBJ_OBJ(
+                "ids"    << ids <<
+                "sizes"  << sizes <<
+                "cursor" << cursor <<
+                "more"   << (more ? 1 : 0)));
+
+        break;
+    }
+
+    case Request::GetMessage: {
+
+        // parts go out before the answer, as the server does it
+
+        PACKET_LIST parts;
+
+        {
+            std::unique_lock<std::mutex> locker(m_server->m_mutex);
+
+            Inbox &inbox = m_server->m_inboxes[accountId];
+
+            UBJ::Value &messageIds = head["messageIds"];
+
+            for (uint32_t i=0; i<messageIds.numValues(); ++i) {
+
+                auto it = inbox.messages.find(messageIds[i].toInt());
+
+                if (it == inbox.messages.end() || !it->second.seq) {
+
+                    continue;
+                }
+
+                parts.splice(parts.end(), it->second.parts);
+
+                inbox.listed.erase(it->second.seq);
+
+                inbox.messages.erase(it);
+            }
+        }
+
+        for (auto &part : parts) {
+
+            send(part);
+        }
+
+        respond(head, UBJ::Object());
+
+        break;
+    }
+
+    case Request::ResumeMessage:
+
+        respond(head, UBJ_OBJ("messagePart" << 0));
+
+        break;
+
+    default:
+
+        respond(head, UBJ::Object());
+
+        break;
+    }
+}
+
+// ============================================================ //
+
+//! Pass a message part on to its recipient
+/*!
+ *  The first part carries the message key encrypted for each
+ *  recipient in "keys", the recipient gets its own one as
+ *  "messageKey". Other parts go out as they came in. Messages
+ *  to accounts which are offline, or were when the message
+ *  started, go to the inbox.
+ */
+
+void MockServer::Connection::processMessage(PACKET pkt)
+{
+    UBJ::Object head;
+
+    if (!m_accountId || !pkt->getHeadUbj(head)) {
+
+        return;
+    }
+
+    uint32_t dst = head["messageDst"].toInt();
+
+    uint32_t messageId = head["messageId"].toInt();
+
+    if (head.hasField("keys")) {
+
+        UBJ::Value &keys = head["keys"];
+
+        for (uint32_t i=0; i<keys.numValues(); ++i) {
+
+            if ((uint32_t)keys[i]["dst"].toInt() == dst) {
+
+                head["messageKey"] = keys[i]["key"];
+            }
+        }
+
+        head.remove("keys");
+
+        pkt = Packet::create(Packet::Message, UBJ::Value::Writer::write(head), pkt->getBody());
+    }
+
+    CONNECTION connection = m_server->online(dst);
+
+    if (!connection || m_server->inboxed(dst, messageId)) {
+
+        if (!m_server->store(dst, messageId, head["messageParts"].toInt(), pkt)) {
+
+            m_server->m_dropped++;
+        }
+
+        return;
+    }
+
+    if (connection->send(pkt)) {
+
+        m_server->m_relayed++;
+    }
+}
+
+// ============================================================ //
+
+void MockServer::Connection::respond(const UBJ::Value &request, UBJ::Object response, uint32_t status)
+{
+    response["requestId"] = request["requestId"];
+
+    response["status"] = status;
+
+    send(Packet::createFromUbj(Packet::Request, response));
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,240 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef MOCKSERVER_H_
+#define MOCKSERVER_H_
+
+#include "Zway/packet.h"
+#include "Zway/thread.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The MockServer class
+*
+* Just enough of the Zway server for clients on loopback to
+* log in, become contacts and send each other messages. Every
+* connection has a thread of its own, message parts are passed
+* on to the recipient as they come in. Messages to accounts
+* which are not online are held in memory until the account
+* lists them with GetInbox and fetches them with GetMessage.
+*
+* TLS uses a self-signed certificate made at startup, the
+* client does not check it.
+*/
+
+class MockServer : public Thread
+{
+public:
+
+    struct Stats
+    {
+        uint64_t packetsIn;
+
+        uint64_t packetsOut;
+
+        uint64_t bytesIn;
+
+        uint64_t bytesOut;
+
+        uint64_t relayed;
+
+        uint64_t dropped;
+
+        uint64_t inboxed;
+    };
+
+    MockServer();
+
+    ~MockServer();
+
+    bool start(uint32_t port = 0);
+
+    void stop();
+
+    uint32_t port();
+
+    Stats stats();
+
+    void addAccount(uint32_t id, uint32_t pw, const std::string &label);
+
+    void onRun();
+
+protected:
+
+    class Connection : public Thread, public std::enable_shared_from_this<Connection>
+    {
+    public:
+
+        typedef std::shared_ptr<Connection> Pointer;
+
+        Connection(MockServer *server, int32_t socket);
+
+        ~Connection();
+
+        bool send(PACKET pkt);
+
+        void close();
+
+        bool finished();
+
+        uint32_t accountId();
+
+        void onRun();
+
+    protected:
+
+        bool handshake();
+
+        PACKET recv();
+
+        bool recvAll(void *data, size_t size);
+
+        bool sendAll(const void *data, size_t size);
+
+        void processRequest(PACKET pkt);
+
+        void processMessage(PACKET pkt);
+
+        void respond(const UBJ::Value &request, UBJ::Object response, uint32_t status = 1);
+
+    protected:
+
+        MockServer *m_server;
+
+        int32_t m_socket;
+
+        /*gnutls_session_t*/ void *m_session;
+
+        std::mutex m_sendMutex;
+
+        std::atomic<bool> m_finished;
+
+        std::atomic<uint32_t> m_accountId;
+    };
+
+    typedef Connection::Pointer CONNECTION;
+
+    struct Account
+    {
+        uint32_t pw;
+
+        std::string label;
+
+        UBJ::Value publicKey;
+    };
+
+    struct ContactRequest
+    {
+        uint32_t src;
+
+        uint32_t dst;
+    };
+
+    struct InboxMessage
+    {
+        PACKET_LIST parts;
+
+        uint32_t numParts;
+
+        uint32_t size;
+
+        uint32_t seq;
+    };
+
+    struct Inbox
+    {
+        uint32_t seq;
+
+        std::map<uint32_t, uint32_t> listed;
+
+        std::map<uint32_t, InboxMessage> messages;
+    };
+
+    bool login(CONNECTION connection, uint32_t id, uint32_t pw);
+
+    void logout(Connection *connection);
+
+    CONNECTION online(uint32_t id);
+
+    bool inboxed(uint32_t dst, uint32_t messageId);
+
+    bool store(uint32_t dst, uint32_t messageId, uint32_t numParts, PACKET pkt);
+
+    void countIn(PACKET pkt);
+
+    void countOut(PACKET pkt);
+
+protected:
+
+    int32_t m_socket;
+
+    uint32_t m_port;
+
+    /*gnutls_certificate_credentials_t*/ void *m_cred;
+
+    std::mutex m_mutex;
+
+    std::list<CONNECTION> m_connections;
+
+    std::map<uint32_t, CONNECTION> m_online;
+
+    std::map<uint32_t, Account> m_accounts;
+
+    std::map<std::string, uint32_t> m_addCodes;
+
+    std::map<uint32_t, ContactRequest> m_contactRequests;
+
+    std::map<uint32_t, Inbox> m_inboxes;
+
+    uint32_t m_nextAccountId;
+
+    std::atomic<uint64_t> m_packetsIn;
+
+    std::atomic<uint64_t> m_packetsOut;
+
+    std::atomic<uint64_t> m_bytesIn;
+
+    std::atomic<uint64_t> m_bytesOut;
+
+    std::atomic<uint64_t> m_relayed;
+
+    std::atomic<uint64_t> m_dropped;
+
+    std::atomic<uint64_t> m_inboxed;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* MOCKSERVER_H_ */
@@ -0,0 +1,95 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef CLIENT_POOL_H_
+#define CLIENT_POOL_H_
+
+#include "Zway/event/eventdispatcher.h"
+#include "Zway/reactor.h"
+#include "Zway/timer.h"
+
+namespace Zway {
+
+// ============================================================ //
+// ClientPool
+// ============================================================ //
+
+/**
+* @brief The ClientPool class
+*
+* Threads shared by clients which are given the pool: I/O loops,
+* event dispatch workers, one timer and connector threads for
+* the blocking connect and TLS handshake. Crypto work goes to
+* the process wide ThreadPool, so neither holds up the other.
+* A client of a pool runs no threads of its own, each further
+* account costs memory only. The pool is kept alive by its
+* clients and has to be released outside of its own threads.
+*/
+
+class ClientPool
+{
+public:
+
+    typedef std::shared_ptr<ClientPool> Pointer;
+
+    static Pointer create(uint32_t numLoops = 0, uint32_t numEventWorkers = 1, uint32_t numConnectors = 2);
+
+    ~ClientPool();
+
+    Reactor &reactor();
+
+    DispatchPool &dispatchPool();
+
+    Timer &timer();
+
+    ThreadPool &connector();
+
+protected:
+
+    ClientPool(uint32_t numLoops, uint32_t numEventWorkers, uint32_t numConnectors);
+
+    bool run();
+
+protected:
+
+    Reactor m_reactor;
+
+    DispatchPool m_dispatchPool;
+
+    Timer m_timer;
+
+    ThreadPool m_connector;
+
+    bool m_running;
+};
+
+typedef ClientPool::Pointer CLIENT_POOL;
+
+// ============================================================ //
+
+}
+
+#endif /* CLIENT_POOL_H_ */
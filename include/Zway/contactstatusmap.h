@@ -0,0 +1,143 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef CONTACT_STATUS_MAP_H_
+#define CONTACT_STATUS_MAP_H_
+
+#include "Zway/buffer.h"
+#include "Zway/thread.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The ContactStatusMap class
+*
+* Status of each contact by contact id. Readers take a snapshot,
+* an immutable flat hash table, without locking. Writers build a
+* new table with their changes applied and publish it, so each
+* batch of changes costs one copy and readers never wait.
+*
+* The map also keeps the epoch and version of the server's status
+* set, against which server pushed diffs are applied, and packs
+* status lists into varint arrays for the wire.
+*/
+
+class ContactStatusMap
+{
+public:
+
+    struct Entry
+    {
+        uint32_t contactId;
+
+        uint32_t status;
+    };
+
+    typedef std::vector<Entry> ENTRY_LIST;
+
+    //! Open addressing table, contact id 0 marks a free slot
+
+    class Table
+    {
+    public:
+
+        Table(uint32_t size = 0);
+
+        uint32_t get(uint32_t contactId, uint32_t def = 0) const;
+
+        bool contains(uint32_t contactId) const;
+
+        uint32_t size() const;
+
+        ENTRY_LIST entries() const;
+
+    protected:
+
+        void set(uint32_t contactId, uint32_t status);
+
+        uint32_t slot(uint32_t contactId) const;
+
+    protected:
+
+        std::vector<Entry> m_slots;
+
+        uint32_t m_mask;
+
+        uint32_t m_size;
+
+        friend class ContactStatusMap;
+    };
+
+    typedef std::shared_ptr<const Table> Snapshot;
+
+    ContactStatusMap();
+
+    Snapshot snapshot() const;
+
+    uint32_t get(uint32_t contactId) const;
+
+    void apply(const ENTRY_LIST &changes);
+
+    void applyFull(uint32_t epoch, uint32_t version, const ENTRY_LIST &entries);
+
+    bool applyDelta(uint32_t epoch, uint32_t base, uint32_t version, const ENTRY_LIST &changes);
+
+    uint32_t epoch();
+
+    uint32_t version();
+
+    void clear();
+
+    static BUFFER pack(const ENTRY_LIST &entries);
+
+    static bool unpack(const BUFFER &buffer, ENTRY_LIST &entries);
+
+    static BUFFER packIds(const std::vector<uint32_t> &ids);
+
+    static bool unpackIds(const BUFFER &buffer, std::vector<uint32_t> &ids);
+
+protected:
+
+    void publish(const Table *base, const ENTRY_LIST &changes);
+
+protected:
+
+    std::shared_ptr<const Table> m_table;
+
+    std::mutex m_writeMutex;
+
+    uint32_t m_epoch;
+
+    uint32_t m_version;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* CONTACT_STATUS_MAP_H_ */
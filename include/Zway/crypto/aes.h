@@ -45,6 +45,8 @@ public:
 
     void setCtr(BUFFER ctr);
 
+    void setCtr(BUFFER ctr, uint64_t offset);
+
     void encrypt(void* src, void* dst, uint32_t size);
 
     void encrypt(BUFFER src, BUFFER dst, uint32_t size);
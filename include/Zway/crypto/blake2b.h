@@ -0,0 +1,85 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef BLAKE2B_H_
+#define BLAKE2B_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The Blake2b class
+*
+* BLAKE2b as in RFC 7693, unkeyed. Faster than MD5 on 64 bit
+* CPUs and collision resistant, used to find resources that
+* are stored already.
+*/
+
+class Blake2b
+{
+public:
+
+    enum {
+        BLOCK_SIZE = 128,
+        MAX_DIGEST_SIZE = 64
+    };
+
+    void init(size_t digestSize);
+
+    void update(const uint8_t *data, size_t size);
+
+    void digest(uint8_t *digest, size_t size);
+
+protected:
+
+    void compress(const uint8_t *block, bool last);
+
+    void addCounter(uint64_t size);
+
+protected:
+
+    uint64_t m_h[8];
+
+    uint64_t m_t[2];
+
+    uint8_t m_block[BLOCK_SIZE];
+
+    uint32_t m_index;
+
+    uint32_t m_digestSize;
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* BLAKE2B_H_ */
@@ -39,12 +39,14 @@ public:
 
     enum {
         DIGEST_MD5_SIZE = 16,
-        DIGEST_SHA256_SIZE = 32
+        DIGEST_SHA256_SIZE = 32,
+        DIGEST_BLAKE2B_SIZE = 32
     };
 
     enum DigestType {
         DIGEST_MD5,
-        DIGEST_SHA256
+        DIGEST_SHA256,
+        DIGEST_BLAKE2B
     };
 
     Digest(DigestType type);
@@ -67,8 +69,12 @@ public:
 
 protected:
 
+    static uint32_t ctxSize(DigestType type, bool hardware);
+
     DigestType m_type;
 
+    bool m_hardware;
+
     uint8_t* m_ctx;
 };
 
@@ -0,0 +1,104 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef KDF_H_
+#define KDF_H_
+
+#include "Zway/ubj/value.h"
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The Kdf class
+*
+* Password based key derivation with its parameters kept in
+* a UBJ object: "alg", "iter", "salt" and, for Argon2id, "mem"
+* (KiB) and "lanes". Parameters are picked by calibrate() so
+* that a derivation takes about a given time on this device.
+*/
+
+class Kdf
+{
+public:
+
+    enum Algorithm {
+        Pbkdf2Sha256 = 1,
+        Argon2id = 2
+    };
+
+    enum {
+        SALT_SIZE = 16,
+        KEY_SIZE = 32,
+        LEGACY_ITERATIONS = 10000,
+        DEFAULT_TARGET_MS = 250,
+        DEFAULT_MEMORY = 16384,
+        MIN_MEMORY = 1024
+    };
+
+    static UBJ::Object legacyParams();
+
+    static UBJ::Object calibrate(
+            Algorithm algorithm = Argon2id,
+            uint32_t targetMs = DEFAULT_TARGET_MS,
+            uint32_t memory = DEFAULT_MEMORY);
+
+    static bool isValid(const UBJ::Object &params);
+
+    static BUFFER derive(
+            const std::string &password,
+            const UBJ::Object &params,
+            uint32_t size = KEY_SIZE);
+
+    static bool pbkdf2Sha256(
+            const uint8_t *password, size_t passwordSize,
+            const uint8_t *salt, size_t saltSize,
+            uint32_t iterations,
+            uint8_t *out, size_t outSize);
+
+    static bool argon2id(
+            const uint8_t *password, size_t passwordSize,
+            const uint8_t *salt, size_t saltSize,
+            uint32_t iterations,
+            uint32_t memory,
+            uint32_t lanes,
+            uint8_t *out, size_t outSize,
+            const uint8_t *secret = nullptr, size_t secretSize = 0,
+            const uint8_t *data = nullptr, size_t dataSize = 0);
+
+protected:
+
+    static double measure(Algorithm algorithm, uint32_t iterations, uint32_t memory);
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* KDF_H_ */
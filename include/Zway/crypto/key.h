@@ -0,0 +1,102 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef KEY_H_
+#define KEY_H_
+
+#include "Zway/ubj/value.h"
+
+#include <map>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The Key class
+*
+* Dispatches key operations to the key type in use. Account
+* and contact key objects hold the RSA key, an "ec" field next
+* to it holds the Curve25519 keys. A contact is talked to with
+* EC keys as soon as both sides have them, RSA otherwise.
+* Decryption and verification pick the type from the input.
+*/
+
+class Key
+{
+public:
+
+    enum Type {
+        RSAType,
+        ECType
+    };
+
+    static bool createKeyPair(
+            UBJ::Value &publicKeyObj,
+            UBJ::Value &privateKeyObj,
+            uint32_t bits);
+
+    static bool addECKeyPair(
+            UBJ::Value &publicKeyObj,
+            UBJ::Value &privateKeyObj);
+
+    static Type negotiate(
+            const UBJ::Value &ownPublicKeyObj,
+            const UBJ::Value &contactPublicKeyObj);
+
+    static BUFFER encrypt(
+            UBJ::Value &publicKeyObj,
+            BUFFER buf,
+            Type type);
+
+    static bool encrypt(
+            UBJ::Value &ownPublicKeyObj,
+            std::map<uint32_t, UBJ::Value> &publicKeyObjs,
+            BUFFER buf,
+            std::map<uint32_t, BUFFER> &res);
+
+    static BUFFER decrypt(
+            UBJ::Value &privateKeyObj,
+            BUFFER buf);
+
+    static BUFFER sign(
+            UBJ::Value &privateKeyObj,
+            BUFFER buf,
+            Type type);
+
+    static bool verify(
+            UBJ::Value &publicKeyObj,
+            BUFFER buf,
+            BUFFER sign);
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* KEY_H_ */
@@ -0,0 +1,101 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef KEY_POOL_H_
+#define KEY_POOL_H_
+
+#include "Zway/ubj/value.h"
+
+#include <functional>
+#include <list>
+#include <mutex>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The KeyPool class
+*
+* Account key pairs generated ahead of time on the shared
+* thread pool. Taking a pair hands out a pregenerated one if
+* there is one, otherwise one is generated in the background.
+* The pool is refilled one pair at a time, so it never holds
+* more than one worker.
+*/
+
+class KeyPool
+{
+public:
+
+    enum {
+        KEY_BITS = 2048,
+        DEFAULT_SIZE = 2
+    };
+
+    typedef std::function<void (bool, const UBJ::Object&, const UBJ::Object&)> Callback;
+
+    static KeyPool &instance();
+
+    void take(Callback callback);
+
+    void fill();
+
+    void setSize(uint32_t size);
+
+    uint32_t available();
+
+protected:
+
+    KeyPool();
+
+    void refill();
+
+    struct KeyPair
+    {
+        UBJ::Object publicKey;
+
+        UBJ::Object privateKey;
+    };
+
+protected:
+
+    std::list<KeyPair> m_pairs;
+
+    std::mutex m_mutex;
+
+    uint32_t m_size;
+
+    bool m_filling;
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* KEY_POOL_H_ */
@@ -0,0 +1,86 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef MERKLE_TREE_H_
+#define MERKLE_TREE_H_
+
+#include "Zway/buffer.h"
+
+#include <vector>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The MerkleTree class
+*
+* SHA-256 hash tree over the parts of a resource. A single
+* signature over the root covers all parts, each part can be
+* checked on its own with the sibling hashes on its path.
+* An odd node at the end of a level is promoted unchanged.
+*/
+
+class MerkleTree
+{
+public:
+
+    enum {
+        HASH_SIZE = 32
+    };
+
+    MerkleTree();
+
+    bool build(BUFFER leaves);
+
+    uint32_t numLeaves();
+
+    BUFFER leaves();
+
+    BUFFER root();
+
+    BUFFER proof(uint32_t index);
+
+    static BUFFER leaf(uint8_t* data, uint32_t size);
+
+    static BUFFER root(BUFFER leaf, uint32_t index, uint32_t numLeaves, BUFFER proof);
+
+protected:
+
+    static void node(uint8_t* left, uint8_t* right, uint8_t* dst);
+
+protected:
+
+    std::vector<BUFFER> m_levels;
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* MERKLE_TREE_H_ */
@@ -27,6 +27,7 @@
 #ifndef RANDOM_H_
 #define RANDOM_H_
 
+#include <cstddef>
 #include <cstdint>
 
 namespace Zway { namespace Crypto {
@@ -51,7 +52,7 @@ public:
 
     static bool random(uint8_t* data, uint32_t size, RandomLevel level = Weak);
 
-    static void* getYarrowCtx();
+    static void nettleRandom(void *ctx, size_t size, uint8_t *data);
 
 private:
 
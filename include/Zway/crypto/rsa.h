@@ -29,6 +29,10 @@
 
 #include "Zway/ubj/value.h"
 
+#include <map>
+
+struct rsa_public_key;
+
 namespace Zway { namespace Crypto {
 
 // ============================================================ //
@@ -37,6 +41,19 @@ class RSA
 {
 public:
 
+    enum {
+        BINARY_TAG = 0xB0
+    };
+
+    enum Format {
+        HexFormat,
+        BinaryFormat
+    };
+
+    static void setFormat(Format format);
+
+    static Format format();
+
     static bool createKeyPair(
             UBJ::Value &publicKeyObj,
             UBJ::Value &privateKeyObj,
@@ -46,6 +63,11 @@ public:
             UBJ::Value &publicKeyObj,
             BUFFER buf);
 
+    static bool encrypt(
+            std::map<uint32_t, UBJ::Value> &publicKeyObjs,
+            BUFFER buf,
+            std::map<uint32_t, BUFFER> &res);
+
     static BUFFER decrypt(
             UBJ::Value &privateKeyObj,
             BUFFER buf);
@@ -58,6 +80,12 @@ public:
             UBJ::Value &publicKeyObj,
             BUFFER buf,
             BUFFER sign);
+
+protected:
+
+    static BUFFER encrypt(
+            struct rsa_public_key &publicKey,
+            BUFFER buf);
 };
 
 // ============================================================ //
@@ -30,16 +30,50 @@
 #include <Zway/buffer.h>
 #include <Zway/thread.h>
 #include <stddef.h>
-#include <map>
+#include <atomic>
+#include <vector>
 
 namespace Zway {
 
 // ============================================================ //
 
+/**
+* @brief The SecMem class
+*
+* Allocator for locked memory. The locked area is cut into
+* slabs, a slab is assigned to one power of two size class on
+* first use and holds blocks of that size only. Free blocks
+* are kept in a list per class, threads keep a few blocks per
+* class for themselves, so malloc and free are O(1) and mostly
+* lock free. Freed blocks are wiped.
+*/
+
 class SecMem
 {
 public:
 
+    enum {
+        MIN_BLOCK_SIZE = 16,
+        SLAB_SIZE = 4096,
+        NUM_CLASSES = 9,
+        THREAD_CACHE_SIZE = 8
+    };
+
+    struct Stats
+    {
+        size_t lockedSize;
+
+        size_t used;
+
+        size_t slabsUsed;
+
+        size_t allocs;
+
+        size_t frees;
+
+        size_t failures;
+    };
+
     static bool setup(size_t size=0);
 
     static bool cleanup();
@@ -48,6 +82,8 @@ public:
 
     static bool free(uint8_t* ptr);
 
+    static bool owns(uint8_t* ptr);
+
     static size_t getPageSize();
 
     static size_t getLockedSize();
@@ -56,11 +92,32 @@ public:
 
     static size_t getLockedSizeAvailable();
 
+    static Stats getStats();
+
 private:
 
+    struct ThreadCache
+    {
+        ~ThreadCache();
+
+        uint8_t* blocks[NUM_CLASSES][THREAD_CACHE_SIZE];
+
+        uint32_t count[NUM_CLASSES];
+
+        uint32_t generation;
+    };
+
     SecMem();
 
-    bool getOffset(size_t size, size_t* offset);
+    static int32_t sizeClass(size_t size);
+
+    static size_t blockSize(uint32_t sizeClass);
+
+    static ThreadCache &threadCache();
+
+    uint8_t* allocBlock(uint32_t sizeClass);
+
+    void freeBlock(uint8_t* ptr, uint32_t sizeClass);
 
 private:
 
@@ -68,7 +125,23 @@ private:
 
     size_t m_lockedSize;
 
-    ThreadSafe<std::map<uint8_t*, size_t> > m_lockedMallocs;
+    std::mutex m_mutex;
+
+    uint8_t* m_freeBlocks[NUM_CLASSES];
+
+    std::vector<uint8_t> m_slabClasses;
+
+    size_t m_slabsUsed;
+
+    std::atomic<size_t> m_used;
+
+    std::atomic<size_t> m_allocs;
+
+    std::atomic<size_t> m_frees;
+
+    std::atomic<size_t> m_failures;
+
+    std::atomic<uint32_t> m_generation;
 
     static SecMem* instance;
 };
@@ -0,0 +1,105 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+/**
+* @brief The Sha256 class
+*
+* SHA-256 on the SHA extensions of x86 (SHA-NI) and ARMv8.
+* The backend is picked once, on first use, from what the CPU
+* supports and what this build has code for. A backend is only
+* picked if it passes a known answer test against nettle.
+* Digest falls back to nettle if no hardware backend is there.
+*/
+
+class Sha256
+{
+public:
+
+    enum Backend {
+        NettleBackend,
+        ShaNiBackend,
+        ArmV8Backend
+    };
+
+    enum {
+        DIGEST_SIZE = 32,
+        BLOCK_SIZE = 64
+    };
+
+    static Backend backend();
+
+    static bool setBackend(Backend backend);
+
+    static bool supported(Backend backend);
+
+    static const char *backendName(Backend backend);
+
+    void init();
+
+    void update(const uint8_t *data, size_t size);
+
+    void digest(uint8_t *digest, size_t size);
+
+protected:
+
+    typedef void (*Compress)(uint32_t *state, const uint8_t *data, size_t numBlocks);
+
+    static Compress compressFunc(Backend backend);
+
+    static bool selfTest(Backend backend);
+
+    void reset(Compress compress);
+
+protected:
+
+    Compress m_compress;
+
+    uint32_t m_state[8];
+
+    uint8_t m_block[BLOCK_SIZE];
+
+    uint32_t m_index;
+
+    uint64_t m_numBlocks;
+};
+
+// ============================================================ //
+
+}
+
+}
+
+#endif /* SHA256_H_ */
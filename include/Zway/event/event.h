@@ -64,7 +64,11 @@ public:
         MessageRecv,
         ResourceSent,
         ResourceRecv,
-        ResourceFailure
+        ResourceFailure,
+
+        MessageProgress,
+
+        InboxSynced
     };
 
     typedef std::shared_ptr<Event> Pointer;
@@ -83,10 +87,18 @@ public:
 
     uint32_t id() const;
 
+    uint64_t key() const;
+
+    void setKey(uint64_t key);
+
     UBJ::Value &data();
 
     UBJ::Value &error();
 
+    static uint64_t messageKey(uint32_t messageId);
+
+    static uint64_t contactKey(uint32_t contactId);
+
 protected:
 
     Event(
@@ -99,6 +111,8 @@ protected:
 
     uint32_t m_id;
 
+    uint64_t m_key;
+
     UBJ::Value m_data;
 
     UBJ::Value m_error;
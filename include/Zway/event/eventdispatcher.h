@@ -30,43 +30,250 @@
 #include "Zway/event/event.h"
 #include "Zway/thread.h"
 
+#include <chrono>
 #include <condition_variable>
+#include <map>
+#include <unordered_map>
 
 namespace Zway {
 
 typedef std::function<void (EVENT)> EVENT_HANDLER;
 
+class EventDispatcher;
+
+// ============================================================ //
+// DispatchPool
+// ============================================================ //
+
+/**
+* @brief The DispatchPool class
+*
+* Worker threads delivering the events of one or more event
+* dispatchers. A dispatcher without a shared pool uses one of
+* its own. Events are spread by dispatcher and key, so events
+* sharing both keep their order.
+*/
+
+class DispatchPool
+{
+public:
+
+    DispatchPool(uint32_t numWorkers = 1);
+
+    ~DispatchPool();
+
+    void setNumWorkers(uint32_t numWorkers);
+
+    uint32_t numWorkers();
+
+    bool run();
+
+    void cancel();
+
+    void join();
+
+    void cancelAndJoin();
+
+protected:
+
+    struct ITEM
+    {
+        ITEM(EventDispatcher *dispatcher = nullptr, uint64_t serial = 0, EVENT event = EVENT(), uint64_t queued = 0)
+            : dispatcher(dispatcher),
+              serial(serial),
+              event(event),
+              queued(queued)
+        {
+
+        }
+
+        EventDispatcher *dispatcher;
+
+        uint64_t serial;
+
+        EVENT event;
+
+        uint64_t queued;
+    };
+
+    class Worker : public Thread
+    {
+    public:
+
+        Worker(DispatchPool *pool);
+
+        void post(ITEM item);
+
+        void wake();
+
+        void reset();
+
+        void cancel();
+
+        void onRun();
+
+    protected:
+
+        DispatchPool *m_pool;
+
+        MpscQueue<ITEM> m_events;
+
+        std::atomic<bool> m_sleeping;
+
+        bool m_woken;
+
+        std::mutex m_waitMutex;
+
+        std::condition_variable m_waitCondition;
+    };
+
+    bool start(uint32_t first);
+
+    void attach(EventDispatcher *dispatcher);
+
+    void detach(EventDispatcher *dispatcher);
+
+    void post(EventDispatcher *dispatcher, EVENT event);
+
+    void dispatch(ITEM &item);
+
+    void drop(ITEM &item);
+
+    void wake();
+
+    uint32_t flushDeferred();
+
+protected:
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    uint32_t m_first;
+
+    bool m_started;
+
+    std::unordered_map<uint64_t, EventDispatcher*> m_dispatchers;
+
+    std::mutex m_dispatchersMutex;
+
+    std::condition_variable m_idleCondition;
+
+    friend class EventDispatcher;
+};
+
+// ============================================================ //
+// EventDispatcher
 // ============================================================ //
 
 class EventDispatcher : public Thread
 {
 public:
 
-    EventDispatcher();
+    EventDispatcher(uint32_t numWorkers = 1);
+
+    ~EventDispatcher();
+
+    void setNumWorkers(uint32_t numWorkers);
 
-    void addHandler(EVENT_HANDLER handler);
+    uint32_t numWorkers();
+
+    void setPool(DispatchPool *pool);
+
+    uint32_t addHandler(EVENT_HANDLER handler);
+
+    uint32_t addHandler(Event::EventType type, EVENT_HANDLER handler);
+
+    uint32_t addMessageHandler(uint32_t messageId, EVENT_HANDLER handler);
+
+    uint32_t addContactHandler(uint32_t contactId, EVENT_HANDLER handler);
+
+    bool removeHandler(uint32_t handlerId);
+
+    void setCoalescing(Event::EventType type, bool enabled, uint32_t windowMs = 0);
 
     void post(EVENT event, bool immediately = false);
 
+    bool run();
+
     void cancel();
 
+    void join();
+
     void onRun();
 
 private:
 
-    EVENT getEvent();
+    enum Scope {
+        AllScope,
+        TypeScope,
+        MessageScope,
+        ContactScope
+    };
+
+    typedef std::vector<std::pair<uint32_t, EVENT_HANDLER>> HANDLER_LIST;
+
+    typedef std::unordered_map<uint32_t, HANDLER_LIST> HANDLER_MAP;
+
+    struct Handlers
+    {
+        HANDLER_LIST all;
+
+        HANDLER_MAP byType;
+
+        HANDLER_MAP byMessage;
+
+        HANDLER_MAP byContact;
+    };
+
+    struct Coalesced
+    {
+        EVENT queued;
+
+        EVENT deferred;
+
+        std::chrono::steady_clock::time_point last;
+    };
+
+    typedef std::pair<uint64_t, uint32_t> COALESCE_KEY;
+
+    uint32_t addHandler(Scope scope, uint32_t value, EVENT_HANDLER handler);
+
+    void enqueue(EVENT event);
+
+    bool coalesce(EVENT event, std::vector<EVENT> &flushed);
+
+    void take(EVENT event);
+
+    uint32_t flushDeferred();
 
     void dispatchEvent(EVENT event);
 
 private:
 
-    ThreadSafe<std::list<EVENT>> m_events;
+    DispatchPool m_ownPool;
+
+    DispatchPool *m_pool;
+
+    std::atomic<uint64_t> m_serial;
+
+    uint32_t m_inFlight;
+
+    std::atomic<bool> m_detached;
+
+    std::shared_ptr<const Handlers> m_handlers;
+
+    std::mutex m_handlersMutex;
+
+    uint32_t m_handlerId;
+
+    std::map<COALESCE_KEY, Coalesced> m_coalesced;
+
+    std::unordered_map<uint32_t, uint32_t> m_coalesceWindows;
 
-    ThreadSafe<std::list<EVENT_HANDLER>> m_handlers;
+    std::mutex m_coalesceMutex;
 
-    std::mutex m_waitMutex;
+    std::atomic<uint32_t> m_numDeferred;
 
-    std::condition_variable m_waitCondition;
+    friend class DispatchPool;
 };
 
 // ============================================================ //
@@ -0,0 +1,93 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef MESSAGE_SCHEDULER_H_
+#define MESSAGE_SCHEDULER_H_
+
+#include "Zway/message/messagesender.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The MessageScheduler class
+*
+* Decides which message sender may put the next part on the wire.
+* Interactive senders are served first, all other senders share the
+* remaining bandwidth by deficit round-robin over the bytes they send,
+* weighted by their priority class.
+*/
+
+class MessageScheduler
+{
+public:
+
+    MessageScheduler();
+
+    void add(MESSAGE_SENDER sender);
+
+    bool remove(MESSAGE_SENDER sender);
+
+    MESSAGE_SENDER next();
+
+    void clear();
+
+    MESSAGE_SENDER_LIST senders();
+
+    uint32_t size();
+
+    bool empty();
+
+    static uint32_t quantum(MessageSender::Priority priority);
+
+protected:
+
+    struct Flow {
+
+        MESSAGE_SENDER sender;
+
+        uint32_t deficit;
+    };
+
+    typedef std::list<Flow> FLOW_LIST;
+
+    bool remove(FLOW_LIST &flows, MESSAGE_SENDER sender);
+
+protected:
+
+    FLOW_LIST m_interactive;
+
+    FLOW_LIST m_flows;
+
+    bool m_quantumGranted;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* MESSAGE_SCHEDULER_H_ */
@@ -98,13 +98,17 @@ public:
 
     std::string md5Hex();
 
+    BUFFER hash();
+
+    std::string hashHex();
+
     std::mutex &mutex();
 
 protected:
 
     Resource();
 
-    void updateMD5();
+    void resetHashes();
 
 protected:
 
@@ -112,6 +116,10 @@ protected:
 
     BUFFER m_md5;
 
+    BUFFER m_hash;
+
+    std::mutex m_hashMutex;
+
     std::mutex m_mutex;
 };
 
@@ -0,0 +1,219 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The Metrics class
+*
+* Process wide registry of counters, gauges and latency
+* histograms. Every thread records into a shard of its own,
+* so the hot paths take no lock and share no cache line; a
+* snapshot sums all shards. Histograms keep eight buckets per
+* power of two of nanoseconds, so percentiles are within 12.5%.
+*/
+
+class Metrics
+{
+public:
+
+    enum Counter {
+        BytesSent,
+        BytesRecv,
+        PacketsSent,
+        PacketsRecv,
+        HeartbeatsSent,
+        HeartbeatsRecv,
+        RequestPacketsSent,
+        RequestPacketsRecv,
+        MessagePacketsSent,
+        MessagePacketsRecv,
+        NUM_COUNTERS
+    };
+
+    enum Gauge {
+        EventQueueDepth,
+        ActiveSenders,
+        ActiveReceivers,
+        NUM_GAUGES
+    };
+
+    enum Histogram {
+        RttDispatch,
+        RttCreateAccount,
+        RttLogin,
+        RttConfig,
+        RttAddContact,
+        RttCreateAddCode,
+        RttFindContact,
+        RttAcceptContact,
+        RttRejectContact,
+        RttContactStatus,
+        RttGetInbox,
+        RttGetMessage,
+        RttResumeMessage,
+        RttOther,
+        StorageSelect,
+        StorageInsert,
+        StorageUpdate,
+        StorageDelete,
+        StorageCount,
+        CryptoAes,
+        CryptoDigest,
+        CryptoRsa,
+        EventQueueWait,
+        EventDispatch,
+        NUM_HISTOGRAMS
+    };
+
+    enum {
+        SUB_BUCKETS = 8,
+        NUM_BUCKETS = 62 * SUB_BUCKETS
+    };
+
+    struct HistogramSnapshot
+    {
+        HistogramSnapshot();
+
+        uint64_t percentile(double p) const;
+
+        uint64_t mean() const;
+
+        uint64_t count;
+
+        uint64_t sum;
+
+        uint64_t max;
+
+        std::vector<uint64_t> buckets;
+    };
+
+    struct Snapshot
+    {
+        std::string toString() const;
+
+        uint64_t counters[NUM_COUNTERS];
+
+        int64_t gauges[NUM_GAUGES];
+
+        HistogramSnapshot histograms[NUM_HISTOGRAMS];
+    };
+
+    /**
+    * @brief The Scope class
+    *
+    * Records the time between its construction and destruction
+    */
+
+    class Scope
+    {
+    public:
+
+        Scope(Histogram histogram);
+
+        ~Scope();
+
+    protected:
+
+        Histogram m_histogram;
+
+        uint64_t m_start;
+    };
+
+    static Metrics &instance();
+
+    static uint64_t now();
+
+    static const char *name(Counter counter);
+
+    static const char *name(Gauge gauge);
+
+    static const char *name(Histogram histogram);
+
+    static Histogram requestHistogram(uint32_t requestType);
+
+    static uint32_t bucket(uint64_t value);
+
+    static uint64_t bucketValue(uint32_t bucket);
+
+    void setEnabled(bool enabled);
+
+    bool enabled() const;
+
+    void add(Counter counter, uint64_t n = 1);
+
+    void add(Gauge gauge, int64_t delta);
+
+    void record(Histogram histogram, uint64_t ns);
+
+    Snapshot snapshot();
+
+protected:
+
+    struct Shard;
+
+    struct ShardHolder
+    {
+        ~ShardHolder();
+
+        Shard *shard;
+    };
+
+    Metrics();
+
+    Shard &shard();
+
+    void retire(Shard *shard);
+
+    void merge(Snapshot &snapshot, Shard &shard);
+
+protected:
+
+    std::atomic<bool> m_enabled;
+
+    std::vector<Shard*> m_shards;
+
+    Shard *m_retired;
+
+    std::mutex m_mutex;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,137 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include "Zway/thread.h"
+
+#if defined _WIN32
+#include <winsock2.h>
+#endif
+
+#include <unordered_map>
+
+namespace Zway {
+
+// ============================================================ //
+// Reactor
+// ============================================================ //
+
+/**
+* @brief The Reactor class
+*
+* A fixed number of I/O loops shared by many connections. Each
+* loop is a thread waiting on the sockets watched on it and
+* running the tasks posted to it in order. Everything posted or
+* called back for one socket runs on its loop, one at a time.
+*/
+
+class Reactor
+{
+public:
+
+    typedef std::function<void()> Task;
+
+#if defined _WIN32
+    typedef SOCKET Socket;
+#else
+    typedef int32_t Socket;
+#endif
+
+    class Loop : public Thread
+    {
+    public:
+
+        Loop();
+
+        ~Loop();
+
+        bool run();
+
+        void cancel();
+
+        void post(Task task);
+
+        void watch(Socket socket, Task onReadable);
+
+        void watchWritable(Socket socket, Task onWritable);
+
+        void unwatch(Socket socket);
+
+        void sync();
+
+        uint32_t numWatched();
+
+        bool current();
+
+        void onRun();
+
+    protected:
+
+        void wake();
+
+    protected:
+
+        MpscQueue<Task> m_tasks;
+
+        std::unordered_map<Socket, Task> m_watched;
+
+        std::unordered_map<Socket, Task> m_writable;
+
+        bool m_changed;
+
+        std::mutex m_mutex;
+
+#if !defined _WIN32
+        int m_wakePipe[2];
+#endif
+    };
+
+    Reactor(uint32_t numLoops = 0);
+
+    ~Reactor();
+
+    bool run();
+
+    void cancelAndJoin();
+
+    uint32_t numLoops();
+
+    Loop *next();
+
+protected:
+
+    std::vector<std::unique_ptr<Loop>> m_loops;
+
+    std::atomic<uint32_t> m_next;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* REACTOR_H_ */
@@ -40,13 +40,21 @@ public:
 
     typedef std::shared_ptr<ContactStatusRequest> Pointer;
 
-    static Pointer create(const UBJ::Value &contacts, STORAGE storage);
+    static Pointer create(
+            const UBJ::Value &contacts,
+            STORAGE storage,
+            uint32_t epoch = 0,
+            uint32_t version = 0);
 
     bool processRecv(PACKET pkt, const UBJ::Value &head);
 
 protected:
 
-    ContactStatusRequest(const UBJ::Value &contacts, STORAGE storage);
+    ContactStatusRequest(
+            const UBJ::Value &contacts,
+            STORAGE storage,
+            uint32_t epoch,
+            uint32_t version);
 };
 
 typedef ContactStatusRequest::Pointer CONTACT_STATUS_REQUEST;
@@ -48,6 +48,10 @@ public:
             const std::string &storagePassword,
             Callback callback = nullptr);
 
+    bool start();
+
+    bool checkTimeout();
+
     bool processRecv(PACKET pkt, const UBJ::Value &head);
 
     void invokeCallback(EVENT event);
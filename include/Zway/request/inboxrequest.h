@@ -39,15 +39,33 @@ public:
 
     typedef std::shared_ptr<InboxRequest> Pointer;
 
-    static Pointer create();
+    enum {
+        DEFAULT_LIMIT = 500
+    };
+
+    static Pointer create(
+            uint32_t cursor = 0,
+            uint32_t limit = DEFAULT_LIMIT,
+            EVENT_CALLBACK callback = nullptr);
 
     bool processRecv(PACKET pkt, const UBJ::Value &head);
 
+    void invokeCallback(EVENT event);
+
+protected:
+
+    InboxRequest(
+            uint32_t cursor,
+            uint32_t limit,
+            EVENT_CALLBACK callback = nullptr);
+
 protected:
 
-    InboxRequest();
+    EVENT_CALLBACK m_callback;
 };
 
+typedef InboxRequest::Pointer INBOX_REQUEST;
+
 // ============================================================ //
 
 }
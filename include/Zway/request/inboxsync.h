@@ -0,0 +1,131 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef INBOX_SYNC_H_
+#define INBOX_SYNC_H_
+
+#include "Zway/request/inboxrequest.h"
+#include "Zway/request/messagerequest.h"
+#include "Zway/request/requestevent.h"
+#include "Zway/storage/storage.h"
+
+#include <deque>
+
+namespace Zway {
+
+class Client;
+
+// ============================================================ //
+
+/**
+* @brief The InboxSync class
+*
+* Fetches the messages that piled up on the server while we were
+* offline. The inbox is listed page by page from the last cursor,
+* messages we have already are skipped and the rest is fetched in
+* batches, a few batches at a time. The cursor is stored once all
+* messages of a page have been fetched, so an interrupted sync
+* repeats at most one page.
+*/
+
+class InboxSync : public std::enable_shared_from_this<InboxSync>
+{
+public:
+
+    typedef std::shared_ptr<InboxSync> Pointer;
+
+    enum {
+        PAGE_SIZE = 500,
+        BATCH_SIZE = 50,
+        BATCH_BYTES = 4 * 1024 * 1024,
+        MAX_BATCHES = 4
+    };
+
+    static Pointer create(Client *client, STORAGE storage);
+
+    bool start();
+
+    void cancel();
+
+    bool running();
+
+    uint32_t fetched();
+
+protected:
+
+    InboxSync(Client *client, STORAGE storage);
+
+    void requestPage();
+
+    void onPage(EVENT event);
+
+    void fetchNext();
+
+    void onBatch(EVENT event, uint32_t numMessages);
+
+    void finish(const std::string &error = std::string());
+
+protected:
+
+    struct Entry
+    {
+        uint32_t id;
+
+        uint32_t size;
+    };
+
+    Client *m_client;
+
+    STORAGE m_storage;
+
+    std::mutex m_mutex;
+
+    bool m_running;
+
+    bool m_cancelled;
+
+    bool m_failed;
+
+    bool m_more;
+
+    uint32_t m_cursor;
+
+    uint32_t m_pageCursor;
+
+    std::deque<Entry> m_pending;
+
+    uint32_t m_inFlight;
+
+    uint32_t m_fetched;
+};
+
+typedef InboxSync::Pointer INBOX_SYNC;
+
+// ============================================================ //
+
+}
+
+#endif /* INBOX_SYNC_H_ */
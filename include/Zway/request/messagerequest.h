@@ -41,17 +41,27 @@ public:
 
     static Pointer create(uint32_t messageId);
 
-    bool processSend();
+    static Pointer create(
+            const std::vector<uint32_t> &messageIds,
+            EVENT_CALLBACK callback = nullptr);
 
     bool processRecv(PACKET pkt, const UBJ::Value &head);
 
+    void invokeCallback(EVENT event);
+
+    const std::vector<uint32_t> &messageIds();
+
 protected:
 
-    MessageRequest(uint32_t messageId);
+    MessageRequest(
+            const std::vector<uint32_t> &messageIds,
+            EVENT_CALLBACK callback = nullptr);
 
 protected:
 
-    uint32_t m_messageId;
+    std::vector<uint32_t> m_messageIds;
+
+    EVENT_CALLBACK m_callback;
 };
 
 typedef MessageRequest::Pointer MESSAGE_REQUEST;
@@ -0,0 +1,108 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef REQUEST_FUTURE_H_
+#define REQUEST_FUTURE_H_
+
+#include "Zway/request/requestevent.h"
+
+#if defined __has_include
+#if __has_include(<coroutine>) && defined __cpp_impl_coroutine
+#include <coroutine>
+#define ZWAY_COROUTINES 1
+#endif
+#endif
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The RequestFuture class
+*
+* Result of a request posted by one of the client's ...Async()
+* methods: the event that finished the request. It can be waited
+* for, chained with then() or, when compiled as C++20, awaited
+* with co_await. The result is handed over by the thread that
+* finishes the request, not through the event dispatcher.
+*
+* A request that could not be posted yields a future which is
+* ready with an error event right away.
+*/
+
+class RequestFuture
+{
+public:
+
+    RequestFuture(REQUEST request);
+
+    RequestFuture(EVENT event);
+
+    bool posted() const;
+
+    REQUEST request() const;
+
+    bool ready();
+
+    bool waitFor(uint32_t ms);
+
+    EVENT get();
+
+    std::shared_future<EVENT> future();
+
+    void then(std::function<void (EVENT)> continuation);
+
+#if defined ZWAY_COROUTINES
+
+    bool await_ready()
+    {
+        return ready();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        then([handle] (EVENT) { handle.resume(); });
+    }
+
+    EVENT await_resume()
+    {
+        return get();
+    }
+
+#endif
+
+protected:
+
+    REQUEST m_request;
+
+    EVENT m_event;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* REQUEST_FUTURE_H_ */
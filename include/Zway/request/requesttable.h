@@ -0,0 +1,91 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef REQUEST_TABLE_H_
+#define REQUEST_TABLE_H_
+
+#include "Zway/request/request.h"
+
+#include <list>
+#include <unordered_map>
+
+namespace Zway {
+
+// ============================================================ //
+
+typedef std::list<REQUEST> REQUEST_LIST;
+
+/**
+* @brief The RequestTable class
+*
+* Pending requests by id, split into shards with a lock each, so
+* matching responses to requests on the client thread does not
+* contend with requests being posted or timing out elsewhere.
+*/
+
+class RequestTable
+{
+public:
+
+    enum {
+        NUM_SHARDS = 16
+    };
+
+    RequestTable();
+
+    void add(REQUEST request);
+
+    REQUEST find(uint32_t requestId);
+
+    bool remove(uint32_t requestId);
+
+    void clear();
+
+    REQUEST_LIST requests();
+
+    uint32_t size();
+
+protected:
+
+    struct Shard
+    {
+        std::mutex mutex;
+
+        std::unordered_map<uint32_t, REQUEST> requests;
+    };
+
+    Shard &shard(uint32_t requestId);
+
+protected:
+
+    Shard m_shards[NUM_SHARDS];
+};
+
+// ============================================================ //
+
+}
+
+#endif /* REQUEST_TABLE_H_ */
@@ -0,0 +1,94 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef RESUME_MESSAGE_REQUEST_H_
+#define RESUME_MESSAGE_REQUEST_H_
+
+#include "Zway/request/request.h"
+#include "Zway/request/requestevent.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+/**
+* @brief The ResumeMessageRequest class
+*
+* Continues a message transfer which was interrupted by a lost
+* connection. For an outgoing message the server answers with
+* the number of parts it has received, for an incoming message
+* we tell the server how many parts we have processed and it
+* delivers the remaining ones.
+*/
+
+class ResumeMessageRequest : public Request
+{
+public:
+
+    typedef std::shared_ptr<ResumeMessageRequest> Pointer;
+
+    typedef std::function<void (REQUEST_EVENT, Pointer)> Callback;
+
+    static Pointer create(
+            uint32_t messageId,
+            uint32_t messagePart,
+            bool incoming,
+            Callback callback = nullptr);
+
+    bool processRecv(PACKET pkt, const UBJ::Value &head);
+
+    void invokeCallback(EVENT event);
+
+    uint32_t messageId();
+
+    uint32_t messagePart();
+
+protected:
+
+    ResumeMessageRequest(
+            uint32_t messageId,
+            uint32_t messagePart,
+            bool incoming,
+            Callback callback = nullptr);
+
+protected:
+
+    uint32_t m_messageId;
+
+    uint32_t m_messagePart;
+
+    Callback m_callback;
+};
+
+typedef ResumeMessageRequest::Pointer RESUME_MESSAGE_REQUEST;
+
+typedef ResumeMessageRequest::Callback RESUME_MESSAGE_CALLBACK;
+
+// ============================================================ //
+
+}
+
+#endif /* RESUME_MESSAGE_REQUEST_H_ */
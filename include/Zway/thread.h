@@ -1,190 +1,348 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#ifndef THREAD_H_
-#define THREAD_H_
-
-#include <thread>
-#include <mutex>
-
-namespace Zway {
-
-typedef std::lock_guard<std::mutex> MutexLocker;
-
-// ============================================================ //
-// ThreadSafe
-// ============================================================ //
-
-template <typename T>
-class ThreadSafe : public std::mutex
-{
-public:
-
-    ThreadSafe()
-        : std::mutex()
-    {
-    }
-
-    ThreadSafe(T t)
-        : std::mutex()
-    {
-        m_t = t;
-    }
-
-    ThreadSafe& operator=(T t)
-    {
-        m_t = t;
-
-        return *this;
-    }
-
-    operator T&() const
-    {
-        return (T&)m_t;
-    }
-
-    operator T&()
-    {
-        return m_t;
-    }
-
-    T& operator*()
-    {
-        return m_t;
-    }
-
-    T* operator->()
-    {
-        return &m_t;
-    }
-
-protected:
-
-    T m_t;
-};
-
-// ============================================================ //
-
-class Thread
-{
-public:
-
-    Thread();
-
-    virtual ~Thread();
-
-    virtual bool run();
-
-    virtual void cancelAndJoin();
-
-    virtual void cancel();
-
-    virtual void join();
-
-    virtual bool testCancel();
-
-    virtual void onRun() = 0;
-
-protected:
-
-    std::thread m_thread;
-
-    ThreadSafe<bool> m_cancel;
-};
-
-// ============================================================ //
-
-template <typename T>
-class EnableLock
-{
-public:
-
-    class Lock
-    {
-    public:
-
-        Lock(T & value) : m_value(value), m_guard(value.mutex()) {}
-
-        T * operator -> () { return &m_value; }
-
-    private:
-
-        T & m_value;
-
-        std::lock_guard<std::mutex> m_guard;
-    };
-
-    virtual std::mutex &mutex() = 0;
-};
-
-// ============================================================ //
-
-template <typename T>
-class EnableRecursiveLock
-{
-public:
-
-    class Lock
-    {
-    public:
-
-        Lock(T & value) : m_value(value), m_guard(value.mutex()) {}
-
-        T * operator -> () { return &m_value; }
-
-    private:
-
-        T & m_value;
-
-        std::lock_guard<std::recursive_mutex> m_guard;
-    };
-
-    virtual std::recursive_mutex &mutex() = 0;
-};
-
-// ============================================================ //
-
-class EnableVisit
-{
-public:
-
-    template <typename TAction>
-    auto visit(TAction action) -> decltype (action())
-    {
-        std::lock_guard<std::mutex> locker(mutex());
-        return action();
-    }
-
-private:
-
-    virtual std::mutex &mutex() = 0;
-};
-
-// ============================================================ //
-
-}
-
-#endif /* THREAD_H_ */
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef THREAD_H_
+#define THREAD_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace Zway {
+
+typedef std::lock_guard<std::mutex> MutexLocker;
+
+// ============================================================ //
+// ThreadSafe
+// ============================================================ //
+
+template <typename T>
+class ThreadSafe : public std::mutex
+{
+public:
+
+    ThreadSafe()
+        : std::mutex()
+    {
+    }
+
+    ThreadSafe(T t)
+        : std::mutex()
+    {
+        m_t = t;
+    }
+
+    ThreadSafe& operator=(T t)
+    {
+        m_t = t;
+
+        return *this;
+    }
+
+    operator T&() const
+    {
+        return (T&)m_t;
+    }
+
+    operator T&()
+    {
+        return m_t;
+    }
+
+    T& operator*()
+    {
+        return m_t;
+    }
+
+    T* operator->()
+    {
+        return &m_t;
+    }
+
+protected:
+
+    T m_t;
+};
+
+// ============================================================ //
+
+class Thread
+{
+public:
+
+    Thread();
+
+    virtual ~Thread();
+
+    virtual bool run();
+
+    virtual void cancelAndJoin();
+
+    virtual void cancel();
+
+    virtual void join();
+
+    virtual bool testCancel();
+
+    virtual void onRun() = 0;
+
+protected:
+
+    std::thread m_thread;
+
+    ThreadSafe<bool> m_cancel;
+};
+
+// ============================================================ //
+// ThreadPool
+// ============================================================ //
+
+//! Fixed size pool of worker threads
+/*!
+ *  Tasks are run in the order they were posted. A task posted
+ *  from one of the pool's own workers runs inline, so nested
+ *  batches cannot deadlock waiting on themselves.
+ */
+
+class ThreadPool
+{
+public:
+
+    typedef std::function<void()> Task;
+
+    static ThreadPool &instance();
+
+    ThreadPool(uint32_t numThreads = 0);
+
+    virtual ~ThreadPool();
+
+    uint32_t numThreads();
+
+    void post(Task task);
+
+    template <typename F>
+    auto submit(F f) -> std::future<decltype (f())>
+    {
+        typedef decltype (f()) R;
+
+        auto task = std::make_shared<std::packaged_task<R()>>(f);
+
+        std::future<R> res = task->get_future();
+
+        post([task] () { (*task)(); });
+
+        return res;
+    }
+
+protected:
+
+    void work();
+
+    bool isWorker();
+
+protected:
+
+    std::vector<std::thread> m_threads;
+
+    std::queue<Task> m_tasks;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    bool m_stop;
+};
+
+// ============================================================ //
+// MpscQueue
+// ============================================================ //
+
+//! Unbounded lock-free multi-producer single-consumer queue
+/*!
+ *  Producers only exchange the head pointer. The consumer owns
+ *  the tail, which is always a stub node whose value was taken
+ *  already. A push that has swapped the head but not linked its
+ *  node yet makes the queue look empty until it completes.
+ */
+
+template <typename T>
+class MpscQueue
+{
+public:
+
+    MpscQueue()
+        : m_head(new Node()),
+          m_tail(m_head.load())
+    {
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+
+        while (pop(value));
+
+        delete m_tail;
+    }
+
+    void push(T value)
+    {
+        Node *node = new Node();
+
+        node->value = std::move(value);
+
+        Node *prev = m_head.exchange(node);
+
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T &value)
+    {
+        Node *next = m_tail->next.load(std::memory_order_acquire);
+
+        if (!next) {
+
+            return false;
+        }
+
+        value = std::move(next->value);
+
+        next->value = T();
+
+        delete m_tail;
+
+        m_tail = next;
+
+        return true;
+    }
+
+    bool empty() const
+    {
+        return !m_tail->next.load(std::memory_order_acquire);
+    }
+
+protected:
+
+    struct Node
+    {
+        Node() : next(nullptr) {}
+
+        std::atomic<Node*> next;
+
+        T value;
+    };
+
+    MpscQueue(const MpscQueue&) = delete;
+
+    MpscQueue &operator=(const MpscQueue&) = delete;
+
+protected:
+
+    std::atomic<Node*> m_head;
+
+    Node *m_tail;
+};
+
+// ============================================================ //
+
+template <typename T>
+class EnableLock
+{
+public:
+
+    class Lock
+    {
+    public:
+
+        Lock(T & value) : m_value(value), m_guard(value.mutex()) {}
+
+        T * operator -> () { return &m_value; }
+
+    private:
+
+        T & m_value;
+
+        std::lock_guard<std::mutex> m_guard;
+    };
+
+    virtual std::mutex &mutex() = 0;
+};
+
+// ============================================================ //
+
+template <typename T>
+class EnableRecursiveLock
+{
+public:
+
+    class Lock
+    {
+    public:
+
+        Lock(T & value) : m_value(value), m_guard(value.mutex()) {}
+
+        T * operator -> () { return &m_value; }
+
+    private:
+
+        T & m_value;
+
+        std::lock_guard<std::recursive_mutex> m_guard;
+    };
+
+    virtual std::recursive_mutex &mutex() = 0;
+};
+
+// ============================================================ //
+
+class EnableVisit
+{
+public:
+
+    template <typename TAction>
+    auto visit(TAction action) -> decltype (action())
+    {
+        std::lock_guard<std::mutex> locker(mutex());
+        return action();
+    }
+
+private:
+
+    virtual std::mutex &mutex() = 0;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* THREAD_H_ */
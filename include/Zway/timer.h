@@ -0,0 +1,112 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include "Zway/thread.h"
+
+#include <chrono>
+#include <unordered_map>
+
+namespace Zway {
+
+// ============================================================ //
+// Timer
+// ============================================================ //
+
+/**
+* @brief The Timer class
+*
+* One-shot timers kept in a min-heap ordered by deadline. The
+* timer thread sleeps until the earliest deadline and not at all
+* while no timer is pending. Callbacks run on the timer thread
+* and get the id start() returned for them. A stopped timer
+* stays in the heap until its deadline or the next compaction.
+*/
+
+class Timer : public Thread
+{
+public:
+
+    typedef std::function<void(uint32_t id)> Callback;
+
+    Timer();
+
+    uint32_t start(uint32_t ms, Callback callback);
+
+    bool stop(uint32_t id);
+
+    uint32_t numPending();
+
+    void clear();
+
+    void sync();
+
+    void cancel();
+
+    void onRun();
+
+protected:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        Clock::time_point deadline;
+
+        uint32_t id;
+
+        bool operator>(const Entry &other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    void compact();
+
+protected:
+
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+
+    std::unordered_map<uint32_t, Callback> m_callbacks;
+
+    uint32_t m_nextId;
+
+    bool m_running;
+
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    std::condition_variable m_idle;
+};
+
+// ============================================================ //
+
+}
+
+#endif /* TIMER_H_ */
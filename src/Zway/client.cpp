@@ -1,1884 +1,3763 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#include "Zway/client.h"
-
-#if !defined _WIN32
-#include <arpa/inet.h>
-#include <unistd.h>
-#include <netdb.h>
-#include <fcntl.h>
-#include <errno.h>
-#include <sys/time.h>
-#endif
-
-#include <cstdarg>
-#include <cstdlib>
-#include <gnutls/gnutls.h>
-
-namespace Zway {
-
-// ============================================================ //
-// Client
-// ============================================================ //
-
-Client *Client::m_instance = nullptr;
-
-#if defined _WIN32
-
-void Client::initWSA()
-{
-    WSADATA wsa;
-    WSAStartup(MAKEWORD(2,2), &wsa);
-}
-
-// ============================================================ //
-
-void Client::freeWSA()
-{
-    WSACleanup();
-}
-
-#endif
-
-// ============================================================ //
-
-bool Client::startup(Client *client, const std::string &host, uint32_t port) {
-
-    if (!m_instance && client) {
-
-        m_instance = client;
-
-        if (m_instance->start(host, port)) {
-
-            return true;
-        }
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::cleanup() {
-
-    if (m_instance) {
-
-        if (!m_instance->close()) {
-
-        }
-
-        delete m_instance;
-
-        m_instance = nullptr;
-
-        return true;
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-void Client::log(const char *msg, ...)
-{
-    if (m_instance) {
-
-        va_list args;
-        va_start(args, msg);
-        int len = vsnprintf(0, 0, msg, args);
-        va_end(args);
-
-        std::string str;
-
-        if (len) {
-
-            str.resize(len);
-
-            va_start(args, msg);
-            vsnprintf(&str[0], len + 1, msg, args);
-            va_end(args);
-        }
-
-        m_instance->postEvent(Event::create(Event::Log, UBJ_OBJ("type" << 0 << "message" << str)));
-    }
-}
-
-// ============================================================ //
-
-Client::Client()
-    : Thread(),
-      m_port(0),
-      m_socket(-1),
-      m_session(nullptr),
-      m_anonCred(nullptr),
-      m_certCred(nullptr),
-      m_sender(this),
-      m_storage(nullptr),
-      m_status(Disconnected),
-      m_lastHrtbRecv(0),
-      m_lastHrtbSent(0)
-{
-
-}
-
-// ============================================================ //
-
-Client::~Client()
-{
-
-}
-
-// ============================================================ //
-
-bool Client::start(const std::string& host, uint32_t port)
-{
-    // init gnutls
-
-    int res = gnutls_global_init();
-
-    if (res < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    res = gnutls_certificate_allocate_credentials((gnutls_certificate_credentials_t*)&m_certCred);
-
-    if (res < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    res = gnutls_anon_allocate_client_credentials((gnutls_anon_client_credentials_t*)&m_anonCred);
-
-    if (res < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    m_host = host;
-
-    m_port = port;
-
-    // run event dispatcher
-
-    if (!m_eventDispatcher.run()) {
-
-        //postEvent(MAKE_ERROR(0, "Failed to start event dispatcher"));
-
-        return false;
-    }
-
-    // run client thread
-
-    if (!run()) {
-
-        //postEvent(MAKE_ERROR(0, "Failed to start client"));
-
-        return false;
-    }
-
-    // run sender thread
-
-    if (!m_sender.run()) {
-
-        return false;
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::close()
-{
-    // cancel pending requests
-
-    {
-        MutexLocker locker(m_requests);
-
-        m_requests->clear();
-    }
-
-    // cancel pending message senders
-
-    {
-        MutexLocker locker(m_messageSenders);
-
-        m_messageSenders->clear();
-    }
-
-    // cancel pending message receivers
-
-    {
-        MutexLocker locker(m_messageReceivers);
-
-        m_messageReceivers->clear();
-    }
-
-    // shutdown sender
-
-    m_sender.cancelAndJoin();
-
-    // shutdown client
-
-    cancelAndJoin();
-
-    disconnect();
-
-    // shutdown event dispatcher
-
-    m_eventDispatcher.cancelAndJoin();
-
-    // close storage
-
-    m_storage.reset();
-
-    // release gnutls resources
-
-    if (m_certCred) {
-
-        gnutls_certificate_free_credentials((gnutls_certificate_credentials_t)m_certCred);
-    }
-
-    if (m_anonCred) {
-
-        gnutls_anon_free_client_credentials((gnutls_anon_client_credentials_t)m_anonCred);
-    }
-
-    m_certCred = nullptr;
-
-    m_anonCred = nullptr;
-
-    gnutls_global_deinit();
-
-    m_port = 0;
-
-    return true;
-}
-
-// ============================================================ //
-
-void Client::setEventHandler(EVENT_HANDLER handler)
-{
-    m_eventDispatcher.addHandler(handler);
-}
-
-// ============================================================ //
-
-Client::ClientStatus Client::status()
-{
-    MutexLocker locker(m_status);
-
-    return m_status;
-}
-
-// ============================================================ //
-
-uint32_t Client::lastHrtbRecv()
-{
-    MutexLocker locker(m_lastHrtbRecv);
-
-    return m_lastHrtbRecv;
-}
-
-// ============================================================ //
-
-uint32_t Client::lastHrtbSent()
-{
-    MutexLocker locker(m_lastHrtbSent);
-
-    return m_lastHrtbSent;
-}
-
-// ============================================================ //
-
-uint32_t Client::tickCount()
-{
-    // TODO replace by std::chrono
-
-#if defined _WIN32
-
-    return GetTickCount();
-
-#else
-
-    struct timeval tv;
-
-    gettimeofday(&tv, nullptr);
-
-    return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-
-#endif
-
-    return 0;
-}
-
-// ============================================================ //
-
-bool Client::createAccount(
-        const UBJ::Object &account,
-        const std::string &storagePassword,
-        CREATE_ACCOUNT_CALLBACK callback)
-{
-    if (!m_storage &&
-            status() >= Secure) {
-
-        return postRequest(CreateAccountRequest::create(account, storagePassword, callback));
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::deleteAccount()
-{
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::login(
-        STORAGE storage,
-        LOGIN_CALLBACK callback)
-{
-    if (storage &&
-            status() >= Secure &&
-            status() != LoggedIn) {
-
-        return postRequest(LoginRequest::create(storage, callback));
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::setConfig(const UBJ::Value &config, EVENT_CALLBACK callback)
-{
-    if (m_storage && m_storage->setConfig(config)) {
-
-        if (status() >= LoggedIn) {
-
-            // update server conf
-
-            UBJ::Object conf;
-
-            m_storage->getConfig(conf);
-
-            // add contacts
-
-            UBJ::Object contacts;
-
-            Storage::NODE_LIST nodes = m_storage->getContacts();
-
-            for (auto &node : nodes) {
-
-                contacts[node->user1()] = UBJ_OBJ("notifyStatus" << 1);
-            }
-
-            conf["contacts"] = contacts;
-
-            return postRequest(Zway::ConfigRequest::create(conf, callback));
-        }
-        else
-        if (callback) {
-
-            callback(DUMMY_EVENT(0));
-        }
-    }
-    else
-    if (callback) {
-
-        callback(ERROR_EVENT(0, "Failed to set config"));
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::addContact(
-        const std::string &addCode,
-        const std::string &label,
-        const std::string &phone,
-        ADD_CONTACT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(AddContactRequest::create(m_storage, addCode, label, phone, false, callback));
-}
-
-// ============================================================ //
-
-bool Client::createAddCode(ADD_CONTACT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(AddContactRequest::create(m_storage, std::string(), std::string(), std::string(), true, callback));
-}
-
-// ============================================================ //
-
-bool Client::findContact(const UBJ::Value &query, EVENT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(FindContactRequest::create(query, callback));
-}
-
-// ============================================================ //
-
-bool Client::acceptContact(uint32_t requestId, ACCEPT_CONTACT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(AcceptContactRequest::create(requestId, m_storage, callback));
-}
-
-// ============================================================ //
-
-bool Client::rejectContact(uint32_t requestId, REJECT_CONTACT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(RejectContactRequest::create(requestId, callback));
-}
-
-// ============================================================ //
-
-bool Client::requestContactStatus(const UBJ::Value &contacts)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    return postRequest(ContactStatusRequest::create(contacts, m_storage));
-}
-
-// ============================================================ //
-
-bool Client::cancelRequest(uint32_t requestId, EVENT_CALLBACK callback)
-{
-    if (status() < LoggedIn) {
-
-        return false;
-    }
-
-    UBJ::Object request;
-
-    if (!m_storage->getRequest(requestId, request)) {
-
-        return false;
-    }
-
-    postRequest(Zway::DispatchRequest::create(
-                    UBJ_OBJ("requestDispatchId" << requestId << "action" << "cancel"),
-                    callback));
-
-    return true;
-}
-
-// ============================================================ //
-
-void Client::postEvent(EVENT event, bool immediately)
-{
-    m_eventDispatcher.post(event);
-}
-
-// ============================================================ //
-
-bool Client::postRequest(REQUEST request)
-{
-    MutexLocker locker(m_requests);
-
-    request->setClient(this);
-
-    request->start();
-
-    (*m_requests)[request->id()] = request;
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::postMessage(MESSAGE message)
-{
-    // set latest history id
-
-    uint32_t historyId = m_storage->latestHistory(message->dst());
-
-    message->setHistory(historyId);
-
-    // create message sender
-
-    MESSAGE_SENDER sender = MessageSender::create(this, message);
-
-    if (!sender) {
-
-        return false;
-    }
-
-    MutexLocker locker(m_messageSenders);
-
-    m_messageSenders->push_back(sender);
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::requestPending(Request::Type type)
-{
-    MutexLocker locker(m_requests);
-
-    for (auto &it : *m_requests) {
-
-        if (it.second->type() == type) {
-
-            return true;
-        }
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-uint32_t Client::getContactStatus(uint32_t id)
-{
-    MutexLocker locker(m_contactStatus);
-
-    if (m_contactStatus->find(id) != m_contactStatus->end()) {
-
-        return (*m_contactStatus)[id];
-    }
-
-    return 0;
-}
-
-// ============================================================ //
-
-void Client::setStatus(ClientStatus status)
-{
-    MutexLocker locker(m_status);
-
-    m_status = status;
-}
-
-// ============================================================ //
-
-void Client::onRun()
-{
-    // connect us to the server
-
-    if (!connect(m_host, m_port)) {
-
-        reconnect();
-
-        //onThreadFinish();
-
-        //return nullptr;
-    }
-
-    // loop
-
-    for (;;) {
-
-        // are we asked to cancel
-
-        if (testCancel()) {
-
-            break;
-        }
-
-        // check if the connection has been interrupted
-
-        if (lastHrtbSent() > 0 && tickCount() >= lastHrtbSent() + HEARTBEAT_TIMEOUT) {
-
-            postEvent(ERROR_EVENT(Event::ConnectionInterrupted, "Connection interrupted"));
-
-            disconnect(false, false);
-
-            reconnect();
-
-            continue;
-        }
-
-        // receiver
-
-        // wait for incoming packet
-
-        PACKET pkt;
-
-        if (readable(500)) {
-
-            pkt = Packet::create();
-
-            // read packet
-
-            int32_t res = recvPacket(pkt);
-
-            if (res <= 0) {
-
-                // was the connection closed by the server
-
-                if (res == 0) {
-
-                }
-
-                disconnect(false);
-
-                reconnect();
-
-                continue;
-            }
-            else {
-
-                {
-                    MutexLocker locker(m_lastHrtbSent);
-
-                    m_lastHrtbSent = 0;
-                }
-
-                {
-                    MutexLocker locker(m_lastHrtbRecv);
-
-                    m_lastHrtbRecv = tickCount();
-                }
-
-                // process current packet
-
-                switch (pkt->getId()) {
-
-                case Packet::Heartbeat:
-
-                    break;
-
-                case Packet::Request:
-
-                    processRequestPkt(pkt);
-
-                    break;
-
-                case Packet::Message:
-
-                    processMessagePkt(pkt);
-
-                    break;
-                }
-            }
-        }
-
-        // sender
-
-        if (!m_sender.busy()) {
-
-            // if there is work for the sender, wake it up
-
-            uint32_t numIdle;
-
-            checkRequests(&numIdle);
-
-            if (numIdle || numMessageSenders() || (lastHrtbRecv() > 0 && tickCount() >= lastHrtbRecv() + HEARTBEAT_INTERVAL)) {
-
-                m_sender.notify();
-            }
-        }
-    }
-}
-
-// ============================================================ //
-
-bool Client::connect(const std::string& host, uint32_t port)
-{
-    if (status() != Disconnected) {
-
-        return false;
-    }
-
-    uint32_t a = inet_addr(host.c_str());
-
-    if (a == INADDR_NONE) {
-
-        struct hostent* he = gethostbyname(host.c_str());
-
-        if (!he) {
-
-            //postEvent(MAKE_ERROR(0, "Failed to resolve hostname"));
-
-            return false;
-        }
-
-        a = *(uint32_t*)he->h_addr;
-    }
-
-#if defined _WIN32
-
-    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-    if (s == INVALID_SOCKET) {
-
-        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
-
-        return false;
-    }
-
-    u_long on = 1;
-
-    {
-        int32_t ret = ioctlsocket(s, FIONBIO, &on);
-
-        if (ret != NO_ERROR) {
-
-            // ...
-        }
-    }
-
-#else
-
-    int32_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-    if (s == -1) {
-
-        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
-
-        return false;
-    }
-
-    int32_t flags = fcntl(s, F_GETFL, 0);
-
-    fcntl(s, F_SETFL, flags | O_NONBLOCK);
-
-#endif
-
-    // setup address and connect
-
-    struct sockaddr_in addr;
-    addr.sin_addr.s_addr = a;
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(port);
-
-    setStatus(Connecting);
-
-    int32_t res = ::connect(s, (struct sockaddr*)&addr, sizeof(addr));
-
-#if defined _WIN32
-
-    if (WSAGetLastError() == WSAEWOULDBLOCK) {
-
-#else
-
-    if (errno == EINPROGRESS) {
-
-#endif
-        // wait for socket to be connected
-
-        uint32_t timeout = 10000;
-        uint32_t ms = 0;
-
-        while (ms < timeout) {
-
-            if (testCancel()) {
-
-                return false;
-            }
-
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 200000;
-
-            fd_set ws;
-            FD_ZERO(&ws);
-            FD_SET(s, &ws);
-
-            if (select(s + 1, nullptr, &ws, nullptr, &tv) > 0) {
-
-                res = -1;
-
-#if defined _WIN32
-
-                uint32_t len = sizeof(int32_t);
-
-                getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&res, (int32_t*)&len);
-#else
-
-                socklen_t len = sizeof(int32_t);
-
-                getsockopt(s, SOL_SOCKET, SO_ERROR, &res, &len);
-#endif
-
-                break;
-            }
-
-            ms += 200;
-        }
-    }
-
-    if (res) {
-
-#if defined _WIN32
-
-        closesocket(s);
-
-#else
-
-        ::close(s);
-
-#endif
-        setStatus(Disconnected);
-
-        postEvent(ERROR_EVENT(Event::ConnectionFailure, "Connection failed"));
-
-        return false;
-    }
-
-    m_socket = s;
-
-    setStatus(Connected);
-
-    // init tls session
-
-    if ((res = gnutls_init((gnutls_session_t*)&m_session, GNUTLS_CLIENT)) < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    // set priority
-
-    if ((res = gnutls_priority_set_direct((gnutls_session_t)m_session, "NORMAL:+VERS-TLS1.2", nullptr)) < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    // set credentials
-
-    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_ANON, m_anonCred)) < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_CERTIFICATE, m_certCred)) < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    // assign socket
-
-    gnutls_transport_set_ptr((gnutls_session_t)m_session, (gnutls_transport_ptr_t)m_socket);
-
-    // perform handshake
-
-    do {
-
-        res = gnutls_handshake((gnutls_session_t)m_session);
-    }
-    while (res < 0 && gnutls_error_is_fatal(res) == 0);
-
-    if (res < 0) {
-
-        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
-
-        return false;
-    }
-
-    // TODO: verify server certificate here
-
-    //parseCert();
-
-    setStatus(Secure);
-
-    {
-        MutexLocker locker(m_lastHrtbSent);
-
-        m_lastHrtbSent = 0;
-    }
-
-    {
-        MutexLocker locker(m_lastHrtbRecv);
-
-        m_lastHrtbRecv = tickCount();
-    }
-
-    postEvent(Event::create(Event::ConnectionSuccess));
-
-    return true;
-}
-
-// ============================================================ //
-
-void Client::reconnect()
-{
-    for (;;) {
-
-        uint32_t ms = 0;
-
-        while (ms < RECONNECT_INTERVAL) {
-
-            if (testCancel()) {
-
-                return;
-            }
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
-
-            ms += 200;
-        }
-
-        if (connect(m_host, m_port)) {
-
-            postEvent(Event::create(Event::Reconnected));
-
-            return;
-        }
-    }
-}
-
-// ============================================================ //
-
-void Client::disconnect(bool bye, bool event)
-{
-    if (m_session) {
-
-        if (bye) {
-
-            int32_t res = gnutls_bye((gnutls_session_t)m_session, GNUTLS_SHUT_RDWR);
-
-            if (gnutls_error_is_fatal(res)) {
-
-                // ...
-            }
-        }
-
-        gnutls_deinit((gnutls_session_t)m_session);
-
-        m_session = nullptr;
-    }
-
-    if (m_socket) {
-
-#if defined _WIN32
-
-        closesocket(m_socket);
-
-#else
-
-        ::close(m_socket);
-
-#endif
-
-        m_socket = -1;
-
-        setStatus(Disconnected);
-
-        if (event) {
-
-            postEvent(Event::create(Event::Disconnected));
-        }
-    }
-}
-
-// ============================================================ //
-
-bool Client::processContactRequest(const UBJ::Value &head)
-{
-    uint32_t requestId = head["requestId"].toInt();
-
-    UBJ::Object request;
-
-    if (m_storage->getRequest(requestId, request)) {
-
-        postEvent(Event::create(Event::ContactRequest, head));
-    }
-    else {
-
-        // incoming contact request
-
-        m_storage->addRequest(head);
-
-        postEvent(Event::create(Event::ContactRequest, head));
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::processContactRequestAccepted(const UBJ::Value &head)
-{
-    uint32_t requestId = head["requestId"].toInt();
-
-    uint32_t requestOrigId = head["requestOrigId"].toInt();
-
-    UBJ::Object request;
-
-    if (m_storage->getRequest(requestOrigId, request)) {
-
-        // update request
-
-        Storage::NODE node = m_storage->getNode(UBJ_OBJ("type" << Storage::Node::RequestType << "id" << requestOrigId));
-
-        if (node) {
-
-            node->setUser1(Request::Completed);
-            node->setUser2(Request::AcceptContact);
-
-            m_storage->updateNode(node, UBJ::Object(), false, false);
-        }
-
-        // add contact
-
-        m_storage->addContact(
-                UBJ_OBJ(
-                    "contactId" << head["contactId"] <<
-                    "label"     << head["label"] <<
-                    "phone"     << head["phone"] <<
-                    "publicKey" << head["publicKey"]));
-
-        // set status
-
-        setContactStatus(head["contactId"].toInt(), head["contactStatus"].toInt());
-
-        // set config
-
-        setConfig();
-
-        // raise event
-
-        postEvent(RequestEvent::create(Event::ContactRequestAccepted, nullptr, head));
-
-        // dispatch request
-
-        postRequest(DispatchRequest::create(UBJ_OBJ("requestDispatchId" << requestId)));
-
-        return true;
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::processContactRequestRejected(const UBJ::Value &head)
-{
-    uint32_t requestId = head["requestId"].toInt();
-
-    uint32_t requestOrigId = head["requestOrigId"].toInt();
-
-    UBJ::Object request;
-
-    if (m_storage->getRequest(requestOrigId, request)) {
-
-        // update request
-
-        Storage::NODE node = m_storage->getNode(UBJ_OBJ("type" << Storage::Node::RequestType << "id" << requestOrigId));
-
-        if (node) {
-
-            node->setUser1(Request::Completed);
-            node->setUser2(Request::RejectContact);
-
-            m_storage->updateNode(node, UBJ::Object(), false, false);
-        }
-
-        // raise event
-
-        postEvent(RequestEvent::create(Event::ContactRequestRejected, nullptr, head));
-
-        // dispatch request
-
-        postRequest(DispatchRequest::create(UBJ_OBJ("requestDispatchId" << requestId)));
-
-
-        return true;
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Client::processContactStatus(const UBJ::Value &head)
-{
-    // adjust contact status in our map
-
-    MutexLocker locker(m_contactStatus);
-
-    const UBJ::Value &contactStatus = head["contactStatus"];
-
-    for (auto it = contactStatus.cbegin(); it != contactStatus.cend(); ++it) {
-
-        const UBJ::Value &val = it->second;
-
-        uint32_t contactId = atoi(it->first.c_str());
-
-        (*m_contactStatus)[contactId] = val["status"].toInt();
-    }
-
-    // raise event
-
-    postEvent(Event::create(
-            Event::ContactStatus,
-            contactStatus,
-            UBJ::Object()));
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::processRequestPkt(PACKET pkt)
-{
-    UBJ::Object head;
-
-    if (!pkt->getHeadUbj(head)) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    if (head.hasField("requestId")) {
-
-        uint32_t requestId = head["requestId"].toInt();
-
-        REQUEST request;
-
-        {
-            MutexLocker locker(m_requests);
-
-            if (m_requests->find(requestId) != m_requests->end()) {
-
-                request = (*m_requests)[requestId];
-            }
-        }
-
-        // process request
-
-        if (request) {
-
-            if (!request->processRecv(pkt, head)) {
-
-                // ...
-            }
-        }
-    }
-
-    if (head.hasField("requestType")) {
-
-        uint32_t type = head["requestType"].toInt();
-
-        if (type == Request::AddContact) {
-
-            processContactRequest(head);
-        }
-        else
-        if (type == Request::AcceptContact) {
-
-            processContactRequestAccepted(head);
-        }
-        else
-        if (type == Request::RejectContact) {
-
-            processContactRequestRejected(head);
-        }
-        else
-        if (type == Request::ContactStatus) {
-
-            processContactStatus(head);
-        }
-    }
-
-    return true;
-}
-// ============================================================ //
-
-bool Client::processMessagePkt(PACKET pkt)
-{
-    UBJ::Object head;
-
-    if (!pkt->getHeadUbj(head)) {
-
-        return false;
-    }
-
-    uint32_t messageId  = head["messageId"].toInt();
-    uint32_t messageSrc = head["messageSrc"].toInt();
-
-    UBJ::Object publicKey;
-
-    if (messageSrc != m_storage->accountId()) {
-
-        // contact check
-
-        UBJ::Object contact;
-
-        if (!m_storage->getContact(messageSrc, contact)) {
-
-            return false;
-        }
-
-        publicKey = contact["publicKey"];
-    }
-    else {
-
-        publicKey = m_storage->publicKey();
-    }
-
-    // request access to message receivers
-
-    MutexLocker locker(m_messageReceivers);
-
-    // get receiver by message id
-
-    MESSAGE_RECEIVER receiver = (*m_messageReceivers)[messageId];
-
-    // if there is no receiver yet we create one
-
-    if (!receiver) {
-
-        receiver = MessageReceiver::create(this, head, publicKey);
-
-        if (!receiver) {
-
-            //postEvent(MAKE_ERROR(0, "Failed to create message receiver"));
-
-            return false;
-        }
-
-        (*m_messageReceivers)[messageId] = receiver;
-    }
-
-    // let the receiver process the packet
-
-    if (receiver->process(pkt, head)) {
-
-        // check whether the receiver has completed
-
-        if (receiver->completed()) {
-
-            m_messageReceivers->erase(messageId);
-        }
-    }
-    else {
-
-        // TODO: handle situation please
-
-        m_messageReceivers->erase(messageId);
-
-        return false;
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-void Client::checkRequests(uint32_t *numIdle, uint32_t *numWaiting)
-{
-    MutexLocker locker(m_requests);
-
-    std::list<REQUEST> completed;
-
-    uint32_t nIdle = 0;
-    uint32_t nWaiting = 0;
-
-    for (auto &it : *m_requests) {
-
-        REQUEST &req = it.second;
-
-        if (req->status() == Request::Completed ||
-                req->status() == Request::Timeout ||
-                req->status() == Request::Error) {
-
-            completed.push_back(req);
-        }
-
-        if (req->status() != Request::Sending && req->checkTimeout()) {
-
-            completed.push_back(req);
-
-            postEvent(RequestEvent::create(
-                    Event::RequestTimeout,
-                    req,
-                    UBJ::Object(),
-                    UBJ::Object(),
-                    [req] (EVENT event) {
-                        req->invokeCallback(event);
-                    }));
-        }
-        else
-            if (req->status() == Request::Idle) {
-
-                nIdle++;
-            }
-            else
-                if (req->status() == Request::WaitingForResponse) {
-
-                    nWaiting++;
-                }
-    }
-
-    // remove completed requests
-
-    for (auto &req : completed) {
-
-        m_requests->erase(req->id());
-    }
-
-    if (numIdle) {
-
-        *numIdle = nIdle;
-    }
-
-    if (numWaiting) {
-
-        *numWaiting = nWaiting;
-    }
-}
-
-// ============================================================ //
-
-bool Client::processRequests()
-{
-    REQUEST_MAP requests;
-
-    // get snapshot of current requests to enable requests to spawn requests
-
-    {
-        MutexLocker locker(m_requests);
-
-        requests = *m_requests;
-    }
-
-    // process requests
-
-    for (auto &it : requests) {
-
-        auto &request = it.second;
-
-        request->processSend();
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-uint32_t Client::processMessageSenders()
-{
-    uint32_t i=0;
-
-    MutexLocker locker(m_messageSenders);
-
-    for (auto it = m_messageSenders->begin(); it != m_messageSenders->end(); ++it, i++) {
-
-        MESSAGE_SENDER sender = *it;
-
-        if (sender->process()) {
-
-            if (sender->completed()) {
-
-                m_messageSenders->erase(it++);
-            }
-        }
-        else {
-
-            m_messageSenders->erase(it);
-        }
-    }
-
-    return i;
-}
-
-// ============================================================ //
-
-uint32_t Client::numMessageSenders()
-{
-    MutexLocker locker(m_messageSenders);
-
-    return m_messageSenders->size();
-}
-
-// ============================================================ //
-
-uint32_t Client::sendPacket(PACKET pkt)
-{
-    uint32_t s = 0;
-
-    uint32_t r = send((uint8_t*)&pkt->getId(), PACKET_BASE_SIZE);
-
-    if (r < PACKET_BASE_SIZE) {
-
-        return -1;
-    }
-
-    s += r;
-
-    if (pkt->getHeadSize() > 0) {
-
-        r = send(pkt->getHead()->data(), pkt->getHeadSize());
-
-        if (r < pkt->getHeadSize()) {
-
-            return -1;
-        }
-
-        s += r;
-    }
-
-    if (pkt->getBodySize() > 0) {
-
-        r = send(pkt->getBody()->data(), pkt->getBodySize());
-
-        if (r < pkt->getBodySize()) {
-
-            return -1;
-        }
-
-        s += r;
-    }
-
-    return s;
-}
-
-// ============================================================ //
-
-uint32_t Client::recvPacket(PACKET pkt)
-{
-    uint32_t s = 0;
-
-    uint32_t r = recv((uint8_t*)&pkt->getId(), PACKET_BASE_SIZE);
-
-    if (r < PACKET_BASE_SIZE) {
-
-        return r;
-    }
-
-    s += r;
-
-    if (pkt->getHeadSize() > 0) {
-
-        if (pkt->getHeadSize() > MAX_PACKET_HEAD) {
-
-            return -1;
-        }
-
-        pkt->setHead(Buffer::create(nullptr, pkt->getHeadSize()));
-
-        r = recv(pkt->getHead()->data(), pkt->getHeadSize());
-
-        if (r < pkt->getHeadSize()) {
-
-            return r;
-        }
-
-        s += r;
-    }
-
-    if (pkt->getBodySize() > 0) {
-
-        if (pkt->getBodySize() > MAX_PACKET_BODY) {
-
-            return -1;
-        }
-
-        pkt->setBody(Buffer::create(nullptr, pkt->getBodySize()));
-
-        r = recv(pkt->getBody()->data(), pkt->getBodySize());
-
-        if (r < pkt->getBodySize()) {
-
-            return -1;
-        }
-
-        s += r;
-    }
-
-    return s;
-}
-
-// ============================================================ //
-
-uint32_t Client::send(uint8_t* data, uint32_t size)
-{
-    uint32_t s = 0;
-
-    while (s < size) {
-
-        if (m_sender.testCancel()) {
-
-            break;
-        }
-
-        if (!writable(200)) {
-
-            continue;
-        }
-
-        int32_t ret;
-
-        ret = gnutls_record_send((gnutls_session_t)m_session, &data[s], size - s);
-
-        if (ret == GNUTLS_E_AGAIN) {
-
-        }
-
-        if (gnutls_error_is_fatal(ret)) {
-
-            return -1;
-        }
-
-        if (ret > 0) {
-
-            s += ret;
-        }
-    }
-
-    return s;
-}
-
-// ============================================================ //
-
-uint32_t Client::recv(uint8_t* data, uint32_t size)
-{
-    uint32_t s = 0;
-
-    while (s < size) {
-
-        if (testCancel()) {
-
-            break;
-        }
-
-        if (!readable(200)) {
-
-            continue;
-        }
-
-        int32_t ret;
-
-        ret = gnutls_record_recv((gnutls_session_t)m_session, &data[s], size - s);
-
-        if (gnutls_error_is_fatal(ret)) {
-
-            return -1;
-        }
-
-        if (ret > 0) {
-
-            s += ret;
-        }
-    }
-
-    return s;
-}
-
-// ============================================================ //
-
-bool Client::readable(uint32_t ms)
-{
-    // check if there is data left over from previous read
-
-    if (gnutls_record_check_pending((gnutls_session_t)m_session)) {
-
-        return true;
-    }
-
-    // check for socket read readiness
-
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(m_socket, &fds);
-
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = ms * 1000;
-
-    int32_t res = select(m_socket+1, &fds, nullptr, nullptr, &tv);
-
-    if (res <= 0) {
-
-        return false;
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Client::writable(uint32_t ms)
-{
-    // check for socket write readiness
-
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(m_socket, &fds);
-
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = ms * 1000;
-
-    int32_t res = select(m_socket+1, nullptr, &fds, nullptr, &tv);
-
-    if (res <= 0) {
-
-        return false;
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-void Client::setContactStatus(uint32_t contactId, uint32_t status)
-{
-    MutexLocker locker(m_contactStatus);
-
-    (*m_contactStatus)[contactId] = status;
-}
-
-// ============================================================ //
-
-void Client::setStorageDir(const std::string &dir)
-{
-    m_storageDir = dir;
-}
-
-// ============================================================ //
-
-std::string Client::storageDir()
-{
-    return m_storageDir;
-}
-
-// ============================================================ //
-
-STORAGE Client::storage()
-{
-    return m_storage;
-}
-
-// ============================================================ //
-// Sender
-// ============================================================ //
-
-Sender::Sender(Client *client)
-    : Thread(),
-      m_client(client),
-      m_busy(false)
-{
-
-}
-
-// ============================================================ //
-
-bool Sender::busy()
-{
-    MutexLocker locker(m_busy);
-
-    return m_busy;
-}
-
-// ============================================================ //
-
-void Sender::notify()
-{
-    m_waitCondition.notify_one();
-}
-
-// ============================================================ //
-
-void Sender::cancel()
-{
-    Thread::cancel();
-
-    m_waitCondition.notify_one();
-}
-
-// ============================================================ //
-
-void Sender::onRun()
-{
-    for (;;) {
-
-        if (testCancel()) {
-
-            break;
-        }
-
-        if (m_client->status() < Client::Secure) {
-
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-
-            continue;
-        }
-
-        uint32_t numIdle;
-
-        // check for work
-
-        m_client->checkRequests(&numIdle);
-
-        if (!numIdle || !m_client->numMessageSenders()) {
-
-            // wait for work to do
-
-            {
-                MutexLocker locker(m_busy);
-
-                m_busy = false;
-            }
-
-            std::unique_lock<std::mutex> locker(m_waitMutex);
-
-            m_waitCondition.wait(locker);
-        }
-
-        // check for work again
-
-        m_client->checkRequests(&numIdle);
-
-        if (numIdle || m_client->numMessageSenders()) {
-
-            {
-                MutexLocker locker(m_busy);
-
-                m_busy = true;
-            }
-
-            // process requests
-
-            m_client->processRequests();
-
-            // process messages
-
-            m_client->processMessageSenders();
-        }
-        else
-        if (m_client->lastHrtbRecv() > 0 && m_client->tickCount() >= m_client->lastHrtbRecv() + HEARTBEAT_INTERVAL) {
-
-            // send heartbeat
-
-            {
-                MutexLocker locker(m_client->m_lastHrtbSent);
-
-                m_client->sendPacket(Packet::create(Packet::Heartbeat));
-
-                m_client->m_lastHrtbSent = m_client->tickCount();
-            }
-
-            {
-                MutexLocker locker(m_client->m_lastHrtbRecv);
-
-                m_client->m_lastHrtbRecv = 0;
-            }
-        }
-    }
-}
-
-// ============================================================ //
-
-/*
-void Client::parseCert()
-{
-    char serial[40];
-    char dn[256];
-    size_t size;
-    unsigned int algo, bits;
-    time_t expiration_time, activation_time;
-    const gnutls_datum_t* cert_list;
-    unsigned int cert_list_size = 0;
-    gnutls_x509_crt_t cert;
-    gnutls_datum_t cinfo;
-
-    if (gnutls_certificate_type_get(m_session) != GNUTLS_CRT_X509) {
-
-        return;
-    }
-
-    cert_list = gnutls_certificate_get_peers(m_session, &cert_list_size);
-
-    std::cout << "Peer provided " << cert_list_size << " certificate(s)\n";
-
-    if (cert_list_size > 0) {
-
-        int ret;
-
-        gnutls_x509_crt_init(&cert);
-
-        gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER);
-
-        std::cout << "Certificate info:\n";
-
-        ret = gnutls_x509_crt_print(cert, GNUTLS_CRT_PRINT_ONELINE, &cinfo);
-        if (ret == 0) {
-
-            std::cout << cinfo.data << "\n";
-
-            gnutls_free(cinfo.data);
-        }
-
-        gnutls_x509_crt_deinit(cert);
-    }
-}
-*/
-
-// ============================================================ //
-
-}
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/client.h"
+
+#if !defined _WIN32
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdlib>
+#include <random>
+#include <gnutls/gnutls.h>
+
+namespace Zway {
+
+// ============================================================ //
+// ClientHandle
+// ============================================================ //
+
+CLIENT_HANDLE ClientHandle::create(Client *client)
+{
+    return CLIENT_HANDLE(new ClientHandle(client));
+}
+
+// ============================================================ //
+
+ClientHandle::ClientHandle(Client *client)
+    : m_client(client)
+{
+
+}
+
+// ============================================================ //
+
+//! Run a function on the client if it is still open
+/*!
+ *  The client cannot be closed while the function runs
+ */
+
+bool ClientHandle::call(std::function<void (Client*)> fn)
+{
+    MutexLocker locker(m_mutex);
+
+    if (!m_client) {
+
+        return false;
+    }
+
+    fn(m_client);
+
+    return true;
+}
+
+// ============================================================ //
+
+void ClientHandle::reset()
+{
+    MutexLocker locker(m_mutex);
+
+    m_client = nullptr;
+}
+
+// ============================================================ //
+// Client
+// ============================================================ //
+
+Client *Client::m_instance = nullptr;
+
+//! Count a packet and its bytes, in total and by packet type
+
+static void countPacket(PACKET pkt, uint32_t size, bool sent)
+{
+    Metrics &metrics = Metrics::instance();
+
+    metrics.add(sent ? Metrics::PacketsSent : Metrics::PacketsRecv);
+
+    metrics.add(sent ? Metrics::BytesSent : Metrics::BytesRecv, size);
+
+    switch (pkt->getId()) {
+
+    case Packet::Heartbeat:
+
+        metrics.add(sent ? Metrics::HeartbeatsSent : Metrics::HeartbeatsRecv);
+
+        break;
+
+    case Packet::Request:
+
+        metrics.add(sent ? Metrics::RequestPacketsSent : Metrics::RequestPacketsRecv);
+
+        break;
+
+    case Packet::Message:
+
+        metrics.add(sent ? Metrics::MessagePacketsSent : Metrics::MessagePacketsRecv);
+
+        break;
+    }
+}
+
+// ============================================================ //
+
+static uint32_t jitter()
+{
+    static thread_local std::minstd_rand rng(std::random_device{}());
+
+    return rng();
+}
+
+#if !defined _WIN32
+
+static void drainWakePipe(int fd)
+{
+    char buf[64];
+
+    while (::read(fd, buf, sizeof(buf)) > 0);
+}
+
+#endif
+
+#if defined _WIN32
+
+void Client::initWSA()
+{
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2), &wsa);
+}
+
+// ============================================================ //
+
+void Client::freeWSA()
+{
+    WSACleanup();
+}
+
+#endif
+
+// ============================================================ //
+
+bool Client::startup(Client *client, const std::string &host, uint32_t port) {
+
+    if (!m_instance && client) {
+
+        m_instance = client;
+
+        if (m_instance->start(host, port)) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+bool Client::cleanup() {
+
+    if (m_instance) {
+
+        if (!m_instance->close()) {
+
+        }
+
+        delete m_instance;
+
+        m_instance = nullptr;
+
+        return true;
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+void Client::log(const char *msg, ...)
+{
+    if (m_instance) {
+
+        va_list args;
+        va_start(args, msg);
+        int len = vsnprintf(0, 0, msg, args);
+        va_end(args);
+
+        std::string str;
+
+        if (len) {
+
+            str.resize(len);
+
+            va_start(args, msg);
+            vsnprintf(&str[0], len + 1, msg, args);
+            va_end(args);
+        }
+
+        m_instance->postEvent(Event::create(Event::Log, UBJ_OBJ("type" << 0 << "message" << str)));
+    }
+}
+
+// ============================================================ //
+
+Client::Client()
+    : Thread(),
+      m_loop(nullptr),
+      m_port(0),
+      m_socket(-1),
+      m_session(nullptr),
+      m_anonCred(nullptr),
+      m_certCred(nullptr),
+      m_sender(this),
+      m_timers(&m_ownTimers),
+      m_storage(nullptr),
+      m_status(Disconnected),
+      m_lastHrtbRecv(0),
+      m_lastHrtbSent(0),
+      m_heartbeatTimer(0),
+      m_interrupted(false),
+      m_reconnectDue(false),
+      m_recvOffset(0),
+      m_outgoingOffset(0),
+      m_outgoingRetry(0),
+      m_servePending(false),
+      m_connecting(0),
+      m_connectTimer(0)
+{
+#if !defined _WIN32
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+#endif
+
+    m_handle = ClientHandle::create(this);
+}
+
+// ============================================================ //
+
+//! A client served by the threads of a pool
+/*!
+ *  Any number of clients may share a pool, none of them starts
+ *  threads of its own
+ */
+
+Client::Client(CLIENT_POOL pool)
+    : Client()
+{
+    m_pool = pool;
+
+    if (m_pool) {
+
+        m_timers = &m_pool->timer();
+
+        m_eventDispatcher.setPool(&m_pool->dispatchPool());
+    }
+}
+
+// ============================================================ //
+
+Client::~Client()
+{
+    MutexLocker locker(m_handle);
+
+    (*m_handle)->reset();
+}
+
+// ============================================================ //
+
+bool Client::start(const std::string& host, uint32_t port)
+{
+    // init gnutls
+
+    int res = gnutls_global_init();
+
+    if (res < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    res = gnutls_certificate_allocate_credentials((gnutls_certificate_credentials_t*)&m_certCred);
+
+    if (res < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    res = gnutls_anon_allocate_client_credentials((gnutls_anon_client_credentials_t*)&m_anonCred);
+
+    if (res < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    m_host = host;
+
+    m_port = port;
+
+    // without an account the next thing likely is to create one,
+    // have its keys ready by then
+
+    if (!m_storage) {
+
+        Crypto::KeyPool::instance().fill();
+    }
+
+    // run event dispatcher
+
+    if (!m_eventDispatcher.run()) {
+
+        //postEvent(MAKE_ERROR(0, "Failed to start event dispatcher"));
+
+        return false;
+    }
+
+    if (m_pool) {
+
+        // no threads of our own, one of the pool's loops serves us
+
+        {
+            MutexLocker locker(m_cancel);
+
+            m_cancel = false;
+        }
+
+        m_loop = m_pool->reactor().next();
+
+        connectLater(0, false);
+
+        return true;
+    }
+
+#if !defined _WIN32
+
+    // lets other threads interrupt the client thread's select
+
+    if (pipe(m_wakePipe) != 0) {
+
+        return false;
+    }
+
+    for (int i=0; i<2; ++i) {
+
+        fcntl(m_wakePipe[i], F_SETFL, fcntl(m_wakePipe[i], F_GETFL) | O_NONBLOCK);
+
+        fcntl(m_wakePipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+#endif
+
+    // run timer thread
+
+    if (!m_timers->run()) {
+
+        return false;
+    }
+
+    // run client thread
+
+    if (!run()) {
+
+        //postEvent(MAKE_ERROR(0, "Failed to start client"));
+
+        return false;
+    }
+
+    // run sender thread
+
+    if (!m_sender.run()) {
+
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Client::close()
+{
+    // no events from here on, not even those close() causes; a
+    // handler closing its own client must not wait for them
+
+    m_eventDispatcher.cancel();
+
+    // work still running on shared threads no longer reaches us,
+    // a reopened client gets a new handle
+
+    {
+        MutexLocker locker(m_handle);
+
+        (*m_handle)->reset();
+
+        m_handle = ClientHandle::create(this);
+    }
+
+    // cancel pending requests
+
+    {
+        MutexLocker locker(m_inboxSync);
+
+        INBOX_SYNC &current = m_inboxSync;
+
+        if (current) {
+
+            current->cancel();
+        }
+    }
+
+    for (auto &request : m_requests.requests()) {
+
+        m_timers->stop(request->timer());
+
+        finishRequest(request, "Client closed");
+    }
+
+    m_requests.clear();
+
+    // cancel pending message senders
+
+    {
+        MutexLocker locker(m_messageScheduler);
+
+        m_messageScheduler->clear();
+    }
+
+    {
+        MutexLocker locker(m_suspendedSenders);
+
+        m_suspendedSenders->clear();
+    }
+
+    // cancel pending message receivers
+
+    {
+        MutexLocker locker(m_messageReceivers);
+
+        m_messageReceivers->clear();
+    }
+
+    {
+        MutexLocker locker(m_pendingParts);
+
+        m_pendingParts->clear();
+    }
+
+    if (m_pool) {
+
+        // nothing of ours may be left to run on the pool's threads
+
+        cancel();
+
+        stopHeartbeat();
+
+        {
+            MutexLocker locker(m_connectTimer);
+
+            m_timers->stop(m_connectTimer);
+
+            m_connectTimer = 0;
+        }
+
+        m_timers->sync();
+
+        {
+            std::unique_lock<std::mutex> locker(m_connecting);
+
+            m_connectingCondition.wait(locker, [this] () {
+
+                return *m_connecting == 0;
+            });
+        }
+
+        if (m_loop) {
+
+            m_loop->unwatch(m_socket);
+
+            m_loop->sync();
+        }
+
+        disconnect();
+    }
+    else {
+
+        // shutdown sender
+
+        m_sender.cancelAndJoin();
+
+        // shutdown client
+
+        cancelAndJoin();
+
+        disconnect();
+
+        // shutdown timer
+
+        m_timers->cancelAndJoin();
+
+        m_timers->clear();
+
+#if !defined _WIN32
+
+        for (int i=0; i<2; ++i) {
+
+            if (m_wakePipe[i] >= 0) {
+
+                ::close(m_wakePipe[i]);
+
+                m_wakePipe[i] = -1;
+            }
+        }
+
+#endif
+    }
+
+    // shutdown event dispatcher
+
+    m_eventDispatcher.join();
+
+    // close storage
+
+    m_storage.reset();
+
+    // release gnutls resources
+
+    if (m_certCred) {
+
+        gnutls_certificate_free_credentials((gnutls_certificate_credentials_t)m_certCred);
+    }
+
+    if (m_anonCred) {
+
+        gnutls_anon_free_client_credentials((gnutls_anon_client_credentials_t)m_anonCred);
+    }
+
+    m_certCred = nullptr;
+
+    m_anonCred = nullptr;
+
+    gnutls_global_deinit();
+
+    m_port = 0;
+
+    return true;
+}
+
+// ============================================================ //
+
+CLIENT_POOL Client::pool()
+{
+    return m_pool;
+}
+
+// ============================================================ //
+
+void Client::setEventHandler(EVENT_HANDLER handler)
+{
+    m_eventDispatcher.addHandler(handler);
+}
+
+// ============================================================ //
+
+//! Dispatch events on several threads
+/*!
+ *  Has to be called before start(). Events of one message keep
+ *  their order, everything else may be delivered out of order.
+ *  Clients of a pool use the pool's workers.
+ */
+
+void Client::setEventWorkers(uint32_t numWorkers)
+{
+    m_eventDispatcher.setNumWorkers(numWorkers);
+}
+
+// ============================================================ //
+
+//! The event dispatcher
+/*!
+ *  For subscribing to single event types, messages or contacts
+ */
+
+EventDispatcher &Client::eventDispatcher()
+{
+    return m_eventDispatcher;
+}
+
+// ============================================================ //
+
+Client::ClientStatus Client::status()
+{
+    MutexLocker locker(m_status);
+
+    return m_status;
+}
+
+// ============================================================ //
+
+uint32_t Client::lastHrtbRecv()
+{
+    MutexLocker locker(m_lastHrtbRecv);
+
+    return m_lastHrtbRecv;
+}
+
+// ============================================================ //
+
+uint32_t Client::lastHrtbSent()
+{
+    MutexLocker locker(m_lastHrtbSent);
+
+    return m_lastHrtbSent;
+}
+
+// ============================================================ //
+
+uint32_t Client::tickCount()
+{
+    // TODO replace by std::chrono
+
+#if defined _WIN32
+
+    return GetTickCount();
+
+#else
+
+    struct timeval tv;
+
+    gettimeofday(&tv, nullptr);
+
+    return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+
+#endif
+
+    return 0;
+}
+
+// ============================================================ //
+
+bool Client::createAccount(
+        const UBJ::Object &account,
+        const std::string &storagePassword,
+        CREATE_ACCOUNT_CALLBACK callback)
+{
+    return createAccountAsync(account, storagePassword, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::createAccountAsync(
+        const UBJ::Object &account,
+        const std::string &storagePassword,
+        CREATE_ACCOUNT_CALLBACK callback)
+{
+    if (!m_storage &&
+            status() >= Secure) {
+
+        return postRequestAsync(CreateAccountRequest::create(account, storagePassword, callback));
+    }
+
+    return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+}
+
+// ============================================================ //
+
+bool Client::deleteAccount()
+{
+    return false;
+}
+
+// ============================================================ //
+
+bool Client::login(
+        STORAGE storage,
+        LOGIN_CALLBACK callback)
+{
+    return loginAsync(storage, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::loginAsync(
+        STORAGE storage,
+        LOGIN_CALLBACK callback)
+{
+    if (storage &&
+            status() >= Secure &&
+            status() != LoggedIn) {
+
+        // the account we log in with is the one we work on
+
+        m_storage = storage;
+
+        return postRequestAsync(LoginRequest::create(storage, callback));
+    }
+
+    return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+}
+
+// ============================================================ //
+
+bool Client::setConfig(const UBJ::Value &config, EVENT_CALLBACK callback)
+{
+    return setConfigAsync(config, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::setConfigAsync(const UBJ::Value &config, EVENT_CALLBACK callback)
+{
+    if (m_storage && m_storage->setConfig(config)) {
+
+        if (status() >= LoggedIn) {
+
+            // update server conf
+
+            UBJ::Object conf;
+
+            m_storage->getConfig(conf);
+
+            // add contacts, the packed id list goes along for
+            // servers that understand it
+
+            UBJ::Object contacts;
+
+            std::vector<uint32_t> ids;
+
+            Storage::NODE_LIST nodes = m_storage->getContacts();
+
+            for (auto &node : nodes) {
+
+                contacts[node->user1()] = UBJ_OBJ("notifyStatus" << 1);
+
+                ids.push_back(node->user1());
+            }
+
+            conf["contacts"] = contacts;
+
+            conf["notifyContacts"] = ContactStatusMap::packIds(ids);
+
+            return postRequestAsync(Zway::ConfigRequest::create(conf, callback));
+        }
+
+        // stored locally only, the server gets it on login
+
+        EVENT event = DUMMY_EVENT(0);
+
+        if (callback) {
+
+            callback(event);
+        }
+
+        return RequestFuture(event);
+    }
+
+    EVENT event = ERROR_EVENT(0, "Failed to set config");
+
+    if (callback) {
+
+        callback(event);
+    }
+
+    return RequestFuture(event);
+}
+
+// ============================================================ //
+
+bool Client::addContact(
+        const std::string &addCode,
+        const std::string &label,
+        const std::string &phone,
+        ADD_CONTACT_CALLBACK callback)
+{
+    return addContactAsync(addCode, label, phone, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::addContactAsync(
+        const std::string &addCode,
+        const std::string &label,
+        const std::string &phone,
+        ADD_CONTACT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(AddContactRequest::create(m_storage, addCode, label, phone, false, callback));
+}
+
+// ============================================================ //
+
+bool Client::createAddCode(ADD_CONTACT_CALLBACK callback)
+{
+    return createAddCodeAsync(callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::createAddCodeAsync(ADD_CONTACT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(AddContactRequest::create(m_storage, std::string(), std::string(), std::string(), true, callback));
+}
+
+// ============================================================ //
+
+bool Client::findContact(const UBJ::Value &query, EVENT_CALLBACK callback)
+{
+    return findContactAsync(query, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::findContactAsync(const UBJ::Value &query, EVENT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(FindContactRequest::create(query, callback));
+}
+
+// ============================================================ //
+
+bool Client::acceptContact(uint32_t requestId, ACCEPT_CONTACT_CALLBACK callback)
+{
+    return acceptContactAsync(requestId, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::acceptContactAsync(uint32_t requestId, ACCEPT_CONTACT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(AcceptContactRequest::create(requestId, m_storage, callback));
+}
+
+// ============================================================ //
+
+bool Client::rejectContact(uint32_t requestId, REJECT_CONTACT_CALLBACK callback)
+{
+    return rejectContactAsync(requestId, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::rejectContactAsync(uint32_t requestId, REJECT_CONTACT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(RejectContactRequest::create(requestId, callback));
+}
+
+// ============================================================ //
+
+bool Client::requestContactStatus(const UBJ::Value &contacts)
+{
+    return requestContactStatusAsync(contacts).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::requestContactStatusAsync(const UBJ::Value &contacts)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(ContactStatusRequest::create(
+            contacts,
+            m_storage,
+            m_contactStatus.epoch(),
+            m_contactStatus.version()));
+}
+
+// ============================================================ //
+
+//! Fetch messages received by the server while we were offline
+/*!
+ *  Runs after every login. A sync still running from a previous
+ *  session is dropped. Event::InboxSynced reports the result.
+ */
+
+bool Client::syncInbox()
+{
+    if (status() < LoggedIn) {
+
+        return false;
+    }
+
+    INBOX_SYNC sync = InboxSync::create(this, m_storage);
+
+    {
+        MutexLocker locker(m_inboxSync);
+
+        INBOX_SYNC &current = m_inboxSync;
+
+        if (current) {
+
+            current->cancel();
+        }
+
+        m_inboxSync = sync;
+    }
+
+    return sync->start();
+}
+
+// ============================================================ //
+
+bool Client::cancelRequest(uint32_t requestId, EVENT_CALLBACK callback)
+{
+    return cancelRequestAsync(requestId, callback).posted();
+}
+
+// ============================================================ //
+
+RequestFuture Client::cancelRequestAsync(uint32_t requestId, EVENT_CALLBACK callback)
+{
+    if (status() < LoggedIn) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    UBJ::Object request;
+
+    if (!m_storage->getRequest(requestId, request)) {
+
+        return RequestFuture(ERROR_EVENT(0, "Request not posted"));
+    }
+
+    return postRequestAsync(Zway::DispatchRequest::create(
+                    UBJ_OBJ("requestDispatchId" << requestId << "action" << "cancel"),
+                    callback));
+}
+
+// ============================================================ //
+
+void Client::postEvent(EVENT event, bool immediately)
+{
+    // the event finishing a request completes its future right here,
+    // handlers and callbacks get it through the dispatcher as before
+
+    REQUEST_EVENT requestEvent = RequestEvent::cast(event);
+
+    if (requestEvent && requestEvent->request()) {
+
+        Request::Status status = requestEvent->request()->status();
+
+        if (status == Request::Completed ||
+                status == Request::Timeout ||
+                status == Request::Error) {
+
+            requestEvent->request()->resolve(event);
+        }
+    }
+
+    m_eventDispatcher.post(event);
+}
+
+// ============================================================ //
+
+bool Client::postRequest(REQUEST request)
+{
+    request->setClient(this);
+
+    {
+        MutexLocker locker(m_retryPolicies);
+
+        auto it = m_retryPolicies->find(request->type());
+
+        if (it != m_retryPolicies->end()) {
+
+            request->setRetryPolicy(it->second);
+        }
+    }
+
+    // add it before it can be sent, the response may be quick
+
+    m_requests.add(request);
+
+    if (request->delay() > 0) {
+
+        startRequestLater(request, request->delay());
+    }
+    else {
+
+        startRequest(request);
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+RequestFuture Client::postRequestAsync(REQUEST request)
+{
+    postRequest(request);
+
+    return RequestFuture(request);
+}
+
+// ============================================================ //
+
+//! Override the retry policy of all requests of a type posted from now on
+
+void Client::setRetryPolicy(Request::Type type, const Request::RetryPolicy &policy)
+{
+    MutexLocker locker(m_retryPolicies);
+
+    (*m_retryPolicies)[type] = policy;
+}
+
+// ============================================================ //
+
+void Client::startRequest(REQUEST request)
+{
+    // removed while waiting for its start
+
+    if (m_requests.find(request->id()) != request) {
+
+        return;
+    }
+
+    request->start();
+
+    startRequestTimer(request, request->timeLeft());
+
+    // requests which start later queue themselves once they are ready
+
+    if (request->status() == Request::Idle) {
+
+        queueRequest(request);
+    }
+}
+
+// ============================================================ //
+
+void Client::startRequestLater(REQUEST request, uint32_t ms)
+{
+    MutexLocker locker(m_requestTimerMutex);
+
+    request->setTimer(m_timers->start(ms, [this, request] (uint32_t) {
+
+        startRequest(request);
+    }));
+}
+
+// ============================================================ //
+
+//! Schedule another attempt if the request's retry policy allows it
+
+bool Client::retryRequest(REQUEST request)
+{
+    uint32_t ms;
+
+    if (!request->retry(jitter(), &ms)) {
+
+        return false;
+    }
+
+    startRequestLater(request, ms);
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Hand a started request to the sender
+/*!
+ *  The sender writes all queued requests in one go
+ */
+
+void Client::queueRequest(REQUEST request)
+{
+    m_sendQueue.push(request);
+
+    notifySender();
+}
+
+// ============================================================ //
+
+bool Client::postMessage(MESSAGE message, MessageSender::Priority priority)
+{
+    // set latest history id
+
+    uint32_t historyId = m_storage->latestHistory(message->dst());
+
+    message->setHistory(historyId);
+
+    // create message sender
+
+    MESSAGE_SENDER sender = MessageSender::create(this, message, priority);
+
+    if (!sender) {
+
+        return false;
+    }
+
+    // the hash trees cover the whole payload, those of large
+    // messages are built on the thread pool so posting does not
+    // wait for them
+
+    if (sender->messageSize() <= SMALL_MESSAGE_SIZE) {
+
+        if (!sender->activate(sender->buildTrees())) {
+
+            return false;
+        }
+
+        queueSender(sender);
+
+        return true;
+    }
+
+    CLIENT_HANDLE handle = this->handle();
+
+    ThreadPool::instance().post([sender, handle] () {
+
+        bool treesBuilt = sender->buildTrees();
+
+        handle->call([&] (Client *client) {
+
+            if (sender->activate(treesBuilt)) {
+
+                client->queueSender(sender);
+            }
+        });
+    });
+
+    return true;
+}
+
+// ============================================================ //
+
+void Client::queueSender(MESSAGE_SENDER sender)
+{
+    {
+        MutexLocker locker(m_messageScheduler);
+
+        m_messageScheduler->add(sender);
+    }
+
+    // wake up the sender so an interactive message does not wait for the next poll
+
+    notifySender();
+}
+
+// ============================================================ //
+
+bool Client::requestPending(Request::Type type)
+{
+    for (auto &request : m_requests.requests()) {
+
+        if (request->type() == type) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+//! Handle for work which may outlive the client's session
+
+CLIENT_HANDLE Client::handle()
+{
+    MutexLocker locker(m_handle);
+
+    return m_handle;
+}
+
+// ============================================================ //
+
+uint32_t Client::getContactStatus(uint32_t id)
+{
+    return m_contactStatus.get(id);
+}
+
+// ============================================================ //
+
+//! Status of all contacts, reading it never blocks
+
+ContactStatusMap::Snapshot Client::contactStatus()
+{
+    return m_contactStatus.snapshot();
+}
+
+// ============================================================ //
+
+void Client::setStatus(ClientStatus status)
+{
+    MutexLocker locker(m_status);
+
+    m_status = status;
+}
+
+// ============================================================ //
+
+void Client::onRun()
+{
+    // connect us to the server
+
+    if (!connect(m_host, m_port)) {
+
+        reconnect();
+
+        //onThreadFinish();
+
+        //return nullptr;
+    }
+
+    // loop
+
+    for (;;) {
+
+        // are we asked to cancel
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        // check if the heartbeat timer found the connection interrupted
+
+        if (m_interrupted.exchange(false)) {
+
+            postEvent(ERROR_EVENT(Event::ConnectionInterrupted, "Connection interrupted"));
+
+            disconnect(false, false);
+
+            reconnect();
+
+            continue;
+        }
+
+        // receiver
+
+        // wait for incoming packet or a wake up, timers take care
+        // of everything which is due at some point
+
+        PACKET pkt;
+
+        if (readable(WAIT_INFINITE)) {
+
+            pkt = Packet::create();
+
+            // read packet
+
+            int32_t res = recvPacket(pkt);
+
+            if (res <= 0) {
+
+                // was the connection closed by the server
+
+                if (res == 0) {
+
+                }
+
+                disconnect(false);
+
+                reconnect();
+
+                continue;
+            }
+            else {
+
+                processPacket(pkt);
+            }
+        }
+
+        // sender
+
+        if (!m_sender.busy()) {
+
+            // if packets made work for the sender, wake it up
+
+            if (numMessageSenders()) {
+
+                m_sender.notify();
+            }
+        }
+    }
+}
+
+// ============================================================ //
+
+//! Work for a client of a pool
+/*!
+ *  Runs on the client's loop whenever it is woken. Sends the
+ *  queued requests and a round of message parts, then lets the
+ *  other clients of the loop have their turn. Nothing new is
+ *  sent while the socket has not taken the last round yet, the
+ *  loop calls us again once it is writable.
+ */
+
+void Client::serve()
+{
+    m_servePending = false;
+
+    if (testCancel()) {
+
+        return;
+    }
+
+    // check if the heartbeat timer found the connection interrupted
+
+    if (m_interrupted.exchange(false)) {
+
+        postEvent(ERROR_EVENT(Event::ConnectionInterrupted, "Connection interrupted"));
+
+        disconnect(false, false);
+
+        connectLater(RECONNECT_INTERVAL, true);
+
+        return;
+    }
+
+    if (status() < Secure) {
+
+        return;
+    }
+
+    if (!flush()) {
+
+        return;
+    }
+
+    if (!m_sendQueue.empty() || numMessageSenders()) {
+
+        processRequests();
+
+        processMessageSenders();
+
+        if (!flush()) {
+
+            return;
+        }
+
+        if (!m_sendQueue.empty() || numMessageSenders()) {
+
+            wake();
+        }
+    }
+    else
+    if (heartbeatDue()) {
+
+        sendHeartbeat();
+
+        flush();
+    }
+}
+
+// ============================================================ //
+
+//! Read what arrived for a client of a pool
+/*!
+ *  Runs on the client's loop. Packets are put together across
+ *  calls, so a slow connection never holds up the loop.
+ */
+
+void Client::onReadable()
+{
+    for (;;) {
+
+        int32_t res = recvNext();
+
+        if (res < 0) {
+
+            disconnect(false);
+
+            connectLater(RECONNECT_INTERVAL, true);
+
+            return;
+        }
+
+        if (res == 0) {
+
+            break;
+        }
+
+        PACKET pkt = m_recvPkt;
+
+        m_recvPkt.reset();
+
+        processPacket(pkt);
+    }
+
+    // if packets made work for the sender, wake it up
+
+    if (numMessageSenders()) {
+
+        notifySender();
+    }
+}
+
+// ============================================================ //
+
+void Client::processPacket(PACKET pkt)
+{
+    {
+        MutexLocker locker(m_lastHrtbSent);
+
+        m_lastHrtbSent = 0;
+    }
+
+    {
+        MutexLocker locker(m_lastHrtbRecv);
+
+        m_lastHrtbRecv = tickCount();
+    }
+
+    countPacket(pkt, PACKET_BASE_SIZE + pkt->getHeadSize() + pkt->getBodySize(), false);
+
+    // process current packet
+
+    switch (pkt->getId()) {
+
+    case Packet::Heartbeat:
+
+        break;
+
+    case Packet::Request:
+
+        processRequestPkt(pkt);
+
+        break;
+
+    case Packet::Message:
+
+        processMessagePkt(pkt);
+
+        break;
+    }
+}
+
+// ============================================================ //
+
+bool Client::heartbeatDue()
+{
+    uint32_t recv = lastHrtbRecv();
+
+    return recv > 0 && tickCount() >= recv + HEARTBEAT_INTERVAL;
+}
+
+// ============================================================ //
+
+void Client::sendHeartbeat()
+{
+    {
+        MutexLocker locker(m_lastHrtbSent);
+
+        sendPacket(Packet::create(Packet::Heartbeat));
+
+        m_lastHrtbSent = tickCount();
+    }
+
+    {
+        MutexLocker locker(m_lastHrtbRecv);
+
+        m_lastHrtbRecv = 0;
+    }
+}
+
+// ============================================================ //
+
+//! Tell whoever sends for us that there is work
+
+void Client::notifySender()
+{
+    if (m_pool) {
+
+        wake();
+    }
+    else {
+
+        m_sender.notify();
+    }
+}
+
+// ============================================================ //
+
+bool Client::connect(const std::string& host, uint32_t port)
+{
+    if (status() != Disconnected) {
+
+        return false;
+    }
+
+    uint32_t a = inet_addr(host.c_str());
+
+    if (a == INADDR_NONE) {
+
+        struct hostent* he = gethostbyname(host.c_str());
+
+        if (!he) {
+
+            //postEvent(MAKE_ERROR(0, "Failed to resolve hostname"));
+
+            return false;
+        }
+
+        a = *(uint32_t*)he->h_addr;
+    }
+
+#if defined _WIN32
+
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (s == INVALID_SOCKET) {
+
+        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
+
+        return false;
+    }
+
+    u_long on = 1;
+
+    {
+        int32_t ret = ioctlsocket(s, FIONBIO, &on);
+
+        if (ret != NO_ERROR) {
+
+            // ...
+        }
+    }
+
+#else
+
+    int32_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (s == -1) {
+
+        //postEvent(MAKE_ERROR(0, "Failed to create socket"));
+
+        return false;
+    }
+
+    int32_t flags = fcntl(s, F_GETFL, 0);
+
+    fcntl(s, F_SETFL, flags | O_NONBLOCK);
+
+#endif
+
+    // setup address and connect
+
+    struct sockaddr_in addr;
+    addr.sin_addr.s_addr = a;
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+
+    setStatus(Connecting);
+
+    int32_t res = ::connect(s, (struct sockaddr*)&addr, sizeof(addr));
+
+#if defined _WIN32
+
+    if (WSAGetLastError() == WSAEWOULDBLOCK) {
+
+#else
+
+    if (errno == EINPROGRESS) {
+
+#endif
+        // wait for socket to be connected
+
+        uint32_t timeout = 10000;
+        uint32_t ms = 0;
+
+        while (ms < timeout) {
+
+            if (testCancel()) {
+
+                return false;
+            }
+
+            struct timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = 200000;
+
+            fd_set ws;
+            FD_ZERO(&ws);
+            FD_SET(s, &ws);
+
+            if (select(s + 1, nullptr, &ws, nullptr, &tv) > 0) {
+
+                res = -1;
+
+#if defined _WIN32
+
+                uint32_t len = sizeof(int32_t);
+
+                getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&res, (int32_t*)&len);
+#else
+
+                socklen_t len = sizeof(int32_t);
+
+                getsockopt(s, SOL_SOCKET, SO_ERROR, &res, &len);
+#endif
+
+                break;
+            }
+
+            ms += 200;
+        }
+    }
+
+    if (res) {
+
+#if defined _WIN32
+
+        closesocket(s);
+
+#else
+
+        ::close(s);
+
+#endif
+        setStatus(Disconnected);
+
+        postEvent(ERROR_EVENT(Event::ConnectionFailure, "Connection failed"));
+
+        return false;
+    }
+
+    m_socket = s;
+
+    setStatus(Connected);
+
+    // init tls session
+
+    if ((res = gnutls_init((gnutls_session_t*)&m_session, GNUTLS_CLIENT)) < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    // set priority
+
+    if ((res = gnutls_priority_set_direct((gnutls_session_t)m_session, "NORMAL:+VERS-TLS1.2", nullptr)) < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    // set credentials
+
+    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_ANON, m_anonCred)) < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    if ((res = gnutls_credentials_set((gnutls_session_t)m_session, GNUTLS_CRD_CERTIFICATE, m_certCred)) < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    // assign socket
+
+    gnutls_transport_set_ptr((gnutls_session_t)m_session, (gnutls_transport_ptr_t)m_socket);
+
+    // perform handshake
+
+    do {
+
+        res = gnutls_handshake((gnutls_session_t)m_session);
+
+        if (res == GNUTLS_E_AGAIN) {
+
+            // wait for the socket instead of spinning
+
+            if (testCancel()) {
+
+                return false;
+            }
+
+            if (gnutls_record_get_direction((gnutls_session_t)m_session)) {
+
+                writable(200);
+            }
+            else {
+
+                readable(200);
+            }
+        }
+    }
+    while (res < 0 && gnutls_error_is_fatal(res) == 0);
+
+    if (res < 0) {
+
+        //postEvent(MAKE_ERROR(res, gnutls_strerror(res)));
+
+        return false;
+    }
+
+    // TODO: verify server certificate here
+
+    //parseCert();
+
+    setStatus(Secure);
+
+    {
+        MutexLocker locker(m_lastHrtbSent);
+
+        m_lastHrtbSent = 0;
+    }
+
+    {
+        MutexLocker locker(m_lastHrtbRecv);
+
+        m_lastHrtbRecv = tickCount();
+    }
+
+    m_interrupted = false;
+
+    startHeartbeat(HEARTBEAT_INTERVAL);
+
+    postEvent(Event::create(Event::ConnectionSuccess));
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Connect a client of a pool
+/*!
+ *  Connecting and the TLS handshake run on the pool's connector
+ *  threads, the outcome is handled on the client's loop.
+ */
+
+void Client::connectLater(uint32_t ms, bool reconnected)
+{
+    auto connectTask = [this, reconnected] () {
+
+        {
+            MutexLocker locker(m_connecting);
+
+            (*m_connecting)++;
+        }
+
+        m_pool->connector().post([this, reconnected] () {
+
+            if (!testCancel()) {
+
+                bool success = connect(m_host, m_port);
+
+                m_loop->post([this, success, reconnected] () {
+
+                    onConnected(success, reconnected);
+                });
+            }
+
+            // close() may return once we let go of the lock
+
+            MutexLocker locker(m_connecting);
+
+            (*m_connecting)--;
+
+            m_connectingCondition.notify_all();
+        });
+    };
+
+    if (!ms) {
+
+        connectTask();
+
+        return;
+    }
+
+    MutexLocker locker(m_connectTimer);
+
+    if (testCancel()) {
+
+        return;
+    }
+
+    m_timers->stop(m_connectTimer);
+
+    m_connectTimer = m_timers->start(ms, [this, connectTask] (uint32_t timer) {
+
+        {
+            MutexLocker locker(m_connectTimer);
+
+            // stopped or restarted meanwhile
+
+            if (m_connectTimer != timer) {
+
+                return;
+            }
+
+            m_connectTimer = 0;
+        }
+
+        connectTask();
+    });
+}
+
+// ============================================================ //
+
+void Client::onConnected(bool success, bool reconnected)
+{
+    if (testCancel()) {
+
+        return;
+    }
+
+    if (!success) {
+
+        // a failed handshake leaves the socket open
+
+        if (status() != Disconnected) {
+
+            disconnect(false, false);
+        }
+
+        connectLater(RECONNECT_INTERVAL, true);
+
+        return;
+    }
+
+    m_loop->watch(m_socket, [this] () {
+
+        onReadable();
+    });
+
+    if (reconnected) {
+
+        postEvent(Event::create(Event::Reconnected));
+    }
+
+    // send what was queued while we were offline
+
+    wake();
+}
+
+// ============================================================ //
+
+void Client::reconnect()
+{
+    for (;;) {
+
+        // sleep until the timer says it is time for the next attempt
+
+        m_reconnectDue = false;
+
+        uint32_t timer = m_timers->start(RECONNECT_INTERVAL, [this] (uint32_t) {
+
+            m_reconnectDue = true;
+
+            wake();
+        });
+
+        while (!m_reconnectDue) {
+
+            if (testCancel()) {
+
+                m_timers->stop(timer);
+
+                return;
+            }
+
+            waitWakeup();
+        }
+
+        if (connect(m_host, m_port)) {
+
+            postEvent(Event::create(Event::Reconnected));
+
+            return;
+        }
+    }
+}
+
+// ============================================================ //
+
+void Client::disconnect(bool bye, bool event)
+{
+    stopHeartbeat();
+
+    if (m_loop) {
+
+        m_loop->unwatch(m_socket);
+    }
+
+    m_recvPkt.reset();
+
+    m_outgoing.clear();
+
+    m_outgoingOffset = 0;
+
+    m_outgoingRetry = 0;
+
+    if (m_session) {
+
+        if (bye) {
+
+            int32_t res = gnutls_bye((gnutls_session_t)m_session, GNUTLS_SHUT_RDWR);
+
+            if (gnutls_error_is_fatal(res)) {
+
+                // ...
+            }
+        }
+
+        gnutls_deinit((gnutls_session_t)m_session);
+
+        m_session = nullptr;
+    }
+
+    if (m_socket) {
+
+#if defined _WIN32
+
+        closesocket(m_socket);
+
+#else
+
+        ::close(m_socket);
+
+#endif
+
+        m_socket = -1;
+
+        setStatus(Disconnected);
+
+        suspendTransfers();
+
+        if (event) {
+
+            postEvent(Event::create(Event::Disconnected));
+        }
+    }
+}
+
+// ============================================================ //
+
+void Client::startHeartbeat(uint32_t ms)
+{
+    MutexLocker locker(m_heartbeatTimer);
+
+    m_timers->stop(m_heartbeatTimer);
+
+    m_heartbeatTimer = m_timers->start(ms, [this] (uint32_t timer) {
+
+        onHeartbeatTimer(timer);
+    });
+}
+
+// ============================================================ //
+
+void Client::stopHeartbeat()
+{
+    MutexLocker locker(m_heartbeatTimer);
+
+    m_timers->stop(m_heartbeatTimer);
+
+    m_heartbeatTimer = 0;
+}
+
+// ============================================================ //
+
+//! Heartbeat deadlines
+/*!
+ *  A single timer follows the connection: it is due when the
+ *  server has been silent for HEARTBEAT_INTERVAL, or when our
+ *  heartbeat got no answer within HEARTBEAT_TIMEOUT. Packets
+ *  received in between only move the deadline, which is picked
+ *  up when the timer fires.
+ */
+
+void Client::onHeartbeatTimer(uint32_t timer)
+{
+    uint32_t now = tickCount();
+
+    uint32_t sent = lastHrtbSent();
+
+    uint32_t recv = lastHrtbRecv();
+
+    bool interrupted = false;
+
+    bool heartbeatDue = false;
+
+    uint32_t ms = 0;
+
+    if (sent > 0) {
+
+        if (now >= sent + HEARTBEAT_TIMEOUT) {
+
+            interrupted = true;
+        }
+        else {
+
+            ms = sent + HEARTBEAT_TIMEOUT - now;
+        }
+    }
+    else
+    if (recv > 0) {
+
+        if (now >= recv + HEARTBEAT_INTERVAL) {
+
+            heartbeatDue = true;
+
+            ms = HEARTBEAT_TIMEOUT;
+        }
+        else {
+
+            ms = recv + HEARTBEAT_INTERVAL - now;
+        }
+    }
+    else {
+
+        return;
+    }
+
+    MutexLocker locker(m_heartbeatTimer);
+
+    // stopped or restarted meanwhile
+
+    if (m_heartbeatTimer != timer) {
+
+        return;
+    }
+
+    if (interrupted) {
+
+        // let the client thread reconnect
+
+        m_heartbeatTimer = 0;
+
+        m_interrupted = true;
+
+        wake();
+
+        return;
+    }
+
+    if (heartbeatDue) {
+
+        notifySender();
+    }
+
+    m_heartbeatTimer = m_timers->start(ms, [this] (uint32_t timer) {
+
+        onHeartbeatTimer(timer);
+    });
+}
+
+// ============================================================ //
+
+bool Client::processContactRequest(const UBJ::Value &head)
+{
+    uint32_t requestId = head["requestId"].toInt();
+
+    UBJ::Object request;
+
+    if (m_storage->getRequest(requestId, request)) {
+
+        postEvent(Event::create(Event::ContactRequest, head));
+    }
+    else {
+
+        // incoming contact request
+
+        m_storage->addRequest(head);
+
+        postEvent(Event::create(Event::ContactRequest, head));
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Client::processContactRequestAccepted(const UBJ::Value &head)
+{
+    uint32_t requestId = head["requestId"].toInt();
+
+    uint32_t requestOrigId = head["requestOrigId"].toInt();
+
+    UBJ::Object request;
+
+    if (m_storage->getRequest(requestOrigId, request)) {
+
+        // update request
+
+        Storage::NODE node = m_storage->getNode(UBJ_OBJ("type" << Storage::Node::RequestType << "id" << requestOrigId));
+
+        if (node) {
+
+            node->setUser1(Request::Completed);
+            node->setUser2(Request::AcceptContact);
+
+            m_storage->updateNode(node, UBJ::Object(), false, false);
+        }
+
+        // add contact
+
+        m_storage->addContact(
+                UBJ_OBJ(
+                    "contactId" << head["contactId"] <<
+                    "label"     << head["label"] <<
+                    "phone"     << head["phone"] <<
+                    "publicKey" << head["publicKey"]));
+
+        // set status
+
+        setContactStatus(head["contactId"].toInt(), head["contactStatus"].toInt());
+
+        // set config
+
+        setConfig();
+
+        // raise event
+
+        postEvent(RequestEvent::create(Event::ContactRequestAccepted, nullptr, head));
+
+        // dispatch request
+
+        postRequest(DispatchRequest::create(UBJ_OBJ("requestDispatchId" << requestId)));
+
+        return true;
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+bool Client::processContactRequestRejected(const UBJ::Value &head)
+{
+    uint32_t requestId = head["requestId"].toInt();
+
+    uint32_t requestOrigId = head["requestOrigId"].toInt();
+
+    UBJ::Object request;
+
+    if (m_storage->getRequest(requestOrigId, request)) {
+
+        // update request
+
+        Storage::NODE node = m_storage->getNode(UBJ_OBJ("type" << Storage::Node::RequestType << "id" << requestOrigId));
+
+        if (node) {
+
+            node->setUser1(Request::Completed);
+            node->setUser2(Request::RejectContact);
+
+            m_storage->updateNode(node, UBJ::Object(), false, false);
+        }
+
+        // raise event
+
+        postEvent(RequestEvent::create(Event::ContactRequestRejected, nullptr, head));
+
+        // dispatch request
+
+        postRequest(DispatchRequest::create(UBJ_OBJ("requestDispatchId" << requestId)));
+
+
+        return true;
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+//! Apply a status set or diff sent by the server
+/*!
+ *  Packed updates carry the epoch and version of the server's
+ *  status set: "full" ones replace ours, diffs from "base" to
+ *  "version" apply on top of it. A diff that does not follow the
+ *  version we have means we missed one, so the full set is asked
+ *  for again. Unversioned "contactStatus" objects still apply.
+ */
+
+bool Client::processContactStatus(const UBJ::Value &head)
+{
+    ContactStatusMap::ENTRY_LIST changes;
+
+    if (head.hasField("statusPacked")) {
+
+        if (!ContactStatusMap::unpack(head["statusPacked"].buffer(), changes)) {
+
+            // TODO error event
+
+            return false;
+        }
+
+        uint32_t epoch = head["epoch"].toInt();
+
+        uint32_t version = head["version"].toInt();
+
+        if (head["full"].toInt()) {
+
+            m_contactStatus.applyFull(epoch, version, changes);
+        }
+        else
+        if (!m_contactStatus.applyDelta(epoch, head["base"].toInt(), version, changes)) {
+
+            postRequest(ContactStatusRequest::create(UBJ::Array(), m_storage));
+
+            return true;
+        }
+    }
+    else {
+
+        const UBJ::Value &contactStatus = head["contactStatus"];
+
+        for (auto it = contactStatus.cbegin(); it != contactStatus.cend(); ++it) {
+
+            changes.push_back(ContactStatusMap::Entry{
+                    (uint32_t)atoi(it->first.c_str()),
+                    (uint32_t)it->second["status"].toInt()});
+        }
+
+        m_contactStatus.apply(changes);
+    }
+
+    if (changes.empty()) {
+
+        return true;
+    }
+
+    // raise event for the changed contacts
+
+    UBJ::Object contactStatus;
+
+    for (auto &entry : changes) {
+
+        contactStatus[std::to_string(entry.contactId)] = UBJ_OBJ("status" << entry.status);
+    }
+
+    postEvent(Event::create(
+            Event::ContactStatus,
+            contactStatus,
+            UBJ::Object()));
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Client::processRequestPkt(PACKET pkt)
+{
+    UBJ::Object head;
+
+    if (!pkt->getHeadUbj(head)) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    if (head.hasField("requestId")) {
+
+        uint32_t requestId = head["requestId"].toInt();
+
+        REQUEST request = m_requests.find(requestId);
+
+        // process request
+
+        if (request) {
+
+            uint64_t sentTime = request->takeSentTime();
+
+            if (sentTime) {
+
+                Metrics::instance().record(
+                        Metrics::requestHistogram(request->type()),
+                        Metrics::now() - sentTime);
+            }
+
+            if (!request->processRecv(pkt, head)) {
+
+                // ...
+            }
+
+            Request::Status status = request->status();
+
+            if (status == Request::Completed || status == Request::Error) {
+
+                removeRequest(request);
+            }
+        }
+    }
+
+    if (head.hasField("requestType")) {
+
+        uint32_t type = head["requestType"].toInt();
+
+        if (type == Request::AddContact) {
+
+            processContactRequest(head);
+        }
+        else
+        if (type == Request::AcceptContact) {
+
+            processContactRequestAccepted(head);
+        }
+        else
+        if (type == Request::RejectContact) {
+
+            processContactRequestRejected(head);
+        }
+        else
+        if (type == Request::ContactStatus) {
+
+            processContactStatus(head);
+        }
+    }
+
+    return true;
+}
+// ============================================================ //
+
+bool Client::processMessagePkt(PACKET pkt)
+{
+    UBJ::Object head;
+
+    if (!pkt->getHeadUbj(head)) {
+
+        return false;
+    }
+
+    uint32_t messageId  = head["messageId"].toInt();
+    uint32_t messageSrc = head["messageSrc"].toInt();
+
+    UBJ::Object publicKey;
+
+    if (messageSrc != m_storage->accountId()) {
+
+        // contact check
+
+        UBJ::Object contact;
+
+        if (!m_storage->getContact(messageSrc, contact)) {
+
+            return false;
+        }
+
+        publicKey = contact["publicKey"];
+    }
+    else {
+
+        publicKey = m_storage->publicKey();
+    }
+
+    // request access to message receivers
+
+    MutexLocker locker(m_messageReceivers);
+
+    // get receiver by message id
+
+    MESSAGE_RECEIVER receiver = (*m_messageReceivers)[messageId];
+
+    // if there is no receiver yet we continue an interrupted
+    // transfer or create a new one
+
+    PACKET_LIST pkts = {pkt};
+
+    if (!receiver) {
+
+        // parts are only held back while there is no stored
+        // transfer, so a held back message needs no lookup
+
+        bool pending = false;
+
+        {
+            MutexLocker locker(m_pendingParts);
+
+            pending = m_pendingParts->find(messageId) != m_pendingParts->end();
+        }
+
+        UBJ::Object state;
+
+        if (!pending && m_storage->getTransfer(messageId, true, state)) {
+
+            receiver = MessageReceiver::restore(this, state, publicKey);
+        }
+        else
+        if (!head.hasField("messageKey")) {
+
+            // the part overtook the first part of its message,
+            // keep it until the receiver can be created
+
+            return holdBackPart(messageId, pkt);
+        }
+        else {
+
+            receiver = MessageReceiver::create(this, head, publicKey);
+        }
+
+        if (!receiver) {
+
+            //postEvent(MAKE_ERROR(0, "Failed to create message receiver"));
+
+            return false;
+        }
+
+        (*m_messageReceivers)[messageId] = receiver;
+
+        // add parts which arrived early
+
+        MutexLocker locker(m_pendingParts);
+
+        auto it = m_pendingParts->find(messageId);
+
+        if (it != m_pendingParts->end()) {
+
+            pkts.splice(pkts.end(), it->second.pkts);
+
+            m_pendingParts->erase(it);
+        }
+    }
+
+    // let the receiver process the packets
+
+    for (auto &p : pkts) {
+
+        UBJ::Object h;
+
+        if (p == pkt) {
+
+            h = head;
+        }
+        else
+        if (!p->getHeadUbj(h)) {
+
+            continue;
+        }
+
+        if (receiver->process(p, h)) {
+
+            // check whether the receiver has completed
+
+            if (receiver->completed()) {
+
+                m_messageReceivers->erase(messageId);
+
+                break;
+            }
+        }
+        else {
+
+            // TODO: handle situation please
+
+            m_messageReceivers->erase(messageId);
+
+            m_storage->deleteTransfer(messageId, true);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Keep a part until the first part of its message arrives
+/*!
+ *  Held back parts are limited per message and in total. Parts
+ *  whose first part is overdue are dropped, once the limits are
+ *  reached parts of further messages are dropped as well.
+ */
+
+bool Client::holdBackPart(uint32_t messageId, PACKET pkt)
+{
+    MutexLocker locker(m_pendingParts);
+
+    uint32_t now = tickCount();
+
+    uint32_t bytes = 0;
+
+    for (auto it = m_pendingParts->begin(); it != m_pendingParts->end();) {
+
+        if (now - it->second.time >= PENDING_PARTS_TIMEOUT) {
+
+            it = m_pendingParts->erase(it);
+        }
+        else {
+
+            bytes += it->second.bytes;
+
+            ++it;
+        }
+    }
+
+    auto it = m_pendingParts->find(messageId);
+
+    if (it == m_pendingParts->end()) {
+
+        if (m_pendingParts->size() >= MAX_PENDING_MESSAGES) {
+
+            return false;
+        }
+    }
+    else
+    if (it->second.pkts.size() >= MAX_PENDING_PARTS) {
+
+        return false;
+    }
+
+    uint32_t size = pkt->getHeadSize() + pkt->getBodySize();
+
+    if (bytes + size > MAX_PENDING_BYTES) {
+
+        return false;
+    }
+
+    if (it == m_pendingParts->end()) {
+
+        it = m_pendingParts->insert(std::make_pair(messageId, PendingParts())).first;
+
+        it->second.bytes = 0;
+
+        it->second.time = now;
+    }
+
+    it->second.pkts.push_back(pkt);
+
+    it->second.bytes += size;
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Client::processRequests()
+{
+    // all queued requests are written while the session is corked,
+    // so they leave in a single flush instead of three records each;
+    // clients of a pool buffer their packets anyway
+
+    REQUEST request;
+
+    bool corked = false;
+
+    while (m_sendQueue.pop(request)) {
+
+        if (request->status() != Request::Idle) {
+
+            continue;
+        }
+
+        if (!corked && !m_pool) {
+
+            gnutls_record_cork((gnutls_session_t)m_session);
+
+            corked = true;
+        }
+
+        request->processSend();
+
+        if (request->status() == Request::Error && !retryRequest(request)) {
+
+            removeRequest(request);
+        }
+    }
+
+    if (corked) {
+
+        return uncork();
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Send the data written since the session was corked
+/*!
+ *  The socket is non-blocking, so the flush may take several
+ *  attempts while the socket buffer is full
+ */
+
+bool Client::uncork()
+{
+    for (;;) {
+
+        int32_t res = gnutls_record_uncork((gnutls_session_t)m_session, 0);
+
+        if (res >= 0) {
+
+            return true;
+        }
+
+        if (res != GNUTLS_E_AGAIN && res != GNUTLS_E_INTERRUPTED) {
+
+            // TODO error event
+
+            return false;
+        }
+
+        if (m_sender.testCancel() || (m_pool && testCancel())) {
+
+            return false;
+        }
+
+        writable(200);
+    }
+}
+
+// ============================================================ //
+
+void Client::removeRequest(REQUEST request)
+{
+    m_timers->stop(request->timer());
+
+    m_requests.remove(request->id());
+
+    finishRequest(request);
+}
+
+// ============================================================ //
+
+//! Complete the future of a request which finished without an event
+
+void Client::finishRequest(REQUEST request, const char *error)
+{
+    if (request->resolved()) {
+
+        return;
+    }
+
+    if (!error && request->status() != Request::Completed) {
+
+        error = "Request failed";
+    }
+
+    request->resolve(RequestEvent::create(
+            0,
+            request,
+            UBJ::Object(),
+            error ? ERROR_INFO(error) : UBJ::Object()));
+}
+
+// ============================================================ //
+
+//! Arm the timeout of a request
+/*!
+ *  Requests without timeout get no timer
+ */
+
+void Client::startRequestTimer(REQUEST request, uint32_t ms)
+{
+    if (request->timeout() == 0) {
+
+        return;
+    }
+
+    uint32_t requestId = request->id();
+
+    // the callback must not look at the request before it knows its timer
+
+    MutexLocker locker(m_requestTimerMutex);
+
+    request->setTimer(m_timers->start(ms, [this, requestId] (uint32_t timer) {
+
+        onRequestTimer(requestId, timer);
+    }));
+}
+
+// ============================================================ //
+
+void Client::onRequestTimer(uint32_t requestId, uint32_t timer)
+{
+    REQUEST req = m_requests.find(requestId);
+
+    if (!req) {
+
+        return;
+    }
+
+    {
+        MutexLocker locker(m_requestTimerMutex);
+
+        if (req->timer() != timer) {
+
+            return;
+        }
+    }
+
+    Request::Status status = req->status();
+
+    if (status == Request::Completed ||
+            status == Request::Timeout ||
+            status == Request::Error) {
+
+        // finished without anyone removing it
+
+        m_requests.remove(requestId);
+
+        finishRequest(req);
+
+        return;
+    }
+
+    if (status == Request::Sending || !req->checkTimeout()) {
+
+        // still being sent or not started yet, look again when it may be due
+
+        uint32_t ms = req->timeLeft();
+
+        startRequestTimer(req, ms > 0 ? ms : REQUEST_TIMEOUT_RETRY);
+
+        return;
+    }
+
+    if (retryRequest(req)) {
+
+        return;
+    }
+
+    m_requests.remove(requestId);
+
+    postEvent(RequestEvent::create(
+            Event::RequestTimeout,
+            req,
+            UBJ::Object(),
+            UBJ::Object(),
+            [req] (EVENT event) {
+                req->invokeCallback(event);
+            }));
+}
+
+// ============================================================ //
+
+uint32_t Client::processMessageSenders()
+{
+    // one pass sends as many parts as there are senders, the scheduler
+    // decides which sender gets to send each of them
+
+    uint32_t numParts = numMessageSenders();
+
+    uint32_t i=0;
+
+    for (; i<numParts; ++i) {
+
+        MESSAGE_SENDER sender;
+
+        {
+            MutexLocker locker(m_messageScheduler);
+
+            sender = m_messageScheduler->next();
+        }
+
+        if (!sender) {
+
+            break;
+        }
+
+        // send part without holding the scheduler lock
+
+        bool res = sender->process();
+
+        if (!res || sender->completed()) {
+
+            {
+                MutexLocker locker(m_messageScheduler);
+
+                m_messageScheduler->remove(sender);
+            }
+
+            if (sender->suspended()) {
+
+                // wait for the connection to come back
+
+                MutexLocker locker(m_suspendedSenders);
+
+                (*m_suspendedSenders)[sender->messageId()] = sender;
+            }
+        }
+    }
+
+    return i;
+}
+
+// ============================================================ //
+
+uint32_t Client::numMessageSenders()
+{
+    MutexLocker locker(m_messageScheduler);
+
+    return m_messageScheduler->size();
+}
+
+// ============================================================ //
+
+//! Take started transfers off the schedule
+/*!
+ *  Parts which were in flight when the connection dropped may
+ *  never have reached the server, so these senders wait until
+ *  the server tells them where to continue
+ */
+
+void Client::suspendTransfers()
+{
+    MESSAGE_SENDER_LIST senders;
+
+    {
+        MutexLocker locker(m_messageScheduler);
+
+        senders = m_messageScheduler->senders();
+
+        for (auto &sender : senders) {
+
+            if (sender->messagePart() > 0) {
+
+                m_messageScheduler->remove(sender);
+            }
+        }
+    }
+
+    MutexLocker locker(m_suspendedSenders);
+
+    for (auto &sender : senders) {
+
+        if (sender->messagePart() > 0) {
+
+            (*m_suspendedSenders)[sender->messageId()] = sender;
+        }
+    }
+}
+
+// ============================================================ //
+
+//! Continue interrupted transfers after login
+/*!
+ *  Outgoing transfers of a previous session are restored from
+ *  storage, incoming ones are continued as soon as the server
+ *  delivers the remaining parts
+ */
+
+void Client::resumeTransfers()
+{
+    // messages which are still scheduled need no resume
+
+    std::map<uint32_t, bool> scheduled;
+
+    {
+        MutexLocker locker(m_messageScheduler);
+
+        for (auto &sender : m_messageScheduler->senders()) {
+
+            scheduled[sender->messageId()] = true;
+        }
+    }
+
+    MESSAGE_SENDER_MAP senders;
+
+    {
+        MutexLocker locker(m_suspendedSenders);
+
+        // restore outgoing transfers of a previous session
+
+        Storage::NODE_LIST nodes = m_storage->getTransfers(false);
+
+        for (auto &node : nodes) {
+
+            uint32_t messageId = node->user1();
+
+            if (scheduled.find(messageId) != scheduled.end() ||
+                    m_suspendedSenders->find(messageId) != m_suspendedSenders->end()) {
+
+                continue;
+            }
+
+            UBJ::Object state;
+
+            if (!m_storage->getTransfer(messageId, false, state)) {
+
+                continue;
+            }
+
+            MESSAGE_SENDER sender = MessageSender::restore(this, state);
+
+            if (!sender) {
+
+                // TODO error event
+
+                m_storage->deleteTransfer(messageId, false);
+
+                continue;
+            }
+
+            (*m_suspendedSenders)[messageId] = sender;
+        }
+
+        senders = *m_suspendedSenders;
+    }
+
+    // ask the server how many parts it has got
+
+    for (auto &it : senders) {
+
+        MESSAGE_SENDER sender = it.second;
+
+        postRequest(ResumeMessageRequest::create(
+                it.first,
+                0,
+                false,
+                [this, sender] (REQUEST_EVENT event, RESUME_MESSAGE_REQUEST request) {
+
+                    // without an answer the message is sent from the start
+
+                    uint32_t messagePart = 0;
+
+                    if (event->id() != Event::RequestTimeout && !event->error().isValid()) {
+
+                        messagePart = request->messagePart();
+                    }
+
+                    resumeSender(sender, messagePart);
+                }));
+    }
+
+    // tell the server how many parts of incoming messages we have
+
+    std::map<uint32_t, uint32_t> incoming;
+
+    {
+        MutexLocker locker(m_messageReceivers);
+
+        for (auto &it : *m_messageReceivers) {
+
+            if (it.second) {
+
+                incoming[it.first] = it.second->resumePart();
+            }
+        }
+    }
+
+    Storage::NODE_LIST nodes = m_storage->getTransfers(true);
+
+    for (auto &node : nodes) {
+
+        uint32_t messageId = node->user1();
+
+        UBJ::Object state;
+
+        if (incoming.find(messageId) == incoming.end() &&
+                m_storage->getTransfer(messageId, true, state)) {
+
+            incoming[messageId] = state["resumePart"].toInt();
+        }
+    }
+
+    for (auto &it : incoming) {
+
+        postRequest(ResumeMessageRequest::create(it.first, it.second, true));
+    }
+}
+
+// ============================================================ //
+
+void Client::resumeSender(MESSAGE_SENDER sender, uint32_t messagePart)
+{
+    {
+        MutexLocker locker(m_suspendedSenders);
+
+        m_suspendedSenders->erase(sender->messageId());
+    }
+
+    if (!sender->resume(messagePart) || sender->completed()) {
+
+        return;
+    }
+
+    {
+        MutexLocker locker(m_messageScheduler);
+
+        m_messageScheduler->add(sender);
+    }
+
+    notifySender();
+}
+
+// ============================================================ //
+
+uint32_t Client::sendPacket(PACKET pkt)
+{
+    if (m_pool) {
+
+        return bufferPacket(pkt);
+    }
+
+    uint32_t s = 0;
+
+    uint32_t r = send((uint8_t*)&pkt->getId(), PACKET_BASE_SIZE);
+
+    if (r < PACKET_BASE_SIZE) {
+
+        return -1;
+    }
+
+    s += r;
+
+    if (pkt->getHeadSize() > 0) {
+
+        r = send(pkt->getHead()->data(), pkt->getHeadSize());
+
+        if (r < pkt->getHeadSize()) {
+
+            return -1;
+        }
+
+        s += r;
+    }
+
+    if (pkt->getBodySize() > 0) {
+
+        r = send(pkt->getBody()->data(), pkt->getBodySize());
+
+        if (r < pkt->getBodySize()) {
+
+            return -1;
+        }
+
+        s += r;
+    }
+
+    countPacket(pkt, s, true);
+
+    return s;
+}
+
+// ============================================================ //
+
+//! Queue a packet of a client of a pool
+/*!
+ *  Runs on the client's loop, flush() sends what was queued
+ *  without waiting for the socket
+ */
+
+uint32_t Client::bufferPacket(PACKET pkt)
+{
+    uint32_t s = PACKET_BASE_SIZE + pkt->getHeadSize() + pkt->getBodySize();
+
+    const uint8_t* base = (const uint8_t*)&pkt->getId();
+
+    m_outgoing.insert(m_outgoing.end(), base, base + PACKET_BASE_SIZE);
+
+    if (pkt->getHeadSize() > 0) {
+
+        const uint8_t* head = pkt->getHead()->data();
+
+        m_outgoing.insert(m_outgoing.end(), head, head + pkt->getHeadSize());
+    }
+
+    if (pkt->getBodySize() > 0) {
+
+        const uint8_t* body = pkt->getBody()->data();
+
+        m_outgoing.insert(m_outgoing.end(), body, body + pkt->getBodySize());
+    }
+
+    countPacket(pkt, s, true);
+
+    return s;
+}
+
+// ============================================================ //
+
+//! Send what a client of a pool has queued
+/*!
+ *  Runs on the client's loop. Once the socket takes no more,
+ *  the loop calls serve() again as soon as it is writable.
+ *  Returns true if everything is sent.
+ */
+
+bool Client::flush()
+{
+    while (m_outgoingOffset < m_outgoing.size()) {
+
+        // a record that could not be sent is retried with the same size
+
+        uint32_t size = m_outgoingRetry ? m_outgoingRetry : m_outgoing.size() - m_outgoingOffset;
+
+        int32_t res = gnutls_record_send((gnutls_session_t)m_session, &m_outgoing[m_outgoingOffset], size);
+
+        if (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) {
+
+            m_outgoingRetry = size;
+
+            m_loop->watchWritable(m_socket, [this] () {
+
+                serve();
+            });
+
+            return false;
+        }
+
+        m_outgoingRetry = 0;
+
+        if (res < 0) {
+
+            disconnect(false);
+
+            connectLater(RECONNECT_INTERVAL, true);
+
+            return false;
+        }
+
+        m_outgoingOffset += res;
+    }
+
+    // an idle client keeps no more than a small buffer
+
+    if (m_outgoing.capacity() > OUTGOING_BUFFER_SIZE) {
+
+        std::vector<uint8_t>().swap(m_outgoing);
+    }
+    else {
+
+        m_outgoing.clear();
+    }
+
+    m_outgoingOffset = 0;
+
+    return true;
+}
+
+// ============================================================ //
+
+uint32_t Client::recvPacket(PACKET pkt)
+{
+    uint32_t s = 0;
+
+    uint32_t r = recv((uint8_t*)&pkt->getId(), PACKET_BASE_SIZE);
+
+    if (r < PACKET_BASE_SIZE) {
+
+        return r;
+    }
+
+    s += r;
+
+    if (pkt->getHeadSize() > 0) {
+
+        if (pkt->getHeadSize() > MAX_PACKET_HEAD) {
+
+            return -1;
+        }
+
+        pkt->setHead(Buffer::create(nullptr, pkt->getHeadSize()));
+
+        r = recv(pkt->getHead()->data(), pkt->getHeadSize());
+
+        if (r < pkt->getHeadSize()) {
+
+            return r;
+        }
+
+        s += r;
+    }
+
+    if (pkt->getBodySize() > 0) {
+
+        if (pkt->getBodySize() > MAX_PACKET_BODY) {
+
+            return -1;
+        }
+
+        pkt->setBody(Buffer::create(nullptr, pkt->getBodySize()));
+
+        r = recv(pkt->getBody()->data(), pkt->getBodySize());
+
+        if (r < pkt->getBodySize()) {
+
+            return -1;
+        }
+
+        s += r;
+    }
+
+    return s;
+}
+
+// ============================================================ //
+
+//! Read as much of the next packet as has arrived
+/*!
+ *  Returns 1 once m_recvPkt is complete, 0 if more data has to
+ *  arrive first and -1 if the connection is gone or the packet
+ *  is invalid. Never waits.
+ */
+
+int32_t Client::recvNext()
+{
+    if (!m_recvPkt) {
+
+        m_recvPkt = Packet::create();
+
+        m_recvOffset = 0;
+    }
+
+    for (;;) {
+
+        // find the part of the packet to continue with
+
+        uint32_t offset = m_recvOffset;
+
+        uint8_t *data;
+
+        uint32_t size;
+
+        if (offset < PACKET_BASE_SIZE) {
+
+            data = (uint8_t*)&m_recvPkt->getId();
+
+            size = PACKET_BASE_SIZE;
+        }
+        else
+        if ((offset -= PACKET_BASE_SIZE) < m_recvPkt->getHeadSize()) {
+
+            data = m_recvPkt->getHead()->data();
+
+            size = m_recvPkt->getHeadSize();
+        }
+        else
+        if ((offset -= m_recvPkt->getHeadSize()) < m_recvPkt->getBodySize()) {
+
+            data = m_recvPkt->getBody()->data();
+
+            size = m_recvPkt->getBodySize();
+        }
+        else {
+
+            return 1;
+        }
+
+        int32_t res = gnutls_record_recv((gnutls_session_t)m_session, &data[offset], size - offset);
+
+        if (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) {
+
+            return 0;
+        }
+
+        if (res == 0 || gnutls_error_is_fatal(res)) {
+
+            return -1;
+        }
+
+        if (res < 0) {
+
+            continue;
+        }
+
+        m_recvOffset += res;
+
+        if (m_recvOffset == PACKET_BASE_SIZE) {
+
+            // sizes are known, make room for head and body
+
+            if (m_recvPkt->getHeadSize() > MAX_PACKET_HEAD ||
+                    m_recvPkt->getBodySize() > MAX_PACKET_BODY) {
+
+                return -1;
+            }
+
+            if (m_recvPkt->getHeadSize() > 0) {
+
+                m_recvPkt->setHead(Buffer::create(nullptr, m_recvPkt->getHeadSize()));
+            }
+
+            if (m_recvPkt->getBodySize() > 0) {
+
+                m_recvPkt->setBody(Buffer::create(nullptr, m_recvPkt->getBodySize()));
+            }
+        }
+    }
+}
+
+// ============================================================ //
+
+uint32_t Client::send(uint8_t* data, uint32_t size)
+{
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        if (m_sender.testCancel() || (m_pool && testCancel())) {
+
+            break;
+        }
+
+        if (!writable(200)) {
+
+            continue;
+        }
+
+        int32_t ret;
+
+        ret = gnutls_record_send((gnutls_session_t)m_session, &data[s], size - s);
+
+        if (ret == GNUTLS_E_AGAIN) {
+
+        }
+
+        if (gnutls_error_is_fatal(ret)) {
+
+            return -1;
+        }
+
+        if (ret > 0) {
+
+            s += ret;
+        }
+    }
+
+    return s;
+}
+
+// ============================================================ //
+
+uint32_t Client::recv(uint8_t* data, uint32_t size)
+{
+    uint32_t s = 0;
+
+    while (s < size) {
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        if (!readable(200)) {
+
+            continue;
+        }
+
+        int32_t ret;
+
+        ret = gnutls_record_recv((gnutls_session_t)m_session, &data[s], size - s);
+
+        if (gnutls_error_is_fatal(ret)) {
+
+            return -1;
+        }
+
+        if (ret > 0) {
+
+            s += ret;
+        }
+    }
+
+    return s;
+}
+
+// ============================================================ //
+
+bool Client::readable(uint32_t ms)
+{
+    // check if there is data left over from previous read
+
+    if (gnutls_record_check_pending((gnutls_session_t)m_session)) {
+
+        return true;
+    }
+
+    // check for socket read readiness, a wake up ends the wait early
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(m_socket, &fds);
+
+#if defined _WIN32
+
+    int32_t nfds = 0;
+
+    if (ms == WAIT_INFINITE) {
+
+        // no wake up pipe, poll
+
+        ms = 500;
+    }
+
+#else
+
+    int32_t nfds = m_socket + 1;
+
+    if (m_wakePipe[0] >= 0) {
+
+        FD_SET(m_wakePipe[0], &fds);
+
+        nfds = std::max(m_socket, m_wakePipe[0]) + 1;
+    }
+
+#endif
+
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+
+    int32_t res = select(nfds, &fds, nullptr, nullptr, ms == WAIT_INFINITE ? nullptr : &tv);
+
+    if (res <= 0) {
+
+        return false;
+    }
+
+#if !defined _WIN32
+
+    if (m_wakePipe[0] >= 0 && FD_ISSET(m_wakePipe[0], &fds)) {
+
+        drainWakePipe(m_wakePipe[0]);
+    }
+
+#endif
+
+    return FD_ISSET(m_socket, &fds) != 0;
+}
+
+// ============================================================ //
+
+bool Client::writable(uint32_t ms)
+{
+    // check for socket write readiness
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(m_socket, &fds);
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = ms * 1000;
+
+    int32_t res = select(m_socket+1, nullptr, &fds, nullptr, &tv);
+
+    if (res <= 0) {
+
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void Client::cancel()
+{
+    Thread::cancel();
+
+    wake();
+}
+
+// ============================================================ //
+
+//! Interrupt the client thread's wait
+/*!
+ *  Without a wake up pipe on Windows the client thread polls.
+ *  A client of a pool gets serve() run on its loop instead.
+ */
+
+void Client::wake()
+{
+    if (m_pool) {
+
+        // one pending serve() covers any number of wake ups
+
+        if (m_loop && !m_servePending.exchange(true)) {
+
+            m_loop->post([this] () {
+
+                serve();
+            });
+        }
+
+        return;
+    }
+
+#if !defined _WIN32
+
+    if (m_wakePipe[1] >= 0) {
+
+        // a full pipe has a wake up pending already
+
+        char c = 0;
+
+        ssize_t res = ::write(m_wakePipe[1], &c, 1);
+
+        (void)res;
+    }
+
+#endif
+}
+
+// ============================================================ //
+
+void Client::waitWakeup()
+{
+#if defined _WIN32
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+#else
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(m_wakePipe[0], &fds);
+
+    if (select(m_wakePipe[0]+1, &fds, nullptr, nullptr, nullptr) > 0) {
+
+        drainWakePipe(m_wakePipe[0]);
+    }
+
+#endif
+}
+
+// ============================================================ //
+
+void Client::setContactStatus(uint32_t contactId, uint32_t status)
+{
+    m_contactStatus.apply({ContactStatusMap::Entry{contactId, status}});
+}
+
+// ============================================================ //
+
+void Client::setStorageDir(const std::string &dir)
+{
+    m_storageDir = dir;
+}
+
+// ============================================================ //
+
+std::string Client::storageDir()
+{
+    return m_storageDir;
+}
+
+// ============================================================ //
+
+STORAGE Client::storage()
+{
+    return m_storage;
+}
+
+// ============================================================ //
+// Sender
+// ============================================================ //
+
+Sender::Sender(Client *client)
+    : Thread(),
+      m_client(client),
+      m_busy(false),
+      m_notified(false)
+{
+
+}
+
+// ============================================================ //
+
+bool Sender::busy()
+{
+    MutexLocker locker(m_busy);
+
+    return m_busy;
+}
+
+// ============================================================ //
+
+void Sender::notify()
+{
+    {
+        MutexLocker locker(m_waitMutex);
+
+        m_notified = true;
+    }
+
+    m_waitCondition.notify_one();
+}
+
+// ============================================================ //
+
+void Sender::cancel()
+{
+    Thread::cancel();
+
+    {
+        MutexLocker locker(m_waitMutex);
+    }
+
+    m_waitCondition.notify_one();
+}
+
+// ============================================================ //
+
+void Sender::onRun()
+{
+    for (;;) {
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        if (m_client->status() < Client::Secure) {
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+
+            continue;
+        }
+
+        // check for work
+
+        if (m_client->m_sendQueue.empty() && !m_client->numMessageSenders()) {
+
+            // wait for work to do
+
+            {
+                MutexLocker locker(m_busy);
+
+                m_busy = false;
+            }
+
+            // nothing polls the sender anymore, so a notification
+            // must not get lost between the check and the wait
+
+            std::unique_lock<std::mutex> locker(m_waitMutex);
+
+            m_waitCondition.wait(locker, [this] () {
+                return m_notified || testCancel();
+            });
+
+            m_notified = false;
+        }
+
+        // check for work again
+
+        if (!m_client->m_sendQueue.empty() || m_client->numMessageSenders()) {
+
+            {
+                MutexLocker locker(m_busy);
+
+                m_busy = true;
+            }
+
+            // process requests
+
+            m_client->processRequests();
+
+            // process messages
+
+            m_client->processMessageSenders();
+        }
+        else
+        if (m_client->heartbeatDue()) {
+
+            // send heartbeat
+
+            m_client->sendHeartbeat();
+        }
+    }
+}
+
+// ============================================================ //
+
+/*
+void Client::parseCert()
+{
+    char serial[40];
+    char dn[256];
+    size_t size;
+    unsigned int algo, bits;
+    time_t expiration_time, activation_time;
+    const gnutls_datum_t* cert_list;
+    unsigned int cert_list_size = 0;
+    gnutls_x509_crt_t cert;
+    gnutls_datum_t cinfo;
+
+    if (gnutls_certificate_type_get(m_session) != GNUTLS_CRT_X509) {
+
+        return;
+    }
+
+    cert_list = gnutls_certificate_get_peers(m_session, &cert_list_size);
+
+    std::cout << "Peer provided " << cert_list_size << " certificate(s)\n";
+
+    if (cert_list_size > 0) {
+
+        int ret;
+
+        gnutls_x509_crt_init(&cert);
+
+        gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER);
+
+        std::cout << "Certificate info:\n";
+
+        ret = gnutls_x509_crt_print(cert, GNUTLS_CRT_PRINT_ONELINE, &cinfo);
+        if (ret == 0) {
+
+            std::cout << cinfo.data << "\n";
+
+            gnutls_free(cinfo.data);
+        }
+
+        gnutls_x509_crt_deinit(cert);
+    }
+}
+*/
+
+// ============================================================ //
+
+}
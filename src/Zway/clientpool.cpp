@@ -0,0 +1,122 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/clientpool.h"
+
+namespace Zway {
+
+// ============================================================ //
+// ClientPool
+// ============================================================ //
+
+//! Create and start a pool
+/*!
+ *  Without numLoops there is one I/O loop per core. Returns
+ *  nullptr if the threads could not be started.
+ */
+
+CLIENT_POOL ClientPool::create(uint32_t numLoops, uint32_t numEventWorkers, uint32_t numConnectors)
+{
+    CLIENT_POOL pool(new ClientPool(numLoops, numEventWorkers, numConnectors));
+
+    if (!pool->run()) {
+
+        return nullptr;
+    }
+
+    return pool;
+}
+
+// ============================================================ //
+
+ClientPool::ClientPool(uint32_t numLoops, uint32_t numEventWorkers, uint32_t numConnectors)
+    : m_reactor(numLoops),
+      m_dispatchPool(numEventWorkers),
+      m_connector(numConnectors ? numConnectors : 1),
+      m_running(false)
+{
+
+}
+
+// ============================================================ //
+
+ClientPool::~ClientPool()
+{
+    if (m_running) {
+
+        m_reactor.cancelAndJoin();
+
+        m_timer.cancelAndJoin();
+
+        m_dispatchPool.cancelAndJoin();
+    }
+}
+
+// ============================================================ //
+
+Reactor &ClientPool::reactor()
+{
+    return m_reactor;
+}
+
+// ============================================================ //
+
+DispatchPool &ClientPool::dispatchPool()
+{
+    return m_dispatchPool;
+}
+
+// ============================================================ //
+
+Timer &ClientPool::timer()
+{
+    return m_timer;
+}
+
+// ============================================================ //
+
+//! Threads which connect the pool's clients
+/*!
+ *  Connecting blocks until the handshake is done or times out
+ */
+
+ThreadPool &ClientPool::connector()
+{
+    return m_connector;
+}
+
+// ============================================================ //
+
+bool ClientPool::run()
+{
+    m_running = true;
+
+    return m_reactor.run() && m_timer.run() && m_dispatchPool.run();
+}
+
+// ============================================================ //
+
+}
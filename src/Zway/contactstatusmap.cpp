@@ -0,0 +1,457 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/contactstatusmap.h"
+
+#include <algorithm>
+
+namespace Zway {
+
+// ============================================================ //
+// ContactStatusMap::Table
+// ============================================================ //
+
+ContactStatusMap::Table::Table(uint32_t size)
+    : m_mask(0),
+      m_size(0)
+{
+    // keep the load at or below one half
+
+    uint32_t capacity = 16;
+
+    while (capacity < size * 2) {
+
+        capacity *= 2;
+    }
+
+    m_slots.resize(capacity, Entry{0, 0});
+
+    m_mask = capacity - 1;
+}
+
+// ============================================================ //
+
+uint32_t ContactStatusMap::Table::get(uint32_t contactId, uint32_t def) const
+{
+    const Entry &entry = m_slots[slot(contactId)];
+
+    return entry.contactId == contactId && contactId ? entry.status : def;
+}
+
+// ============================================================ //
+
+bool ContactStatusMap::Table::contains(uint32_t contactId) const
+{
+    return contactId && m_slots[slot(contactId)].contactId == contactId;
+}
+
+// ============================================================ //
+
+uint32_t ContactStatusMap::Table::size() const
+{
+    return m_size;
+}
+
+// ============================================================ //
+
+ContactStatusMap::ENTRY_LIST ContactStatusMap::Table::entries() const
+{
+    ENTRY_LIST res;
+
+    res.reserve(m_size);
+
+    for (auto &entry : m_slots) {
+
+        if (entry.contactId) {
+
+            res.push_back(entry);
+        }
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+void ContactStatusMap::Table::set(uint32_t contactId, uint32_t status)
+{
+    if (!contactId) {
+
+        return;
+    }
+
+    Entry &entry = m_slots[slot(contactId)];
+
+    if (!entry.contactId) {
+
+        entry.contactId = contactId;
+
+        m_size++;
+    }
+
+    entry.status = status;
+}
+
+// ============================================================ //
+
+//! Slot holding contactId, or the free slot it would go to
+
+uint32_t ContactStatusMap::Table::slot(uint32_t contactId) const
+{
+    uint32_t i = (contactId * 2654435761u) & m_mask;
+
+    while (m_slots[i].contactId && m_slots[i].contactId != contactId) {
+
+        i = (i + 1) & m_mask;
+    }
+
+    return i;
+}
+
+// ============================================================ //
+// ContactStatusMap
+// ============================================================ //
+
+ContactStatusMap::ContactStatusMap()
+    : m_table(std::make_shared<Table>()),
+      m_epoch(0),
+      m_version(0)
+{
+
+}
+
+// ============================================================ //
+
+ContactStatusMap::Snapshot ContactStatusMap::snapshot() const
+{
+    return std::atomic_load(&m_table);
+}
+
+// ============================================================ //
+
+uint32_t ContactStatusMap::get(uint32_t contactId) const
+{
+    return snapshot()->get(contactId);
+}
+
+// ============================================================ //
+
+//! Apply changes which do not belong to a versioned status set
+
+void ContactStatusMap::apply(const ENTRY_LIST &changes)
+{
+    MutexLocker locker(m_writeMutex);
+
+    publish(m_table.get(), changes);
+}
+
+// ============================================================ //
+
+void ContactStatusMap::applyFull(uint32_t epoch, uint32_t version, const ENTRY_LIST &entries)
+{
+    MutexLocker locker(m_writeMutex);
+
+    publish(nullptr, entries);
+
+    m_epoch = epoch;
+
+    m_version = version;
+}
+
+// ============================================================ //
+
+//! Apply a diff from version base to version
+/*!
+ *  Returns false if the diff does not follow the version we have,
+ *  in which case the full set has to be requested again
+ */
+
+bool ContactStatusMap::applyDelta(uint32_t epoch, uint32_t base, uint32_t version, const ENTRY_LIST &changes)
+{
+    MutexLocker locker(m_writeMutex);
+
+    if (epoch != m_epoch || base != m_version) {
+
+        return false;
+    }
+
+    publish(m_table.get(), changes);
+
+    m_version = version;
+
+    return true;
+}
+
+// ============================================================ //
+
+uint32_t ContactStatusMap::epoch()
+{
+    MutexLocker locker(m_writeMutex);
+
+    return m_epoch;
+}
+
+// ============================================================ //
+
+uint32_t ContactStatusMap::version()
+{
+    MutexLocker locker(m_writeMutex);
+
+    return m_version;
+}
+
+// ============================================================ //
+
+void ContactStatusMap::clear()
+{
+    MutexLocker locker(m_writeMutex);
+
+    publish(nullptr, ENTRY_LIST());
+
+    m_epoch = 0;
+
+    m_version = 0;
+}
+
+// ============================================================ //
+
+//! Copy base with changes applied into a new table and publish it, m_writeMutex must be locked
+
+void ContactStatusMap::publish(const Table *base, const ENTRY_LIST &changes)
+{
+    auto table = std::make_shared<Table>((base ? base->size() : 0) + changes.size());
+
+    if (base) {
+
+        for (auto &entry : base->m_slots) {
+
+            if (entry.contactId) {
+
+                table->set(entry.contactId, entry.status);
+            }
+        }
+    }
+
+    for (auto &entry : changes) {
+
+        table->set(entry.contactId, entry.status);
+    }
+
+    std::atomic_store(&m_table, std::shared_ptr<const Table>(table));
+}
+
+// ============================================================ //
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t val)
+{
+    while (val >= 0x80) {
+
+        out.push_back((uint8_t)(val | 0x80));
+
+        val >>= 7;
+    }
+
+    out.push_back((uint8_t)val);
+}
+
+// ============================================================ //
+
+static bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &val)
+{
+    val = 0;
+
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+
+        if (p == end) {
+
+            return false;
+        }
+
+        uint8_t b = *p++;
+
+        val |= (uint32_t)(b & 0x7f) << shift;
+
+        if (!(b & 0x80)) {
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+//! Pack entries as varints: count, then id delta and status per entry
+/*!
+ *  Entries are sorted by contact id first, so the deltas stay small
+ */
+
+BUFFER ContactStatusMap::pack(const ENTRY_LIST &entries)
+{
+    ENTRY_LIST sorted = entries;
+
+    std::sort(sorted.begin(), sorted.end(), [] (const Entry &a, const Entry &b) {
+        return a.contactId < b.contactId;
+    });
+
+    std::vector<uint8_t> out;
+
+    out.reserve(sorted.size() * 3 + 5);
+
+    putVarint(out, sorted.size());
+
+    uint32_t prev = 0;
+
+    for (auto &entry : sorted) {
+
+        putVarint(out, entry.contactId - prev);
+
+        putVarint(out, entry.status);
+
+        prev = entry.contactId;
+    }
+
+    return Buffer::create(out.data(), out.size());
+}
+
+// ============================================================ //
+
+bool ContactStatusMap::unpack(const BUFFER &buffer, ENTRY_LIST &entries)
+{
+    if (!buffer) {
+
+        return false;
+    }
+
+    const uint8_t *p = buffer->data();
+
+    const uint8_t *end = p + buffer->size();
+
+    uint32_t count;
+
+    // every entry takes at least two bytes
+
+    if (!getVarint(p, end, count) || count > (uint32_t)(end - p) / 2) {
+
+        return false;
+    }
+
+    entries.clear();
+
+    entries.reserve(count);
+
+    uint32_t id = 0;
+
+    for (uint32_t i=0; i<count; ++i) {
+
+        uint32_t delta, status;
+
+        if (!getVarint(p, end, delta) || !getVarint(p, end, status)) {
+
+            return false;
+        }
+
+        id += delta;
+
+        entries.push_back(Entry{id, status});
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+BUFFER ContactStatusMap::packIds(const std::vector<uint32_t> &ids)
+{
+    std::vector<uint32_t> sorted = ids;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<uint8_t> out;
+
+    out.reserve(sorted.size() * 2 + 5);
+
+    putVarint(out, sorted.size());
+
+    uint32_t prev = 0;
+
+    for (auto id : sorted) {
+
+        putVarint(out, id - prev);
+
+        prev = id;
+    }
+
+    return Buffer::create(out.data(), out.size());
+}
+
+// ============================================================ //
+
+bool ContactStatusMap::unpackIds(const BUFFER &buffer, std::vector<uint32_t> &ids)
+{
+    if (!buffer) {
+
+        return false;
+    }
+
+    const uint8_t *p = buffer->data();
+
+    const uint8_t *end = p + buffer->size();
+
+    uint32_t count;
+
+    if (!getVarint(p, end, count) || count > (uint32_t)(end - p)) {
+
+        return false;
+    }
+
+    ids.clear();
+
+    ids.reserve(count);
+
+    uint32_t id = 0;
+
+    for (uint32_t i=0; i<count; ++i) {
+
+        uint32_t delta;
+
+        if (!getVarint(p, end, delta)) {
+
+            return false;
+        }
+
+        id += delta;
+
+        ids.push_back(id);
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+}
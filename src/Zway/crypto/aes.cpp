@@ -26,6 +26,7 @@
 
 #include "Zway/crypto/aes.h"
 #include "Zway/crypto/secmem.h"
+#include "Zway/metrics.h"
 
 #include <string.h>
 #include <nettle/aes.h>
@@ -43,17 +44,12 @@ typedef struct CTR_CTX(aes_ctx, AES_BLOCK_SIZE) AES_CTR_CTX;
 
 AES::AES()
 {
-    /*
-    if (SecMem::getLockedSize()) {
+    m_ctx = SecMem::malloc(sizeof(AES_CTR_CTX));
+
+    if (!m_ctx) {
 
-        m_ctx = SecMem::malloc(sizeof(AES_CTR_CTX));
-    }
-    else {
-    */
         m_ctx = new uint8_t[sizeof(AES_CTR_CTX)];
-    /*
     }
-    */
 }
 
 // ============================================================ //
@@ -62,19 +58,12 @@ AES::~AES()
 {
     if (m_ctx) {
 
-        /*
-        if (SecMem::getLockedSize()) {
+        if (!SecMem::free(m_ctx)) {
 
-            SecMem::free(m_ctx);
-        }
-        else {
-        */
             memset(m_ctx, 0, sizeof(AES_CTR_CTX));
 
             delete[] m_ctx;
-        /*
         }
-        */
 
         m_ctx = 0;
     }
@@ -112,8 +101,41 @@ void AES::setCtr(BUFFER ctr)
 
 // ============================================================ //
 
+//! Set counter for a position in the stream
+/*!
+ * \param ctr           The counter at stream position zero
+ * \param offset        Stream position in bytes, a multiple of the block size
+ */
+
+void AES::setCtr(BUFFER ctr, uint64_t offset)
+{
+    if (ctr) {
+
+        CTR_SET_COUNTER((AES_CTR_CTX*)m_ctx, ctr->data());
+
+        // the counter is a big endian integer advancing once per block
+
+        uint8_t* p = ((AES_CTR_CTX*)m_ctx)->ctr;
+
+        uint64_t carry = offset / AES_BLOCK_SIZE;
+
+        for (int32_t i = AES_BLOCK_SIZE - 1; i >= 0 && carry; --i) {
+
+            carry += p[i];
+
+            p[i] = carry & 0xff;
+
+            carry >>= 8;
+        }
+    }
+}
+
+// ============================================================ //
+
 void AES::encrypt(void *src, void *dst, uint32_t size)
 {
+    Metrics::Scope scope(Metrics::CryptoAes);
+
     /*
     cbc_encrypt(
             &m_ctx,
@@ -168,6 +190,8 @@ void AES::encrypt(BUFFER src, BUFFER dst, uint32_t size)
 
 void AES::decrypt(void *src, void *dst, uint32_t size)
 {
+    Metrics::Scope scope(Metrics::CryptoAes);
+
     /*
     cbc_decrypt(
             &m_ctx,
@@ -0,0 +1,254 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/blake2b.h"
+
+#include <cstring>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+static const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t SIGMA[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+// ============================================================ //
+
+static inline uint64_t rotr(uint64_t x, uint32_t n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+// ============================================================ //
+
+static inline uint64_t load64(const uint8_t *p)
+{
+    return (uint64_t)p[0]         | ((uint64_t)p[1] << 8)  |
+           ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+           ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+// ============================================================ //
+
+#define G(a, b, c, d, x, y)             \
+    v[a] = v[a] + v[b] + (x);           \
+    v[d] = rotr(v[d] ^ v[a], 32);       \
+    v[c] = v[c] + v[d];                 \
+    v[b] = rotr(v[b] ^ v[c], 24);       \
+    v[a] = v[a] + v[b] + (y);           \
+    v[d] = rotr(v[d] ^ v[a], 16);       \
+    v[c] = v[c] + v[d];                 \
+    v[b] = rotr(v[b] ^ v[c], 63);
+
+// ============================================================ //
+// Blake2b
+// ============================================================ //
+
+void Blake2b::init(size_t digestSize)
+{
+    if (!digestSize || digestSize > MAX_DIGEST_SIZE) {
+
+        digestSize = MAX_DIGEST_SIZE;
+    }
+
+    memcpy(m_h, IV, sizeof(IV));
+
+    // parameter block: digest size, no key, fanout and depth 1
+
+    m_h[0] ^= 0x01010000 ^ digestSize;
+
+    m_t[0] = 0;
+
+    m_t[1] = 0;
+
+    m_index = 0;
+
+    m_digestSize = digestSize;
+}
+
+// ============================================================ //
+
+void Blake2b::update(const uint8_t *data, size_t size)
+{
+    // the last block is compressed differently, so a full block
+    // is only compressed once more data follows
+
+    while (size) {
+
+        if (m_index == BLOCK_SIZE) {
+
+            addCounter(BLOCK_SIZE);
+
+            compress(m_block, false);
+
+            m_index = 0;
+        }
+
+        if (!m_index) {
+
+            while (size > BLOCK_SIZE) {
+
+                addCounter(BLOCK_SIZE);
+
+                compress(data, false);
+
+                data += BLOCK_SIZE;
+
+                size -= BLOCK_SIZE;
+            }
+        }
+
+        size_t len = BLOCK_SIZE - m_index;
+
+        if (len > size) {
+
+            len = size;
+        }
+
+        memcpy(m_block + m_index, data, len);
+
+        m_index += len;
+
+        data += len;
+
+        size -= len;
+    }
+}
+
+// ============================================================ //
+
+//! Write the digest and start over
+/*!
+ *  Writes the first size bytes of the digest
+ */
+
+void Blake2b::digest(uint8_t *digest, size_t size)
+{
+    addCounter(m_index);
+
+    memset(m_block + m_index, 0, BLOCK_SIZE - m_index);
+
+    compress(m_block, true);
+
+    if (size > m_digestSize) {
+
+        size = m_digestSize;
+    }
+
+    for (size_t i=0; i<size; ++i) {
+
+        digest[i] = m_h[i >> 3] >> (8 * (i & 7));
+    }
+
+    init(m_digestSize);
+}
+
+// ============================================================ //
+
+void Blake2b::compress(const uint8_t *block, bool last)
+{
+    uint64_t v[16];
+
+    uint64_t m[16];
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        v[i] = m_h[i];
+
+        v[i + 8] = IV[i];
+    }
+
+    v[12] ^= m_t[0];
+
+    v[13] ^= m_t[1];
+
+    if (last) {
+
+        v[14] = ~v[14];
+    }
+
+    for (uint32_t i=0; i<16; ++i) {
+
+        m[i] = load64(block + i * 8);
+    }
+
+    for (uint32_t r=0; r<12; ++r) {
+
+        const uint8_t *s = SIGMA[r];
+
+        G(0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+        G(1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+        G(2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+        G(3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+        G(0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+        G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        G(2, 7,  8, 13, m[s[12]], m[s[13]]);
+        G(3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        m_h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+// ============================================================ //
+
+void Blake2b::addCounter(uint64_t size)
+{
+    m_t[0] += size;
+
+    if (m_t[0] < size) {
+
+        m_t[1]++;
+    }
+}
+
+// ============================================================ //
+
+}
+
+}
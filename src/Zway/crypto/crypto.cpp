@@ -1,95 +1,225 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#include "Zway/crypto/crypto.h"
-
-namespace Zway { namespace Crypto {
-
-// ============================================================ //
-
-bool setup()
-{
-    if (!Random::setup()) {
-
-        return false;
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-void cleanup()
-{
-
-}
-
-// ============================================================ //
-
-uint32_t mkId()
-{
-	uint32_t id;
-
-    Random::random((uint8_t*)&id, sizeof(id));
-
-	return id;
-}
-
-// ============================================================ //
-
-std::string hexStr(uint8_t* data, uint32_t size)
-{
-    std::string r;
-
-    r.resize(size*2);
-
-    for (uint32_t i=0; i<size; ++i) {
-
-        sprintf(&r[i*2], "%.2x", data[i]);
-    }
-
-    return r;
-}
-
-// ============================================================ //
-
-std::string hexStr(BUFFER data)
-{
-    std::string r;
-
-    if (data) {
-
-        r = hexStr(data->data(), data->size());
-    }
-
-    return r;
-}
-
-// ============================================================ //
-
-}
-
-}
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/crypto.h"
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+bool setup()
+{
+    if (!Random::setup()) {
+
+        return false;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void cleanup()
+{
+
+}
+
+// ============================================================ //
+
+uint32_t mkId()
+{
+	uint32_t id;
+
+    Random::random((uint8_t*)&id, sizeof(id));
+
+	return id;
+}
+
+// ============================================================ //
+
+//! Lower case hex digits of every byte value
+/*!
+ *  Two characters per byte, so encoding is one lookup per byte
+ */
+
+static const char hexDigits[] =
+        "000102030405060708090a0b0c0d0e0f"
+        "101112131415161718191a1b1c1d1e1f"
+        "202122232425262728292a2b2c2d2e2f"
+        "303132333435363738393a3b3c3d3e3f"
+        "404142434445464748494a4b4c4d4e4f"
+        "505152535455565758595a5b5c5d5e5f"
+        "606162636465666768696a6b6c6d6e6f"
+        "707172737475767778797a7b7c7d7e7f"
+        "808182838485868788898a8b8c8d8e8f"
+        "909192939495969798999a9b9c9d9e9f"
+        "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+        "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+        "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+        "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+        "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+        "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+//! Nibble value of every character, 0xff if not a hex digit
+
+static const uint8_t hexValues[256] = {
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0x0a,0x0b,0x0c,0x0d,0x0e,0x0f,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+    0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff
+};
+
+// ============================================================ //
+
+void hexEncode(const uint8_t *data, uint32_t size, char *str)
+{
+    for (uint32_t i=0; i<size; ++i) {
+
+        const char *digits = &hexDigits[data[i] * 2];
+
+        str[i*2] = digits[0];
+
+        str[i*2+1] = digits[1];
+    }
+}
+
+// ============================================================ //
+
+//! Decode size*2 hex digits into size bytes
+/*!
+ *  Accepts upper and lower case, fails on any other character
+ */
+
+bool hexDecode(const char *str, uint32_t size, uint8_t *data)
+{
+    uint8_t invalid = 0;
+
+    for (uint32_t i=0; i<size; ++i) {
+
+        uint8_t hi = hexValues[(uint8_t)str[i*2]];
+
+        uint8_t lo = hexValues[(uint8_t)str[i*2+1]];
+
+        invalid |= (hi | lo) & 0xf0;
+
+        data[i] = (hi << 4) | (lo & 0x0f);
+    }
+
+    return !invalid;
+}
+
+// ============================================================ //
+
+std::string hexStr(uint8_t* data, uint32_t size)
+{
+    std::string r;
+
+    r.resize(size*2);
+
+    hexEncode(data, size, &r[0]);
+
+    return r;
+}
+
+// ============================================================ //
+
+std::string hexStr(BUFFER data)
+{
+    std::string r;
+
+    if (data) {
+
+        r = hexStr(data->data(), data->size());
+    }
+
+    return r;
+}
+
+// ============================================================ //
+
+//! Decode a hex string
+/*!
+ *  An odd number of digits is read as if it had a leading zero,
+ *  like numbers written by mpz_get_str
+ */
+
+BUFFER fromHexStr(const std::string &str)
+{
+    uint32_t len = str.size();
+
+    // ignore a terminating null
+
+    while (len && !str[len-1]) {
+
+        len--;
+    }
+
+    uint32_t odd = len % 2;
+
+    BUFFER res = Buffer::create(nullptr, len / 2 + odd);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    if (odd) {
+
+        uint8_t lo = hexValues[(uint8_t)str[0]];
+
+        if (lo & 0xf0) {
+
+            return BUFFER();
+        }
+
+        res->data()[0] = lo;
+    }
+
+    if (!hexDecode(&str[odd], len / 2, res->data() + odd)) {
+
+        return BUFFER();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+}
+
+}
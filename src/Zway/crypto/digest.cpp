@@ -27,6 +27,9 @@
 #include "Zway/crypto/crypto.h"
 #include "Zway/crypto/digest.h"
 #include "Zway/crypto/secmem.h"
+#include "Zway/crypto/sha256.h"
+#include "Zway/crypto/blake2b.h"
+#include "Zway/metrics.h"
 
 #include <string.h>
 #include <nettle/md5.h>
@@ -38,32 +41,16 @@ namespace Zway { namespace Crypto {
 
 Digest::Digest(DigestType type)
     : m_type(type),
+      m_hardware(type == DIGEST_SHA256 && Sha256::backend() != Sha256::NettleBackend),
       m_ctx(0)
 {
-    uint32_t ctxSize = 0;
+    uint32_t size = ctxSize(type, m_hardware);
 
-    switch (type) {
-
-        case DIGEST_MD5:
-
-            ctxSize = sizeof(md5_ctx);
+    m_ctx = SecMem::malloc(size);
 
-            break;
+    if (!m_ctx) {
 
-        case DIGEST_SHA256:
-
-            ctxSize = sizeof(sha256_ctx);
-
-            break;
-    }
-
-    if (SecMem::getLockedSize()) {
-
-        m_ctx = SecMem::malloc(ctxSize);
-    }
-    else {
-
-        m_ctx = new uint8_t[ctxSize];
+        m_ctx = new uint8_t[size];
     }
 
     if (m_ctx) {
@@ -78,7 +65,20 @@ Digest::Digest(DigestType type)
 
             case DIGEST_SHA256:
 
-                sha256_init((sha256_ctx*)m_ctx);
+                if (m_hardware) {
+
+                    ((Sha256*)m_ctx)->init();
+                }
+                else {
+
+                    sha256_init((sha256_ctx*)m_ctx);
+                }
+
+                break;
+
+            case DIGEST_BLAKE2B:
+
+                ((Blake2b*)m_ctx)->init(DIGEST_BLAKE2B_SIZE);
 
                 break;
         }
@@ -91,26 +91,9 @@ Digest::~Digest()
 {
     if (m_ctx) {
 
-        if (SecMem::getLockedSize()) {
-
-            SecMem::free(m_ctx);
-        }
-        else {
-
-            switch (m_type) {
-
-                case DIGEST_MD5:
+        if (!SecMem::free(m_ctx)) {
 
-                    memset(m_ctx, 0, sizeof(md5_ctx));
-
-                    break;
-
-                case DIGEST_SHA256:
-
-                    memset(m_ctx, 0, sizeof(sha256_ctx));
-
-                    break;
-            }
+            memset(m_ctx, 0, ctxSize(m_type, m_hardware));
 
             delete[] m_ctx;
         }
@@ -121,6 +104,8 @@ Digest::~Digest()
 
 void Digest::update(uint8_t* data, uint32_t size)
 {
+    Metrics::Scope scope(Metrics::CryptoDigest);
+
     if (m_ctx) {
 
         switch (m_type) {
@@ -133,7 +118,20 @@ void Digest::update(uint8_t* data, uint32_t size)
 
             case DIGEST_SHA256:
 
-                sha256_update((sha256_ctx*)m_ctx, size, data);
+                if (m_hardware) {
+
+                    ((Sha256*)m_ctx)->update(data, size);
+                }
+                else {
+
+                    sha256_update((sha256_ctx*)m_ctx, size, data);
+                }
+
+                break;
+
+            case DIGEST_BLAKE2B:
+
+                ((Blake2b*)m_ctx)->update(data, size);
 
                 break;
         }
@@ -156,7 +154,20 @@ void Digest::result(uint8_t* digest, uint32_t size)
 
             case DIGEST_SHA256:
 
-                sha256_digest((sha256_ctx*)m_ctx, size, digest);
+                if (m_hardware) {
+
+                    ((Sha256*)m_ctx)->digest(digest, size);
+                }
+                else {
+
+                    sha256_digest((sha256_ctx*)m_ctx, size, digest);
+                }
+
+                break;
+
+            case DIGEST_BLAKE2B:
+
+                ((Blake2b*)m_ctx)->digest(digest, size);
 
                 break;
         }
@@ -243,6 +254,32 @@ uint32_t Digest::size(Digest::DigestType type)
         case DIGEST_SHA256:
 
             return DIGEST_SHA256_SIZE;
+
+        case DIGEST_BLAKE2B:
+
+            return DIGEST_BLAKE2B_SIZE;
+    }
+
+    return 0;
+}
+
+// ============================================================ //
+
+uint32_t Digest::ctxSize(DigestType type, bool hardware)
+{
+    switch (type) {
+
+        case DIGEST_MD5:
+
+            return sizeof(md5_ctx);
+
+        case DIGEST_SHA256:
+
+            return hardware ? sizeof(Sha256) : sizeof(sha256_ctx);
+
+        case DIGEST_BLAKE2B:
+
+            return sizeof(Blake2b);
     }
 
     return 0;
@@ -0,0 +1,353 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/ec.h"
+#include "Zway/crypto/digest.h"
+#include "Zway/crypto/random.h"
+
+#include <nettle/curve25519.h>
+#include <nettle/eddsa.h>
+#include <nettle/gcm.h>
+#include <nettle/memops.h>
+
+#include <cstring>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+// EC
+// ============================================================ //
+
+bool EC::createKeyPair(
+        UBJ::Value &publicKeyObj,
+        UBJ::Value &privateKeyObj)
+{
+    BUFFER x = Buffer::create(nullptr, KEY_SIZE);
+
+    BUFFER e = Buffer::create(nullptr, KEY_SIZE);
+
+    BUFFER xPub = Buffer::create(nullptr, KEY_SIZE);
+
+    BUFFER ePub = Buffer::create(nullptr, KEY_SIZE);
+
+    if (!x || !e || !xPub || !ePub) {
+
+        return false;
+    }
+
+    if (!Random::random(x->data(), x->size(), Random::Strong) ||
+        !Random::random(e->data(), e->size(), Random::Strong)) {
+
+        return false;
+    }
+
+    curve25519_mul_g(xPub->data(), x->data());
+
+    ed25519_sha512_public_key(ePub->data(), e->data());
+
+    UBJ::Object publicKey;
+
+    publicKey["x"] = xPub;
+
+    publicKey["e"] = ePub;
+
+    UBJ::Object privateKey;
+
+    privateKey["x"] = x;
+
+    privateKey["e"] = e;
+
+    publicKeyObj = publicKey;
+
+    privateKeyObj = privateKey;
+
+    return true;
+}
+
+// ============================================================ //
+
+bool EC::isValidPublicKey(const UBJ::Value &publicKeyObj)
+{
+    return publicKeyObj.hasField("x") &&
+           publicKeyObj.hasField("e") &&
+           publicKeyObj["x"].size() == KEY_SIZE &&
+           publicKeyObj["e"].size() == KEY_SIZE;
+}
+
+// ============================================================ //
+
+bool EC::isTagged(BUFFER buf)
+{
+    return buf && buf->size() && buf->data()[0] == TAG;
+}
+
+// ============================================================ //
+
+//! Encrypt a buffer for the owner of a public key
+/*!
+ *  Output is TAG, the ephemeral X25519 key, the ciphertext
+ *  and the GCM digest. Meant for small buffers like message
+ *  keys.
+ */
+
+BUFFER EC::encrypt(
+        UBJ::Value &publicKeyObj,
+        BUFFER buf)
+{
+    if (!buf || !isValidPublicKey(publicKeyObj)) {
+
+        return BUFFER();
+    }
+
+    BUFFER publicKey = publicKeyObj["x"].buffer();
+
+    uint8_t ephemeral[KEY_SIZE];
+
+    uint8_t ephemeralPub[KEY_SIZE];
+
+    uint8_t shared[KEY_SIZE];
+
+    if (!Random::random(ephemeral, KEY_SIZE, Random::Strong)) {
+
+        return BUFFER();
+    }
+
+    curve25519_mul_g(ephemeralPub, ephemeral);
+
+    curve25519_mul(shared, ephemeral, publicKey->data());
+
+    memset(ephemeral, 0, KEY_SIZE);
+
+    BUFFER key = wrapKey(shared, ephemeralPub, publicKey->data());
+
+    memset(shared, 0, KEY_SIZE);
+
+    if (!key) {
+
+        return BUFFER();
+    }
+
+    BUFFER res = Buffer::create(nullptr, 1 + KEY_SIZE + buf->size() + DIGEST_SIZE);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    uint8_t *p = res->data();
+
+    *p++ = TAG;
+
+    memcpy(p, ephemeralPub, KEY_SIZE);
+
+    p += KEY_SIZE;
+
+    uint8_t iv[GCM_IV_SIZE] = {0};
+
+    struct gcm_aes256_ctx ctx;
+
+    gcm_aes256_set_key(&ctx, key->data());
+
+    gcm_aes256_set_iv(&ctx, GCM_IV_SIZE, iv);
+
+    gcm_aes256_encrypt(&ctx, buf->size(), p, buf->data());
+
+    gcm_aes256_digest(&ctx, DIGEST_SIZE, p + buf->size());
+
+    memset(&ctx, 0, sizeof(ctx));
+
+    return res;
+}
+
+// ============================================================ //
+
+BUFFER EC::decrypt(
+        UBJ::Value &privateKeyObj,
+        BUFFER buf)
+{
+    if (!isTagged(buf) || buf->size() < 1 + KEY_SIZE + DIGEST_SIZE) {
+
+        return BUFFER();
+    }
+
+    if (!privateKeyObj.hasField("x") || privateKeyObj["x"].size() != KEY_SIZE) {
+
+        return BUFFER();
+    }
+
+    BUFFER privateKey = privateKeyObj["x"].buffer();
+
+    uint8_t *ephemeralPub = buf->data() + 1;
+
+    uint8_t *ciphertext = ephemeralPub + KEY_SIZE;
+
+    uint32_t size = buf->size() - 1 - KEY_SIZE - DIGEST_SIZE;
+
+    uint8_t publicKey[KEY_SIZE];
+
+    uint8_t shared[KEY_SIZE];
+
+    curve25519_mul_g(publicKey, privateKey->data());
+
+    curve25519_mul(shared, privateKey->data(), ephemeralPub);
+
+    BUFFER key = wrapKey(shared, ephemeralPub, publicKey);
+
+    memset(shared, 0, KEY_SIZE);
+
+    if (!key) {
+
+        return BUFFER();
+    }
+
+    BUFFER res = Buffer::create(nullptr, size);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    uint8_t iv[GCM_IV_SIZE] = {0};
+
+    uint8_t digest[DIGEST_SIZE];
+
+    struct gcm_aes256_ctx ctx;
+
+    gcm_aes256_set_key(&ctx, key->data());
+
+    gcm_aes256_set_iv(&ctx, GCM_IV_SIZE, iv);
+
+    gcm_aes256_decrypt(&ctx, size, res->data(), ciphertext);
+
+    gcm_aes256_digest(&ctx, DIGEST_SIZE, digest);
+
+    memset(&ctx, 0, sizeof(ctx));
+
+    if (!memeql_sec(digest, ciphertext + size, DIGEST_SIZE)) {
+
+        return BUFFER();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+BUFFER EC::sign(
+        UBJ::Value &privateKeyObj,
+        BUFFER buf)
+{
+    if (!buf || !privateKeyObj.hasField("e") || privateKeyObj["e"].size() != KEY_SIZE) {
+
+        return BUFFER();
+    }
+
+    BUFFER privateKey = privateKeyObj["e"].buffer();
+
+    uint8_t publicKey[KEY_SIZE];
+
+    ed25519_sha512_public_key(publicKey, privateKey->data());
+
+    BUFFER res = Buffer::create(nullptr, 1 + SIGNATURE_SIZE);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    res->data()[0] = TAG;
+
+    ed25519_sha512_sign(publicKey, privateKey->data(), buf->size(), buf->data(), res->data() + 1);
+
+    return res;
+}
+
+// ============================================================ //
+
+bool EC::verify(
+        UBJ::Value &publicKeyObj,
+        BUFFER buf,
+        BUFFER sign)
+{
+    if (!buf || !isTagged(sign) || sign->size() != 1 + SIGNATURE_SIZE) {
+
+        return false;
+    }
+
+    if (!isValidPublicKey(publicKeyObj)) {
+
+        return false;
+    }
+
+    BUFFER publicKey = publicKeyObj["e"].buffer();
+
+    return ed25519_sha512_verify(publicKey->data(), buf->size(), buf->data(), sign->data() + 1) == 1;
+}
+
+// ============================================================ //
+
+//! Derive the AES key for a wrapped buffer
+/*!
+ *  SHA-256 over the shared secret and both public keys, so
+ *  the key is bound to this exchange.
+ */
+
+BUFFER EC::wrapKey(uint8_t *shared, uint8_t *ephemeral, uint8_t *publicKey)
+{
+    uint8_t zero[KEY_SIZE] = {0};
+
+    if (memeql_sec(shared, zero, KEY_SIZE)) {
+
+        // low order point
+
+        return BUFFER();
+    }
+
+    Digest digest(Digest::DIGEST_SHA256);
+
+    digest.update(shared, KEY_SIZE);
+
+    digest.update(ephemeral, KEY_SIZE);
+
+    digest.update(publicKey, KEY_SIZE);
+
+    BUFFER res = Buffer::create(nullptr, Digest::DIGEST_SHA256_SIZE);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    digest.result(res->data(), res->size());
+
+    return res;
+}
+
+// ============================================================ //
+
+}
+
+}
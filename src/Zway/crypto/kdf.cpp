@@ -0,0 +1,857 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/kdf.h"
+#include "Zway/crypto/blake2b.h"
+#include "Zway/crypto/random.h"
+#include "Zway/thread.h"
+
+#include <nettle/pbkdf2.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+// Argon2id (RFC 9106)
+// ============================================================ //
+
+namespace {
+
+struct Block
+{
+    uint64_t v[128];
+};
+
+}
+
+enum {
+    ARGON2_VERSION = 0x13,
+    ARGON2_TYPE_ID = 2,
+    ARGON2_BLOCK_SIZE = 1024,
+    ARGON2_SYNC_POINTS = 4,
+    ARGON2_ADDRESSES_IN_BLOCK = 128,
+    ARGON2_MAX_MEMORY = 1 << 22,
+    ARGON2_MAX_LANES = 16
+};
+
+// ============================================================ //
+
+static inline void store32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// ============================================================ //
+
+static inline void update32(Blake2b &b, uint32_t v)
+{
+    uint8_t buf[4];
+
+    store32(buf, v);
+
+    b.update(buf, 4);
+}
+
+// ============================================================ //
+
+static inline uint64_t rotr64(uint64_t x, uint32_t n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+// ============================================================ //
+
+static inline uint64_t blaMka(uint64_t x, uint64_t y)
+{
+    return x + y + 2 * ((x & 0xFFFFFFFF) * (y & 0xFFFFFFFF));
+}
+
+// ============================================================ //
+
+static inline void mix(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d)
+{
+    a = blaMka(a, b); d = rotr64(d ^ a, 32);
+    c = blaMka(c, d); b = rotr64(b ^ c, 24);
+    a = blaMka(a, b); d = rotr64(d ^ a, 16);
+    c = blaMka(c, d); b = rotr64(b ^ c, 63);
+}
+
+// ============================================================ //
+
+static inline void permute(
+        uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3,
+        uint64_t &v4, uint64_t &v5, uint64_t &v6, uint64_t &v7,
+        uint64_t &v8, uint64_t &v9, uint64_t &v10, uint64_t &v11,
+        uint64_t &v12, uint64_t &v13, uint64_t &v14, uint64_t &v15)
+{
+    mix(v0, v4, v8, v12);
+    mix(v1, v5, v9, v13);
+    mix(v2, v6, v10, v14);
+    mix(v3, v7, v11, v15);
+    mix(v0, v5, v10, v15);
+    mix(v1, v6, v11, v12);
+    mix(v2, v7, v8, v13);
+    mix(v3, v4, v9, v14);
+}
+
+// ============================================================ //
+
+//! Compression function G
+/*!
+ *  With xorInto the result is xored into out, as required for
+ *  all passes after the first.
+ */
+
+static void compress(const Block &x, const Block &y, Block &out, bool xorInto)
+{
+    Block r;
+    Block z;
+
+    for (uint32_t i=0; i<128; ++i) {
+
+        r.v[i] = x.v[i] ^ y.v[i];
+    }
+
+    z = r;
+
+    // rows
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        uint64_t *v = &z.v[16 * i];
+
+        permute(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+                v[8], v[9], v[10], v[11], v[12], v[13], v[14], v[15]);
+    }
+
+    // columns
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        uint64_t *v = &z.v[2 * i];
+
+        permute(v[0], v[1], v[16], v[17], v[32], v[33], v[48], v[49],
+                v[64], v[65], v[80], v[81], v[96], v[97], v[112], v[113]);
+    }
+
+    if (xorInto) {
+
+        for (uint32_t i=0; i<128; ++i) {
+
+            out.v[i] ^= z.v[i] ^ r.v[i];
+        }
+    }
+    else {
+
+        for (uint32_t i=0; i<128; ++i) {
+
+            out.v[i] = z.v[i] ^ r.v[i];
+        }
+    }
+}
+
+// ============================================================ //
+
+//! Variable length hash H'
+/*!
+ *  Chains 64 byte BLAKE2b outputs for sizes above 64 bytes
+ */
+
+static void hashLong(uint8_t *out, size_t outSize, const uint8_t *in, size_t inSize)
+{
+    Blake2b b;
+
+    if (outSize <= Blake2b::MAX_DIGEST_SIZE) {
+
+        b.init(outSize);
+
+        update32(b, outSize);
+
+        b.update(in, inSize);
+
+        b.digest(out, outSize);
+
+        return;
+    }
+
+    uint8_t v[Blake2b::MAX_DIGEST_SIZE];
+
+    b.init(Blake2b::MAX_DIGEST_SIZE);
+
+    update32(b, outSize);
+
+    b.update(in, inSize);
+
+    b.digest(v, sizeof(v));
+
+    while (true) {
+
+        memcpy(out, v, 32);
+
+        out += 32;
+
+        outSize -= 32;
+
+        if (outSize <= Blake2b::MAX_DIGEST_SIZE) {
+
+            break;
+        }
+
+        b.init(Blake2b::MAX_DIGEST_SIZE);
+
+        b.update(v, sizeof(v));
+
+        b.digest(v, sizeof(v));
+    }
+
+    b.init(outSize);
+
+    b.update(v, sizeof(v));
+
+    b.digest(out, outSize);
+
+    memset(v, 0, sizeof(v));
+}
+
+// ============================================================ //
+
+static void loadBlock(Block &block, const uint8_t *in)
+{
+    for (uint32_t i=0; i<128; ++i) {
+
+        uint64_t w = 0;
+
+        for (uint32_t j=0; j<8; ++j) {
+
+            w |= (uint64_t)in[i * 8 + j] << (8 * j);
+        }
+
+        block.v[i] = w;
+    }
+}
+
+// ============================================================ //
+
+static void storeBlock(uint8_t *out, const Block &block)
+{
+    for (uint32_t i=0; i<128; ++i) {
+
+        for (uint32_t j=0; j<8; ++j) {
+
+            out[i * 8 + j] = block.v[i] >> (8 * j);
+        }
+    }
+}
+
+// ============================================================ //
+
+namespace {
+
+struct Instance
+{
+    std::vector<Block> memory;
+
+    uint32_t passes;
+
+    uint32_t lanes;
+
+    uint32_t laneLength;
+
+    uint32_t segmentLength;
+};
+
+}
+
+// ============================================================ //
+
+static uint32_t referenceIndex(
+        const Instance &inst,
+        uint32_t pass,
+        uint32_t slice,
+        uint32_t index,
+        bool sameLane,
+        uint32_t pseudoRand)
+{
+    uint32_t area;
+
+    if (pass == 0) {
+
+        if (slice == 0) {
+
+            area = index - 1;
+        }
+        else
+        if (sameLane) {
+
+            area = slice * inst.segmentLength + index - 1;
+        }
+        else {
+
+            area = slice * inst.segmentLength - (index == 0 ? 1 : 0);
+        }
+    }
+    else {
+
+        if (sameLane) {
+
+            area = inst.laneLength - inst.segmentLength + index - 1;
+        }
+        else {
+
+            area = inst.laneLength - inst.segmentLength - (index == 0 ? 1 : 0);
+        }
+    }
+
+    uint64_t rel = pseudoRand;
+
+    rel = (rel * rel) >> 32;
+
+    rel = area - 1 - ((area * rel) >> 32);
+
+    uint32_t start = 0;
+
+    if (pass != 0 && slice != ARGON2_SYNC_POINTS - 1) {
+
+        start = (slice + 1) * inst.segmentLength;
+    }
+
+    return (start + rel) % inst.laneLength;
+}
+
+// ============================================================ //
+
+static void fillSegment(Instance &inst, uint32_t pass, uint32_t lane, uint32_t slice)
+{
+    // argon2id takes data independent addresses in the first half
+    // of the first pass and data dependent ones after that
+
+    bool independent = pass == 0 && slice < ARGON2_SYNC_POINTS / 2;
+
+    Block zero;
+    Block input;
+    Block addresses;
+
+    auto nextAddresses = [&] () {
+
+        Block tmp;
+
+        input.v[6]++;
+
+        compress(zero, input, tmp, false);
+
+        compress(zero, tmp, addresses, false);
+    };
+
+    if (independent) {
+
+        memset(&zero, 0, sizeof(zero));
+
+        memset(&input, 0, sizeof(input));
+
+        input.v[0] = pass;
+        input.v[1] = lane;
+        input.v[2] = slice;
+        input.v[3] = inst.memory.size();
+        input.v[4] = inst.passes;
+        input.v[5] = ARGON2_TYPE_ID;
+    }
+
+    uint32_t start = 0;
+
+    if (pass == 0 && slice == 0) {
+
+        // the first two blocks of each lane are filled from H0
+
+        start = 2;
+
+        if (independent) {
+
+            nextAddresses();
+        }
+    }
+
+    uint32_t curr = lane * inst.laneLength + slice * inst.segmentLength + start;
+
+    uint32_t prev = (curr % inst.laneLength == 0) ? curr + inst.laneLength - 1 : curr - 1;
+
+    for (uint32_t i=start; i<inst.segmentLength; ++i, ++curr, ++prev) {
+
+        if (curr % inst.laneLength == 1) {
+
+            prev = curr - 1;
+        }
+
+        uint64_t pseudoRand;
+
+        if (independent) {
+
+            if (i % ARGON2_ADDRESSES_IN_BLOCK == 0) {
+
+                nextAddresses();
+            }
+
+            pseudoRand = addresses.v[i % ARGON2_ADDRESSES_IN_BLOCK];
+        }
+        else {
+
+            pseudoRand = inst.memory[prev].v[0];
+        }
+
+        uint32_t refLane = (pseudoRand >> 32) % inst.lanes;
+
+        if (pass == 0 && slice == 0) {
+
+            refLane = lane;
+        }
+
+        uint32_t refIndex = referenceIndex(inst, pass, slice, i, refLane == lane, (uint32_t)pseudoRand);
+
+        const Block &ref = inst.memory[refLane * inst.laneLength + refIndex];
+
+        compress(inst.memory[prev], ref, inst.memory[curr], pass != 0);
+    }
+}
+
+// ============================================================ //
+
+static uint32_t defaultLanes()
+{
+    return std::min<uint32_t>(4, std::max<uint32_t>(1, ThreadPool::instance().numThreads()));
+}
+
+// ============================================================ //
+// Kdf
+// ============================================================ //
+
+//! Parameters of storages created before the kdf block existed
+/*!
+ *  PBKDF2-SHA256, 10000 iterations and an all zero salt
+ */
+
+UBJ::Object Kdf::legacyParams()
+{
+    return UBJ_OBJ(
+            "alg"  << Pbkdf2Sha256 <<
+            "iter" << LEGACY_ITERATIONS <<
+            "salt" << Buffer::create(nullptr, SALT_SIZE));
+}
+
+// ============================================================ //
+
+//! Pick parameters for a target derivation time
+/*!
+ *  PBKDF2 scales the iteration count from a short run. Argon2id
+ *  keeps the given memory (halving it while a single pass is
+ *  already too slow) and scales the number of passes, with one
+ *  lane per pool thread up to four.
+ *
+ *  The measured cost is cached per process, every call returns
+ *  a fresh random salt.
+ */
+
+UBJ::Object Kdf::calibrate(Algorithm algorithm, uint32_t targetMs, uint32_t memory)
+{
+    typedef std::tuple<int, uint32_t, uint32_t> CacheKey;
+
+    static std::mutex mutex;
+
+    static std::map<CacheKey, UBJ::Object> cache;
+
+    UBJ::Object params;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = cache.find(CacheKey(algorithm, targetMs, memory));
+
+        if (it != cache.end()) {
+
+            params = it->second;
+        }
+    }
+
+    if (!params.numValues()) {
+
+        if (algorithm == Argon2id) {
+
+            uint32_t lanes = defaultLanes();
+
+            uint32_t mem = std::max<uint32_t>(memory, 8 * lanes);
+
+            double ms = measure(Argon2id, 1, mem);
+
+            while (ms > targetMs && mem / 2 >= std::max<uint32_t>(MIN_MEMORY, 8 * lanes)) {
+
+                mem /= 2;
+
+                ms = measure(Argon2id, 1, mem);
+            }
+
+            uint32_t iter = ms > 0 ? (uint32_t)(targetMs / ms) : 1;
+
+            params = UBJ_OBJ(
+                    "alg"   << Argon2id <<
+                    "iter"  << std::max<uint32_t>(1, iter) <<
+                    "mem"   << mem <<
+                    "lanes" << lanes);
+        }
+        else {
+
+            // double the probe until it is long enough to time
+
+            uint32_t probe = 1000;
+
+            double ms = measure(Pbkdf2Sha256, probe, 0);
+
+            while (ms < 20 && probe < (1 << 24)) {
+
+                probe *= 2;
+
+                ms = measure(Pbkdf2Sha256, probe, 0);
+            }
+
+            double iter = ms > 0 ? probe * (targetMs / ms) : (double)LEGACY_ITERATIONS;
+
+            if (iter > 0x7FFFFFFF) {
+
+                iter = 0x7FFFFFFF;
+            }
+
+            params = UBJ_OBJ(
+                    "alg"  << Pbkdf2Sha256 <<
+                    "iter" << std::max<uint32_t>(LEGACY_ITERATIONS, (uint32_t)iter));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        cache[CacheKey(algorithm, targetMs, memory)] = params;
+    }
+
+    BUFFER salt = Buffer::create(nullptr, SALT_SIZE);
+
+    if (!Random::random(salt->data(), salt->size(), Random::VeryStrong)) {
+
+        return UBJ::Object();
+    }
+
+    params["salt"] = salt;
+
+    return params;
+}
+
+// ============================================================ //
+
+//! Check parameters read from a storage
+/*!
+ *  Also rejects costs no device could meet, so a damaged root
+ *  node fails to open instead of exhausting memory.
+ */
+
+bool Kdf::isValid(const UBJ::Object &params)
+{
+    BUFFER salt = params["salt"].buffer();
+
+    int32_t iter = params["iter"].toInt();
+
+    if (!salt || salt->size() < 8 || iter < 1) {
+
+        return false;
+    }
+
+    switch (params["alg"].toInt()) {
+
+        case Pbkdf2Sha256:
+
+            return true;
+
+        case Argon2id: {
+
+            int32_t mem = params["mem"].toInt();
+
+            int32_t lanes = params["lanes"].toInt();
+
+            return lanes >= 1 && lanes <= ARGON2_MAX_LANES &&
+                   mem >= 8 * lanes && mem <= ARGON2_MAX_MEMORY;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+BUFFER Kdf::derive(const std::string &password, const UBJ::Object &params, uint32_t size)
+{
+    if (!isValid(params)) {
+
+        return nullptr;
+    }
+
+    BUFFER salt = params["salt"].buffer();
+
+    BUFFER res = Buffer::create(nullptr, size);
+
+    bool ok = false;
+
+    switch (params["alg"].toInt()) {
+
+        case Pbkdf2Sha256:
+
+            ok = pbkdf2Sha256(
+                    (const uint8_t*)password.data(), password.size(),
+                    salt->data(), salt->size(),
+                    params["iter"].toInt(),
+                    res->data(), res->size());
+
+            break;
+
+        case Argon2id:
+
+            ok = argon2id(
+                    (const uint8_t*)password.data(), password.size(),
+                    salt->data(), salt->size(),
+                    params["iter"].toInt(),
+                    params["mem"].toInt(),
+                    params["lanes"].toInt(),
+                    res->data(), res->size());
+
+            break;
+    }
+
+    return ok ? res : nullptr;
+}
+
+// ============================================================ //
+
+bool Kdf::pbkdf2Sha256(
+        const uint8_t *password, size_t passwordSize,
+        const uint8_t *salt, size_t saltSize,
+        uint32_t iterations,
+        uint8_t *out, size_t outSize)
+{
+    if (!iterations || !outSize) {
+
+        return false;
+    }
+
+    pbkdf2_hmac_sha256(passwordSize, password, iterations, saltSize, salt, outSize, out);
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Argon2id
+/*!
+ *  Memory is given in KiB, i.e. 1 KiB blocks. Lanes are filled
+ *  on the shared thread pool, one slice at a time.
+ */
+
+bool Kdf::argon2id(
+        const uint8_t *password, size_t passwordSize,
+        const uint8_t *salt, size_t saltSize,
+        uint32_t iterations,
+        uint32_t memory,
+        uint32_t lanes,
+        uint8_t *out, size_t outSize,
+        const uint8_t *secret, size_t secretSize,
+        const uint8_t *data, size_t dataSize)
+{
+    if (!iterations || !lanes || lanes > ARGON2_MAX_LANES ||
+        memory < 8 * lanes || memory > ARGON2_MAX_MEMORY ||
+        outSize < 4 || saltSize < 8) {
+
+        return false;
+    }
+
+    Instance inst;
+
+    inst.passes = iterations;
+
+    inst.lanes = lanes;
+
+    inst.segmentLength = memory / (lanes * ARGON2_SYNC_POINTS);
+
+    inst.laneLength = inst.segmentLength * ARGON2_SYNC_POINTS;
+
+    inst.memory.resize(inst.laneLength * lanes);
+
+    // H0
+
+    uint8_t h0[Blake2b::MAX_DIGEST_SIZE + 8];
+
+    Blake2b b;
+
+    b.init(Blake2b::MAX_DIGEST_SIZE);
+
+    update32(b, lanes);
+    update32(b, outSize);
+    update32(b, memory);
+    update32(b, iterations);
+    update32(b, ARGON2_VERSION);
+    update32(b, ARGON2_TYPE_ID);
+
+    update32(b, passwordSize);
+    b.update(password, passwordSize);
+
+    update32(b, saltSize);
+    b.update(salt, saltSize);
+
+    update32(b, secretSize);
+    b.update(secret, secretSize);
+
+    update32(b, dataSize);
+    b.update(data, dataSize);
+
+    b.digest(h0, Blake2b::MAX_DIGEST_SIZE);
+
+    // first two blocks of each lane
+
+    uint8_t bytes[ARGON2_BLOCK_SIZE];
+
+    for (uint32_t lane=0; lane<lanes; ++lane) {
+
+        for (uint32_t i=0; i<2; ++i) {
+
+            store32(h0 + Blake2b::MAX_DIGEST_SIZE, i);
+
+            store32(h0 + Blake2b::MAX_DIGEST_SIZE + 4, lane);
+
+            hashLong(bytes, sizeof(bytes), h0, sizeof(h0));
+
+            loadBlock(inst.memory[lane * inst.laneLength + i], bytes);
+        }
+    }
+
+    // fill memory, lanes of a slice are independent of each other
+
+    ThreadPool &pool = ThreadPool::instance();
+
+    bool parallel = lanes > 1 && pool.numThreads() > 1;
+
+    for (uint32_t pass=0; pass<iterations; ++pass) {
+
+        for (uint32_t slice=0; slice<ARGON2_SYNC_POINTS; ++slice) {
+
+            if (parallel) {
+
+                std::vector<std::future<void>> futures;
+
+                for (uint32_t lane=1; lane<lanes; ++lane) {
+
+                    futures.push_back(pool.submit([&inst, pass, lane, slice] () {
+
+                        fillSegment(inst, pass, lane, slice);
+                    }));
+                }
+
+                fillSegment(inst, pass, 0, slice);
+
+                for (auto &future : futures) {
+
+                    future.get();
+                }
+            }
+            else {
+
+                for (uint32_t lane=0; lane<lanes; ++lane) {
+
+                    fillSegment(inst, pass, lane, slice);
+                }
+            }
+        }
+    }
+
+    // xor the last block of each lane and hash it
+
+    Block tag = inst.memory[inst.laneLength - 1];
+
+    for (uint32_t lane=1; lane<lanes; ++lane) {
+
+        const Block &last = inst.memory[lane * inst.laneLength + inst.laneLength - 1];
+
+        for (uint32_t i=0; i<128; ++i) {
+
+            tag.v[i] ^= last.v[i];
+        }
+    }
+
+    storeBlock(bytes, tag);
+
+    hashLong(out, outSize, bytes, sizeof(bytes));
+
+    // wipe
+
+    memset(bytes, 0, sizeof(bytes));
+
+    memset(h0, 0, sizeof(h0));
+
+    memset(&tag, 0, sizeof(tag));
+
+    memset(inst.memory.data(), 0, inst.memory.size() * sizeof(Block));
+
+    return true;
+}
+
+// ============================================================ //
+
+double Kdf::measure(Algorithm algorithm, uint32_t iterations, uint32_t memory)
+{
+    const std::string password = "calibrate";
+
+    uint8_t salt[SALT_SIZE] = {0};
+
+    uint8_t key[KEY_SIZE];
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (algorithm == Argon2id) {
+
+        argon2id((const uint8_t*)password.data(), password.size(), salt, sizeof(salt), iterations, memory, defaultLanes(), key, sizeof(key));
+    }
+    else {
+
+        pbkdf2Sha256((const uint8_t*)password.data(), password.size(), salt, sizeof(salt), iterations, key, sizeof(key));
+    }
+
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ============================================================ //
+
+}
+
+}
@@ -0,0 +1,230 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/key.h"
+#include "Zway/crypto/ec.h"
+#include "Zway/crypto/rsa.h"
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+// Key
+// ============================================================ //
+
+bool Key::createKeyPair(
+        UBJ::Value &publicKeyObj,
+        UBJ::Value &privateKeyObj,
+        uint32_t bits)
+{
+    if (!RSA::createKeyPair(publicKeyObj, privateKeyObj, bits)) {
+
+        return false;
+    }
+
+    return addECKeyPair(publicKeyObj, privateKeyObj);
+}
+
+// ============================================================ //
+
+//! Add EC keys next to an existing RSA key pair
+/*!
+ *  Does nothing if the key pair has them already. Only for
+ *  new key pairs, contacts verify signatures against the copy
+ *  of the public key they received.
+ */
+
+bool Key::addECKeyPair(
+        UBJ::Value &publicKeyObj,
+        UBJ::Value &privateKeyObj)
+{
+    if (privateKeyObj.hasField("ec")) {
+
+        return true;
+    }
+
+    UBJ::Value publicKey;
+
+    UBJ::Value privateKey;
+
+    if (!EC::createKeyPair(publicKey, privateKey)) {
+
+        return false;
+    }
+
+    publicKeyObj["ec"] = publicKey;
+
+    privateKeyObj["ec"] = privateKey;
+
+    return true;
+}
+
+// ============================================================ //
+
+Key::Type Key::negotiate(
+        const UBJ::Value &ownPublicKeyObj,
+        const UBJ::Value &contactPublicKeyObj)
+{
+    if (ownPublicKeyObj.hasField("ec") &&
+        contactPublicKeyObj.hasField("ec") &&
+        EC::isValidPublicKey(ownPublicKeyObj["ec"]) &&
+        EC::isValidPublicKey(contactPublicKeyObj["ec"])) {
+
+        return ECType;
+    }
+
+    return RSAType;
+}
+
+// ============================================================ //
+
+BUFFER Key::encrypt(
+        UBJ::Value &publicKeyObj,
+        BUFFER buf,
+        Type type)
+{
+    if (type == ECType) {
+
+        return EC::encrypt(publicKeyObj["ec"], buf);
+    }
+
+    return RSA::encrypt(publicKeyObj, buf);
+}
+
+// ============================================================ //
+
+//! Encrypt one buffer for several recipients
+/*!
+ *  The key type is negotiated per recipient against our own
+ *  public key. EC wraps are cheap and done in place, the RSA
+ *  ones go through the parallel RSA batch.
+ *
+ * \param ownPublicKeyObj   Our public key
+ * \param publicKeyObjs     Public keys by recipient id
+ * \param buf               Input buffer
+ * \param res               Map to receive the encrypted buffers
+ */
+
+bool Key::encrypt(
+        UBJ::Value &ownPublicKeyObj,
+        std::map<uint32_t, UBJ::Value> &publicKeyObjs,
+        BUFFER buf,
+        std::map<uint32_t, BUFFER> &res)
+{
+    std::map<uint32_t, UBJ::Value> rsaKeys;
+
+    std::map<uint32_t, BUFFER> keys;
+
+    for (auto &it : publicKeyObjs) {
+
+        if (negotiate(ownPublicKeyObj, it.second) == ECType) {
+
+            BUFFER key = EC::encrypt(it.second["ec"], buf);
+
+            if (!key) {
+
+                return false;
+            }
+
+            keys[it.first] = key;
+        }
+        else {
+
+            rsaKeys[it.first] = it.second;
+        }
+    }
+
+    if (!RSA::encrypt(rsaKeys, buf, keys)) {
+
+        return false;
+    }
+
+    for (auto &it : keys) {
+
+        res[it.first] = it.second;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+BUFFER Key::decrypt(
+        UBJ::Value &privateKeyObj,
+        BUFFER buf)
+{
+    if (EC::isTagged(buf)) {
+
+        if (!privateKeyObj.hasField("ec")) {
+
+            return BUFFER();
+        }
+
+        return EC::decrypt(privateKeyObj["ec"], buf);
+    }
+
+    return RSA::decrypt(privateKeyObj, buf);
+}
+
+// ============================================================ //
+
+BUFFER Key::sign(
+        UBJ::Value &privateKeyObj,
+        BUFFER buf,
+        Type type)
+{
+    if (type == ECType) {
+
+        return EC::sign(privateKeyObj["ec"], buf);
+    }
+
+    return RSA::sign(privateKeyObj, buf);
+}
+
+// ============================================================ //
+
+bool Key::verify(
+        UBJ::Value &publicKeyObj,
+        BUFFER buf,
+        BUFFER sign)
+{
+    if (EC::isTagged(sign)) {
+
+        if (!publicKeyObj.hasField("ec")) {
+
+            return false;
+        }
+
+        return EC::verify(publicKeyObj["ec"], buf, sign);
+    }
+
+    return RSA::verify(publicKeyObj, buf, sign);
+}
+
+// ============================================================ //
+
+}
+
+}
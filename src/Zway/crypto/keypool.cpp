@@ -0,0 +1,184 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/keypool.h"
+#include "Zway/crypto/key.h"
+#include "Zway/thread.h"
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+// KeyPool
+// ============================================================ //
+
+KeyPool &KeyPool::instance()
+{
+    static KeyPool pool;
+
+    return pool;
+}
+
+// ============================================================ //
+
+KeyPool::KeyPool()
+    : m_size(DEFAULT_SIZE),
+      m_filling(false)
+{
+
+}
+
+// ============================================================ //
+
+//! Get a key pair
+/*!
+ *  The callback is invoked right away with a pregenerated pair
+ *  or later from a pool thread once a new one is generated.
+ */
+
+void KeyPool::take(Callback callback)
+{
+    KeyPair pair;
+
+    bool ready = false;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (!m_pairs.empty()) {
+
+            pair = m_pairs.front();
+
+            m_pairs.pop_front();
+
+            ready = true;
+        }
+    }
+
+    if (ready) {
+
+        callback(true, pair.publicKey, pair.privateKey);
+
+        fill();
+
+        return;
+    }
+
+    ThreadPool::instance().post([this, callback] () {
+
+        KeyPair pair;
+
+        bool res = Key::createKeyPair(pair.publicKey, pair.privateKey, KEY_BITS);
+
+        callback(res, pair.publicKey, pair.privateKey);
+
+        fill();
+    });
+}
+
+// ============================================================ //
+
+//! Refill the pool in the background
+/*!
+ *  Does nothing if the pool is full or a refill is running.
+ */
+
+void KeyPool::fill()
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_filling || m_pairs.size() >= m_size) {
+
+            return;
+        }
+
+        m_filling = true;
+    }
+
+    ThreadPool::instance().post([this] () {
+
+        refill();
+    });
+}
+
+// ============================================================ //
+
+void KeyPool::setSize(uint32_t size)
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        m_size = size;
+
+        while (m_pairs.size() > m_size) {
+
+            m_pairs.pop_back();
+        }
+    }
+
+    fill();
+}
+
+// ============================================================ //
+
+uint32_t KeyPool::available()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_pairs.size();
+}
+
+// ============================================================ //
+
+void KeyPool::refill()
+{
+    for (;;) {
+
+        KeyPair pair;
+
+        bool res = Key::createKeyPair(pair.publicKey, pair.privateKey, KEY_BITS);
+
+        MutexLocker locker(m_mutex);
+
+        if (res && m_pairs.size() < m_size) {
+
+            m_pairs.push_back(pair);
+        }
+
+        if (!res || m_pairs.size() >= m_size) {
+
+            m_filling = false;
+
+            return;
+        }
+    }
+}
+
+// ============================================================ //
+
+}
+
+}
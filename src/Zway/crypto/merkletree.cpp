@@ -0,0 +1,270 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/merkletree.h"
+#include "Zway/crypto/digest.h"
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+// MerkleTree
+// ============================================================ //
+
+MerkleTree::MerkleTree()
+{
+
+}
+
+// ============================================================ //
+
+//! Build tree
+/*!
+ * \param leaves        Leaf hashes, HASH_SIZE bytes each
+ */
+
+bool MerkleTree::build(BUFFER leaves)
+{
+    m_levels.clear();
+
+    if (!leaves || !leaves->size() || leaves->size() % HASH_SIZE) {
+
+        return false;
+    }
+
+    m_levels.push_back(leaves);
+
+    while (m_levels.back()->size() > HASH_SIZE) {
+
+        BUFFER level = m_levels.back();
+
+        uint32_t n = level->size() / HASH_SIZE;
+
+        BUFFER parent = Buffer::create(nullptr, ((n + 1) / 2) * HASH_SIZE);
+
+        if (!parent) {
+
+            return false;
+        }
+
+        for (uint32_t i=0; i<n; i+=2) {
+
+            uint8_t* dst = parent->data() + (i / 2) * HASH_SIZE;
+
+            if (i + 1 < n) {
+
+                node(level->data() + i * HASH_SIZE, level->data() + (i + 1) * HASH_SIZE, dst);
+            }
+            else {
+
+                level->read(dst, HASH_SIZE, i * HASH_SIZE);
+            }
+        }
+
+        m_levels.push_back(parent);
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+uint32_t MerkleTree::numLeaves()
+{
+    if (m_levels.empty()) {
+
+        return 0;
+    }
+
+    return m_levels.front()->size() / HASH_SIZE;
+}
+
+// ============================================================ //
+
+BUFFER MerkleTree::leaves()
+{
+    if (m_levels.empty()) {
+
+        return nullptr;
+    }
+
+    return m_levels.front()->copy();
+}
+
+// ============================================================ //
+
+BUFFER MerkleTree::root()
+{
+    if (m_levels.empty()) {
+
+        return nullptr;
+    }
+
+    return m_levels.back()->copy();
+}
+
+// ============================================================ //
+
+//! Get proof for a leaf
+/*!
+ *  Sibling hashes from the leaf level upwards, levels where
+ *  the node is promoted have no sibling
+ */
+
+BUFFER MerkleTree::proof(uint32_t index)
+{
+    if (index >= numLeaves()) {
+
+        return nullptr;
+    }
+
+    std::vector<uint8_t> res;
+
+    for (uint32_t l=0; l+1<m_levels.size(); ++l) {
+
+        uint32_t n = m_levels[l]->size() / HASH_SIZE;
+
+        uint32_t sibling = index ^ 1;
+
+        if (sibling < n) {
+
+            uint8_t* p = m_levels[l]->data() + sibling * HASH_SIZE;
+
+            res.insert(res.end(), p, p + HASH_SIZE);
+        }
+
+        index /= 2;
+    }
+
+    if (res.empty()) {
+
+        // single leaf, the leaf is the root
+
+        return Buffer::create(nullptr, 0);
+    }
+
+    return Buffer::create(res.data(), res.size());
+}
+
+// ============================================================ //
+
+BUFFER MerkleTree::leaf(uint8_t *data, uint32_t size)
+{
+    BUFFER res = Buffer::create(nullptr, HASH_SIZE);
+
+    if (!res) {
+
+        return nullptr;
+    }
+
+    uint8_t prefix = 0;
+
+    Digest sha2(Digest::DIGEST_SHA256);
+
+    sha2.update(&prefix, 1);
+
+    sha2.update(data, size);
+
+    sha2.result(res->data(), res->size());
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Compute root from a leaf and its proof
+/*!
+ *  The leaf is valid if the result equals the signed root
+ */
+
+BUFFER MerkleTree::root(BUFFER leaf, uint32_t index, uint32_t numLeaves, BUFFER proof)
+{
+    if (!leaf || leaf->size() != HASH_SIZE || index >= numLeaves) {
+
+        return nullptr;
+    }
+
+    BUFFER res = leaf->copy();
+
+    uint32_t offset = 0;
+
+    for (uint32_t n = numLeaves; n > 1; n = (n + 1) / 2) {
+
+        uint32_t sibling = index ^ 1;
+
+        if (sibling < n) {
+
+            if (!proof || offset + HASH_SIZE > proof->size()) {
+
+                return nullptr;
+            }
+
+            uint8_t* p = proof->data() + offset;
+
+            if (index & 1) {
+
+                node(p, res->data(), res->data());
+            }
+            else {
+
+                node(res->data(), p, res->data());
+            }
+
+            offset += HASH_SIZE;
+        }
+
+        index /= 2;
+    }
+
+    if (proof && offset != proof->size()) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+void MerkleTree::node(uint8_t *left, uint8_t *right, uint8_t *dst)
+{
+    uint8_t prefix = 1;
+
+    Digest sha2(Digest::DIGEST_SHA256);
+
+    sha2.update(&prefix, 1);
+
+    sha2.update(left, HASH_SIZE);
+
+    sha2.update(right, HASH_SIZE);
+
+    sha2.result(dst, HASH_SIZE);
+}
+
+// ============================================================ //
+
+}
+
+}
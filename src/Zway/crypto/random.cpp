@@ -26,24 +26,102 @@
 
 #include "Zway/crypto/random.h"
 
-#include <nettle/yarrow.h>
+#include <nettle/chacha.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
 #include <stdio.h>
 
+#if defined __gnu_linux__ || defined __MAC_10_6 || defined ANDROID
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined __linux__
+#include <sys/syscall.h>
+#endif
+
 namespace Zway { namespace Crypto {
 
-struct yarrow256_ctx yarrow;
+// ============================================================ //
+
+//! Per thread ChaCha20 generator
+/*!
+ *  Keystream is generated in blocks of BUFFER_SIZE bytes. The
+ *  first bytes of each block become the next key, served bytes
+ *  are wiped, so earlier output can not be recovered from the
+ *  state. The key is replaced from the kernel every
+ *  RESEED_INTERVAL bytes and after a fork.
+ */
+
+static const uint32_t BUFFER_SIZE = 512;
+
+static const uint64_t RESEED_INTERVAL = 1 << 20;
+
+struct Generator
+{
+    uint8_t key[CHACHA_KEY_SIZE];
+
+    uint8_t buf[BUFFER_SIZE];
+
+    uint32_t pos;
+
+    uint64_t output;
+
+    uint32_t forks;
+
+    bool seeded;
+};
+
+static thread_local Generator generator;
+
+static std::atomic<uint32_t> forks(0);
+
+static std::once_flag forkHandlerFlag;
 
 // ============================================================ //
 
-bool Random::setup()
+static void onFork()
+{
+    forks++;
+}
+
+// ============================================================ //
+
+static bool kernelRandom(uint8_t *data, size_t size)
 {
-    // init yarrow256
+#if defined __linux__ && defined SYS_getrandom
+
+    while (size) {
+
+        long res = syscall(SYS_getrandom, data, size, 0);
+
+        if (res < 0) {
+
+            if (errno == EINTR) {
+
+                continue;
+            }
+
+            // kernel without getrandom, use the device below
+
+            break;
+        }
+
+        data += res;
+
+        size -= res;
+    }
 
-    yarrow256_init(&yarrow, 0, NULL);
+    if (!size) {
 
-    // seed yarrow256
+        return true;
+    }
 
-    uint8_t seed[YARROW256_SEED_FILE_SIZE];
+#endif
 
 #if defined __gnu_linux__ || defined __MAC_10_6 || defined ANDROID
 
@@ -54,70 +132,130 @@ bool Random::setup()
         return false;
     }
 
-    fread(seed, sizeof(seed), 1, pf);
+    size_t res = fread(data, size, 1, pf);
 
     fclose(pf);
 
+    return res == 1;
+
+#else
+
+    return false;
+
 #endif
+}
+
+// ============================================================ //
 
-    yarrow256_seed(&yarrow, sizeof(seed), seed);
+static bool seed(Generator &gen)
+{
+#if defined __gnu_linux__ || defined __MAC_10_6 || defined ANDROID
 
-    if (!yarrow256_is_seeded(&yarrow)) {
+    std::call_once(forkHandlerFlag, [] () {
+        pthread_atfork(nullptr, nullptr, onFork);
+    });
+
+#endif
+
+    uint8_t key[CHACHA_KEY_SIZE];
+
+    if (!kernelRandom(key, sizeof(key))) {
 
         return false;
     }
 
+    for (uint32_t i=0; i<CHACHA_KEY_SIZE; ++i) {
+
+        gen.key[i] ^= key[i];
+    }
+
+    memset(key, 0, sizeof(key));
+
+    gen.pos = BUFFER_SIZE;
+
+    gen.output = 0;
+
+    gen.forks = forks;
+
+    gen.seeded = true;
+
     return true;
 }
 
 // ============================================================ //
 
-bool Random::random(uint8_t *data, uint32_t size, RandomLevel level)
+static void refill(Generator &gen)
 {
-    if (level == Weak) {
+    uint8_t nonce[CHACHA_NONCE_SIZE] = {0};
 
-#if defined __gnu_linux__ || defined __MAC_10_6 || defined ANDROID
+    struct chacha_ctx ctx;
 
-        FILE* pf = fopen("/dev/urandom", "rb");
+    chacha_set_key(&ctx, gen.key);
 
-        if (!pf) {
+    chacha_set_nonce(&ctx, nonce);
 
-            return false;
-        }
+    memset(gen.buf, 0, BUFFER_SIZE);
 
-        fread(data, size, 1, pf);
+    chacha_crypt(&ctx, BUFFER_SIZE, gen.buf, gen.buf);
 
-        fclose(pf);
-#endif
+    memset(&ctx, 0, sizeof(ctx));
 
-    }
-    else
-    if (level == Strong) {
+    // fast key erasure
 
-#if defined __gnu_linux__ || defined __MAC_10_6 || defined ANDROID
+    memcpy(gen.key, gen.buf, CHACHA_KEY_SIZE);
 
-        FILE* pf = fopen("/dev/urandom", "rb");
+    memset(gen.buf, 0, CHACHA_KEY_SIZE);
 
-        if (!pf) {
+    gen.pos = CHACHA_KEY_SIZE;
+}
 
-            return false;
-        }
+// ============================================================ //
 
-        fread(data, size, 1, pf);
+bool Random::setup()
+{
+    return seed(generator);
+}
 
-        fclose(pf);
-#endif
+// ============================================================ //
 
-    }
-    else
-    if (level == VeryStrong) {
+//! Fill a buffer with random bytes
+/*!
+ *  All levels are served from the calling thread's generator,
+ *  which only goes to the kernel to reseed.
+ */
+
+bool Random::random(uint8_t *data, uint32_t size, RandomLevel /*level*/)
+{
+    Generator &gen = generator;
+
+    if (!gen.seeded || gen.output >= RESEED_INTERVAL || gen.forks != forks.load(std::memory_order_relaxed)) {
 
-        if (!yarrow256_is_seeded(&yarrow)) {
+        if (!seed(gen)) {
 
             return false;
         }
+    }
+
+    gen.output += size;
+
+    while (size) {
+
+        if (gen.pos == BUFFER_SIZE) {
+
+            refill(gen);
+        }
 
-        yarrow256_random(&yarrow, size, data);
+        uint32_t len = std::min(size, BUFFER_SIZE - gen.pos);
+
+        memcpy(data, gen.buf + gen.pos, len);
+
+        memset(gen.buf + gen.pos, 0, len);
+
+        gen.pos += len;
+
+        data += len;
+
+        size -= len;
     }
 
     return true;
@@ -125,9 +263,23 @@ bool Random::random(uint8_t *data, uint32_t size, RandomLevel level)
 
 // ============================================================ //
 
-void *Random::getYarrowCtx()
+//! Nettle random function on the calling thread's generator
+/*!
+ *  Lets the RSA operations run on several threads at once.
+ */
+
+void Random::nettleRandom(void* /*ctx*/, size_t size, uint8_t *data)
 {
-    return &yarrow;
+    while (size) {
+
+        uint32_t len = size > BUFFER_SIZE ? BUFFER_SIZE : size;
+
+        random(data, len, VeryStrong);
+
+        data += len;
+
+        size -= len;
+    }
 }
 
 // ============================================================ //
@@ -27,16 +27,24 @@
 #include "Zway/crypto/crypto.h"
 #include "Zway/crypto/random.h"
 #include "Zway/crypto/rsa.h"
+#include "Zway/metrics.h"
+#include "Zway/thread.h"
 
-#include <nettle/yarrow.h>
+#include <nettle/bignum.h>
 #include <nettle/rsa.h>
 
+#include <atomic>
+
 namespace Zway { namespace Crypto {
 
 // ============================================================ //
 // RSA
 // ============================================================ //
 
+static std::atomic<int> currentFormat(RSA::HexFormat);
+
+// ============================================================ //
+
 //! Create a key pair
 /*!
  *  Key size would be 1024 or 2048
@@ -51,7 +59,16 @@ void mpzFromHexStr(const std::string& str, mpz_t* z)
 {
     mpz_init(*z);
 
-    mpz_set_str(*z, str.c_str(), 16);
+    BUFFER buf = fromHexStr(str);
+
+    if (buf) {
+
+        nettle_mpz_set_str_256_u(*z, buf->size(), buf->data());
+    }
+    else {
+
+        mpz_set_str(*z, str.c_str(), 16);
+    }
 }
 
 // ============================================================ //
@@ -71,13 +88,107 @@ std::string mpzToHexStr(mpz_t z)
 
 // ============================================================ //
 
+//! Key number in the current format
+/*!
+ *  A hex string or a big endian binary buffer
+ */
+
+UBJ::Value mpzToUbj(mpz_t z)
+{
+    if (currentFormat == RSA::BinaryFormat) {
+
+        size_t len = nettle_mpz_sizeinbase_256_u(z);
+
+        BUFFER res = Buffer::create(nullptr, len);
+
+        nettle_mpz_get_str_256(len, res->data(), z);
+
+        return res;
+    }
+
+    return mpzToHexStr(z);
+}
+
+// ============================================================ //
+
+void mpzFromUbj(const UBJ::Value &val, mpz_t* z)
+{
+    if (val.type() == UBJ_STRING) {
+
+        mpzFromHexStr(val.toString(), z);
+    }
+    else {
+
+        mpz_init(*z);
+
+        nettle_mpz_set_str_256_u(*z, val.size(), val.data());
+    }
+}
+
+// ============================================================ //
+
+//! Ciphertext or signature in the current format
+/*!
+ *  The binary format is BINARY_TAG followed by the number in
+ *  big endian, padded to the key size. The tag is not a hex
+ *  digit, readers tell the formats apart by the first byte.
+ */
+
+BUFFER mpzToBuffer(mpz_t z, size_t size)
+{
+    if (currentFormat == RSA::BinaryFormat) {
+
+        BUFFER res = Buffer::create(nullptr, size + 1);
+
+        if (!res) {
+
+            return BUFFER();
+        }
+
+        res->data()[0] = RSA::BINARY_TAG;
+
+        nettle_mpz_get_str_256(size, res->data() + 1, z);
+
+        return res;
+    }
+
+    uint32_t len = mpz_sizeinbase(z, 16) + 1;
+
+    BUFFER res = Buffer::create(NULL, len);
+
+    if (!res) {
+
+        return BUFFER();
+    }
+
+    mpz_get_str((char*)res->data(), 16, z);
+
+    return res;
+}
+
+// ============================================================ //
+
+void mpzFromBuffer(BUFFER buf, mpz_t z)
+{
+    if (buf->size() && buf->data()[0] == RSA::BINARY_TAG) {
+
+        nettle_mpz_set_str_256_u(z, buf->size() - 1, buf->data() + 1);
+    }
+    else {
+
+        mpz_set_str(z, std::string((char*)buf->data(), buf->size()).c_str(), 16);
+    }
+}
+
+// ============================================================ //
+
 UBJ::Value publicKeyToUbj(struct rsa_public_key& publicKey)
 {
     UBJ::Object res;
 
-    res["e"] = mpzToHexStr(publicKey.e);
+    res["e"] = mpzToUbj(publicKey.e);
 
-    res["n"] = mpzToHexStr(publicKey.n);
+    res["n"] = mpzToUbj(publicKey.n);
 
     res["s"] = publicKey.size;
 
@@ -90,17 +201,17 @@ UBJ::Value privateKeyToUbj(struct rsa_private_key& privateKey)
 {
     UBJ::Object res;
 
-    res["a"] = mpzToHexStr(privateKey.a);
+    res["a"] = mpzToUbj(privateKey.a);
 
-    res["b"] = mpzToHexStr(privateKey.b);
+    res["b"] = mpzToUbj(privateKey.b);
 
-    res["c"] = mpzToHexStr(privateKey.c);
+    res["c"] = mpzToUbj(privateKey.c);
 
-    res["d"] = mpzToHexStr(privateKey.d);
+    res["d"] = mpzToUbj(privateKey.d);
 
-    res["p"] = mpzToHexStr(privateKey.p);
+    res["p"] = mpzToUbj(privateKey.p);
 
-    res["q"] = mpzToHexStr(privateKey.q);
+    res["q"] = mpzToUbj(privateKey.q);
 
     res["s"] = privateKey.size;
 
@@ -111,9 +222,9 @@ UBJ::Value privateKeyToUbj(struct rsa_private_key& privateKey)
 
 void ubjToPublicKey(UBJ::Value publicKeyObj, struct rsa_public_key& publicKey)
 {
-    mpzFromHexStr(publicKeyObj["e"].toString(), &publicKey.e);
+    mpzFromUbj(publicKeyObj["e"], &publicKey.e);
 
-    mpzFromHexStr(publicKeyObj["n"].toString(), &publicKey.n);
+    mpzFromUbj(publicKeyObj["n"], &publicKey.n);
 
     publicKey.size = publicKeyObj["s"].toInt();
 }
@@ -122,23 +233,43 @@ void ubjToPublicKey(UBJ::Value publicKeyObj, struct rsa_public_key& publicKey)
 
 void ubjToPrivateKey(UBJ::Value privateKeyObj, struct rsa_private_key& privateKey)
 {
-    mpzFromHexStr(privateKeyObj["a"].toString(), &privateKey.a);
+    mpzFromUbj(privateKeyObj["a"], &privateKey.a);
 
-    mpzFromHexStr(privateKeyObj["b"].toString(), &privateKey.b);
+    mpzFromUbj(privateKeyObj["b"], &privateKey.b);
 
-    mpzFromHexStr(privateKeyObj["c"].toString(), &privateKey.c);
+    mpzFromUbj(privateKeyObj["c"], &privateKey.c);
 
-    mpzFromHexStr(privateKeyObj["d"].toString(), &privateKey.d);
+    mpzFromUbj(privateKeyObj["d"], &privateKey.d);
 
-    mpzFromHexStr(privateKeyObj["p"].toString(), &privateKey.p);
+    mpzFromUbj(privateKeyObj["p"], &privateKey.p);
 
-    mpzFromHexStr(privateKeyObj["q"].toString(), &privateKey.q);
+    mpzFromUbj(privateKeyObj["q"], &privateKey.q);
 
     privateKey.size = privateKeyObj["s"].toInt();
 }
 
 // ============================================================ //
 
+//! Select the format of new keys, ciphertexts and signatures
+/*!
+ *  Hex by default. Both formats are always read, the binary
+ *  one halves the size but peers need to understand it.
+ */
+
+void RSA::setFormat(Format format)
+{
+    currentFormat = format;
+}
+
+// ============================================================ //
+
+RSA::Format RSA::format()
+{
+    return (Format)currentFormat.load();
+}
+
+// ============================================================ //
+
 bool RSA::createKeyPair(
         UBJ::Value& publicKeyObj,
         UBJ::Value& privateKeyObj,
@@ -155,8 +286,8 @@ bool RSA::createKeyPair(
     if (!rsa_generate_keypair(
             &publicKey,
             &privateKey,
-            Random::getYarrowCtx(),
-            (nettle_random_func*)yarrow256_random,
+            NULL,
+            (nettle_random_func*)Random::nettleRandom,
             NULL,
             NULL,
             bits,
@@ -199,36 +330,131 @@ BUFFER RSA::encrypt(
 
     ubjToPublicKey(publicKeyObj, publicKey);
 
+    BUFFER res = encrypt(publicKey, buf);
+
+    rsa_public_key_clear(&publicKey);
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Encrypt one buffer for several recipients
+/*!
+ *  Every public key is parsed once, the RSA operations are
+ *  spread across the shared thread pool. Fails if any of the
+ *  recipients fails.
+ *
+ * \param publicKeyObjs Public keys by recipient id
+ * \param buf           Input buffer
+ * \param res           Map to receive the encrypted buffers
+ */
+
+bool RSA::encrypt(
+        std::map<uint32_t, UBJ::Value> &publicKeyObjs,
+        BUFFER buf,
+        std::map<uint32_t, BUFFER> &res)
+{
+    if (publicKeyObjs.empty()) {
+
+        return true;
+    }
+
+    std::vector<uint32_t> ids;
+
+    std::vector<struct rsa_public_key> publicKeys(publicKeyObjs.size());
+
+    for (auto &it : publicKeyObjs) {
+
+        ubjToPublicKey(it.second, publicKeys[ids.size()]);
+
+        ids.push_back(it.first);
+    }
+
+    std::vector<BUFFER> results(ids.size());
+
+    std::vector<std::future<void>> futures;
+
+    // a single worker would only add hand-off cost
+
+    bool parallel = ThreadPool::instance().numThreads() > 1;
+
+    for (size_t i=1; i<ids.size(); ++i) {
+
+        if (!parallel) {
+
+            results[i] = encrypt(publicKeys[i], buf);
+
+            continue;
+        }
+
+        futures.push_back(ThreadPool::instance().submit([&publicKeys, &results, buf, i] () {
+
+            results[i] = encrypt(publicKeys[i], buf);
+        }));
+    }
+
+    results[0] = encrypt(publicKeys[0], buf);
+
+    for (auto &future : futures) {
+
+        future.wait();
+    }
+
+    bool success = true;
+
+    for (size_t i=0; i<ids.size(); ++i) {
+
+        rsa_public_key_clear(&publicKeys[i]);
+
+        if (!results[i]) {
+
+            success = false;
+        }
+    }
+
+    if (!success) {
+
+        return false;
+    }
+
+    for (size_t i=0; i<ids.size(); ++i) {
+
+        res[ids[i]] = results[i];
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+BUFFER RSA::encrypt(
+        struct rsa_public_key &publicKey,
+        BUFFER buf)
+{
+    Metrics::Scope scope(Metrics::CryptoRsa);
+
     mpz_t z;
 
     mpz_init(z);
 
     if (!rsa_encrypt(
             &publicKey,
-            Random::getYarrowCtx(),
-            (nettle_random_func*)yarrow256_random,
+            NULL,
+            (nettle_random_func*)Random::nettleRandom,
             buf->size(),
             buf->data(),
             z)) {
 
-        return BUFFER();
-    }
-
-    uint32_t len = mpz_sizeinbase(z, 16) + 1;
-
-    BUFFER res = Buffer::create(NULL, len);
-
-    if (!res) {
+        mpz_clear(z);
 
         return BUFFER();
     }
 
-    mpz_get_str((char*)res->data(), 16, z);
+    BUFFER res = mpzToBuffer(z, publicKey.size);
 
     mpz_clear(z);
 
-    rsa_public_key_clear(&publicKey);
-
     return res;
 }
 
@@ -245,6 +471,8 @@ BUFFER RSA::encrypt(
 
 BUFFER RSA::decrypt(UBJ::Value &privateKeyObj, BUFFER buf)
 {
+    Metrics::Scope scope(Metrics::CryptoRsa);
+
     struct rsa_private_key privateKey;
 
     ubjToPrivateKey(privateKeyObj, privateKey);
@@ -253,7 +481,7 @@ BUFFER RSA::decrypt(UBJ::Value &privateKeyObj, BUFFER buf)
 
     mpz_init(z);
 
-    mpz_set_str(z, (char*)buf->data(), 16);
+    mpzFromBuffer(buf, z);
 
     BUFFER tmp = Buffer::create(NULL, 2048);
 
@@ -286,6 +514,8 @@ BUFFER RSA::decrypt(UBJ::Value &privateKeyObj, BUFFER buf)
 
 BUFFER RSA::sign(UBJ::Value &privateKeyObj, BUFFER buf)
 {
+    Metrics::Scope scope(Metrics::CryptoRsa);
+
     struct rsa_private_key privateKey;
 
     ubjToPrivateKey(privateKeyObj, privateKey);
@@ -305,20 +535,7 @@ BUFFER RSA::sign(UBJ::Value &privateKeyObj, BUFFER buf)
         return BUFFER();
     }
 
-    uint32_t len = mpz_sizeinbase(z, 16) + 1;
-
-    BUFFER sign = Buffer::create(NULL, len);
-
-    if (!sign) {
-
-        mpz_clear(z);
-
-        rsa_private_key_clear(&privateKey);
-
-        return BUFFER();
-    }
-
-    mpz_get_str((char*)sign->data(), 16, z);
+    BUFFER sign = mpzToBuffer(z, privateKey.size);
 
     mpz_clear(z);
 
@@ -334,6 +551,8 @@ bool RSA::verify(
         BUFFER buf,
         BUFFER sign)
 {
+    Metrics::Scope scope(Metrics::CryptoRsa);
+
     struct rsa_public_key publicKey;
 
     ubjToPublicKey(publicKeyObj, publicKey);
@@ -344,7 +563,7 @@ bool RSA::verify(
 
     mpz_init(z);
 
-    mpz_set_str(z, (char*)sign->data(), 16);
+    mpzFromBuffer(sign, z);
 
     if (!rsa_sha256_verify_digest(&publicKey, digest->data(), z)) {
 
@@ -36,18 +36,48 @@
 #endif
 
 #include <memory.h>
-#include <list>
 
 namespace Zway {
 
 SecMem* SecMem::instance = NULL;
 
+const uint8_t NO_CLASS = 0xff;
+
 // ============================================================ //
 
 SecMem::SecMem()
     : m_lockedData(NULL),
-      m_lockedSize(0)
+      m_lockedSize(0),
+      m_slabsUsed(0),
+      m_used(0),
+      m_allocs(0),
+      m_frees(0),
+      m_failures(0),
+      m_generation(1)
+{
+    memset(m_freeBlocks, 0, sizeof(m_freeBlocks));
+}
+
+// ============================================================ //
+
+//! Return the blocks of an exiting thread to the shared lists
+
+SecMem::ThreadCache::~ThreadCache()
 {
+    if (!instance || generation != instance->m_generation) {
+
+        return;
+    }
+
+    for (uint32_t c=0; c<NUM_CLASSES; ++c) {
+
+        for (uint32_t i=0; i<count[c]; ++i) {
+
+            instance->freeBlock(blocks[c][i], c);
+        }
+
+        count[c] = 0;
+    }
 }
 
 // ============================================================ //
@@ -129,6 +159,8 @@ bool SecMem::setup(size_t size)
 
     instance->m_lockedSize = pagesLocked * pageSize;
 
+    instance->m_slabClasses.assign(instance->m_lockedSize / SLAB_SIZE, NO_CLASS);
+
     return true;
 }
 
@@ -161,11 +193,19 @@ bool SecMem::cleanup()
 
     instance->m_lockedSize = 0;
 
-    MutexLocker locker(instance->m_lockedMallocs);
+    MutexLocker locker(instance->m_mutex);
+
+    memset(instance->m_freeBlocks, 0, sizeof(instance->m_freeBlocks));
+
+    instance->m_slabClasses.clear();
 
-    std::map<uint8_t*, size_t>& mallocs = instance->m_lockedMallocs;
+    instance->m_slabsUsed = 0;
 
-    mallocs.clear();
+    instance->m_used = 0;
+
+    // blocks still held in thread caches are dropped
+
+    instance->m_generation++;
 
     return true;
 }
@@ -174,58 +214,97 @@ bool SecMem::cleanup()
 
 uint8_t* SecMem::malloc(size_t size)
 {
-    if (!instance) {
+    if (!instance || !instance->m_lockedSize) {
+
+        return NULL;
+    }
+
+    int32_t c = sizeClass(size);
+
+    if (c < 0) {
+
+        instance->m_failures++;
 
         return NULL;
     }
 
     uint8_t* ptr = NULL;
 
-    if (instance->m_lockedSize) {
+    ThreadCache &cache = threadCache();
 
-        size_t offset = 0;
+    if (cache.count[c]) {
 
-        if (instance->getOffset(size, &offset)) {
+        ptr = cache.blocks[c][--cache.count[c]];
+    }
+    else {
 
-            ptr = instance->m_lockedData + offset;
+        ptr = instance->allocBlock(c);
+    }
 
-            MutexLocker locker(instance->m_lockedMallocs);
+    if (!ptr) {
 
-            std::map<uint8_t*, size_t>& mallocs = instance->m_lockedMallocs;
+        instance->m_failures++;
 
-            mallocs[ptr] = size;
-        }
+        return NULL;
     }
 
+    instance->m_used += blockSize(c);
+
+    instance->m_allocs++;
+
     return ptr;
 }
 
 // ============================================================ //
 
+//! Wipe and release a block
+/*!
+ *  Returns false if the pointer is not in locked memory, so
+ *  callers can fall back to the heap for both malloc and free.
+ */
+
 bool SecMem::free(uint8_t *ptr)
 {
-    if (!instance) {
+    if (!owns(ptr)) {
 
         return false;
     }
 
-    if (instance->m_lockedSize) {
+    uint8_t c = instance->m_slabClasses[(ptr - instance->m_lockedData) / SLAB_SIZE];
 
-        MutexLocker locker(instance->m_lockedMallocs);
+    if (c == NO_CLASS) {
 
-        std::map<uint8_t*, size_t>& mallocs = instance->m_lockedMallocs;
+        return false;
+    }
 
-        if (mallocs.find(ptr) != mallocs.end()) {
+    memset(ptr, 0, blockSize(c));
 
-            memset(ptr, 0, mallocs[ptr]);
+    instance->m_used -= blockSize(c);
 
-            mallocs.erase(ptr);
+    instance->m_frees++;
 
-            return true;
-        }
+    ThreadCache &cache = threadCache();
+
+    if (cache.count[c] < THREAD_CACHE_SIZE) {
+
+        cache.blocks[c][cache.count[c]++] = ptr;
+    }
+    else {
+
+        instance->freeBlock(ptr, c);
     }
 
-    return false;
+    return true;
+}
+
+// ============================================================ //
+
+bool SecMem::owns(uint8_t *ptr)
+{
+    return instance &&
+           instance->m_lockedSize &&
+           ptr >= instance->m_lockedData &&
+           ptr < instance->m_lockedData + instance->m_lockedSize;
 }
 
 // ============================================================ //
@@ -240,15 +319,11 @@ size_t SecMem::getPageSize()
 
     return info.dwPageSize;
 
-#endif
-
-#ifdef __gnu_linux__
+#else
 
-    return getpagesize();
+    return sysconf(_SC_PAGESIZE);
 
 #endif
-
-    return 0;
 }
 
 // ============================================================ //
@@ -272,75 +347,149 @@ size_t SecMem::getLockedSizeUsed()
         return 0;
     }
 
-    size_t size = 0;
+    return instance->m_used;
+}
 
-    MutexLocker locker(instance->m_lockedMallocs);
+// ============================================================ //
 
-    for (auto &it : *instance->m_lockedMallocs) {
+size_t SecMem::getLockedSizeAvailable()
+{
+    return getLockedSize() - getLockedSizeUsed();
+}
+
+// ============================================================ //
+
+SecMem::Stats SecMem::getStats()
+{
+    Stats stats = {};
+
+    if (!instance) {
+
+        return stats;
+    }
+
+    {
+        MutexLocker locker(instance->m_mutex);
 
-        size += it.second;
+        stats.slabsUsed = instance->m_slabsUsed;
     }
 
-    return size;
+    stats.lockedSize = instance->m_lockedSize;
+
+    stats.used = instance->m_used;
+
+    stats.allocs = instance->m_allocs;
+
+    stats.frees = instance->m_frees;
+
+    stats.failures = instance->m_failures;
+
+    return stats;
 }
 
 // ============================================================ //
 
-size_t SecMem::getLockedSizeAvailable()
+//! Smallest size class holding size bytes, -1 if too large
+
+int32_t SecMem::sizeClass(size_t size)
 {
-    return getLockedSize() - getLockedSizeUsed();
+    size_t blockSize = MIN_BLOCK_SIZE;
+
+    for (int32_t c=0; c<NUM_CLASSES; ++c) {
+
+        if (size <= blockSize) {
+
+            return c;
+        }
+
+        blockSize <<= 1;
+    }
+
+    return -1;
 }
 
 // ============================================================ //
 
-bool SecMem::getOffset(size_t size, size_t* offset)
+size_t SecMem::blockSize(uint32_t sizeClass)
 {
-    size_t o = 0;
-    size_t s = 0;
+    return (size_t)MIN_BLOCK_SIZE << sizeClass;
+}
 
-    MutexLocker locker(instance->m_lockedMallocs);
+// ============================================================ //
 
-    for (auto &it : *instance->m_lockedMallocs) {
+SecMem::ThreadCache &SecMem::threadCache()
+{
+    static thread_local ThreadCache cache;
 
-        size_t tmp = (size_t)it.first - (size_t)m_lockedData;
+    if (cache.generation != instance->m_generation) {
 
-        if (tmp > o) {
+        memset(cache.count, 0, sizeof(cache.count));
 
-            s = tmp - o;
-        }
-        else {
+        cache.generation = instance->m_generation;
+    }
 
-            s = 0;
+    return cache;
+}
 
-            o = tmp + it.second;
-        }
+// ============================================================ //
+
+//! Take a block from the shared list of a class
+/*!
+ *  Free blocks link to the next one through their first bytes.
+ *  An empty list gets a new slab cut into blocks.
+ */
 
-        if (size <= s) {
+uint8_t* SecMem::allocBlock(uint32_t sizeClass)
+{
+    MutexLocker locker(m_mutex);
 
-            *offset = o;
+    uint8_t* ptr = m_freeBlocks[sizeClass];
 
-            return true;
-        }
-        else {
+    if (ptr) {
 
-            s = 0;
+        memcpy(&m_freeBlocks[sizeClass], ptr, sizeof(uint8_t*));
 
-            o = tmp + it.second;
-        }
+        uint8_t* next = nullptr;
+
+        memcpy(ptr, &next, sizeof(next));
+
+        return ptr;
     }
 
-    o += s;
+    if (m_slabsUsed >= m_slabClasses.size()) {
 
-    s = m_lockedSize - o;
+        return NULL;
+    }
 
-    if (s && size <= s) {
+    size_t slab = m_slabsUsed++;
 
-        *offset = o;
+    m_slabClasses[slab] = sizeClass;
 
-        return true;
+    ptr = m_lockedData + slab * SLAB_SIZE;
+
+    size_t size = blockSize(sizeClass);
+
+    for (size_t offset = SLAB_SIZE - size; offset > 0; offset -= size) {
+
+        uint8_t* block = ptr + offset;
+
+        memcpy(block, &m_freeBlocks[sizeClass], sizeof(uint8_t*));
+
+        m_freeBlocks[sizeClass] = block;
     }
 
-    return false;
+    return ptr;
+}
+
+// ============================================================ //
+
+void SecMem::freeBlock(uint8_t* ptr, uint32_t sizeClass)
+{
+    MutexLocker locker(m_mutex);
+
+    memcpy(ptr, &m_freeBlocks[sizeClass], sizeof(uint8_t*));
+
+    m_freeBlocks[sizeClass] = ptr;
 }
 
 // ============================================================ //
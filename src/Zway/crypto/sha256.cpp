@@ -0,0 +1,565 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/crypto/sha256.h"
+
+#include <nettle/sha2.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#if (defined __x86_64__ || defined __i386__) && (defined __GNUC__ || defined __clang__)
+#define ZWAY_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined __aarch64__ && (defined __ARM_FEATURE_SHA2 || defined __ARM_FEATURE_CRYPTO)
+#define ZWAY_SHA_ARMV8
+#include <arm_neon.h>
+#if defined __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+namespace Zway { namespace Crypto {
+
+// ============================================================ //
+
+#if defined ZWAY_SHA_NI || defined ZWAY_SHA_ARMV8
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#endif
+
+// ============================================================ //
+
+#if defined ZWAY_SHA_NI
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compressShaNi(uint32_t *state, const uint8_t *data, size_t numBlocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the instructions want the state as ABEF and CDGH
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (numBlocks--) {
+
+        __m128i abef = state0;
+
+        __m128i cdgh = state1;
+
+        __m128i w[4];
+
+#if defined __clang__
+#pragma unroll
+#elif defined __GNUC__
+#pragma GCC unroll 16
+#endif
+        for (uint32_t g=0; g<16; ++g) {
+
+            __m128i msg;
+
+            if (g < 4) {
+
+                msg = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + g * 16)), mask);
+            }
+            else {
+
+                msg = _mm_sha256msg1_epu32(w[g % 4], w[(g + 1) % 4]);
+
+                msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(g + 3) % 4], w[(g + 2) % 4], 4));
+
+                msg = _mm_sha256msg2_epu32(msg, w[(g + 3) % 4]);
+            }
+
+            w[g % 4] = msg;
+
+            msg = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i*)&K[g * 4]));
+
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+
+        state1 = _mm_add_epi32(state1, cdgh);
+
+        data += Sha256::BLOCK_SIZE;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128((__m128i*)&state[0], state0);
+
+    _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+// ============================================================ //
+
+static bool hasShaNi()
+{
+    uint32_t a, b, c, d;
+
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & (1 << 19)) || !(c & (1 << 9))) {
+
+        // no sse4.1 or ssse3
+
+        return false;
+    }
+
+    if (__get_cpuid_max(0, nullptr) < 7) {
+
+        return false;
+    }
+
+    __cpuid_count(7, 0, a, b, c, d);
+
+    return b & (1 << 29);
+}
+
+#endif
+
+// ============================================================ //
+
+#if defined ZWAY_SHA_ARMV8
+
+static void compressArmV8(uint32_t *state, const uint8_t *data, size_t numBlocks)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    while (numBlocks--) {
+
+        uint32x4_t abcd = state0;
+
+        uint32x4_t efgh = state1;
+
+        uint32x4_t w[4];
+
+        for (uint32_t g=0; g<16; ++g) {
+
+            if (g < 4) {
+
+                w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + g * 16)));
+            }
+            else {
+
+                w[g % 4] = vsha256su1q_u32(
+                        vsha256su0q_u32(w[g % 4], w[(g + 1) % 4]),
+                        w[(g + 2) % 4],
+                        w[(g + 3) % 4]);
+            }
+
+            uint32x4_t msg = vaddq_u32(w[g % 4], vld1q_u32(&K[g * 4]));
+
+            uint32x4_t tmp = state0;
+
+            state0 = vsha256hq_u32(state0, state1, msg);
+
+            state1 = vsha256h2q_u32(state1, tmp, msg);
+        }
+
+        state0 = vaddq_u32(state0, abcd);
+
+        state1 = vaddq_u32(state1, efgh);
+
+        data += Sha256::BLOCK_SIZE;
+    }
+
+    vst1q_u32(&state[0], state0);
+
+    vst1q_u32(&state[4], state1);
+}
+
+// ============================================================ //
+
+static bool hasArmV8Sha()
+{
+#if defined __APPLE__
+
+    return true;
+
+#elif defined __linux__
+
+    return getauxval(AT_HWCAP) & HWCAP_SHA2;
+
+#else
+
+    return false;
+
+#endif
+}
+
+#endif
+
+// ============================================================ //
+// Sha256
+// ============================================================ //
+
+static std::atomic<int> currentBackend(Sha256::NettleBackend);
+
+static std::once_flag backendFlag;
+
+// ============================================================ //
+
+Sha256::Backend Sha256::backend()
+{
+    std::call_once(backendFlag, [] () {
+
+        if (supported(ShaNiBackend) && selfTest(ShaNiBackend)) {
+
+            currentBackend = ShaNiBackend;
+        }
+        else
+        if (supported(ArmV8Backend) && selfTest(ArmV8Backend)) {
+
+            currentBackend = ArmV8Backend;
+        }
+    });
+
+    return (Backend)currentBackend.load();
+}
+
+// ============================================================ //
+
+//! Force a backend
+/*!
+ *  Fails if the CPU or the build does not support it
+ */
+
+bool Sha256::setBackend(Backend backend)
+{
+    // run the automatic selection first so it does not override us later
+
+    Sha256::backend();
+
+    if (backend != NettleBackend && !(supported(backend) && selfTest(backend))) {
+
+        return false;
+    }
+
+    currentBackend = backend;
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Sha256::supported(Backend backend)
+{
+    switch (backend) {
+
+        case NettleBackend:
+
+            return true;
+
+        case ShaNiBackend:
+
+#if defined ZWAY_SHA_NI
+            return hasShaNi();
+#else
+            return false;
+#endif
+
+        case ArmV8Backend:
+
+#if defined ZWAY_SHA_ARMV8
+            return hasArmV8Sha();
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+const char *Sha256::backendName(Backend backend)
+{
+    switch (backend) {
+
+        case NettleBackend:
+
+            return "nettle";
+
+        case ShaNiBackend:
+
+            return "sha-ni";
+
+        case ArmV8Backend:
+
+            return "armv8";
+    }
+
+    return "";
+}
+
+// ============================================================ //
+
+void Sha256::init()
+{
+    reset(compressFunc(backend()));
+}
+
+// ============================================================ //
+
+void Sha256::update(const uint8_t *data, size_t size)
+{
+    if (m_index) {
+
+        size_t len = BLOCK_SIZE - m_index;
+
+        if (len > size) {
+
+            len = size;
+        }
+
+        memcpy(m_block + m_index, data, len);
+
+        m_index += len;
+
+        data += len;
+
+        size -= len;
+
+        if (m_index < BLOCK_SIZE) {
+
+            return;
+        }
+
+        m_compress(m_state, m_block, 1);
+
+        m_numBlocks++;
+
+        m_index = 0;
+    }
+
+    size_t numBlocks = size / BLOCK_SIZE;
+
+    if (numBlocks) {
+
+        m_compress(m_state, data, numBlocks);
+
+        m_numBlocks += numBlocks;
+
+        data += numBlocks * BLOCK_SIZE;
+
+        size -= numBlocks * BLOCK_SIZE;
+    }
+
+    if (size) {
+
+        memcpy(m_block, data, size);
+
+        m_index = size;
+    }
+}
+
+// ============================================================ //
+
+//! Write the digest and start over
+/*!
+ *  Writes the first size bytes of the digest, like nettle
+ */
+
+void Sha256::digest(uint8_t *digest, size_t size)
+{
+    uint64_t bits = (m_numBlocks * BLOCK_SIZE + m_index) * 8;
+
+    m_block[m_index++] = 0x80;
+
+    if (m_index > BLOCK_SIZE - 8) {
+
+        memset(m_block + m_index, 0, BLOCK_SIZE - m_index);
+
+        m_compress(m_state, m_block, 1);
+
+        m_index = 0;
+    }
+
+    memset(m_block + m_index, 0, BLOCK_SIZE - 8 - m_index);
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        m_block[BLOCK_SIZE - 1 - i] = bits >> (i * 8);
+    }
+
+    m_compress(m_state, m_block, 1);
+
+    uint8_t res[DIGEST_SIZE];
+
+    for (uint32_t i=0; i<8; ++i) {
+
+        res[i*4]   = m_state[i] >> 24;
+        res[i*4+1] = m_state[i] >> 16;
+        res[i*4+2] = m_state[i] >> 8;
+        res[i*4+3] = m_state[i];
+    }
+
+    memcpy(digest, res, std::min<size_t>(size, DIGEST_SIZE));
+
+    memset(res, 0, sizeof(res));
+
+    reset(m_compress);
+}
+
+// ============================================================ //
+
+Sha256::Compress Sha256::compressFunc(Backend backend)
+{
+    switch (backend) {
+
+#if defined ZWAY_SHA_NI
+        case ShaNiBackend:
+
+            return compressShaNi;
+#endif
+
+#if defined ZWAY_SHA_ARMV8
+        case ArmV8Backend:
+
+            return compressArmV8;
+#endif
+
+        default:
+
+            return nullptr;
+    }
+}
+
+// ============================================================ //
+
+//! Compare a backend against nettle
+/*!
+ *  Messages of several lengths around the block and padding
+ *  boundaries, fed in pieces of changing size
+ */
+
+bool Sha256::selfTest(Backend backend)
+{
+    Compress compress = compressFunc(backend);
+
+    if (!compress) {
+
+        return false;
+    }
+
+    uint8_t msg[300];
+
+    for (uint32_t i=0; i<sizeof(msg); ++i) {
+
+        msg[i] = i * 7 + 3;
+    }
+
+    const size_t lengths[] = {0, 3, 55, 56, 63, 64, 65, 119, 128, 300};
+
+    for (auto len : lengths) {
+
+        struct sha256_ctx ctx;
+
+        uint8_t expected[DIGEST_SIZE];
+
+        sha256_init(&ctx);
+
+        sha256_update(&ctx, len, msg);
+
+        sha256_digest(&ctx, DIGEST_SIZE, expected);
+
+        Sha256 sha;
+
+        uint8_t res[DIGEST_SIZE];
+
+        sha.reset(compress);
+
+        for (size_t pos = 0, step = 1; pos < len; pos += step, step += 13) {
+
+            sha.update(msg + pos, std::min(step, len - pos));
+        }
+
+        sha.digest(res, DIGEST_SIZE);
+
+        if (memcmp(res, expected, DIGEST_SIZE)) {
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void Sha256::reset(Compress compress)
+{
+    static const uint32_t H[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    m_compress = compress;
+
+    memcpy(m_state, H, sizeof(H));
+
+    m_index = 0;
+
+    m_numBlocks = 0;
+}
+
+// ============================================================ //
+
+}
+
+}
@@ -47,6 +47,7 @@ Event::Event(
         const UBJ::Value &error,
         Callback callback)
     : m_id(id),
+      m_key(0),
       m_data(data),
       m_error(error),
       m_callback(callback)
@@ -80,6 +81,27 @@ uint32_t Event::id() const
 
 // ============================================================ //
 
+//! Ordering key
+/*!
+ *  Events with the same key are delivered in the order they
+ *  were posted, also with several dispatch workers. Key 0 is
+ *  used for everything not tied to a message or contact.
+ */
+
+uint64_t Event::key() const
+{
+    return m_key;
+}
+
+// ============================================================ //
+
+void Event::setKey(uint64_t key)
+{
+    m_key = key;
+}
+
+// ============================================================ //
+
 UBJ::Value &Event::data()
 {
     return m_data;
@@ -94,4 +116,18 @@ UBJ::Value &Event::error()
 
 // ============================================================ //
 
+uint64_t Event::messageKey(uint32_t messageId)
+{
+    return (1ULL << 32) | messageId;
+}
+
+// ============================================================ //
+
+uint64_t Event::contactKey(uint32_t contactId)
+{
+    return (2ULL << 32) | contactId;
+}
+
+// ============================================================ //
+
 }
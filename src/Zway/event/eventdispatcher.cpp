@@ -25,117 +25,924 @@
 // ============================================================ //
 
 #include "Zway/event/eventdispatcher.h"
+#include "Zway/message/messageevent.h"
+#include "Zway/metrics.h"
+
+#include <algorithm>
+#include <cstdlib>
 
 namespace Zway {
 
+// the dispatcher whose event the current thread delivers
+
+static thread_local EventDispatcher *t_dispatching = nullptr;
+
+// tells the events of a dispatcher from those it had before it
+// was detached, or of an earlier one at the same address
+
+static std::atomic<uint64_t> s_serial(0);
+
+// ============================================================ //
+// DispatchPool
+// ============================================================ //
+
+DispatchPool::DispatchPool(uint32_t numWorkers)
+    : m_first(0),
+      m_started(false)
+{
+    setNumWorkers(numWorkers);
+}
+
+// ============================================================ //
+
+DispatchPool::~DispatchPool()
+{
+
+}
+
+// ============================================================ //
+
+//! Set the number of workers
+/*!
+ *  Only takes effect before run()
+ */
+
+void DispatchPool::setNumWorkers(uint32_t numWorkers)
+{
+    if (m_started) {
+
+        return;
+    }
+
+    m_workers.clear();
+
+    for (uint32_t i=0; i<std::max<uint32_t>(1, numWorkers); ++i) {
+
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker(this)));
+    }
+}
+
+// ============================================================ //
+
+uint32_t DispatchPool::numWorkers()
+{
+    return m_workers.size();
+}
+
+// ============================================================ //
+
+//! Start the workers
+/*!
+ *  Dispatchers which are given the pool are served as soon as
+ *  they run
+ */
+
+bool DispatchPool::run()
+{
+    return start(0);
+}
+
+// ============================================================ //
+
+void DispatchPool::cancel()
+{
+    for (auto &worker : m_workers) {
+
+        worker->cancel();
+    }
+}
+
+// ============================================================ //
+
+void DispatchPool::join()
+{
+    if (!m_started) {
+
+        return;
+    }
+
+    for (size_t i=m_first; i<m_workers.size(); ++i) {
+
+        m_workers[i]->join();
+    }
+
+    m_started = false;
+}
+
+// ============================================================ //
+
+void DispatchPool::cancelAndJoin()
+{
+    cancel();
+
+    join();
+}
+
+// ============================================================ //
+
+//! Run the workers from first on
+/*!
+ *  Workers before first are served by threads of the caller
+ */
+
+bool DispatchPool::start(uint32_t first)
+{
+    m_first = first;
+
+    m_started = true;
+
+    for (size_t i=0; i<m_workers.size(); ++i) {
+
+        if (i < first) {
+
+            m_workers[i]->reset();
+        }
+        else
+        if (!m_workers[i]->run()) {
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void DispatchPool::attach(EventDispatcher *dispatcher)
+{
+    MutexLocker locker(m_dispatchersMutex);
+
+    dispatcher->m_detached = false;
+
+    m_dispatchers[dispatcher->m_serial] = dispatcher;
+}
+
+// ============================================================ //
+
+//! Stop serving a dispatcher
+/*!
+ *  Its events still queued are dropped without touching it, it
+ *  may be gone by the time they come up. Events it posts from
+ *  now on carry a new serial.
+ */
+
+void DispatchPool::detach(EventDispatcher *dispatcher)
+{
+    MutexLocker locker(m_dispatchersMutex);
+
+    dispatcher->m_detached = true;
+
+    m_dispatchers.erase(dispatcher->m_serial);
+
+    dispatcher->m_serial = ++s_serial;
+}
+
+// ============================================================ //
+
+void DispatchPool::post(EventDispatcher *dispatcher, EVENT event)
+{
+    uint64_t key = event->key() ^ ((uintptr_t)dispatcher >> 4);
+
+    Metrics &metrics = Metrics::instance();
+
+    metrics.add(Metrics::EventQueueDepth, 1);
+
+    ITEM item(dispatcher, dispatcher->m_serial, event, metrics.enabled() ? Metrics::now() : 0);
+
+    m_workers[(key ^ (key >> 32)) % m_workers.size()]->post(item);
+}
+
+// ============================================================ //
+
+//! Deliver an event
+/*!
+ *  Only if its dispatcher is still attached. The dispatcher
+ *  counts the event as in flight until it is delivered, join()
+ *  waits for that.
+ */
+
+void DispatchPool::dispatch(ITEM &item)
+{
+    EventDispatcher *dispatcher = nullptr;
+
+    {
+        MutexLocker locker(m_dispatchersMutex);
+
+        auto it = m_dispatchers.find(item.serial);
+
+        if (it != m_dispatchers.end()) {
+
+            dispatcher = it->second;
+
+            dispatcher->m_inFlight++;
+        }
+    }
+
+    if (dispatcher) {
+
+        if (item.queued) {
+
+            Metrics::instance().record(Metrics::EventQueueWait, Metrics::now() - item.queued);
+        }
+
+        {
+            Metrics::Scope scope(Metrics::EventDispatch);
+
+            t_dispatching = dispatcher;
+
+            dispatcher->take(item.event);
+
+            dispatcher->dispatchEvent(item.event);
+
+            t_dispatching = nullptr;
+        }
+
+        MutexLocker locker(m_dispatchersMutex);
+
+        dispatcher->m_inFlight--;
+
+        if (dispatcher->m_detached) {
+
+            m_idleCondition.notify_all();
+        }
+    }
+
+    drop(item);
+}
+
+// ============================================================ //
+
+//! Release an event
+
+void DispatchPool::drop(ITEM &item)
+{
+    item = ITEM();
+
+    Metrics::instance().add(Metrics::EventQueueDepth, -1);
+}
+
+// ============================================================ //
+
+//! Wake the first worker, which times held back events
+
+void DispatchPool::wake()
+{
+    m_workers[0]->wake();
+}
+
+// ============================================================ //
+
+//! Queue held back events of all dispatchers
+/*!
+ *  Returns the milliseconds until the next one is due, 0 if
+ *  there is none
+ */
+
+uint32_t DispatchPool::flushDeferred()
+{
+    MutexLocker locker(m_dispatchersMutex);
+
+    uint32_t next = 0;
+
+    for (auto &it : m_dispatchers) {
+
+        uint32_t ms = it.second->flushDeferred();
+
+        if (ms && (!next || ms < next)) {
+
+            next = ms;
+        }
+    }
+
+    return next;
+}
+
+// ============================================================ //
+// EventDispatcher
+// ============================================================ //
+
+EventDispatcher::EventDispatcher(uint32_t numWorkers)
+    : Thread(),
+      m_pool(&m_ownPool),
+      m_serial(++s_serial),
+      m_inFlight(0),
+      m_detached(false),
+      m_handlers(std::make_shared<Handlers>()),
+      m_handlerId(0),
+      m_numDeferred(0)
+{
+    setNumWorkers(numWorkers);
+
+    // progress at most every 100 ms per message, status updates
+    // merged while they wait in the queue
+
+    setCoalescing(Event::MessageProgress, true, 100);
+
+    setCoalescing(Event::ContactStatus, true);
+}
+
+// ============================================================ //
+
+EventDispatcher::~EventDispatcher()
+{
+
+}
+
+// ============================================================ //
+
+//! Set the number of dispatch workers
+/*!
+ *  Only takes effect before run(). With more than one worker,
+ *  events are spread by key and only events sharing a key keep
+ *  their order, so a slow handler only holds up its own key.
+ */
+
+void EventDispatcher::setNumWorkers(uint32_t numWorkers)
+{
+    if (m_thread.joinable()) {
+
+        return;
+    }
+
+    m_ownPool.setNumWorkers(numWorkers);
+}
+
+// ============================================================ //
+
+uint32_t EventDispatcher::numWorkers()
+{
+    return m_pool->numWorkers();
+}
+
+// ============================================================ //
+
+//! Let the workers of a shared pool dispatch our events
+/*!
+ *  Only takes effect before run(). The pool has to outlive the
+ *  dispatcher, nullptr goes back to a pool of our own.
+ */
+
+void EventDispatcher::setPool(DispatchPool *pool)
+{
+    if (m_thread.joinable()) {
+
+        return;
+    }
+
+    m_pool = pool ? pool : &m_ownPool;
+}
+
+// ============================================================ //
+
+//! Add a handler for all events
+/*!
+ *  Returns an id for removeHandler()
+ */
+
+uint32_t EventDispatcher::addHandler(EVENT_HANDLER handler)
+{
+    return addHandler(AllScope, 0, handler);
+}
+
+// ============================================================ //
+
+//! Add a handler for events of one type
+/*!
+ *  Returns an id for removeHandler()
+ */
+
+uint32_t EventDispatcher::addHandler(Event::EventType type, EVENT_HANDLER handler)
+{
+    return addHandler(TypeScope, type, handler);
+}
+
+// ============================================================ //
+
+//! Add a handler for the events of one message
+/*!
+ *  Returns an id for removeHandler()
+ */
+
+uint32_t EventDispatcher::addMessageHandler(uint32_t messageId, EVENT_HANDLER handler)
+{
+    return addHandler(MessageScope, messageId, handler);
+}
+
+// ============================================================ //
+
+//! Add a handler for the events concerning one contact
+/*!
+ *  Messages from or to the contact, contact requests and status
+ *  updates that include it. Returns an id for removeHandler()
+ */
+
+uint32_t EventDispatcher::addContactHandler(uint32_t contactId, EVENT_HANDLER handler)
+{
+    return addHandler(ContactScope, contactId, handler);
+}
+
+// ============================================================ //
+
+//! Remove a handler
+/*!
+ *  Events already being dispatched may still reach it once.
+ */
+
+bool EventDispatcher::removeHandler(uint32_t handlerId)
+{
+    MutexLocker locker(m_handlersMutex);
+
+    std::shared_ptr<Handlers> handlers = std::make_shared<Handlers>(*m_handlers);
+
+    auto remove = [handlerId] (HANDLER_LIST &list) {
+
+        for (auto it = list.begin(); it != list.end(); ++it) {
+
+            if (it->first == handlerId) {
+
+                list.erase(it);
+
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    auto removeFromMap = [&remove] (HANDLER_MAP &map) {
+
+        for (auto it = map.begin(); it != map.end(); ++it) {
+
+            if (remove(it->second)) {
+
+                if (it->second.empty()) {
+
+                    map.erase(it);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    if (remove(handlers->all) ||
+        removeFromMap(handlers->byType) ||
+        removeFromMap(handlers->byMessage) ||
+        removeFromMap(handlers->byContact)) {
+
+        std::atomic_store(&m_handlers, std::shared_ptr<const Handlers>(handlers));
+
+        return true;
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+void EventDispatcher::post(EVENT event, bool immediately)
+{
+    if (event) {
+
+        if (immediately) {
+
+            dispatchEvent(event);
+        }
+        else {
+
+            std::vector<EVENT> flushed;
+
+            bool absorbed = coalesce(event, flushed);
+
+            for (auto &e : flushed) {
+
+                enqueue(e);
+            }
+
+            if (!absorbed) {
+
+                enqueue(event);
+            }
+        }
+    }
+}
+
+// ============================================================ //
+
+//! Merge events of one type
+/*!
+ *  An event of a coalesced type is merged into one of the same
+ *  type and key that is still queued. Within windowMs of the
+ *  last delivery it is held back and delivered when the window
+ *  ends. Object data is merged field by field, later values
+ *  win, so progress reports the latest state and status updates
+ *  add up. Without a window events are only merged while queued.
+ */
+
+void EventDispatcher::setCoalescing(Event::EventType type, bool enabled, uint32_t windowMs)
+{
+    MutexLocker locker(m_coalesceMutex);
+
+    if (enabled) {
+
+        m_coalesceWindows[type] = windowMs;
+    }
+    else {
+
+        m_coalesceWindows.erase(type);
+    }
+}
+
+// ============================================================ //
+
+//! Start the workers
+/*!
+ *  The dispatcher's own thread serves the first worker's queue.
+ *  With a shared pool no thread is started.
+ */
+
+bool EventDispatcher::run()
+{
+    m_pool->attach(this);
+
+    if (m_pool != &m_ownPool) {
+
+        return true;
+    }
+
+    return m_ownPool.start(1) && Thread::run();
+}
+
 // ============================================================ //
 
-EventDispatcher::EventDispatcher()
-    : Thread()
+void EventDispatcher::cancel()
 {
+    m_pool->detach(this);
+
+    Thread::cancel();
 
+    if (m_pool == &m_ownPool) {
+
+        m_ownPool.cancel();
+    }
 }
 
 // ============================================================ //
 
-void EventDispatcher::addHandler(EVENT_HANDLER handler)
+//! Wait for the workers
+/*!
+ *  With a shared pool, wait until none of them is delivering
+ *  one of our events anymore. Events still queued are not
+ *  waited for, they are dropped once detached. Called from one
+ *  of our own handlers, the event it handles is not waited for.
+ */
+
+void EventDispatcher::join()
 {
-    MutexLocker locker(m_handlers);
+    if (m_pool != &m_ownPool) {
+
+        uint32_t self = t_dispatching == this ? 1 : 0;
 
-    m_handlers->push_back(handler);
+        std::unique_lock<std::mutex> lock(m_pool->m_dispatchersMutex);
+
+        m_pool->m_idleCondition.wait(lock, [this, self] () {
+
+            return m_inFlight <= self;
+        });
+
+        return;
+    }
+
+    m_ownPool.join();
+
+    Thread::join();
 }
 
 // ============================================================ //
 
-void EventDispatcher::post(EVENT event, bool immediately)
+void EventDispatcher::onRun()
 {
-    if (event) {
+    m_ownPool.m_workers[0]->onRun();
+}
 
-        if (immediately) {
+// ============================================================ //
 
-            dispatchEvent(event);
+//! Add a handler to the table
+/*!
+ *  The table is copied on write, dispatching works on a
+ *  snapshot and never holds a lock while calling handlers.
+ */
+
+uint32_t EventDispatcher::addHandler(Scope scope, uint32_t value, EVENT_HANDLER handler)
+{
+    MutexLocker locker(m_handlersMutex);
+
+    std::shared_ptr<Handlers> handlers = std::make_shared<Handlers>(*m_handlers);
+
+    uint32_t handlerId = ++m_handlerId;
+
+    switch (scope) {
+
+        case AllScope:
+
+            handlers->all.push_back(std::make_pair(handlerId, handler));
+
+            break;
+
+        case TypeScope:
+
+            handlers->byType[value].push_back(std::make_pair(handlerId, handler));
+
+            break;
+
+        case MessageScope:
+
+            handlers->byMessage[value].push_back(std::make_pair(handlerId, handler));
+
+            break;
+
+        case ContactScope:
+
+            handlers->byContact[value].push_back(std::make_pair(handlerId, handler));
+
+            break;
+    }
+
+    std::atomic_store(&m_handlers, std::shared_ptr<const Handlers>(handlers));
+
+    return handlerId;
+}
+
+// ============================================================ //
+
+//! Contacts an event concerns
+/*!
+ *  Source and destination of a message, the contact of a contact
+ *  keyed event or of a contact request, all contacts of a status
+ *  update.
+ */
+
+static void eventContacts(EVENT event, std::vector<uint32_t> &contacts)
+{
+    MESSAGE_EVENT messageEvent = MessageEvent::cast(event);
+
+    if (messageEvent && messageEvent->getMessage()) {
+
+        MESSAGE msg = messageEvent->getMessage();
+
+        contacts.push_back(msg->src());
+
+        if (msg->dst() != msg->src()) {
+
+            contacts.push_back(msg->dst());
         }
-        else {
+    }
+    else
+    if ((event->key() >> 32) == (Event::contactKey(0) >> 32)) {
 
-            {
-                MutexLocker locker(m_events);
+        contacts.push_back((uint32_t)event->key());
+    }
+    else
+    if (event->data().hasField("contactId")) {
 
-                m_events->push_back(event);
-            }
+        contacts.push_back(event->data()["contactId"].toInt());
+    }
+    else
+    if (event->id() == Event::ContactStatus) {
+
+        const UBJ::Value &data = event->data();
 
-            m_waitCondition.notify_one();
+        for (auto it = data.cbegin(); it != data.cend(); ++it) {
+
+            contacts.push_back(strtoul(it->first.c_str(), nullptr, 10));
         }
     }
 }
 
 // ============================================================ //
 
-void EventDispatcher::cancel()
+//! Queue an event
+/*!
+ *  Events posted once detached are dropped
+ */
+
+void EventDispatcher::enqueue(EVENT event)
 {
-    {
-        MutexLocker locker(m_events);
+    if (m_detached) {
 
-        m_events->clear();
+        return;
     }
 
-    Thread::cancel();
+    m_pool->post(this, event);
+}
 
-    m_waitCondition.notify_one();
+// ============================================================ //
+
+static void mergeData(EVENT event, EVENT other)
+{
+    UBJ::Value &data = event->data();
+
+    const UBJ::Value &otherData = other->data();
+
+    if (data.isObject() && otherData.isObject()) {
+
+        for (auto it = otherData.cbegin(); it != otherData.cend(); ++it) {
+
+            data[it->first] = it->second;
+        }
+    }
+    else {
+
+        data = otherData;
+    }
 }
 
 // ============================================================ //
 
-void EventDispatcher::onRun()
+//! Coalesce an event
+/*!
+ *  Returns true if the event was merged or held back. Held back
+ *  events with the same key go to flushed, they have to be
+ *  queued before the event to keep the order per key.
+ */
+
+bool EventDispatcher::coalesce(EVENT event, std::vector<EVENT> &flushed)
 {
-    for (;;) {
+    auto now = std::chrono::steady_clock::now();
 
-        if (testCancel()) {
+    bool wake = false;
 
-            break;
+    bool res = true;
+
+    {
+        MutexLocker locker(m_coalesceMutex);
+
+        auto window = m_coalesceWindows.find(event->id());
+
+        if (window == m_coalesceWindows.end()) {
+
+            if (m_numDeferred) {
+
+                auto it = m_coalesced.lower_bound(COALESCE_KEY(event->key(), 0));
+
+                for (; it != m_coalesced.end() && it->first.first == event->key(); ++it) {
+
+                    if (it->second.deferred) {
+
+                        it->second.queued = it->second.deferred;
+
+                        it->second.deferred.reset();
+
+                        m_numDeferred--;
+
+                        flushed.push_back(it->second.queued);
+                    }
+                }
+            }
+
+            return false;
         }
 
-        EVENT event;
+        Coalesced &c = m_coalesced[COALESCE_KEY(event->key(), event->id())];
 
-        // grab event if any
+        if (c.queued) {
 
-        if (!(event = getEvent())) {
+            mergeData(c.queued, event);
+        }
+        else
+        if (c.deferred) {
 
-            // wait for event
+            mergeData(c.deferred, event);
+        }
+        else
+        if (now - c.last < std::chrono::milliseconds(window->second)) {
 
-            std::unique_lock<std::mutex> locker(m_waitMutex);
+            c.deferred = event;
 
-            m_waitCondition.wait(locker);
+            wake = m_numDeferred++ == 0;
+        }
+        else {
 
-            // grab event if any
+            c.queued = event;
 
-            event = getEvent();
+            res = false;
         }
+    }
 
-        if (event) {
+    // let the first worker time the window
 
-            // dispatch event
+    if (wake) {
 
-            dispatchEvent(event);
+        m_pool->wake();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Mark a coalesced event as being delivered
+/*!
+ *  From here on it is no longer merged into, later events of
+ *  its type and key start a new one.
+ */
+
+void EventDispatcher::take(EVENT event)
+{
+    MutexLocker locker(m_coalesceMutex);
+
+    auto it = m_coalesced.find(COALESCE_KEY(event->key(), event->id()));
+
+    if (it != m_coalesced.end() && it->second.queued == event) {
+
+        it->second.queued.reset();
+
+        it->second.last = std::chrono::steady_clock::now();
+
+        auto window = m_coalesceWindows.find(event->id());
+
+        if (!it->second.deferred && (window == m_coalesceWindows.end() || !window->second)) {
+
+            m_coalesced.erase(it);
         }
     }
 }
 
 // ============================================================ //
 
-EVENT EventDispatcher::getEvent()
+//! Queue held back events whose window has ended
+/*!
+ *  Also drops idle entries. Returns the milliseconds until the
+ *  next held back event is due, 0 if there is none.
+ */
+
+uint32_t EventDispatcher::flushDeferred()
 {
-    EVENT event;
+    if (!m_numDeferred) {
+
+        return 0;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<EVENT> flushed;
+
+    uint32_t next = 0;
+
+    {
+        MutexLocker locker(m_coalesceMutex);
+
+        for (auto it = m_coalesced.begin(); it != m_coalesced.end(); ) {
+
+            Coalesced &c = it->second;
+
+            auto found = m_coalesceWindows.find(it->first.second);
+
+            auto window = std::chrono::milliseconds(found != m_coalesceWindows.end() ? found->second : 0);
+
+            if (c.deferred) {
+
+                if (now - c.last >= window) {
+
+                    c.queued = c.deferred;
+
+                    c.deferred.reset();
+
+                    m_numDeferred--;
+
+                    flushed.push_back(c.queued);
+                }
+                else {
+
+                    uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(c.last + window - now).count() + 1;
+
+                    if (!next || ms < next) {
+
+                        next = ms;
+                    }
+                }
+            }
+            else
+            if (!c.queued && now - c.last >= window) {
+
+                it = m_coalesced.erase(it);
 
-    MutexLocker locker(m_events);
+                continue;
+            }
 
-    if (!m_events->empty()) {
+            ++it;
+        }
+    }
 
-        event = m_events->front();
+    for (auto &event : flushed) {
 
-        m_events->pop_front();
+        enqueue(event);
     }
 
-    return event;
+    return next;
 }
 
 // ============================================================ //
@@ -146,13 +953,192 @@ void EventDispatcher::dispatchEvent(EVENT event)
 
     // invoke event handlers
 
+    std::shared_ptr<const Handlers> handlers = std::atomic_load(&m_handlers);
+
+    for (auto &h : handlers->all) {
+
+        h.second(event);
+    }
+
+    auto invoke = [&event] (const HANDLER_MAP &map, uint32_t value) {
+
+        auto it = map.find(value);
+
+        if (it != map.end()) {
+
+            for (auto &h : it->second) {
+
+                h.second(event);
+            }
+        }
+    };
+
+    if (!handlers->byType.empty()) {
+
+        invoke(handlers->byType, event->id());
+    }
+
+    if (!handlers->byMessage.empty() && (event->key() >> 32) == (Event::messageKey(0) >> 32)) {
+
+        invoke(handlers->byMessage, (uint32_t)event->key());
+    }
+
+    if (!handlers->byContact.empty()) {
+
+        std::vector<uint32_t> contacts;
+
+        eventContacts(event, contacts);
+
+        for (auto contactId : contacts) {
+
+            invoke(handlers->byContact, contactId);
+        }
+    }
+}
+
+// ============================================================ //
+// DispatchPool::Worker
+// ============================================================ //
+
+DispatchPool::Worker::Worker(DispatchPool *pool)
+    : Thread(),
+      m_pool(pool),
+      m_sleeping(false),
+      m_woken(false)
+{
+
+}
+
+// ============================================================ //
+
+//! Queue an event
+/*!
+ *  Lock free unless the worker is asleep. The sleeping flag and
+ *  the queue are both sequentially consistent, so either the
+ *  worker sees the event before it sleeps or we see it asleep
+ *  and wake it. Taking the wait mutex keeps the notify from
+ *  slipping in between its check and its wait.
+ */
+
+void DispatchPool::Worker::post(ITEM item)
+{
+    m_events.push(item);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (m_sleeping.load()) {
+
+        {
+            std::lock_guard<std::mutex> locker(m_waitMutex);
+        }
+
+        m_waitCondition.notify_one();
+    }
+}
+
+// ============================================================ //
+
+void DispatchPool::Worker::wake()
+{
+    {
+        std::lock_guard<std::mutex> locker(m_waitMutex);
+
+        m_woken = true;
+    }
+
+    m_waitCondition.notify_one();
+}
+
+// ============================================================ //
+
+void DispatchPool::Worker::reset()
+{
+    MutexLocker locker(m_cancel);
+
+    m_cancel = false;
+}
+
+// ============================================================ //
+
+void DispatchPool::Worker::cancel()
+{
+    Thread::cancel();
+
     {
-        MutexLocker locker(m_handlers);
+        std::lock_guard<std::mutex> locker(m_waitMutex);
+    }
+
+    m_waitCondition.notify_one();
+}
+
+// ============================================================ //
+
+void DispatchPool::Worker::onRun()
+{
+    ITEM item;
+
+    for (;;) {
+
+        while (m_events.pop(item)) {
+
+            if (testCancel()) {
 
-        for (auto &h : *m_handlers) {
+                m_pool->drop(item);
 
-            h(event);
+                break;
+            }
+
+            // dispatch event
+
+            m_pool->dispatch(item);
+        }
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        // held back events are timed by the first worker
+
+        uint32_t next = m_pool->flushDeferred();
+
+        if (!m_events.empty()) {
+
+            continue;
+        }
+
+        // wait for event
+
+        std::unique_lock<std::mutex> locker(m_waitMutex);
+
+        m_sleeping.store(true);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto ready = [this] () {
+
+            return !m_events.empty() || m_woken || testCancel();
+        };
+
+        if (next && this == m_pool->m_workers[0].get()) {
+
+            m_waitCondition.wait_for(locker, std::chrono::milliseconds(next), ready);
+        }
+        else {
+
+            m_waitCondition.wait(locker, ready);
         }
+
+        m_woken = false;
+
+        m_sleeping.store(false);
+    }
+
+    // drop what is left
+
+    while (m_events.pop(item)) {
+
+        m_pool->drop(item);
     }
 }
 
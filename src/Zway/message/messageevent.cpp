@@ -50,6 +50,11 @@ MessageEvent::MessageEvent(uint32_t id, MESSAGE msg, RESOURCE res, const UBJ::Ob
       m_res(res)
 {
     m_data = data;
+
+    if (msg) {
+
+        m_key = messageKey(msg->id());
+    }
 }
 
 // ============================================================ //
@@ -1,415 +1,845 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#include "Zway/message/messagereceiver.h"
-#include "Zway/message/messageevent.h"
-#include "Zway/client.h"
-
-namespace Zway {
-
-// ============================================================ //
-
-MESSAGE_RECEIVER MessageReceiver::create(Client *client, UBJ::Value &head, UBJ::Object &contactPublicKey)
-{
-    MESSAGE_RECEIVER res = MESSAGE_RECEIVER(new MessageReceiver(client, contactPublicKey));
-
-    if (!res->init(head)) {
-
-        return nullptr;
-    }
-
-    return res;
-}
-
-// ============================================================ //
-
-MessageReceiver::MessageReceiver(Client *client, UBJ::Object &contactPublicKey)
-    : m_client(client),
-      m_messagePart(0),
-      m_messageParts(0),
-      m_partsProcessed(0),
-      m_status(0),
-      m_completed(false),
-      m_publicKey(contactPublicKey),
-      m_sha2(Crypto::Digest::DIGEST_SHA256)
-{
-
-}
-
-// ============================================================ //
-
-bool MessageReceiver::init(UBJ::Value &head)
-{
-    if (!head.hasField("messageKey")) {
-
-        return false;
-    }
-
-    if (!head.hasField("salt")) {
-
-        return false;
-    }
-
-    if (!head.hasField("meta")) {
-
-        return false;
-    }
-
-    // decrypt message key with our private key
-
-    m_messageKey = Crypto::RSA::decrypt(m_client->storage()->privateKey(), head["messageKey"].buffer());
-
-    if (!m_messageKey) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    m_aes.setKey(m_messageKey);
-
-    m_salt = head["salt"].buffer();
-
-    BUFFER metaData = head["meta"].buffer();
-
-    m_aes.setCtr(m_salt);
-
-    m_aes.decrypt(metaData, metaData, metaData->size());
-
-    if (!UBJ::Value::Reader::read(m_meta, metaData)) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    // create index over resource meta data
-
-    UBJ::Array arr = m_meta["resources"];
-
-    for (auto it : arr.values()) {
-
-        m_resourceMetaData[it.second["id"].toInt()] = it.second;
-    }
-
-    // create message
-
-    m_messageParts = head["messageParts"].toInt();
-
-    m_msg = Message::create();
-
-    m_msg->setId(head["messageId"].toInt());
-
-    m_msg->setStatus(Message::Incoming);
-
-    m_msg->setHistory(m_client->storage()->latestHistory(head["messageSrc"].toInt()));
-
-    m_msg->setSrc(head["messageSrc"].toInt());
-
-    m_msg->setDst(head["messageDst"].toInt());
-
-    // store message
-
-    m_client->storage()->storeMessage(m_msg);
-
-    // raise event
-
-    m_client->postEvent(MessageEvent::create(Event::MessageIncoming, m_msg));
-
-    return true;
-}
-
-// ============================================================ //
-
-bool MessageReceiver::process(PACKET pkt, const UBJ::Value &head)
-{
-    if (!head.hasField("resourceId")) {
-
-        return false;
-    }
-
-    uint32_t resourceId = head["resourceId"].toInt();
-
-    uint32_t resourceSize = head["resourceSize"].toInt();
-
-    uint32_t resourceType = head["resourceType"].toInt();
-
-    uint32_t resourcePart = head["resourcePart"].toInt();
-
-    uint32_t resourceParts = head["resourceParts"].toInt();
-
-    std::string resourceName;
-
-    BUFFER buf = Buffer::create(pkt->getBody());
-
-    if (!buf) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    RESOURCE res;
-
-    if (m_skipResource.find(resourceId) == m_skipResource.end()) {
-
-        res = m_msg->resourceById(resourceId);
-
-        if (!res) {
-
-            UBJ::Object resourceMetaData = m_resourceMetaData[resourceId];
-
-            resourceName = resourceMetaData["name"].toString();
-
-            if (resourceType != Resource::TextType) {
-
-                // try to find node with same name
-
-                RESOURCE r = m_client->storage()->getResource(
-                        UBJ_OBJ(
-                            "name"   << resourceName <<
-                            "parent" << m_client->storage()->incomingDir(m_msg->src())));
-
-                if (r) {
-
-                    // check md5
-
-                    BUFFER md5 = resourceMetaData["hash"].buffer();
-
-                    if (r->md5()->equals(md5)) {
-
-                        m_skipResource[resourceId] = true;
-
-                        m_msg->addResource(r);
-
-                        // raise event
-
-                        UBJ::Object data;
-
-                        data["replaced"] =
-                                UBJ_OBJ(
-                                    "src" << resourceId <<
-                                    "dst" << r->id());
-
-                        m_client->postEvent(MessageEvent::create(Event::ResourceRecv, m_msg, r, data));
-                    }
-                    else {
-
-                        // rename resource
-                    }
-                }
-            }
-
-            if (m_skipResource.find(resourceId) == m_skipResource.end()) {
-
-                // create resource
-
-                res = Resource::create();
-
-                res->setId(resourceId);
-
-                res->setType((Zway::Resource::Type)resourceType);
-
-                res->setName(resourceName);
-
-                m_msg->addResource(res);
-
-                m_resourceParts[res->id()] = 0;
-
-                if (res->type() != Resource::TextType) {
-
-                    uint32_t incomingDir = m_client->storage()->incomingDir(m_msg->src());
-
-                    // create storage node
-
-                    if (!m_client->storage()->storeResource(res, m_msg, resourceSize, incomingDir)) {
-
-                        // TODO error event
-
-                        return false;
-                    }
-
-                    // open body blob
-
-                    if (!m_client->storage()->openBodyBlob(resourceId)) {
-
-                        // TODO error event
-
-                        return false;
-                    }
-                }
-                else {
-
-                    BUFFER resourceBuffer = Buffer::create(nullptr, resourceSize);
-
-                    if (!resourceBuffer) {
-
-                        // TODO error event
-
-                        return false;
-                    }
-
-                    res->setData(resourceBuffer);
-                }
-            }
-
-            // increment salt
-
-            incrementSalt();
-
-            m_aes.setCtr(m_salt);
-        }
-    }
-
-    if (m_skipResource.find(resourceId) == m_skipResource.end()) {
-
-        // update digest
-
-        m_sha2.update(buf->data(), buf->size());
-
-        // decrypt data
-
-        // TODO decrypt directly to storage
-
-        m_aes.decrypt(buf, buf, buf->size());
-
-        // write resource part to storage
-
-        uint32_t offset = resourcePart * MAX_PACKET_BODY;
-
-        if (res->type() != Resource::TextType) {
-
-            if (!m_client->storage()->writeBodyBlob(resourceId, buf->data(), buf->size(), offset)) {
-
-                // TODO error event
-
-                return false;
-            }
-        }
-        else {
-
-            if (!res->data()->write(buf->data(), buf->size(), offset)) {
-
-                // TODO error event
-
-                return false;
-            }
-        }
-
-        // check whether the resource has completed
-
-        if (++m_resourceParts[res->id()] == resourceParts) {
-
-            // resource completed
-
-            if (res->type() != Resource::TextType) {
-
-                m_client->storage()->closeBodyBlob(resourceId);
-            }
-
-            // verify
-
-            BUFFER digest = Buffer::create(nullptr, 32);
-
-            m_sha2.result(digest->data(), digest->size());
-
-            if (!head.hasField("signature")) {
-
-                // TODO: delete resource
-
-                m_client->postEvent(ERROR_EVENT(0, "Missing resource signature!"));
-
-                return false;
-            }
-
-            if (!Crypto::RSA::verify(m_publicKey, digest, head["signature"].buffer())) {
-
-                // TODO: delete resource
-
-                m_client->postEvent(ERROR_EVENT(0, "Failed to verify resource signature!"));
-
-                return false;
-            }
-
-            if (m_partsProcessed + 1 == m_messageParts) {
-
-                Zway::Message::Lock lock(*m_msg);
-
-                m_msg->setTime(time(nullptr));
-
-                m_msg->setStatus(Message::Recv);
-            }
-
-            m_client->postEvent(MessageEvent::create(Event::ResourceRecv, m_msg, res));
-        }
-    }
-
-    m_partsProcessed++;
-
-    if (m_partsProcessed == m_messageParts) {
-
-        m_completed = true;
-
-        {
-            Zway::Message::Lock lock(*m_msg);
-
-            m_msg->setTime(time(nullptr));
-
-            m_msg->setStatus(Message::Recv);
-
-            m_client->storage()->updateMessage(m_msg);
-        }
-
-        // raise event
-
-        m_client->postEvent(MessageEvent::create(Event::MessageRecv, m_msg));
-    }
-
-	return true;
-}
-
-// ============================================================ //
-
-bool MessageReceiver::completed()
-{
-    return m_completed;
-}
-
-// ============================================================ //
-
-void MessageReceiver::incrementSalt()
-{
-    if (m_salt) {
-
-        uint32_t *p = (uint32_t*)(m_salt->data() + 12);
-
-        (*p)++;
-    }
-}
-
-// ============================================================ //
-
-}
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/message/messagereceiver.h"
+#include "Zway/message/messageevent.h"
+#include "Zway/client.h"
+
+#include <algorithm>
+
+namespace Zway {
+
+// ============================================================ //
+
+MESSAGE_RECEIVER MessageReceiver::create(Client *client, UBJ::Value &head, UBJ::Object &contactPublicKey)
+{
+    MESSAGE_RECEIVER res = MESSAGE_RECEIVER(new MessageReceiver(client, contactPublicKey));
+
+    if (!res->init(head)) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Restore a receiver from persisted transfer state
+/*!
+ *  Used when the remaining parts of a message arrive after a restart
+ */
+
+MESSAGE_RECEIVER MessageReceiver::restore(Client *client, const UBJ::Object &state, UBJ::Object &contactPublicKey)
+{
+    MESSAGE_RECEIVER res = MESSAGE_RECEIVER(new MessageReceiver(client, contactPublicKey));
+
+    if (!res->restoreState(state)) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+MessageReceiver::MessageReceiver(Client *client, UBJ::Object &contactPublicKey)
+    : m_client(client),
+      m_messagePart(0),
+      m_messageParts(0),
+      m_partsProcessed(0),
+      m_bytesProcessed(0),
+      m_status(0),
+      m_completed(false),
+      m_publicKey(contactPublicKey)
+{
+    Metrics::instance().add(Metrics::ActiveReceivers, 1);
+}
+
+// ============================================================ //
+
+MessageReceiver::~MessageReceiver()
+{
+    Metrics::instance().add(Metrics::ActiveReceivers, -1);
+}
+
+// ============================================================ //
+
+bool MessageReceiver::init(UBJ::Value &head)
+{
+    if (!head.hasField("messageKey")) {
+
+        return false;
+    }
+
+    if (!head.hasField("salt")) {
+
+        return false;
+    }
+
+    if (!head.hasField("meta")) {
+
+        return false;
+    }
+
+    // decrypt message key with our private key
+
+    m_messageKey = Crypto::Key::decrypt(m_client->storage()->privateKey(), head["messageKey"].buffer());
+
+    if (!m_messageKey) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    m_aes.setKey(m_messageKey);
+
+    m_salt = head["salt"].buffer();
+
+    BUFFER metaData = head["meta"].buffer();
+
+    m_aes.setCtr(m_salt);
+
+    m_aes.decrypt(metaData, metaData, metaData->size());
+
+    // verify meta data, it holds the hash tree roots of all resources
+
+    if (!head.hasField("signature")) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Missing message signature!"));
+
+        return false;
+    }
+
+    if (!Crypto::Key::verify(
+            m_publicKey,
+            Crypto::Digest::digest(metaData, Crypto::Digest::DIGEST_SHA256),
+            head["signature"].buffer())) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Failed to verify message signature!"));
+
+        return false;
+    }
+
+    if (!UBJ::Value::Reader::read(m_meta, metaData)) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    // part counts come from the signed meta data, the head
+    // has to agree with it
+
+    if (!indexResources() || head["messageParts"].toInt() != m_messageParts) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Invalid message meta data!"));
+
+        return false;
+    }
+
+    // create message
+
+    m_msg = Message::create();
+
+    m_msg->setId(head["messageId"].toInt());
+
+    m_msg->setStatus(Message::Incoming);
+
+    m_msg->setHistory(m_client->storage()->latestHistory(head["messageSrc"].toInt()));
+
+    m_msg->setSrc(head["messageSrc"].toInt());
+
+    m_msg->setDst(head["messageDst"].toInt());
+
+    // store message
+
+    m_client->storage()->storeMessage(m_msg);
+
+    // remember transfer in case it gets interrupted, a single
+    // part is simply sent again by the server
+
+    if (m_messageParts > 1) {
+
+        saveState();
+    }
+
+    // raise event
+
+    m_client->postEvent(MessageEvent::create(Event::MessageIncoming, m_msg));
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MessageReceiver::restoreState(const UBJ::Object &state)
+{
+    m_messageKey = state["key"].buffer();
+
+    m_salt = state["salt"].buffer();
+
+    if (!m_messageKey || !m_salt) {
+
+        return false;
+    }
+
+    m_aes.setKey(m_messageKey);
+
+    m_meta = state["meta"];
+
+    if (!indexResources()) {
+
+        return false;
+    }
+
+    m_messageParts = state["messageParts"].toInt();
+
+    m_partsProcessed = state["partsProcessed"].toInt();
+
+    m_bytesProcessed = state["bytesProcessed"].toInt();
+
+    // received parts
+
+    UBJ::Value received = state["received"];
+
+    for (size_t i=0; i<received.numValues(); ++i) {
+
+        UBJ::Value r = received[i];
+
+        uint32_t resourceId = r["id"].toInt();
+
+        uint32_t parts = m_resourceMetaData[resourceId]["parts"].toInt();
+
+        BUFFER bits = r["bits"].buffer();
+
+        std::vector<bool> &receivedParts = m_receivedParts[resourceId];
+
+        receivedParts.resize(parts, false);
+
+        for (uint32_t part=0; bits && part<parts && part/8 < bits->size(); ++part) {
+
+            receivedParts[part] = (bits->data()[part/8] >> (part%8)) & 1;
+        }
+    }
+
+    UBJ::Value skip = state["skip"];
+
+    for (size_t i=0; i<skip.numValues(); ++i) {
+
+        m_skipResource[skip[i].toInt()] = true;
+    }
+
+    // recreate message
+
+    m_msg = Message::create();
+
+    m_msg->setId(state["messageId"].toInt());
+
+    m_msg->setStatus(Message::Incoming);
+
+    m_msg->setHistory(state["history"].toInt());
+
+    m_msg->setSrc(state["messageSrc"].toInt());
+
+    m_msg->setDst(state["messageDst"].toInt());
+
+    UBJ::Value resources = state["resources"];
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value r = resources[i];
+
+        RESOURCE res = Resource::create();
+
+        res->setId(r["id"].toInt());
+
+        res->setType((Zway::Resource::Type)r["type"].toInt());
+
+        res->setName(r["name"].toString());
+
+        m_msg->addResource(res);
+
+        if (!r.hasField("parts")) {
+
+            continue;
+        }
+
+        uint32_t parts = r["parts"].toInt();
+
+        m_resourceParts[res->id()] = parts;
+
+        if (res->type() == Resource::TextType) {
+
+            res->setData(r["data"].buffer());
+        }
+        else
+        if (parts < (uint32_t)m_resourceMetaData[res->id()]["parts"].toInt()) {
+
+            // continue writing the resource
+
+            if (!m_client->storage()->openBodyBlob(res->id())) {
+
+                // TODO error event
+
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MessageReceiver::process(PACKET pkt, const UBJ::Value &head)
+{
+    if (!head.hasField("resourceId")) {
+
+        return false;
+    }
+
+    uint32_t resourceId = head["resourceId"].toInt();
+
+    uint32_t resourceType = head["resourceType"].toInt();
+
+    uint32_t resourcePart = head["resourcePart"].toInt();
+
+    std::string resourceName;
+
+    // size and part count are taken from the signed meta data,
+    // nothing is allocated for a part whose head disagrees
+
+    auto meta = m_resourceMetaData.find(resourceId);
+
+    if (meta == m_resourceMetaData.end()) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Invalid message part!"));
+
+        return false;
+    }
+
+    uint32_t resourceSize = (uint32_t)meta->second["size"].toInt();
+
+    uint32_t resourceParts = (uint32_t)meta->second["parts"].toInt();
+
+    uint32_t offset = resourcePart * MAX_PACKET_BODY;
+
+    if (resourcePart >= resourceParts ||
+            (uint32_t)head["resourceSize"].toInt() != resourceSize ||
+            (uint32_t)head["resourceParts"].toInt() != resourceParts ||
+            pkt->getBodySize() != std::min(MAX_PACKET_BODY, resourceSize - offset)) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Invalid message part!"));
+
+        return false;
+    }
+
+    // parts may arrive in any order, and again after a resume
+
+    std::vector<bool> &receivedParts = m_receivedParts[resourceId];
+
+    if (receivedParts.empty()) {
+
+        receivedParts.resize(resourceParts, false);
+    }
+
+    if (resourcePart >= receivedParts.size()) {
+
+        return false;
+    }
+
+    if (receivedParts[resourcePart]) {
+
+        return true;
+    }
+
+    BUFFER buf = Buffer::create(pkt->getBody());
+
+    if (!buf) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    // verify the part against the signed root before it goes anywhere
+
+    BUFFER root = Crypto::MerkleTree::root(
+            Crypto::MerkleTree::leaf(buf->data(), buf->size()),
+            resourcePart,
+            resourceParts,
+            head["proof"].buffer());
+
+    if (!root || !root->equals(meta->second["root"].buffer())) {
+
+        m_client->postEvent(ERROR_EVENT(0, "Failed to verify message part!"));
+
+        return false;
+    }
+
+    RESOURCE res;
+
+    if (m_skipResource.find(resourceId) == m_skipResource.end()) {
+
+        res = m_msg->resourceById(resourceId);
+
+        if (!res) {
+
+            UBJ::Object resourceMetaData = meta->second;
+
+            resourceName = resourceMetaData["name"].toString();
+
+            if (resourceType != Resource::TextType) {
+
+                // try to find node with same name
+
+                RESOURCE r = m_client->storage()->getResource(
+                        UBJ_OBJ(
+                            "name"   << resourceName <<
+                            "parent" << m_client->storage()->incomingDir(m_msg->src())));
+
+                if (r) {
+
+                    // check hash, older senders only provide md5
+
+                    bool same = false;
+
+                    if (resourceMetaData.hasField("blake2b")) {
+
+                        BUFFER hash = r->hash();
+
+                        same = hash && hash->equals(resourceMetaData["blake2b"].buffer());
+                    }
+                    else {
+
+                        BUFFER md5 = r->md5();
+
+                        same = md5 && md5->equals(resourceMetaData["hash"].buffer());
+                    }
+
+                    if (same) {
+
+                        m_skipResource[resourceId] = true;
+
+                        m_msg->addResource(r);
+
+                        // raise event
+
+                        UBJ::Object data;
+
+                        data["replaced"] =
+                                UBJ_OBJ(
+                                    "src" << resourceId <<
+                                    "dst" << r->id());
+
+                        m_client->postEvent(MessageEvent::create(Event::ResourceRecv, m_msg, r, data));
+                    }
+                    else {
+
+                        // rename resource
+                    }
+                }
+            }
+
+            if (m_skipResource.find(resourceId) == m_skipResource.end()) {
+
+                // create resource
+
+                res = Resource::create();
+
+                res->setId(resourceId);
+
+                res->setType((Zway::Resource::Type)resourceType);
+
+                res->setName(resourceName);
+
+                m_msg->addResource(res);
+
+                m_resourceParts[res->id()] = 0;
+
+                if (res->type() != Resource::TextType) {
+
+                    uint32_t incomingDir = m_client->storage()->incomingDir(m_msg->src());
+
+                    // create storage node, a resumed transfer may already have one
+
+                    if (!m_client->storage()->storeResource(res, m_msg, resourceSize, incomingDir) &&
+                            !m_client->storage()->getNode(UBJ_OBJ("id" << resourceId), UBJ::Object(), UBJ_ARR("id"))) {
+
+                        // TODO error event
+
+                        return false;
+                    }
+
+                    // open body blob
+
+                    if (!m_client->storage()->openBodyBlob(resourceId)) {
+
+                        // TODO error event
+
+                        return false;
+                    }
+                }
+                else {
+
+                    BUFFER resourceBuffer = Buffer::create(nullptr, resourceSize);
+
+                    if (!resourceBuffer) {
+
+                        // TODO error event
+
+                        return false;
+                    }
+
+                    res->setData(resourceBuffer);
+                }
+            }
+        }
+    }
+
+    bool resourceCompleted = false;
+
+    if (m_skipResource.find(resourceId) == m_skipResource.end()) {
+
+        // decrypt data
+
+        // TODO decrypt directly to storage
+
+        m_aes.setCtr(resourceSalt(resourceId), (uint64_t)offset);
+
+        m_aes.decrypt(buf, buf, buf->size());
+
+        // write resource part to storage
+
+        if (res->type() != Resource::TextType) {
+
+            if (!m_client->storage()->writeBodyBlob(resourceId, buf->data(), buf->size(), offset)) {
+
+                // TODO error event
+
+                return false;
+            }
+        }
+        else {
+
+            if (!res->data()->write(buf->data(), buf->size(), offset)) {
+
+                // TODO error event
+
+                return false;
+            }
+        }
+
+        receivedParts[resourcePart] = true;
+
+        // check whether the resource has completed
+
+        if (++m_resourceParts[res->id()] == resourceParts) {
+
+            // resource completed
+
+            resourceCompleted = true;
+
+            if (res->type() != Resource::TextType) {
+
+                m_client->storage()->closeBodyBlob(resourceId);
+            }
+
+            if (m_partsProcessed + 1 == m_messageParts) {
+
+                Zway::Message::Lock lock(*m_msg);
+
+                m_msg->setTime(time(nullptr));
+
+                m_msg->setStatus(Message::Recv);
+            }
+
+            m_client->postEvent(MessageEvent::create(Event::ResourceRecv, m_msg, res));
+        }
+    }
+    else {
+
+        receivedParts[resourcePart] = true;
+    }
+
+    m_partsProcessed++;
+
+    m_bytesProcessed += buf->size();
+
+    postProgress();
+
+    if (m_partsProcessed == m_messageParts) {
+
+        m_completed = true;
+
+        if (m_messageParts > 1) {
+
+            m_client->storage()->deleteTransfer(m_msg->id(), true);
+        }
+
+        {
+            Zway::Message::Lock lock(*m_msg);
+
+            m_msg->setTime(time(nullptr));
+
+            m_msg->setStatus(Message::Recv);
+
+            m_client->storage()->updateMessage(m_msg);
+        }
+
+        // raise event
+
+        m_client->postEvent(MessageEvent::create(Event::MessageRecv, m_msg));
+    }
+    else
+    if (m_partsProcessed % TRANSFER_CHECKPOINT_PARTS == 0 || resourceCompleted) {
+
+        saveState();
+    }
+
+	return true;
+}
+
+// ============================================================ //
+
+bool MessageReceiver::completed()
+{
+    return m_completed;
+}
+
+// ============================================================ //
+
+uint32_t MessageReceiver::messageId()
+{
+    return m_msg->id();
+}
+
+// ============================================================ //
+
+//! Number of leading message parts we have
+/*!
+ *  Parts may arrive out of order, a resumed transfer
+ *  continues after the first missing one
+ */
+
+uint32_t MessageReceiver::resumePart()
+{
+    uint32_t res = 0;
+
+    UBJ::Value resources = m_meta["resources"];
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        auto it = m_receivedParts.find(resources[i]["id"].toInt());
+
+        if (it == m_receivedParts.end()) {
+
+            break;
+        }
+
+        for (bool received : it->second) {
+
+            if (!received) {
+
+                return res;
+            }
+
+            res++;
+        }
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Index the resource meta data
+/*!
+ *  The position in the index determines the resource salt.
+ *  Fails unless the part count of every resource matches its
+ *  size, the message parts are summed up on the way.
+ */
+
+bool MessageReceiver::indexResources()
+{
+    UBJ::Value resources = m_meta["resources"];
+
+    uint32_t messageParts = 0;
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value r = resources[i];
+
+        uint32_t size = r["size"].toInt();
+
+        uint32_t parts = r["parts"].toInt();
+
+        if (!size || parts != size / MAX_PACKET_BODY + (size % MAX_PACKET_BODY ? 1 : 0)) {
+
+            return false;
+        }
+
+        m_resourceMetaData[r["id"].toInt()] = r;
+
+        m_resourceIndex[r["id"].toInt()] = i;
+
+        messageParts += parts;
+    }
+
+    m_messageParts = messageParts;
+
+    return messageParts > 0;
+}
+
+// ============================================================ //
+
+BUFFER MessageReceiver::resourceSalt(uint32_t resourceId)
+{
+    // the sender increments the salt once per resource
+
+    BUFFER salt = m_salt->copy();
+
+    uint32_t *p = (uint32_t*)(salt->data() + 12);
+
+    (*p) += m_resourceIndex[resourceId] + 1;
+
+    return salt;
+}
+
+// ============================================================ //
+
+UBJ::Object MessageReceiver::state()
+{
+    UBJ::Array resources;
+
+    for (uint32_t i=0; i<m_msg->numResources(); ++i) {
+
+        RESOURCE res = m_msg->resourceByIndex(i);
+
+        UBJ::Object r = UBJ_OBJ(
+                "id"   << res->id() <<
+                "type" << res->type() <<
+                "name" << res->name());
+
+        if (m_resourceParts.find(res->id()) != m_resourceParts.end()) {
+
+            r["parts"] = m_resourceParts[res->id()];
+
+            if (res->type() == Resource::TextType && res->data()) {
+
+                r["data"] = res->data();
+            }
+        }
+
+        resources.push(r);
+    }
+
+    // received parts as bitmap per resource
+
+    UBJ::Array received;
+
+    for (auto &it : m_receivedParts) {
+
+        BUFFER bits = Buffer::create(nullptr, (it.second.size() + 7) / 8);
+
+        for (uint32_t part=0; part<it.second.size(); ++part) {
+
+            if (it.second[part]) {
+
+                bits->data()[part/8] |= 1 << (part%8);
+            }
+        }
+
+        received.push(UBJ_OBJ("id" << it.first << "bits" << bits));
+    }
+
+    UBJ::Array skip;
+
+    for (auto &it : m_skipResource) {
+
+        skip << it.first;
+    }
+
+    UBJ::Object state;
+
+    state["messageId"]      = m_msg->id();
+    state["messageSrc"]     = m_msg->src();
+    state["messageDst"]     = m_msg->dst();
+    state["history"]        = m_msg->history();
+    state["messageParts"]   = m_messageParts;
+    state["partsProcessed"] = m_partsProcessed;
+    state["bytesProcessed"] = m_bytesProcessed;
+    state["resumePart"]     = resumePart();
+    state["key"]            = m_messageKey;
+    state["salt"]           = m_salt;
+    state["meta"]           = m_meta;
+    state["resources"]      = resources;
+    state["received"]       = received;
+    state["skip"]           = skip;
+
+    return state;
+}
+
+// ============================================================ //
+
+void MessageReceiver::saveState()
+{
+    m_client->storage()->storeTransfer(m_msg->id(), true, state());
+}
+
+// ============================================================ //
+
+//! Report how much of the message has arrived
+/*!
+ *  Posted for every part, the dispatcher merges them per message.
+ */
+
+void MessageReceiver::postProgress()
+{
+    uint32_t bytes = 0;
+
+    for (auto &it : m_resourceMetaData) {
+
+        bytes += it.second["size"].toInt();
+    }
+
+    m_client->postEvent(MessageEvent::create(
+            Event::MessageProgress,
+            m_msg,
+            nullptr,
+            UBJ_OBJ(
+                "parts"     << m_messageParts <<
+                "partsDone" << m_partsProcessed <<
+                "bytes"     << bytes <<
+                "bytesDone" << m_bytesProcessed)));
+}
+
+// ============================================================ //
+
+}
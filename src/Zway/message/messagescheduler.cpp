@@ -0,0 +1,206 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/message/messagescheduler.h"
+#include "Zway/packet.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+MessageScheduler::MessageScheduler()
+    : m_quantumGranted(false)
+{
+
+}
+
+// ============================================================ //
+
+void MessageScheduler::add(MESSAGE_SENDER sender)
+{
+    if (!sender) {
+
+        return;
+    }
+
+    Flow flow = {sender, 0};
+
+    if (sender->priority() == MessageSender::InteractivePriority) {
+
+        m_interactive.push_back(flow);
+    }
+    else {
+
+        m_flows.push_back(flow);
+    }
+}
+
+// ============================================================ //
+
+bool MessageScheduler::remove(MESSAGE_SENDER sender)
+{
+    if (remove(m_interactive, sender)) {
+
+        return true;
+    }
+
+    if (!m_flows.empty() && m_flows.front().sender == sender) {
+
+        // the next flow starts with a fresh quantum
+
+        m_quantumGranted = false;
+    }
+
+    return remove(m_flows, sender);
+}
+
+// ============================================================ //
+
+MESSAGE_SENDER MessageScheduler::next()
+{
+    // interactive messages are served first, round-robin among them
+
+    if (!m_interactive.empty()) {
+
+        m_interactive.splice(m_interactive.end(), m_interactive, m_interactive.begin());
+
+        return m_interactive.back().sender;
+    }
+
+    // deficit round-robin over all other flows
+
+    while (!m_flows.empty()) {
+
+        Flow &flow = m_flows.front();
+
+        if (!m_quantumGranted) {
+
+            flow.deficit += quantum(flow.sender->priority());
+
+            m_quantumGranted = true;
+        }
+
+        uint32_t size = flow.sender->nextPartSize();
+
+        if (size <= flow.deficit) {
+
+            flow.deficit -= size;
+
+            return flow.sender;
+        }
+
+        // quantum used up, move on to the next flow
+
+        m_flows.splice(m_flows.end(), m_flows, m_flows.begin());
+
+        m_quantumGranted = false;
+    }
+
+    return nullptr;
+}
+
+// ============================================================ //
+
+void MessageScheduler::clear()
+{
+    m_interactive.clear();
+
+    m_flows.clear();
+
+    m_quantumGranted = false;
+}
+
+// ============================================================ //
+
+MESSAGE_SENDER_LIST MessageScheduler::senders()
+{
+    MESSAGE_SENDER_LIST res;
+
+    for (auto &flow : m_interactive) {
+
+        res.push_back(flow.sender);
+    }
+
+    for (auto &flow : m_flows) {
+
+        res.push_back(flow.sender);
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+uint32_t MessageScheduler::size()
+{
+    return m_interactive.size() + m_flows.size();
+}
+
+// ============================================================ //
+
+bool MessageScheduler::empty()
+{
+    return m_interactive.empty() && m_flows.empty();
+}
+
+// ============================================================ //
+
+uint32_t MessageScheduler::quantum(MessageSender::Priority priority)
+{
+    // bytes a flow may send per round, never less than one full part
+
+    switch (priority) {
+
+        case MessageSender::ImagePriority:
+
+            return 4 * MAX_PACKET_BODY;
+
+        default:
+
+            return MAX_PACKET_BODY;
+    }
+}
+
+// ============================================================ //
+
+bool MessageScheduler::remove(FLOW_LIST &flows, MESSAGE_SENDER sender)
+{
+    for (auto it = flows.begin(); it != flows.end(); ++it) {
+
+        if (it->sender == sender) {
+
+            flows.erase(it);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+}
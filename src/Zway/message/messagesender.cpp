@@ -1,539 +1,1163 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#include "Zway/message/messagesender.h"
-#include "Zway/message/messageevent.h"
-#include "Zway/client.h"
-
-#include <vector>
-
-namespace Zway {
-
-// ============================================================ //
-
-MESSAGE_SENDER MessageSender::create(Client *client, MESSAGE msg)
-{
-    MESSAGE_SENDER res = MESSAGE_SENDER(new MessageSender(client, msg));
-
-    if (!res->init()) {
-
-        return nullptr;
-    }
-
-    return res;
-}
-
-// ============================================================ //
-
-MessageSender::MessageSender(Client *client, MESSAGE message)
-    : m_client(client),
-      m_messageSize(0),
-      m_messagePart(0),
-      m_messageParts(0),
-      m_resourcePart(0),
-      m_resourceIndex(0),
-      m_status(0),
-      m_completed(false),
-      m_msg(message),
-      m_sha2(Crypto::Digest::DIGEST_SHA256)
-{
-
-}
-
-// ============================================================ //
-
-bool MessageSender::init()
-{
-    // create message id
-
-    if (!m_msg->id()) {
-
-        m_msg->setId(Crypto::mkId());
-    }
-
-    UBJ::Array resources;
-
-    // process resources
-
-    for (uint32_t i=0; i<m_msg->numResources(); ++i) {
-
-        RESOURCE res = m_msg->resourceByIndex(i);
-
-        // check whether we are going to write the resource
-        // to encrypted storage
-
-        // try to find node with same name
-
-        Zway::Storage::NODE node = m_client->storage()->getNode(
-                UBJ_OBJ(
-                    "type"   << Storage::Node::ResourceType <<
-                    "name"   << res->name() <<
-                    "parent" << m_client->storage()->outgoingDir(m_msg->dst())),
-                UBJ::Object(),
-                UBJ_ARR("user3"));
-
-        if (node) {
-
-            // has this node the same hash
-
-            if (node->user3() == Zway::Crypto::hexStr(res->md5())) {
-
-                // same content, no write
-
-                m_noStoreResource[res->id()] = true;
-            }
-            else {
-
-                // rename node
-
-                // ...
-            }
-        }
-
-        uint32_t parts = 0;
-
-        if (res->size() > 0) {
-
-            m_messageSize += res->size();
-
-            // determine resource parts
-
-            if (res->size() >= MAX_PACKET_BODY) {
-
-                parts += res->size() / MAX_PACKET_BODY;
-
-                if (res->size() % MAX_PACKET_BODY > 0) {
-
-                    parts++;
-                }
-            }
-            else {
-
-                parts++;
-            }
-
-            // create resource id
-
-            if (!res->id()) {
-
-                res->setId(Crypto::mkId());
-            }
-
-            m_resourceParts[res->id()] = parts;
-
-            m_messageParts += parts;
-
-            // add resource to meta data index
-
-            resources.push(UBJ_OBJ(
-                    "id"    << res->id() <<
-                    "name"  << res->name() <<
-                    "size"  << res->size() <<
-                    "hash"  << res->md5() <<
-                    "parts" << parts));
-        }
-    }
-
-    if (m_messageParts) {
-
-        // start with the first resource
-
-        m_res = m_msg->resourceByIndex(0);
-    }
-    else {
-
-        // nothing to do
-
-        return false;
-    }
-
-    // create and set random message key
-
-    m_messageKey = Buffer::create(nullptr, 32);
-
-    if (!m_messageKey) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    if (!Crypto::Random::random(m_messageKey->data(), m_messageKey->size(), Crypto::Random::Strong)) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    m_aes.setKey(m_messageKey);
-
-    // create salt
-
-    m_salt = Buffer::create(nullptr, 16);
-
-    if (!m_salt) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    if (!Crypto::Random::random(m_salt->data(), m_salt->size(), Crypto::Random::Strong)) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    // rsa encrypt message key with own public key
-
-    BUFFER key = Crypto::RSA::encrypt(m_client->storage()->publicKey(), m_messageKey);
-
-    if (!key) {
-
-        // TODO error event
-
-        return false;
-    }
-
-    m_messageKeysEnc[m_msg->src()] = key;
-
-    //
-
-    std::vector<uint32_t> dsts = {m_msg->dst()};
-
-    for (auto &dst : dsts) {
-
-        // get contact public key in order to encrypt the message key
-
-        UBJ::Object contact;
-
-        if (m_client->storage()->getContact(dst, contact)) {
-
-            if (!contact.hasField("publicKey")) {
-
-                // TODO error event
-
-                return false;
-            }
-
-            // encrypt the key using the contact public key
-
-            BUFFER key = Crypto::RSA::encrypt(contact["publicKey"], m_messageKey);
-
-            if (!key) {
-
-                // TODO error event
-
-                return false;
-            }
-
-            m_messageKeysEnc[dst] = key;
-        }
-    }
-
-    m_msg->setSrc(m_client->storage()->accountId());
-
-    m_msg->setStatus(Message::Outgoing);
-
-    m_client->storage()->storeMessage(m_msg);
-
-    m_meta = UBJ_OBJ("resources" << resources);
-
-    return true;
-}
-
-// ============================================================ //
-
-bool MessageSender::process()
-{
-	if (m_messageParts == 0) {
-
-		return false;
-	}
-
-    // prepare packet head
-
-    UBJ::Object head;
-
-    // do some special stuff for first message packet
-
-    if (m_messagePart == 0) {
-
-        // encrypt meta data
-
-        BUFFER meta = UBJ::Value::Writer::write(m_meta);
-
-        m_aes.setCtr(m_salt);
-
-        m_aes.encrypt(meta, meta, meta->size());
-
-        // add initial salt
-
-        head["salt"] = m_salt->copy();
-
-        // add meta data
-
-        head["meta"] = meta;
-
-        // add message keys
-
-        UBJ::Array keys;
-
-        for (auto &it : m_messageKeysEnc) {
-
-            keys << UBJ_OBJ("dst" << it.first << "key" << it.second);
-        }
-
-        head["keys"] = keys;
-    }
-
-    // do some special stuff for first resource packet
-
-    if (m_resourcePart == 0) {
-
-        // open storage blob
-
-        if (m_res->type() != Resource::TextType) {
-
-            if (m_noStoreResource.find(m_res->id()) == m_noStoreResource.end()) {
-
-                uint32_t outgoingDir = m_client->storage()->outgoingDir(m_msg->dst());
-
-                if (!m_client->storage()->storeResource(m_res, m_msg, m_res->size(), outgoingDir)) {
-
-                    // TODO error event
-
-                    return false;
-                }
-
-                if (!m_client->storage()->openBodyBlob(m_res->id())) {
-
-                    // TODO error event
-
-                    return false;
-                }
-            }
-        }
-
-        // increment salt
-
-        incrementSalt();
-
-        m_aes.setCtr(m_salt);
-    }
-
-    // message info
-
-    head["messageId"]    = m_msg->id();
-    head["messageTime"]  = m_msg->time();
-    head["messageSrc"]   = m_msg->src();
-    head["messageDst"]   = m_msg->dst();
-    head["messagePart"]  = m_messagePart;
-    head["messageParts"] = m_messageParts;
-
-    // resource info
-
-    head["resourceId"]    = m_res->id();
-    head["resourceType"]  = m_res->type();
-    head["resourceSize"]  = m_res->size();
-    head["resourcePart"]  = m_resourcePart;
-    head["resourceParts"] = m_resourceParts[m_res->id()];
-
-    // offset into resource buffer
-
-    uint32_t bodySize = MAX_PACKET_BODY;
-
-    uint32_t offset = m_resourcePart * MAX_PACKET_BODY;
-
-    // compute remaining number of bytes to send for the current resource
-
-    uint32_t remainingBytes = m_res->size() - offset;
-
-    if (remainingBytes < MAX_PACKET_BODY) {
-
-        bodySize = remainingBytes;
-    }
-
-    // pointer into resource buffer
-
-    uint8_t* ptr = m_res->data()->data() + offset;
-
-    // write to storage
-
-    if (m_res->type() != Resource::TextType) {
-
-        if (m_noStoreResource.find(m_res->id()) == m_noStoreResource.end()) {
-
-            m_client->storage()->writeBodyBlob(m_res->id(), ptr, bodySize, offset);
-        }
-    }
-
-    BUFFER buf = Buffer::create(ptr, bodySize);
-
-    // encrypt data
-
-    m_aes.encrypt(buf, buf, buf->size());
-
-    // update sha2 with encrypted data
-
-    m_sha2.update(buf->data(), buf->size());
-
-    // sign resource if last part
-
-    if (m_resourcePart == m_resourceParts[m_res->id()] - 1) {
-
-        // get digest for encrypted resource data
-
-        BUFFER digest = Buffer::create(nullptr, Crypto::Digest::DIGEST_SHA256_SIZE);
-
-        if (!digest) {
-
-            // TODO error event
-
-            return false;
-        }
-
-        m_sha2.result(digest->data(), digest->size());
-
-        // create signature
-
-        BUFFER signature = Crypto::RSA::sign(m_client->storage()->privateKey(), digest);
-
-        if (!signature) {
-
-            // TODO error event
-
-            return false;
-        }
-
-        // add signature
-
-        head["signature"] = signature;
-    }
-
-    // send message part
-
-    PACKET pkt = Packet::create(
-            Packet::Message,
-            UBJ::Value::Writer::write(head),
-            buf);
-
-    if (m_client->sendPacket(pkt) <= 0) {
-
-        m_msg->setStatus(Message::Failure);
-
-        m_client->postEvent(MessageEvent::create(Event::ResourceFailure, m_msg, m_res));
-
-        return false;
-    }
-
-	m_messagePart++;
-
-	m_resourcePart++;
-
-    if (m_resourcePart == m_resourceParts[m_res->id()]) {
-
-    	// resource completed
-
-        if (m_res->type() != Resource::TextType) {
-
-            if (m_noStoreResource.find(m_res->id()) == m_noStoreResource.end()) {
-
-                m_client->storage()->closeBodyBlob(m_res->id());
-            }
-        }
-
-        // message completed
-
-        if (m_messagePart == m_messageParts) {
-
-            Zway::Message::Lock lock(*m_msg);
-
-            m_msg->setTime(time(nullptr));
-
-            m_msg->setStatus(Message::Sent);
-
-            m_client->storage()->updateMessage(m_msg);
-        }
-
-        // raise event
-
-        m_client->postEvent(MessageEvent::create(Event::ResourceSent, m_msg, m_res));
-
-    	// next resource
-
-    	m_resourcePart = 0;
-
-    	m_resourceIndex++;
-
-        m_res = m_msg->resourceByIndex(m_resourceIndex);
-
-        if (m_res) {
-
-            // create resource id
-
-            if (!m_res->id()) {
-
-                m_res->setId(Crypto::mkId());
-            }
-        }
-    }
-
-    if (m_messagePart == m_messageParts) {
-
-        m_completed = true;
-
-        // raise event
-
-        m_client->postEvent(MessageEvent::create(Event::MessageSent, m_msg));
-    }
-
-    return true;
-}
-
-// ============================================================ //
-
-bool MessageSender::completed()
-{
-    return m_completed;
-}
-
-// ============================================================ //
-
-void MessageSender::incrementSalt()
-{
-    if (m_salt) {
-
-        uint32_t *p = (uint32_t*)(m_salt->data() + 12);
-
-        (*p)++;
-    }
-}
-
-// ============================================================ //
-
-}
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/message/messagesender.h"
+#include "Zway/message/messageevent.h"
+#include "Zway/client.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Zway {
+
+// images above this size are scheduled as bulk transfers
+
+const uint32_t BULK_RESOURCE_SIZE = 1024 * 1024;
+
+// ============================================================ //
+
+MESSAGE_SENDER MessageSender::create(Client *client, MESSAGE msg, Priority priority)
+{
+    MESSAGE_SENDER res = MESSAGE_SENDER(new MessageSender(client, msg, priority));
+
+    if (!res->init()) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+//! Restore a sender from persisted transfer state
+/*!
+ *  The sender stays suspended until resume() tells it where
+ *  the server wants the message to continue
+ */
+
+MESSAGE_SENDER MessageSender::restore(Client *client, const UBJ::Object &state)
+{
+    MESSAGE msg = Message::create();
+
+    msg->setId(state["messageId"].toInt());
+
+    msg->setSrc(state["messageSrc"].toInt());
+
+    msg->setDst(state["messageDst"].toInt());
+
+    msg->setTime(state["messageTime"].toInt());
+
+    msg->setHistory(state["history"].toInt());
+
+    msg->setStatus(Message::Outgoing);
+
+    UBJ::Value resources = state["resources"];
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value r = resources[i];
+
+        RESOURCE res;
+
+        if (r["type"].toInt() == Resource::TextType) {
+
+            res = Resource::create();
+
+            res->setData(r["data"].buffer());
+        }
+        else {
+
+            // load resource data from storage
+
+            res = client->storage()->getResource(r["node"].toInt());
+
+            if (!res) {
+
+                return nullptr;
+            }
+        }
+
+        res->setId(r["id"].toInt());
+
+        res->setType((Resource::Type)r["type"].toInt());
+
+        res->setName(r["name"].toString());
+
+        msg->addResource(res);
+    }
+
+    MESSAGE_SENDER res = MESSAGE_SENDER(new MessageSender(client, msg, (Priority)state["priority"].toInt()));
+
+    if (!res->init(state)) {
+
+        return nullptr;
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+MessageSender::MessageSender(Client *client, MESSAGE message, Priority priority)
+    : m_client(client),
+      m_messageSize(0),
+      m_messagePart(0),
+      m_messageParts(0),
+      m_resourcePart(0),
+      m_resourceIndex(0),
+      m_status(0),
+      m_completed(false),
+      m_suspended(false),
+      m_stateSaved(false),
+      m_priority(priority),
+      m_msg(message)
+{
+    Metrics::instance().add(Metrics::ActiveSenders, 1);
+}
+
+// ============================================================ //
+
+MessageSender::~MessageSender()
+{
+    Metrics::instance().add(Metrics::ActiveSenders, -1);
+}
+
+// ============================================================ //
+
+bool MessageSender::init()
+{
+    // create message id
+
+    if (!m_msg->id()) {
+
+        m_msg->setId(Crypto::mkId());
+    }
+
+    UBJ::Array resources;
+
+    bool textOnly = true;
+
+    bool bulk = false;
+
+    // process resources
+
+    for (uint32_t i=0; i<m_msg->numResources(); ++i) {
+
+        RESOURCE res = m_msg->resourceByIndex(i);
+
+        // create resource id
+
+        if (!res->id()) {
+
+            res->setId(Crypto::mkId());
+        }
+
+        // classify resource for scheduling
+
+        if (res->type() != Resource::TextType) {
+
+            textOnly = false;
+
+            if (res->type() != Resource::ImageType || res->size() > BULK_RESOURCE_SIZE) {
+
+                bulk = true;
+            }
+        }
+
+        // check whether we are going to write the resource
+        // to encrypted storage
+
+        // try to find node with same name
+
+        Zway::Storage::NODE node = m_client->storage()->getNode(
+                UBJ_OBJ(
+                    "type"   << Storage::Node::ResourceType <<
+                    "name"   << res->name() <<
+                    "parent" << m_client->storage()->outgoingDir(m_msg->dst())),
+                UBJ::Object(),
+                UBJ_ARR("user3"));
+
+        if (node) {
+
+            // has this node the same hash
+
+            if (node->user3() == res->hashHex()) {
+
+                // same content, no write
+
+                m_noStoreResource[res->id()] = true;
+
+                m_resourceNodes[res->id()] = node->id();
+            }
+            else {
+
+                // rename node
+
+                // ...
+            }
+        }
+
+        uint32_t parts = 0;
+
+        if (res->size() > 0) {
+
+            m_messageSize += res->size();
+
+            // determine resource parts
+
+            if (res->size() >= MAX_PACKET_BODY) {
+
+                parts += res->size() / MAX_PACKET_BODY;
+
+                if (res->size() % MAX_PACKET_BODY > 0) {
+
+                    parts++;
+                }
+            }
+            else {
+
+                parts++;
+            }
+
+            m_resourceParts[res->id()] = parts;
+
+            m_messageParts += parts;
+
+            // add resource to meta data index
+
+            resources.push(UBJ_OBJ(
+                    "id"    << res->id() <<
+                    "name"  << res->name() <<
+                    "size"  << res->size() <<
+                    "hash"  << res->md5() <<
+                    "blake2b" << res->hash() <<
+                    "parts" << parts));
+        }
+    }
+
+    // derive priority from content unless the caller gave a hint
+
+    if (m_priority == AutoPriority) {
+
+        m_priority = textOnly ? InteractivePriority : (bulk ? BulkPriority : ImagePriority);
+    }
+
+    if (m_messageParts) {
+
+        // start with the first resource
+
+        m_res = m_msg->resourceByIndex(0);
+    }
+    else {
+
+        // nothing to do
+
+        return false;
+    }
+
+    // create and set random message key
+
+    m_messageKey = Buffer::create(nullptr, 32);
+
+    if (!m_messageKey) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    if (!Crypto::Random::random(m_messageKey->data(), m_messageKey->size(), Crypto::Random::Strong)) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    m_aes.setKey(m_messageKey);
+
+    // create salt
+
+    m_salt = Buffer::create(nullptr, 16);
+
+    if (!m_salt) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    if (!Crypto::Random::random(m_salt->data(), m_salt->size(), Crypto::Random::Strong)) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    // collect the public keys to wrap the message key for,
+    // starting with our own
+
+    std::map<uint32_t, UBJ::Value> publicKeys;
+
+    publicKeys[m_msg->src()] = m_client->storage()->publicKey();
+
+    std::vector<uint32_t> dsts = {m_msg->dst()};
+
+    for (auto &dst : dsts) {
+
+        // get contact public key in order to encrypt the message key
+
+        UBJ::Object contact;
+
+        if (m_client->storage()->getContact(dst, contact)) {
+
+            if (!contact.hasField("publicKey")) {
+
+                // TODO error event
+
+                return false;
+            }
+
+            publicKeys[dst] = contact["publicKey"];
+        }
+    }
+
+    // encrypt the message key for all recipients at once
+
+    if (!Crypto::Key::encrypt(m_client->storage()->publicKey(), publicKeys, m_messageKey, m_messageKeysEnc)) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    m_msg->setSrc(m_client->storage()->accountId());
+
+    m_msg->setStatus(Message::Outgoing);
+
+    m_client->storage()->storeMessage(m_msg);
+
+    // write resources to storage upfront, an interrupted
+    // transfer reads them back from there
+
+    uint32_t outgoingDir = m_client->storage()->outgoingDir(m_msg->dst());
+
+    for (uint32_t i=0; i<m_msg->numResources(); ++i) {
+
+        RESOURCE res = m_msg->resourceByIndex(i);
+
+        if (res->type() == Resource::TextType || !res->size()) {
+
+            continue;
+        }
+
+        if (m_noStoreResource.find(res->id()) != m_noStoreResource.end()) {
+
+            continue;
+        }
+
+        if (!m_client->storage()->storeResource(res, m_msg, 0, outgoingDir)) {
+
+            // TODO error event
+
+            return false;
+        }
+
+        m_resourceNodes[res->id()] = res->id();
+    }
+
+    m_meta = UBJ_OBJ("resources" << resources);
+
+    m_initialSalt = m_salt->copy();
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MessageSender::init(const UBJ::Object &state)
+{
+    m_messageKey = state["key"].buffer();
+
+    m_initialSalt = state["salt"].buffer();
+
+    if (!m_messageKey || !m_initialSalt) {
+
+        return false;
+    }
+
+    m_aes.setKey(m_messageKey);
+
+    m_salt = m_initialSalt->copy();
+
+    m_meta = state["meta"];
+
+    // encrypted message keys
+
+    UBJ::Value keys = state["keys"];
+
+    for (size_t i=0; i<keys.numValues(); ++i) {
+
+        UBJ::Value key = keys[i];
+
+        m_messageKeysEnc[key["dst"].toInt()] = key["key"].buffer();
+    }
+
+    // resource parts from the meta data index
+
+    UBJ::Value resources = m_meta["resources"];
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value r = resources[i];
+
+        m_resourceParts[r["id"].toInt()] = r["parts"].toInt();
+
+        m_messageSize += r["size"].toInt();
+
+        m_messageParts += r["parts"].toInt();
+    }
+
+    // storage nodes holding the resource data
+
+    resources = state["resources"];
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value r = resources[i];
+
+        if (r["type"].toInt() != Resource::TextType) {
+
+            m_resourceNodes[r["id"].toInt()] = r["node"].toInt();
+        }
+    }
+
+    if (!m_messageParts) {
+
+        return false;
+    }
+
+    m_res = m_msg->resourceByIndex(0);
+
+    // the trees are rebuilt from their stored leaves, states
+    // written before the leaves were kept need a full pass
+
+    UBJ::Value &metaResources = m_meta["resources"];
+
+    bool rebuild = false;
+
+    for (size_t i=0; i<metaResources.numValues(); ++i) {
+
+        uint32_t resourceId = metaResources[i]["id"].toInt();
+
+        Crypto::MerkleTree &tree = m_trees[resourceId];
+
+        BUFFER leaves;
+
+        for (size_t j=0; j<resources.numValues(); ++j) {
+
+            if ((uint32_t)resources[j]["id"].toInt() == resourceId) {
+
+                leaves = resources[j]["leaves"].buffer();
+            }
+        }
+
+        if (!leaves ||
+                leaves->size() != m_resourceParts[resourceId] * Crypto::MerkleTree::HASH_SIZE ||
+                !tree.build(leaves) ||
+                !tree.root()->equals(metaResources[i]["root"].buffer())) {
+
+            rebuild = true;
+
+            break;
+        }
+    }
+
+    if (rebuild && !buildTrees()) {
+
+        return false;
+    }
+
+    m_stateSaved = true;
+
+    m_suspended = true;
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Key type to sign the meta data with
+/*!
+ *  The recipient verifies with our public key as stored on
+ *  its side, so the type is negotiated against that contact
+ */
+
+Crypto::Key::Type MessageSender::signatureType()
+{
+    UBJ::Object contact;
+
+    if (m_client->storage()->getContact(m_msg->dst(), contact) && contact.hasField("publicKey")) {
+
+        return Crypto::Key::negotiate(m_client->storage()->publicKey(), contact["publicKey"]);
+    }
+
+    return Crypto::Key::negotiate(m_client->storage()->publicKey(), m_client->storage()->publicKey());
+}
+
+// ============================================================ //
+
+//! Build hash trees over the encrypted parts of all resources
+/*!
+ *  The roots go into the signed meta data, so the receiver can
+ *  verify every part on arrival. Touches nothing but the sender,
+ *  so it may run on any thread before the sender is queued. The
+ *  encrypted parts of a small message are kept for sending.
+ */
+
+bool MessageSender::buildTrees()
+{
+    UBJ::Value &resources = m_meta["resources"];
+
+    bool keepParts = m_messageSize <= SMALL_MESSAGE_SIZE;
+
+    m_encryptedParts.clear();
+
+    m_salt = m_initialSalt->copy();
+
+    for (size_t i=0; i<resources.numValues(); ++i) {
+
+        UBJ::Value &r = resources[i];
+
+        uint32_t resourceId = r["id"].toInt();
+
+        uint32_t parts = m_resourceParts[resourceId];
+
+        RESOURCE res = m_msg->resourceById(resourceId);
+
+        if (!res || !parts) {
+
+            return false;
+        }
+
+        incrementSalt();
+
+        BUFFER leaves = Buffer::create(nullptr, parts * Crypto::MerkleTree::HASH_SIZE);
+
+        if (!leaves) {
+
+            return false;
+        }
+
+        for (uint32_t part=0; part<parts; ++part) {
+
+            BUFFER buf = encryptPart(res, part);
+
+            if (!buf) {
+
+                return false;
+            }
+
+            BUFFER leaf = Crypto::MerkleTree::leaf(buf->data(), buf->size());
+
+            if (!leaf) {
+
+                return false;
+            }
+
+            leaves->write(leaf->data(), leaf->size(), part * Crypto::MerkleTree::HASH_SIZE);
+
+            if (keepParts) {
+
+                m_encryptedParts[((uint64_t)resourceId << 32) | part] = buf;
+            }
+        }
+
+        if (!m_trees[resourceId].build(leaves)) {
+
+            return false;
+        }
+
+        r["root"] = m_trees[resourceId].root();
+    }
+
+    m_salt = m_initialSalt->copy();
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Make a new sender ready to be queued
+/*!
+ *  Called on the client once buildTrees() has run, a sender
+ *  whose trees could not be built fails. A single part is sent
+ *  right away, it only needs a state of its own once it gets
+ *  suspended.
+ */
+
+bool MessageSender::activate(bool treesBuilt)
+{
+    if (!treesBuilt) {
+
+        fail();
+
+        return false;
+    }
+
+    if (m_messageParts > 1) {
+
+        saveState();
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MessageSender::process()
+{
+	if (m_messageParts == 0 || m_completed || m_suspended) {
+
+		return false;
+	}
+
+    // prepare packet head
+
+    UBJ::Object head;
+
+    // do some special stuff for first message packet
+
+    if (m_messagePart == 0) {
+
+        BUFFER meta = UBJ::Value::Writer::write(m_meta);
+
+        // sign meta data, it holds the hash tree roots of all resources
+
+        BUFFER signature = Crypto::Key::sign(
+                m_client->storage()->privateKey(),
+                Crypto::Digest::digest(meta, Crypto::Digest::DIGEST_SHA256),
+                signatureType());
+
+        if (!signature) {
+
+            // TODO error event
+
+            return false;
+        }
+
+        head["signature"] = signature;
+
+        // encrypt meta data
+
+        m_aes.setCtr(m_salt);
+
+        m_aes.encrypt(meta, meta, meta->size());
+
+        // add initial salt
+
+        head["salt"] = m_salt->copy();
+
+        // add meta data
+
+        head["meta"] = meta;
+
+        // add message keys
+
+        UBJ::Array keys;
+
+        for (auto &it : m_messageKeysEnc) {
+
+            keys << UBJ_OBJ("dst" << it.first << "key" << it.second);
+        }
+
+        head["keys"] = keys;
+    }
+
+    // do some special stuff for first resource packet
+
+    if (m_resourcePart == 0) {
+
+        // increment salt
+
+        incrementSalt();
+    }
+
+    // message info
+
+    head["messageId"]    = m_msg->id();
+    head["messageTime"]  = m_msg->time();
+    head["messageSrc"]   = m_msg->src();
+    head["messageDst"]   = m_msg->dst();
+    head["messagePart"]  = m_messagePart;
+    head["messageParts"] = m_messageParts;
+
+    // resource info
+
+    head["resourceId"]    = m_res->id();
+    head["resourceType"]  = m_res->type();
+    head["resourceSize"]  = m_res->size();
+    head["resourcePart"]  = m_resourcePart;
+    head["resourceParts"] = m_resourceParts[m_res->id()];
+
+    // encrypt data, small messages were while building the trees
+
+    BUFFER buf;
+
+    auto encrypted = m_encryptedParts.find(((uint64_t)m_res->id() << 32) | m_resourcePart);
+
+    if (encrypted != m_encryptedParts.end()) {
+
+        buf = encrypted->second;
+
+        m_encryptedParts.erase(encrypted);
+    }
+    else {
+
+        buf = encryptPart(m_res, m_resourcePart);
+    }
+
+    if (!buf) {
+
+        // TODO error event
+
+        return false;
+    }
+
+    // add proof of the part against the signed root
+
+    BUFFER proof = m_trees[m_res->id()].proof(m_resourcePart);
+
+    if (proof && proof->size()) {
+
+        head["proof"] = proof;
+    }
+
+    // send message part
+
+    PACKET pkt = Packet::create(
+            Packet::Message,
+            UBJ::Value::Writer::write(head),
+            buf);
+
+    if (m_client->sendPacket(pkt) <= 0) {
+
+        // the message stays outgoing, it is resumed
+        // from the last part the server has seen
+
+        m_suspended = true;
+
+        if (!m_stateSaved) {
+
+            saveState();
+        }
+
+        return false;
+    }
+
+	m_messagePart++;
+
+	m_resourcePart++;
+
+    postProgress();
+
+    if (m_resourcePart == m_resourceParts[m_res->id()]) {
+
+    	// resource completed
+
+        // message completed
+
+        if (m_messagePart == m_messageParts) {
+
+            complete();
+        }
+
+        // raise event
+
+        m_client->postEvent(MessageEvent::create(Event::ResourceSent, m_msg, m_res));
+
+    	// next resource
+
+    	m_resourcePart = 0;
+
+    	m_resourceIndex++;
+
+        m_res = m_msg->resourceByIndex(m_resourceIndex);
+    }
+
+    if (m_messagePart == m_messageParts) {
+
+        m_completed = true;
+
+        // raise event
+
+        m_client->postEvent(MessageEvent::create(Event::MessageSent, m_msg));
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Continue an interrupted transfer
+/*!
+ *  messagePart is the number of parts the server has received
+ */
+
+bool MessageSender::resume(uint32_t messagePart)
+{
+    if (messagePart >= m_messageParts) {
+
+        // the server already has the whole message
+
+        m_messagePart = m_messageParts;
+
+        complete();
+
+        m_completed = true;
+
+        m_client->postEvent(MessageEvent::create(Event::MessageSent, m_msg));
+
+        return true;
+    }
+
+    if (!rewind(messagePart)) {
+
+        fail();
+
+        return false;
+    }
+
+    m_suspended = false;
+
+    return true;
+}
+
+// ============================================================ //
+
+bool MessageSender::completed()
+{
+    return m_completed;
+}
+
+// ============================================================ //
+
+bool MessageSender::suspended()
+{
+    return m_suspended;
+}
+
+// ============================================================ //
+
+MessageSender::Priority MessageSender::priority()
+{
+    return m_priority;
+}
+
+// ============================================================ //
+
+uint32_t MessageSender::nextPartSize()
+{
+    if (m_completed || !m_res) {
+
+        return 0;
+    }
+
+    uint32_t offset = m_resourcePart * MAX_PACKET_BODY;
+
+    uint32_t remainingBytes = m_res->size() - offset;
+
+    if (remainingBytes < MAX_PACKET_BODY) {
+
+        return remainingBytes;
+    }
+
+    return MAX_PACKET_BODY;
+}
+
+// ============================================================ //
+
+uint32_t MessageSender::messageId()
+{
+    return m_msg->id();
+}
+
+// ============================================================ //
+
+uint32_t MessageSender::messagePart()
+{
+    return m_messagePart;
+}
+
+// ============================================================ //
+
+uint32_t MessageSender::messageSize()
+{
+    return m_messageSize;
+}
+
+// ============================================================ //
+
+bool MessageSender::rewind(uint32_t messagePart)
+{
+    // find resource and resource part for the message part
+
+    uint32_t resourceIndex = 0;
+
+    uint32_t resourcePart = messagePart;
+
+    for (; resourceIndex < m_msg->numResources(); ++resourceIndex) {
+
+        uint32_t parts = m_resourceParts[m_msg->resourceByIndex(resourceIndex)->id()];
+
+        if (resourcePart < parts) {
+
+            break;
+        }
+
+        resourcePart -= parts;
+    }
+
+    m_res = m_msg->resourceByIndex(resourceIndex);
+
+    if (!m_res) {
+
+        return false;
+    }
+
+    m_messagePart = messagePart;
+
+    m_resourceIndex = resourceIndex;
+
+    m_resourcePart = 0;
+
+    // salt as it was before the resource started
+
+    m_salt = m_initialSalt->copy();
+
+    for (uint32_t i=0; i<resourceIndex; ++i) {
+
+        incrementSalt();
+    }
+
+    if (resourcePart > 0) {
+
+        incrementSalt();
+
+        m_resourcePart = resourcePart;
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+BUFFER MessageSender::encryptPart(RESOURCE res, uint32_t part)
+{
+    uint32_t offset = part * MAX_PACKET_BODY;
+
+    uint32_t size = res->size() - offset;
+
+    if (size > MAX_PACKET_BODY) {
+
+        size = MAX_PACKET_BODY;
+    }
+
+    BUFFER buf = Buffer::create(res->data()->data() + offset, size);
+
+    if (!buf) {
+
+        return nullptr;
+    }
+
+    // encrypt data, the counter of each part is derived from
+    // the resource salt so parts can be decrypted in any order
+
+    m_aes.setCtr(m_salt, (uint64_t)offset);
+
+    m_aes.encrypt(buf, buf, buf->size());
+
+    return buf;
+}
+
+// ============================================================ //
+
+UBJ::Object MessageSender::state()
+{
+    UBJ::Array resources;
+
+    for (uint32_t i=0; i<m_msg->numResources(); ++i) {
+
+        RESOURCE res = m_msg->resourceByIndex(i);
+
+        UBJ::Object r = UBJ_OBJ(
+                "id"   << res->id() <<
+                "type" << res->type() <<
+                "name" << res->name());
+
+        if (res->type() == Resource::TextType) {
+
+            if (res->data()) {
+
+                r["data"] = res->data();
+            }
+        }
+        else {
+
+            r["node"] = m_resourceNodes[res->id()];
+        }
+
+        // restoring rebuilds the trees from their leaves
+
+        auto tree = m_trees.find(res->id());
+
+        if (tree != m_trees.end() && tree->second.numLeaves()) {
+
+            r["leaves"] = tree->second.leaves();
+        }
+
+        resources.push(r);
+    }
+
+    UBJ::Array keys;
+
+    for (auto &it : m_messageKeysEnc) {
+
+        keys << UBJ_OBJ("dst" << it.first << "key" << it.second);
+    }
+
+    UBJ::Object state;
+
+    state["messageId"]   = m_msg->id();
+    state["messageSrc"]  = m_msg->src();
+    state["messageDst"]  = m_msg->dst();
+    state["messageTime"] = m_msg->time();
+    state["history"]     = m_msg->history();
+    state["priority"]    = m_priority;
+    state["key"]         = m_messageKey;
+    state["salt"]        = m_initialSalt;
+    state["meta"]        = m_meta;
+    state["keys"]        = keys;
+    state["resources"]   = resources;
+
+    return state;
+}
+
+// ============================================================ //
+
+void MessageSender::saveState()
+{
+    m_stateSaved = m_client->storage()->storeTransfer(m_msg->id(), false, state());
+}
+
+// ============================================================ //
+
+void MessageSender::complete()
+{
+    {
+        Zway::Message::Lock lock(*m_msg);
+
+        m_msg->setTime(time(nullptr));
+
+        m_msg->setStatus(Message::Sent);
+
+        m_client->storage()->updateMessage(m_msg);
+    }
+
+    if (m_stateSaved) {
+
+        m_client->storage()->deleteTransfer(m_msg->id(), false);
+    }
+}
+
+// ============================================================ //
+
+void MessageSender::fail()
+{
+    m_msg->setStatus(Message::Failure);
+
+    if (m_stateSaved) {
+
+        m_client->storage()->deleteTransfer(m_msg->id(), false);
+    }
+
+    m_client->postEvent(MessageEvent::create(Event::ResourceFailure, m_msg, m_res));
+}
+
+// ============================================================ //
+
+void MessageSender::incrementSalt()
+{
+    if (m_salt) {
+
+        uint32_t *p = (uint32_t*)(m_salt->data() + 12);
+
+        (*p)++;
+    }
+}
+
+// ============================================================ //
+
+//! Report how much of the message has been sent
+/*!
+ *  Posted for every part, the dispatcher merges them per message.
+ *  Bytes are derived from the position, so they stay right after
+ *  a resume.
+ */
+
+void MessageSender::postProgress()
+{
+    uint32_t bytesDone = 0;
+
+    for (uint32_t i=0; i<m_resourceIndex; ++i) {
+
+        RESOURCE res = m_msg->resourceByIndex(i);
+
+        if (res) {
+
+            bytesDone += res->size();
+        }
+    }
+
+    if (m_res) {
+
+        bytesDone += std::min<uint32_t>(m_resourcePart * MAX_PACKET_BODY, m_res->size());
+    }
+
+    m_client->postEvent(MessageEvent::create(
+            Event::MessageProgress,
+            m_msg,
+            nullptr,
+            UBJ_OBJ(
+                "parts"     << m_messageParts <<
+                "partsDone" << m_messagePart <<
+                "bytes"     << m_messageSize <<
+                "bytesDone" << bytesDone)));
+}
+
+// ============================================================ //
+
+}
@@ -25,6 +25,7 @@
 // ============================================================ //
 
 #include "Zway/message/resource.h"
+#include "Zway/crypto/crypto.h"
 #include "Zway/crypto/digest.h"
 #include <fstream>
 
@@ -42,12 +43,13 @@ Resource::Resource()
 
 // ============================================================ //
 
-void Resource::updateMD5()
+void Resource::resetHashes()
 {
-    if (m_data) {
+    MutexLocker locker(m_hashMutex);
 
-        m_md5 = Crypto::Digest::digest(m_data);
-    }
+    m_md5.reset();
+
+    m_hash.reset();
 }
 
 // ============================================================ //
@@ -78,8 +80,6 @@ RESOURCE Resource::createFromData(const std::string& name, const uint8_t* data,
 
     p->setData(buffer);
 
-    p->updateMD5();
-
     return p;
 }
 
@@ -112,8 +112,6 @@ RESOURCE Resource::createFromFile(const std::string& name, const std::string& fi
 
     p->setData(buffer);
 
-    p->updateMD5();
-
     return p;
 }
 
@@ -151,7 +149,7 @@ bool Resource::setData(const uint8_t* data, uint32_t size)
 {
     m_data = Buffer::create(data, size);
 
-    updateMD5();
+    resetHashes();
 
     return true;
 }
@@ -162,7 +160,7 @@ bool Resource::setData(BUFFER data)
 {
     m_data = data;
 
-    updateMD5();
+    resetHashes();
 
     return true;
 }
@@ -242,13 +240,66 @@ BUFFER Resource::data()
 
 // ============================================================ //
 
+//! Legacy MD5 of the data
+/*!
+ * Computed on first use and cached until the data changes. Only
+ * kept for the "hash" field older clients compare against, use
+ * hash() for anything new.
+ */
+
 BUFFER Resource::md5()
 {
+    MutexLocker locker(m_hashMutex);
+
+    if (!m_md5 && m_data) {
+
+        m_md5 = Crypto::Digest::digest(m_data, Crypto::Digest::DIGEST_MD5);
+    }
+
     return m_md5;
 }
 
 // ============================================================ //
 
+std::string Resource::md5Hex()
+{
+    BUFFER md5 = this->md5();
+
+    return md5 ? Crypto::hexStr(md5) : std::string();
+}
+
+// ============================================================ //
+
+//! BLAKE2b-256 content hash of the data
+/*!
+ * Used for deduplication in storage and for verifying received
+ * resources. Computed on first use and cached until the data
+ * changes.
+ */
+
+BUFFER Resource::hash()
+{
+    MutexLocker locker(m_hashMutex);
+
+    if (!m_hash && m_data) {
+
+        m_hash = Crypto::Digest::digest(m_data, Crypto::Digest::DIGEST_BLAKE2B);
+    }
+
+    return m_hash;
+}
+
+// ============================================================ //
+
+std::string Resource::hashHex()
+{
+    BUFFER hash = this->hash();
+
+    return hash ? Crypto::hexStr(hash) : std::string();
+}
+
+// ============================================================ //
+
 std::mutex &Resource::mutex()
 {
     return m_mutex;
@@ -0,0 +1,651 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/metrics.h"
+#include "Zway/thread.h"
+#include "Zway/request/request.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace Zway {
+
+// ============================================================ //
+
+struct HistogramData
+{
+    std::atomic<uint64_t> count;
+
+    std::atomic<uint64_t> sum;
+
+    std::atomic<uint64_t> max;
+
+    std::atomic<uint64_t> buckets[Metrics::NUM_BUCKETS];
+};
+
+// ============================================================ //
+
+struct Metrics::Shard
+{
+    Shard();
+
+    ~Shard();
+
+    HistogramData &histogram(Histogram histogram);
+
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+
+    std::atomic<int64_t> gauges[NUM_GAUGES];
+
+    std::atomic<HistogramData*> histograms[NUM_HISTOGRAMS];
+};
+
+// ============================================================ //
+
+//! Add to a value only its owner thread writes
+/*!
+ *  A relaxed load and store is enough and, unlike fetch_add,
+ *  needs no locked instruction
+ */
+
+template <typename T>
+static inline void bump(std::atomic<T> &value, T n)
+{
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+static const char *counterNames[] = {
+    "bytes_sent",
+    "bytes_recv",
+    "packets_sent",
+    "packets_recv",
+    "heartbeats_sent",
+    "heartbeats_recv",
+    "request_packets_sent",
+    "request_packets_recv",
+    "message_packets_sent",
+    "message_packets_recv"
+};
+
+static const char *gaugeNames[] = {
+    "event_queue_depth",
+    "active_senders",
+    "active_receivers"
+};
+
+static const char *histogramNames[] = {
+    "rtt_dispatch",
+    "rtt_create_account",
+    "rtt_login",
+    "rtt_config",
+    "rtt_add_contact",
+    "rtt_create_add_code",
+    "rtt_find_contact",
+    "rtt_accept_contact",
+    "rtt_reject_contact",
+    "rtt_contact_status",
+    "rtt_get_inbox",
+    "rtt_get_message",
+    "rtt_resume_message",
+    "rtt_other",
+    "storage_select",
+    "storage_insert",
+    "storage_update",
+    "storage_delete",
+    "storage_count",
+    "crypto_aes",
+    "crypto_digest",
+    "crypto_rsa",
+    "event_queue_wait",
+    "event_dispatch"
+};
+
+static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == Metrics::NUM_COUNTERS, "counter names");
+static_assert(sizeof(gaugeNames) / sizeof(gaugeNames[0]) == Metrics::NUM_GAUGES, "gauge names");
+static_assert(sizeof(histogramNames) / sizeof(histogramNames[0]) == Metrics::NUM_HISTOGRAMS, "histogram names");
+
+// ============================================================ //
+
+Metrics::Shard::Shard()
+{
+    for (uint32_t i=0; i<NUM_COUNTERS; ++i) {
+
+        counters[i] = 0;
+    }
+
+    for (uint32_t i=0; i<NUM_GAUGES; ++i) {
+
+        gauges[i] = 0;
+    }
+
+    for (uint32_t i=0; i<NUM_HISTOGRAMS; ++i) {
+
+        histograms[i] = nullptr;
+    }
+}
+
+// ============================================================ //
+
+Metrics::Shard::~Shard()
+{
+    for (uint32_t i=0; i<NUM_HISTOGRAMS; ++i) {
+
+        delete histograms[i].load();
+    }
+}
+
+// ============================================================ //
+
+//! Get a histogram, allocating its buckets on first use
+/*!
+ *  Only the owner thread allocates, the release store makes the
+ *  zeroed buckets visible to a concurrent snapshot
+ */
+
+HistogramData &Metrics::Shard::histogram(Histogram histogram)
+{
+    HistogramData *data = histograms[histogram].load(std::memory_order_relaxed);
+
+    if (!data) {
+
+        data = new HistogramData;
+
+        data->count = 0;
+
+        data->sum = 0;
+
+        data->max = 0;
+
+        for (uint32_t i=0; i<NUM_BUCKETS; ++i) {
+
+            data->buckets[i] = 0;
+        }
+
+        histograms[histogram].store(data, std::memory_order_release);
+    }
+
+    return *data;
+}
+
+// ============================================================ //
+
+Metrics::HistogramSnapshot::HistogramSnapshot()
+    : count(0),
+      sum(0),
+      max(0)
+{
+
+}
+
+// ============================================================ //
+
+//! Get the value below which p percent of the samples lie
+/*!
+ *  Reports the upper edge of the bucket, capped by the maximum
+ */
+
+uint64_t Metrics::HistogramSnapshot::percentile(double p) const
+{
+    if (!count || buckets.empty()) {
+
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(count * std::min(std::max(p, 0.0), 100.0) / 100.0 + 0.5);
+
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+
+    for (uint32_t i=0; i<buckets.size(); ++i) {
+
+        seen += buckets[i];
+
+        if (seen >= rank) {
+
+            uint64_t upper = i + 1 < NUM_BUCKETS ? bucketValue(i + 1) - 1 : max;
+
+            return std::min(upper, max);
+        }
+    }
+
+    return max;
+}
+
+// ============================================================ //
+
+uint64_t Metrics::HistogramSnapshot::mean() const
+{
+    return count ? sum / count : 0;
+}
+
+// ============================================================ //
+
+//! Format a snapshot as one "name value" line per metric
+/*!
+ *  Histograms in nanoseconds, empty ones are left out
+ */
+
+std::string Metrics::Snapshot::toString() const
+{
+    std::ostringstream out;
+
+    for (uint32_t i=0; i<NUM_COUNTERS; ++i) {
+
+        out << counterNames[i] << " " << counters[i] << "\n";
+    }
+
+    for (uint32_t i=0; i<NUM_GAUGES; ++i) {
+
+        out << gaugeNames[i] << " " << gauges[i] << "\n";
+    }
+
+    for (uint32_t i=0; i<NUM_HISTOGRAMS; ++i) {
+
+        const HistogramSnapshot &h = histograms[i];
+
+        if (!h.count) {
+
+            continue;
+        }
+
+        out << histogramNames[i]
+            << " count=" << h.count
+            << " mean=" << h.mean()
+            << " p50=" << h.percentile(50)
+            << " p90=" << h.percentile(90)
+            << " p99=" << h.percentile(99)
+            << " max=" << h.max << "\n";
+    }
+
+    return out.str();
+}
+
+// ============================================================ //
+
+Metrics::Scope::Scope(Histogram histogram)
+    : m_histogram(histogram),
+      m_start(Metrics::instance().enabled() ? now() : 0)
+{
+
+}
+
+// ============================================================ //
+
+Metrics::Scope::~Scope()
+{
+    if (m_start) {
+
+        Metrics::instance().record(m_histogram, now() - m_start);
+    }
+}
+
+// ============================================================ //
+
+//! Thread exit, fold the shard into the retired totals
+
+Metrics::ShardHolder::~ShardHolder()
+{
+    if (shard) {
+
+        Metrics::instance().retire(shard);
+    }
+}
+
+// ============================================================ //
+
+Metrics::Metrics()
+    : m_enabled(true),
+      m_retired(new Shard)
+{
+
+}
+
+// ============================================================ //
+
+//! Get the registry
+/*!
+ *  Never destroyed, threads may still record while static
+ *  objects are torn down at exit
+ */
+
+Metrics &Metrics::instance()
+{
+    static Metrics *metrics = new Metrics;
+
+    return *metrics;
+}
+
+// ============================================================ //
+
+uint64_t Metrics::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================ //
+
+const char *Metrics::name(Counter counter)
+{
+    return counter < NUM_COUNTERS ? counterNames[counter] : "";
+}
+
+// ============================================================ //
+
+const char *Metrics::name(Gauge gauge)
+{
+    return gauge < NUM_GAUGES ? gaugeNames[gauge] : "";
+}
+
+// ============================================================ //
+
+const char *Metrics::name(Histogram histogram)
+{
+    return histogram < NUM_HISTOGRAMS ? histogramNames[histogram] : "";
+}
+
+// ============================================================ //
+
+Metrics::Histogram Metrics::requestHistogram(uint32_t requestType)
+{
+    switch (requestType) {
+
+    case Request::Dispatch:
+        return RttDispatch;
+    case Request::CreateAccount:
+        return RttCreateAccount;
+    case Request::Login:
+        return RttLogin;
+    case Request::Config:
+        return RttConfig;
+    case Request::AddContact:
+        return RttAddContact;
+    case Request::CreateAddCode:
+        return RttCreateAddCode;
+    case Request::FindContact:
+        return RttFindContact;
+    case Request::AcceptContact:
+        return RttAcceptContact;
+    case Request::RejectContact:
+        return RttRejectContact;
+    case Request::ContactStatus:
+        return RttContactStatus;
+    case Request::GetInbox:
+        return RttGetInbox;
+    case Request::GetMessage:
+        return RttGetMessage;
+    case Request::ResumeMessage:
+        return RttResumeMessage;
+    default:
+        return RttOther;
+    }
+}
+
+// ============================================================ //
+
+//! Get the bucket of a value
+/*!
+ *  Values below eight have a bucket each, above that every
+ *  power of two is cut into eight by the next three bits
+ */
+
+uint32_t Metrics::bucket(uint64_t value)
+{
+    if (value < SUB_BUCKETS) {
+
+        return (uint32_t)value;
+    }
+
+    uint32_t msb = 63 - __builtin_clzll(value);
+
+    return (msb - 2) * SUB_BUCKETS + (uint32_t)((value >> (msb - 3)) & (SUB_BUCKETS - 1));
+}
+
+// ============================================================ //
+
+//! Get the lowest value of a bucket
+
+uint64_t Metrics::bucketValue(uint32_t bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+
+        return bucket;
+    }
+
+    uint32_t msb = bucket / SUB_BUCKETS + 2;
+
+    return (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (msb - 3);
+}
+
+// ============================================================ //
+
+void Metrics::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+bool Metrics::enabled() const
+{
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+// ============================================================ //
+
+void Metrics::add(Counter counter, uint64_t n)
+{
+    if (enabled()) {
+
+        bump(shard().counters[counter], n);
+    }
+}
+
+// ============================================================ //
+
+//! Move a gauge
+/*!
+ *  Always recorded, so increments and decrements stay paired
+ *  when recording is switched in between. A gauge is the sum
+ *  of all shards, a single one may well be negative.
+ */
+
+void Metrics::add(Gauge gauge, int64_t delta)
+{
+    bump(shard().gauges[gauge], delta);
+}
+
+// ============================================================ //
+
+void Metrics::record(Histogram histogram, uint64_t ns)
+{
+    if (!enabled()) {
+
+        return;
+    }
+
+    HistogramData &data = shard().histogram(histogram);
+
+    bump<uint64_t>(data.buckets[bucket(ns)], 1);
+
+    bump<uint64_t>(data.count, 1);
+
+    bump(data.sum, ns);
+
+    if (ns > data.max.load(std::memory_order_relaxed)) {
+
+        data.max.store(ns, std::memory_order_relaxed);
+    }
+}
+
+// ============================================================ //
+
+//! Sum up all shards
+/*!
+ *  Shards are read while their threads keep writing, so the
+ *  values of a snapshot are not taken at one single instant
+ */
+
+Metrics::Snapshot Metrics::snapshot()
+{
+    Snapshot snapshot;
+
+    for (uint32_t i=0; i<NUM_COUNTERS; ++i) {
+
+        snapshot.counters[i] = 0;
+    }
+
+    for (uint32_t i=0; i<NUM_GAUGES; ++i) {
+
+        snapshot.gauges[i] = 0;
+    }
+
+    MutexLocker locker(m_mutex);
+
+    merge(snapshot, *m_retired);
+
+    for (Shard *shard : m_shards) {
+
+        merge(snapshot, *shard);
+    }
+
+    return snapshot;
+}
+
+// ============================================================ //
+
+//! Get the shard of the calling thread, registering it on first use
+
+Metrics::Shard &Metrics::shard()
+{
+    static thread_local ShardHolder holder = {nullptr};
+
+    if (!holder.shard) {
+
+        holder.shard = new Shard;
+
+        MutexLocker locker(m_mutex);
+
+        m_shards.push_back(holder.shard);
+    }
+
+    return *holder.shard;
+}
+
+// ============================================================ //
+
+void Metrics::retire(Shard *shard)
+{
+    MutexLocker locker(m_mutex);
+
+    for (uint32_t i=0; i<NUM_COUNTERS; ++i) {
+
+        bump(m_retired->counters[i], shard->counters[i].load());
+    }
+
+    for (uint32_t i=0; i<NUM_GAUGES; ++i) {
+
+        bump(m_retired->gauges[i], shard->gauges[i].load());
+    }
+
+    for (uint32_t i=0; i<NUM_HISTOGRAMS; ++i) {
+
+        HistogramData *data = shard->histograms[i].load();
+
+        if (!data) {
+
+            continue;
+        }
+
+        HistogramData &retired = m_retired->histogram((Histogram)i);
+
+        for (uint32_t b=0; b<NUM_BUCKETS; ++b) {
+
+            bump(retired.buckets[b], data->buckets[b].load());
+        }
+
+        bump(retired.count, data->count.load());
+
+        bump(retired.sum, data->sum.load());
+
+        retired.max = std::max(retired.max.load(), data->max.load());
+    }
+
+    m_shards.erase(std::remove(m_shards.begin(), m_shards.end(), shard), m_shards.end());
+
+    delete shard;
+}
+
+// ============================================================ //
+
+void Metrics::merge(Snapshot &snapshot, Shard &shard)
+{
+    for (uint32_t i=0; i<NUM_COUNTERS; ++i) {
+
+        snapshot.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+
+    for (uint32_t i=0; i<NUM_GAUGES; ++i) {
+
+        snapshot.gauges[i] += shard.gauges[i].load(std::memory_order_relaxed);
+    }
+
+    for (uint32_t i=0; i<NUM_HISTOGRAMS; ++i) {
+
+        HistogramData *data = shard.histograms[i].load(std::memory_order_acquire);
+
+        if (!data) {
+
+            continue;
+        }
+
+        HistogramSnapshot &h = snapshot.histograms[i];
+
+        if (h.buckets.empty()) {
+
+            h.buckets.resize(NUM_BUCKETS, 0);
+        }
+
+        for (uint32_t b=0; b<NUM_BUCKETS; ++b) {
+
+            h.buckets[b] += data->buckets[b].load(std::memory_order_relaxed);
+        }
+
+        h.count += data->count.load(std::memory_order_relaxed);
+
+        h.sum += data->sum.load(std::memory_order_relaxed);
+
+        h.max = std::max(h.max, data->max.load(std::memory_order_relaxed));
+    }
+}
+
+// ============================================================ //
+
+}
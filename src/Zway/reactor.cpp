@@ -0,0 +1,502 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/reactor.h"
+
+#if !defined _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#include <future>
+
+namespace Zway {
+
+// ============================================================ //
+// Reactor::Loop
+// ============================================================ //
+
+#if defined _WIN32
+
+// without a wake up pipe, posted tasks are picked up this often
+
+static const int32_t POLL_INTERVAL = 50;
+
+typedef WSAPOLLFD POLL_FD;
+
+#else
+
+typedef struct pollfd POLL_FD;
+
+#endif
+
+Reactor::Loop::Loop()
+    : Thread(),
+      m_changed(true)
+{
+#if !defined _WIN32
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+#endif
+}
+
+// ============================================================ //
+
+Reactor::Loop::~Loop()
+{
+#if !defined _WIN32
+
+    for (int i=0; i<2; ++i) {
+
+        if (m_wakePipe[i] >= 0) {
+
+            ::close(m_wakePipe[i]);
+        }
+    }
+
+#endif
+}
+
+// ============================================================ //
+
+bool Reactor::Loop::run()
+{
+#if !defined _WIN32
+
+    if (m_wakePipe[0] < 0) {
+
+        if (pipe(m_wakePipe) != 0) {
+
+            return false;
+        }
+
+        for (int i=0; i<2; ++i) {
+
+            fcntl(m_wakePipe[i], F_SETFL, fcntl(m_wakePipe[i], F_GETFL) | O_NONBLOCK);
+
+            fcntl(m_wakePipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+#endif
+
+    return Thread::run();
+}
+
+// ============================================================ //
+
+void Reactor::Loop::cancel()
+{
+    Thread::cancel();
+
+    wake();
+}
+
+// ============================================================ //
+
+//! Run a task on the loop
+/*!
+ *  Tasks run in the order they were posted
+ */
+
+void Reactor::Loop::post(Task task)
+{
+    m_tasks.push(task);
+
+    wake();
+}
+
+// ============================================================ //
+
+//! Call back whenever a socket is readable
+/*!
+ *  Also when it was closed or failed, the callback finds out
+ *  by reading from it
+ */
+
+void Reactor::Loop::watch(Socket socket, Task onReadable)
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        m_watched[socket] = onReadable;
+
+        m_changed = true;
+    }
+
+    wake();
+}
+
+// ============================================================ //
+
+//! Call back once when a socket is writable again
+/*!
+ *  For a socket which took less than it was given. The watch
+ *  ends with the callback, it is set again if the socket fills
+ *  up again.
+ */
+
+void Reactor::Loop::watchWritable(Socket socket, Task onWritable)
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        m_writable[socket] = onWritable;
+
+        m_changed = true;
+    }
+
+    wake();
+}
+
+// ============================================================ //
+
+//! Stop watching a socket
+/*!
+ *  Also for writability. A callback already running is not
+ *  waited for, see sync()
+ */
+
+void Reactor::Loop::unwatch(Socket socket)
+{
+    MutexLocker locker(m_mutex);
+
+    if (m_watched.erase(socket) + m_writable.erase(socket)) {
+
+        m_changed = true;
+    }
+}
+
+// ============================================================ //
+
+//! Wait until everything posted so far has run
+/*!
+ *  Returns right away when called on the loop itself
+ */
+
+void Reactor::Loop::sync()
+{
+    if (current() || testCancel()) {
+
+        return;
+    }
+
+    std::promise<void> done;
+
+    post([&done] () {
+
+        done.set_value();
+    });
+
+    done.get_future().wait();
+}
+
+// ============================================================ //
+
+uint32_t Reactor::Loop::numWatched()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_watched.size();
+}
+
+// ============================================================ //
+
+bool Reactor::Loop::current()
+{
+    return std::this_thread::get_id() == m_thread.get_id();
+}
+
+// ============================================================ //
+
+void Reactor::Loop::onRun()
+{
+    std::vector<POLL_FD> fds;
+
+    for (;;) {
+
+        // run posted tasks
+
+        Task task;
+
+        while (m_tasks.pop(task)) {
+
+            task();
+
+            task = nullptr;
+        }
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        // rebuild the poll set only when sockets came or went
+
+        {
+            MutexLocker locker(m_mutex);
+
+            if (m_changed) {
+
+                fds.clear();
+
+#if !defined _WIN32
+
+                POLL_FD wakeFd;
+                wakeFd.fd = m_wakePipe[0];
+                wakeFd.events = POLLIN;
+                wakeFd.revents = 0;
+
+                fds.push_back(wakeFd);
+
+#endif
+
+                for (auto &it : m_watched) {
+
+                    POLL_FD fd;
+                    fd.fd = it.first;
+                    fd.events = POLLIN;
+                    fd.revents = 0;
+
+                    if (m_writable.count(it.first)) {
+
+                        fd.events |= POLLOUT;
+                    }
+
+                    fds.push_back(fd);
+                }
+
+                for (auto &it : m_writable) {
+
+                    if (!m_watched.count(it.first)) {
+
+                        POLL_FD fd;
+                        fd.fd = it.first;
+                        fd.events = POLLOUT;
+                        fd.revents = 0;
+
+                        fds.push_back(fd);
+                    }
+                }
+
+                m_changed = false;
+            }
+        }
+
+        // wait for readable sockets and those waited on to become
+        // writable, a posted task wakes us up
+
+#if defined _WIN32
+
+        if (fds.empty()) {
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL));
+
+            continue;
+        }
+
+        int32_t res = WSAPoll(fds.data(), fds.size(), POLL_INTERVAL);
+
+#else
+
+        int32_t res = poll(fds.data(), fds.size(), -1);
+
+#endif
+
+        if (res <= 0) {
+
+            continue;
+        }
+
+        for (auto &fd : fds) {
+
+            if (!fd.revents) {
+
+                continue;
+            }
+
+#if !defined _WIN32
+
+            if (fd.fd == m_wakePipe[0]) {
+
+                char buf[64];
+
+                while (::read(fd.fd, buf, sizeof(buf)) > 0);
+
+                continue;
+            }
+
+#endif
+
+            // the socket may have been unwatched by an earlier callback
+
+            Task onReadable;
+
+            if (fd.revents & ~POLLOUT) {
+
+                MutexLocker locker(m_mutex);
+
+                auto it = m_watched.find(fd.fd);
+
+                if (it != m_watched.end()) {
+
+                    onReadable = it->second;
+                }
+            }
+
+            if (onReadable) {
+
+                onReadable();
+            }
+
+            // writability is watched for once
+
+            Task onWritable;
+
+            if (fd.revents & POLLOUT) {
+
+                MutexLocker locker(m_mutex);
+
+                auto it = m_writable.find(fd.fd);
+
+                if (it != m_writable.end()) {
+
+                    onWritable = it->second;
+
+                    m_writable.erase(it);
+
+                    m_changed = true;
+                }
+            }
+
+            if (onWritable) {
+
+                onWritable();
+            }
+        }
+    }
+}
+
+// ============================================================ //
+
+void Reactor::Loop::wake()
+{
+#if !defined _WIN32
+
+    if (m_wakePipe[1] >= 0) {
+
+        // a full pipe has a wake up pending already
+
+        char c = 0;
+
+        ssize_t res = ::write(m_wakePipe[1], &c, 1);
+
+        (void)res;
+    }
+
+#endif
+}
+
+// ============================================================ //
+// Reactor
+// ============================================================ //
+
+Reactor::Reactor(uint32_t numLoops)
+    : m_next(0)
+{
+    if (!numLoops) {
+
+        numLoops = std::thread::hardware_concurrency();
+
+        if (!numLoops) {
+
+            numLoops = 2;
+        }
+    }
+
+    for (uint32_t i=0; i<numLoops; ++i) {
+
+        m_loops.push_back(std::unique_ptr<Loop>(new Loop()));
+    }
+}
+
+// ============================================================ //
+
+Reactor::~Reactor()
+{
+
+}
+
+// ============================================================ //
+
+bool Reactor::run()
+{
+    for (auto &loop : m_loops) {
+
+        if (!loop->run()) {
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void Reactor::cancelAndJoin()
+{
+    for (auto &loop : m_loops) {
+
+        loop->cancel();
+    }
+
+    for (auto &loop : m_loops) {
+
+        loop->join();
+    }
+}
+
+// ============================================================ //
+
+uint32_t Reactor::numLoops()
+{
+    return m_loops.size();
+}
+
+// ============================================================ //
+
+//! Hand out the loops in turn
+
+Reactor::Loop *Reactor::next()
+{
+    return m_loops[m_next++ % m_loops.size()].get();
+}
+
+// ============================================================ //
+
+}
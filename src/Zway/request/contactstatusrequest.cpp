@@ -26,21 +26,40 @@
 
 #include "Zway/request/contactstatusrequest.h"
 #include "Zway/client.h"
+#include "Zway/contactstatusmap.h"
 
 namespace Zway {
 
 // ============================================================ //
 
-CONTACT_STATUS_REQUEST ContactStatusRequest::create(const UBJ::Value &contacts, STORAGE storage)
+CONTACT_STATUS_REQUEST ContactStatusRequest::create(
+        const UBJ::Value &contacts,
+        STORAGE storage,
+        uint32_t epoch,
+        uint32_t version)
 {
-    return CONTACT_STATUS_REQUEST(new ContactStatusRequest(contacts, storage));
+    return CONTACT_STATUS_REQUEST(new ContactStatusRequest(contacts, storage, epoch, version));
 }
 
 // ============================================================ //
 
-ContactStatusRequest::ContactStatusRequest(const UBJ::Value &contacts, STORAGE storage)
+//! Ask for the status of contacts
+/*!
+ *  Contact ids go out as array and as packed id list. Servers
+ *  that understand the packed list can, given the epoch and
+ *  version of the status set we have, answer with a diff. With
+ *  zeros they send the full set.
+ */
+
+ContactStatusRequest::ContactStatusRequest(
+        const UBJ::Value &contacts,
+        STORAGE storage,
+        uint32_t epoch,
+        uint32_t version)
     : Request(ContactStatus, DEFAULT_TIMEOUT, 0)
 {
+    std::vector<uint32_t> ids;
+
     if (!contacts.numValues() && storage) {
 
         UBJ::Array arr;
@@ -50,14 +69,27 @@ ContactStatusRequest::ContactStatusRequest(const UBJ::Value &contacts, STORAGE s
         for (auto &contact : contactList) {
 
             arr << contact->user1();
+
+            ids.push_back(contact->user1());
         }
 
         m_head["contacts"] = arr;
     }
     else {
 
+        for (size_t i=0; i<contacts.numValues(); ++i) {
+
+            ids.push_back(contacts[i].toInt());
+        }
+
         m_head["contacts"] = contacts;
     }
+
+    m_head["contactsPacked"] = ContactStatusMap::packIds(ids);
+
+    m_head["epoch"] = epoch;
+
+    m_head["version"] = version;
 }
 
 // ============================================================ //
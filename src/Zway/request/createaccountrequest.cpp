@@ -49,29 +49,77 @@ CreateAccountRequest::CreateAccountRequest(
       m_storagePassword(storagePassword),
       m_callback(callback)
 {
-    // create rsa key pair
+    // set request args
 
-    UBJ::Object publicKey;
-    UBJ::Object privateKey;
+    m_head["label"] = account["label"];
+    m_head["findByLabel"] = account["findByLabel"];
+    m_head["findByPhone"] = account["findByPhone"];
+}
 
-    if (Crypto::RSA::createKeyPair(publicKey, privateKey, 2048)) {
+// ============================================================ //
 
-        m_keys["publicKey"] = publicKey;
-        m_keys["privateKey"] = privateKey;
-    }
-    else {
+//! Start the request once the account keys are there
+/*!
+ *  The request stays inactive while a key pair is generated,
+ *  a pregenerated one from the key pool starts it right away.
+ */
 
-        setStatus(Error);
+bool CreateAccountRequest::start()
+{
+    setStatus(Inactive);
 
-        return;
+    REQUEST self = shared_from_this();
 
-    }
+    CLIENT_HANDLE handle = m_client->handle();
 
-    // set request args
+    Crypto::KeyPool::instance().take([this, self, handle] (bool res, const UBJ::Object &publicKey, const UBJ::Object &privateKey) {
 
-    m_head["label"] = account["label"];
-    m_head["findByLabel"] = account["findByLabel"];
-    m_head["findByPhone"] = account["findByPhone"];
+        // the key pair may arrive after the client was closed,
+        // the request is dropped then
+
+        handle->call([&] (Client *client) {
+
+            if (!res) {
+
+                setStatus(Error);
+
+                client->postEvent(RequestEvent::create(
+                        0,
+                        self,
+                        UBJ::Object(),
+                        ERROR_INFO("failed to create key pair"),
+                        [this] (EVENT event) {
+                            invokeCallback(event);
+                        }));
+
+                return;
+            }
+
+            m_keys["publicKey"] = publicKey;
+
+            m_keys["privateKey"] = privateKey;
+
+            // the timeout counts from here
+
+            Request::start();
+
+            client->queueRequest(self);
+        });
+    });
+
+    return true;
+}
+
+// ============================================================ //
+
+bool CreateAccountRequest::checkTimeout()
+{
+    if (status() == Inactive) {
+
+        return false;
+    }
+
+    return Request::checkTimeout();
 }
 
 // ============================================================ //
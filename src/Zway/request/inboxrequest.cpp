@@ -25,43 +25,64 @@
 // ============================================================ //
 
 #include "Zway/request/inboxrequest.h"
+#include "Zway/request/requestevent.h"
 #include "Zway/client.h"
 
 namespace Zway {
 
 // ============================================================ //
 
-InboxRequest::Pointer InboxRequest::create()
+INBOX_REQUEST InboxRequest::create(uint32_t cursor, uint32_t limit, EVENT_CALLBACK callback)
 {
-    return InboxRequest::Pointer(new InboxRequest());
+    return INBOX_REQUEST(new InboxRequest(cursor, limit, callback));
 }
 
 // ============================================================ //
 
-InboxRequest::InboxRequest()
-    : Request(GetInbox)
+//! List the messages waiting on the server
+/*!
+ *  Asks for up to limit messages after the inbox sequence cursor.
+ *  The response carries them as two parallel arrays "ids" and
+ *  "sizes" (bytes), the "cursor" to continue from and "more" if
+ *  the listing was cut off by the limit.
+ */
+
+InboxRequest::InboxRequest(uint32_t cursor, uint32_t limit, EVENT_CALLBACK callback)
+    : Request(GetInbox),
+      m_callback(callback)
 {
+    m_head["cursor"] = cursor;
 
+    m_head["limit"] = limit;
 }
 
 // ============================================================ //
 
-bool InboxRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &/*head*/)
+bool InboxRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &head)
 {
-    /*
-    if (pkt->getId() == PID_INBOX) {
+    uint32_t status = head["status"].toInt();
 
-        finish();
+    finish();
 
-        UBJ::Object head;
+    m_client->postEvent(RequestEvent::create(
+            0,
+            shared_from_this(),
+            status == 1 ? head : UBJ::Object(),
+            status == 1 ? UBJ::Object() : ERROR_INFO(head["message"]),
+            [this] (EVENT event) {
+                invokeCallback(event);
+            }));
 
-        pkt->getHeadBson(head);
+    return true;
+}
 
-        m_client->postEvent(Event::create(EVENT_INBOX, head));
-    }
-    */
+// ============================================================ //
 
-    return true;
+void InboxRequest::invokeCallback(EVENT event)
+{
+    if (m_callback) {
+        m_callback(RequestEvent::cast(event));
+    }
 }
 
 // ============================================================ //
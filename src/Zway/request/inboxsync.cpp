@@ -0,0 +1,339 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/request/inboxsync.h"
+#include "Zway/client.h"
+
+namespace Zway {
+
+// ============================================================ //
+// InboxSync
+// ============================================================ //
+
+INBOX_SYNC InboxSync::create(Client *client, STORAGE storage)
+{
+    return INBOX_SYNC(new InboxSync(client, storage));
+}
+
+// ============================================================ //
+
+InboxSync::InboxSync(Client *client, STORAGE storage)
+    : m_client(client),
+      m_storage(storage),
+      m_running(false),
+      m_cancelled(false),
+      m_failed(false),
+      m_more(false),
+      m_cursor(0),
+      m_pageCursor(0),
+      m_inFlight(0),
+      m_fetched(0)
+{
+
+}
+
+// ============================================================ //
+
+bool InboxSync::start()
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_running || !m_storage) {
+
+            return false;
+        }
+
+        m_running = true;
+
+        m_cursor = m_storage->inboxCursor();
+    }
+
+    requestPage();
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Stop after the requests in flight, without touching the cursor
+
+void InboxSync::cancel()
+{
+    MutexLocker locker(m_mutex);
+
+    m_cancelled = true;
+
+    m_running = false;
+
+    m_pending.clear();
+}
+
+// ============================================================ //
+
+bool InboxSync::running()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_running;
+}
+
+// ============================================================ //
+
+uint32_t InboxSync::fetched()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_fetched;
+}
+
+// ============================================================ //
+
+void InboxSync::requestPage()
+{
+    uint32_t cursor;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_cancelled) {
+
+            return;
+        }
+
+        cursor = m_cursor;
+    }
+
+    // continuations run on the thread finishing the request, the
+    // sync keeps itself alive through them
+
+    INBOX_SYNC self = shared_from_this();
+
+    m_client->postRequestAsync(InboxRequest::create(cursor, PAGE_SIZE)).then([self] (EVENT event) {
+
+        self->onPage(event);
+    });
+}
+
+// ============================================================ //
+
+void InboxSync::onPage(EVENT event)
+{
+    if (event->error().hasField("message")) {
+
+        finish(event->error()["message"].toString());
+
+        return;
+    }
+
+    UBJ::Value &data = event->data();
+
+    UBJ::Value &ids = data["ids"];
+
+    UBJ::Value &sizes = data["sizes"];
+
+    std::deque<Entry> entries;
+
+    for (uint32_t i=0; i<ids.numValues(); ++i) {
+
+        uint32_t id = ids[i].toInt();
+
+        UBJ::Object state;
+
+        // stored already, or an interrupted transfer which resumes on its own
+
+        if (m_storage->hasMessage(id) || m_storage->getTransfer(id, true, state)) {
+
+            continue;
+        }
+
+        entries.push_back({id, i < sizes.numValues() ? (uint32_t)sizes[i].toInt() : 0});
+    }
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_cancelled) {
+
+            return;
+        }
+
+        m_pending.swap(entries);
+
+        m_pageCursor = data["cursor"].toInt();
+
+        m_more = data["more"].toInt() != 0 && m_pageCursor != m_cursor;
+    }
+
+    fetchNext();
+}
+
+// ============================================================ //
+
+//! Keep up to MAX_BATCHES fetches in flight
+
+void InboxSync::fetchNext()
+{
+    std::list<std::vector<uint32_t>> batches;
+
+    bool pageDone = false;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_cancelled) {
+
+            return;
+        }
+
+        while (m_inFlight < MAX_BATCHES && !m_pending.empty()) {
+
+            std::vector<uint32_t> batch;
+
+            uint32_t bytes = 0;
+
+            while (!m_pending.empty() &&
+                   batch.size() < BATCH_SIZE &&
+                   (batch.empty() || bytes + m_pending.front().size <= BATCH_BYTES)) {
+
+                batch.push_back(m_pending.front().id);
+
+                bytes += m_pending.front().size;
+
+                m_pending.pop_front();
+            }
+
+            batches.push_back(batch);
+
+            m_inFlight++;
+        }
+
+        if (!m_inFlight && m_pending.empty()) {
+
+            pageDone = true;
+        }
+    }
+
+    INBOX_SYNC self = shared_from_this();
+
+    for (auto &batch : batches) {
+
+        uint32_t numMessages = batch.size();
+
+        m_client->postRequestAsync(MessageRequest::create(batch)).then([self, numMessages] (EVENT event) {
+
+            self->onBatch(event, numMessages);
+        });
+    }
+
+    if (!pageDone) {
+
+        return;
+    }
+
+    bool more;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_failed) {
+
+            m_failed = false;
+
+            finish("Failed to fetch messages");
+
+            return;
+        }
+
+        m_cursor = m_pageCursor;
+
+        more = m_more;
+    }
+
+    m_storage->setInboxCursor(m_cursor);
+
+    if (more) {
+
+        requestPage();
+    }
+    else {
+
+        finish();
+    }
+}
+
+// ============================================================ //
+
+void InboxSync::onBatch(EVENT event, uint32_t numMessages)
+{
+    {
+        MutexLocker locker(m_mutex);
+
+        m_inFlight--;
+
+        if (event->error().hasField("message")) {
+
+            m_failed = true;
+        }
+        else {
+
+            m_fetched += numMessages;
+        }
+    }
+
+    fetchNext();
+}
+
+// ============================================================ //
+
+void InboxSync::finish(const std::string &error)
+{
+    UBJ::Object data;
+
+    {
+        MutexLocker locker(m_mutex);
+
+        if (m_cancelled) {
+
+            return;
+        }
+
+        m_running = false;
+
+        data["messages"] = m_fetched;
+
+        data["cursor"] = m_cursor;
+    }
+
+    m_client->postEvent(Event::create(
+            Event::InboxSynced,
+            data,
+            error.empty() ? UBJ::Object() : ERROR_INFO(error)));
+}
+
+// ============================================================ //
+
+}
@@ -26,6 +26,7 @@
 
 #include "Zway/request/loginrequest.h"
 #include "Zway/client.h"
+#include "Zway/contactstatusmap.h"
 
 namespace Zway {
 
@@ -53,16 +54,25 @@ LoginRequest::LoginRequest(STORAGE storage, Callback callback)
 
     m_head["config"] = config;
 
+    // contacts to be notified about, the packed id list goes
+    // along for servers that understand it
+
     UBJ::Object contacts;
 
+    std::vector<uint32_t> ids;
+
     Storage::NODE_LIST nodes = storage->getContacts();
 
     for (auto &node : nodes) {
 
         contacts[node->user1()] = UBJ_OBJ("notifyStatus" << 1);
+
+        ids.push_back(node->user1());
     }
 
     m_head["config"]["contacts"] = contacts;
+
+    m_head["config"]["notifyContacts"] = ContactStatusMap::packIds(ids);
 }
 
 // ============================================================ //
@@ -77,6 +87,14 @@ bool LoginRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &head)
 
         m_client->setStatus(Client::LoggedIn);
 
+        // continue transfers interrupted by a lost connection
+
+        m_client->resumeTransfers();
+
+        // fetch what arrived while we were offline
+
+        m_client->syncInbox();
+
         // raise event
 
         m_client->postEvent(RequestEvent::create(
@@ -25,6 +25,7 @@
 // ============================================================ //
 
 #include "Zway/request/messagerequest.h"
+#include "Zway/request/requestevent.h"
 #include "Zway/client.h"
 
 namespace Zway {
@@ -33,55 +34,75 @@ namespace Zway {
 
 MESSAGE_REQUEST MessageRequest::create(uint32_t messageId)
 {
-    return MESSAGE_REQUEST(new MessageRequest(messageId));
+    return create(std::vector<uint32_t>{messageId});
 }
 
 // ============================================================ //
 
-MessageRequest::MessageRequest(
-        uint32_t messageId)
-    : Request(GetMessage),
-      m_messageId(messageId)
+MESSAGE_REQUEST MessageRequest::create(const std::vector<uint32_t> &messageIds, EVENT_CALLBACK callback)
 {
-
+    return MESSAGE_REQUEST(new MessageRequest(messageIds, callback));
 }
 
 // ============================================================ //
 
-bool MessageRequest::processSend()
+//! Fetch messages waiting on the server
+/*!
+ *  The server delivers the messages as usual message packets and
+ *  answers the request once all of them are queued for sending.
+ */
+
+MessageRequest::MessageRequest(
+        const std::vector<uint32_t> &messageIds,
+        EVENT_CALLBACK callback)
+    : Request(GetMessage),
+      m_messageIds(messageIds),
+      m_callback(callback)
 {
-    /*
-    if (getStatus() == 0) {
+    UBJ::Array ids;
 
-        start();
+    for (auto id : messageIds) {
 
-        UBJ::Object head;
+        ids << id;
+    }
 
-        head["messageId"] = m_messageId;
+    m_head["messageIds"] = ids;
+}
 
-        m_client->sendPacket(Packet::createFromBson(PID_GET_MESSAGE, &head));
+// ============================================================ //
 
-        finish();
-    }
-    */
+bool MessageRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &head)
+{
+    uint32_t status = head["status"].toInt();
+
+    finish();
+
+    m_client->postEvent(RequestEvent::create(
+            0,
+            shared_from_this(),
+            status == 1 ? head : UBJ::Object(),
+            status == 1 ? UBJ::Object() : ERROR_INFO(head["message"]),
+            [this] (EVENT event) {
+                invokeCallback(event);
+            }));
 
     return true;
 }
 
 // ============================================================ //
 
-bool MessageRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &/*head*/)
+void MessageRequest::invokeCallback(EVENT event)
 {
-    /*
-    if (pkt->getId() == PID_GET_MESSAGE) {
-
-        finish();
-
-        // ...
+    if (m_callback) {
+        m_callback(RequestEvent::cast(event));
     }
-    */
+}
 
-    return true;
+// ============================================================ //
+
+const std::vector<uint32_t> &MessageRequest::messageIds()
+{
+    return m_messageIds;
 }
 
 // ============================================================ //
@@ -1,217 +1,494 @@
-
-// ============================================================ //
-//
-//   d88888D db   d8b   db  .d8b.  db    db
-//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
-//      d8'  88   I8I   88 88ooo88  `8bd8'
-//     d8'   Y8   I8I   88 88~~~88    88
-//    d8' db `8b d8'8b d8' 88   88    88
-//   d88888P  `8b8' `8d8'  YP   YP    YP
-//
-//   open-source, cross-platform, crypto-messenger
-//
-//   Copyright (C) 2016 Marc Weiler
-//
-//   This library is free software; you can redistribute it and/or
-//   modify it under the terms of the GNU Lesser General Public
-//   License as published by the Free Software Foundation; either
-//   version 2.1 of the License, or (at your option) any later version.
-//
-//   This library is distributed in the hope that it will be useful,
-//   but WITHOUT ANY WARRANTY; without even the implied warranty of
-//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-//   Lesser General Public License for more details.
-//
-// ============================================================ //
-
-#include "Zway/request/request.h"
-#include "Zway/client.h"
-
-namespace Zway {
-
-// ============================================================ //
-// Request
-// ============================================================ //
-
-Request::Request(
-        Type type,
-        uint32_t timeout,
-        uint32_t delay)
-    : m_id(Crypto::mkId()),
-      m_type(type),
-      m_status(Inactive),
-      m_client(nullptr),
-      m_timeout(timeout),
-      m_delay(delay),
-      m_startTime(0)
-{
-
-}
-
-// ============================================================ //
-
-Request::~Request()
-{
-
-}
-
-// ============================================================ //
-
-bool Request::start()
-{
-    m_startTime = Client::tickCount();
-
-    setStatus(Idle);
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Request::finish()
-{
-    setStatus(Completed);
-
-    return true;
-}
-
-// ============================================================ //
-
-bool Request::processSend()
-{
-    if (status() == Idle) {
-
-        m_head["requestId"] = m_id;
-
-        m_head["requestType"] = m_type;
-
-        if (!sendPacket(Packet::createFromUbj(Packet::Request, m_head))) {
-
-            return false;
-        }
-
-        return waitResponse();
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-bool Request::processRecv(PACKET /*pkt*/, const UBJ::Value &/*head*/)
-{
-    return false;
-}
-
-// ============================================================ //
-
-bool Request::checkTimeout()
-{
-    if (m_timeout > 0 &&
-        m_startTime > 0 &&
-        Client::tickCount() >= m_startTime + m_timeout) {
-
-        setStatus(Timeout);
-
-        return true;
-    }
-
-    return false;
-}
-
-
-// ============================================================ //
-
-void Request::invokeCallback(EVENT event)
-{
-
-}
-
-// ============================================================ //
-
-bool Request::waitResponse()
-{
-    if (status() == Idle) {
-
-        setStatus(WaitingForResponse);
-
-        return true;
-    }
-
-    return false;
-}
-
-// ============================================================ //
-
-void Request::setStatus(Request::Status status)
-{
-    MutexLocker locker(m_status);
-
-    m_status = status;
-}
-
-// ============================================================ //
-
-void Request::setClient(Client *client)
-{
-    m_client = client;
-}
-
-// ============================================================ //
-
-uint32_t Request::id()
-{
-    return m_id;
-}
-
-// ============================================================ //
-
-uint32_t Request::type()
-{
-    return m_type;
-}
-
-// ============================================================ //
-
-Request::Status Request::status()
-{
-    MutexLocker locker(m_status);
-
-    return m_status;
-}
-
-// ============================================================ //
-
-uint32_t Request::timeout()
-{
-    return m_timeout;
-}
-
-// ============================================================ //
-
-bool Request::completed()
-{
-    return status() == Completed;
-}
-
-// ============================================================ //
-
-bool Request::sendPacket(PACKET pkt)
-{
-    setStatus(Sending);
-
-    if (pkt && m_client && m_client->sendPacket(pkt) > 0) {
-
-        setStatus(Idle);
-
-        return true;
-    }
-
-    setStatus(Error);
-
-    return false;
-}
-
-// ============================================================ //
-
-}
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/request/request.h"
+#include "Zway/client.h"
+
+#include <algorithm>
+
+namespace Zway {
+
+// ============================================================ //
+// Request
+// ============================================================ //
+
+//! Retry policy a request of the given type starts with
+/*!
+ *  Only requests which do the same when the server sees them
+ *  twice are retried: queries, login and config. Requests that
+ *  create or change something on the server are sent once.
+ */
+
+Request::RetryPolicy Request::defaultRetryPolicy(Type type)
+{
+    RetryPolicy policy;
+
+    policy.maxAttempts = 1;
+
+    policy.baseDelay = 1000;
+
+    policy.maxDelay = 8000;
+
+    policy.idempotent = false;
+
+    switch (type) {
+
+    case Login:
+    case Config:
+    case FindContact:
+    case ContactStatus:
+    case GetInbox:
+    case GetMessage:
+    case ResumeMessage:
+
+        policy.maxAttempts = 3;
+
+        policy.idempotent = true;
+
+        break;
+
+    default:
+
+        break;
+    }
+
+    return policy;
+}
+
+// ============================================================ //
+
+Request::Request(
+        Type type,
+        uint32_t timeout,
+        uint32_t delay)
+    : m_id(Crypto::mkId()),
+      m_type(type),
+      m_status(Inactive),
+      m_client(nullptr),
+      m_timeout(timeout),
+      m_delay(delay),
+      m_startTime(0),
+      m_timer(0),
+      m_retryPolicy(defaultRetryPolicy(type)),
+      m_attempts(0),
+      m_sentTime(0)
+{
+
+}
+
+// ============================================================ //
+
+Request::~Request()
+{
+
+}
+
+// ============================================================ //
+
+bool Request::start()
+{
+    m_attempts++;
+
+    m_startTime = Client::tickCount();
+
+    setStatus(Idle);
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Request::finish()
+{
+    setStatus(Completed);
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Request::processSend()
+{
+    if (status() == Idle) {
+
+        m_head["requestId"] = m_id;
+
+        m_head["requestType"] = m_type;
+
+        if (!sendPacket(Packet::createFromUbj(Packet::Request, m_head))) {
+
+            return false;
+        }
+
+        return waitResponse();
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+bool Request::processRecv(PACKET /*pkt*/, const UBJ::Value &/*head*/)
+{
+    return false;
+}
+
+// ============================================================ //
+
+bool Request::checkTimeout()
+{
+    if (m_timeout > 0 &&
+        m_startTime > 0 &&
+        Client::tickCount() >= m_startTime + m_timeout) {
+
+        setStatus(Timeout);
+
+        return true;
+    }
+
+    return false;
+}
+
+
+// ============================================================ //
+
+void Request::invokeCallback(EVENT event)
+{
+
+}
+
+// ============================================================ //
+
+bool Request::waitResponse()
+{
+    if (status() == Idle) {
+
+        setStatus(WaitingForResponse);
+
+        return true;
+    }
+
+    return false;
+}
+
+// ============================================================ //
+
+void Request::setStatus(Request::Status status)
+{
+    MutexLocker locker(m_status);
+
+    m_status = status;
+}
+
+// ============================================================ //
+
+void Request::setClient(Client *client)
+{
+    m_client = client;
+}
+
+// ============================================================ //
+
+uint32_t Request::id()
+{
+    return m_id;
+}
+
+// ============================================================ //
+
+uint32_t Request::type()
+{
+    return m_type;
+}
+
+// ============================================================ //
+
+Request::Status Request::status()
+{
+    MutexLocker locker(m_status);
+
+    return m_status;
+}
+
+// ============================================================ //
+
+uint32_t Request::timeout()
+{
+    return m_timeout;
+}
+
+// ============================================================ //
+
+//! Milliseconds until the request times out
+/*!
+ *  A request which has not been started yet has its full
+ *  timeout left. Returns 0 for requests without timeout.
+ */
+
+uint32_t Request::timeLeft()
+{
+    if (m_timeout == 0) {
+
+        return 0;
+    }
+
+    if (m_startTime == 0) {
+
+        return m_timeout;
+    }
+
+    uint32_t elapsed = Client::tickCount() - m_startTime;
+
+    return elapsed < m_timeout ? m_timeout - elapsed : 0;
+}
+
+// ============================================================ //
+
+uint32_t Request::delay()
+{
+    return m_delay;
+}
+
+// ============================================================ //
+
+void Request::setRetryPolicy(const RetryPolicy &policy)
+{
+    m_retryPolicy = policy;
+}
+
+// ============================================================ //
+
+Request::RetryPolicy Request::retryPolicy()
+{
+    return m_retryPolicy;
+}
+
+// ============================================================ //
+
+uint32_t Request::attempts()
+{
+    return m_attempts;
+}
+
+// ============================================================ //
+
+//! Prepare another attempt after a timeout or send error
+/*!
+ *  Returns false if the policy does not allow another attempt.
+ *  Otherwise the request goes back to Inactive and delay is set
+ *  to the exponential backoff for this attempt, of which the
+ *  upper half is jittered by random so that many requests
+ *  failing together do not come back together.
+ */
+
+bool Request::retry(uint32_t random, uint32_t *delay)
+{
+    if (!m_retryPolicy.idempotent || m_attempts >= m_retryPolicy.maxAttempts) {
+
+        return false;
+    }
+
+    uint32_t backoff = m_retryPolicy.baseDelay;
+
+    for (uint32_t i=1; i<m_attempts && backoff < m_retryPolicy.maxDelay; ++i) {
+
+        backoff *= 2;
+    }
+
+    backoff = std::min(backoff, m_retryPolicy.maxDelay);
+
+    if (delay) {
+
+        *delay = backoff / 2 + (backoff > 1 ? random % (backoff - backoff / 2) : 0);
+    }
+
+    m_startTime = 0;
+
+    setStatus(Inactive);
+
+    return true;
+}
+
+// ============================================================ //
+
+//! Future of the event that finishes the request
+/*!
+ *  That is the event posted once the request completed, failed
+ *  or timed out for good
+ */
+
+std::shared_future<EVENT> Request::result()
+{
+    MutexLocker locker(m_resultMutex);
+
+    if (!m_promise) {
+
+        m_promise = std::make_shared<std::promise<EVENT>>();
+
+        m_future = m_promise->get_future().share();
+
+        if (m_result) {
+
+            m_promise->set_value(m_result);
+        }
+    }
+
+    return m_future;
+}
+
+// ============================================================ //
+
+//! Run continuation with the finishing event
+/*!
+ *  Runs right away if the request has finished already, else
+ *  on the thread that finishes it, which is the client or the
+ *  timer thread. A continuation must not block.
+ */
+
+void Request::then(std::function<void (EVENT)> continuation)
+{
+    EVENT result;
+
+    {
+        MutexLocker locker(m_resultMutex);
+
+        if (!m_result) {
+
+            m_continuations.push_back(continuation);
+
+            return;
+        }
+
+        result = m_result;
+    }
+
+    continuation(result);
+}
+
+// ============================================================ //
+
+//! Finish the request's result, only the first call counts
+
+bool Request::resolve(EVENT event)
+{
+    std::list<std::function<void (EVENT)>> continuations;
+
+    {
+        MutexLocker locker(m_resultMutex);
+
+        if (m_result || !event) {
+
+            return false;
+        }
+
+        m_result = event;
+
+        if (m_promise) {
+
+            m_promise->set_value(event);
+        }
+
+        continuations.swap(m_continuations);
+    }
+
+    for (auto &continuation : continuations) {
+
+        continuation(event);
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+bool Request::resolved()
+{
+    MutexLocker locker(m_resultMutex);
+
+    return m_result != nullptr;
+}
+
+// ============================================================ //
+
+void Request::setTimer(uint32_t timer)
+{
+    m_timer = timer;
+}
+
+// ============================================================ //
+
+uint32_t Request::timer()
+{
+    return m_timer;
+}
+
+// ============================================================ //
+
+bool Request::completed()
+{
+    return status() == Completed;
+}
+
+// ============================================================ //
+
+//! Get the time the last packet was sent and clear it
+/*!
+ *  So only the first response to a packet counts for the
+ *  round trip time
+ */
+
+uint64_t Request::takeSentTime()
+{
+    return m_sentTime.exchange(0);
+}
+
+// ============================================================ //
+
+bool Request::sendPacket(PACKET pkt)
+{
+    setStatus(Sending);
+
+    // stamped before sending, the response may beat us back
+
+    m_sentTime = Metrics::now();
+
+    if (pkt && m_client && m_client->sendPacket(pkt) > 0) {
+
+        setStatus(Idle);
+
+        return true;
+    }
+
+    m_sentTime = 0;
+
+    setStatus(Error);
+
+    return false;
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,132 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/request/requestfuture.h"
+
+namespace Zway {
+
+// ============================================================ //
+// RequestFuture
+// ============================================================ //
+
+RequestFuture::RequestFuture(REQUEST request)
+    : m_request(request)
+{
+
+}
+
+// ============================================================ //
+
+RequestFuture::RequestFuture(EVENT event)
+    : m_event(event)
+{
+
+}
+
+// ============================================================ //
+
+bool RequestFuture::posted() const
+{
+    return m_request != nullptr;
+}
+
+// ============================================================ //
+
+REQUEST RequestFuture::request() const
+{
+    return m_request;
+}
+
+// ============================================================ //
+
+bool RequestFuture::ready()
+{
+    return !m_request || m_request->resolved();
+}
+
+// ============================================================ //
+
+bool RequestFuture::waitFor(uint32_t ms)
+{
+    if (ready()) {
+
+        return true;
+    }
+
+    return m_request->result().wait_for(std::chrono::milliseconds(ms)) == std::future_status::ready;
+}
+
+// ============================================================ //
+
+//! Wait for the result
+/*!
+ *  Must not be called on the client thread, which is the one
+ *  that receives the response
+ */
+
+EVENT RequestFuture::get()
+{
+    if (!m_request) {
+
+        return m_event;
+    }
+
+    return m_request->result().get();
+}
+
+// ============================================================ //
+
+std::shared_future<EVENT> RequestFuture::future()
+{
+    if (!m_request) {
+
+        std::promise<EVENT> promise;
+
+        promise.set_value(m_event);
+
+        return promise.get_future().share();
+    }
+
+    return m_request->result();
+}
+
+// ============================================================ //
+
+void RequestFuture::then(std::function<void (EVENT)> continuation)
+{
+    if (!m_request) {
+
+        continuation(m_event);
+
+        return;
+    }
+
+    m_request->then(continuation);
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,142 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/request/requesttable.h"
+
+namespace Zway {
+
+// ============================================================ //
+// RequestTable
+// ============================================================ //
+
+RequestTable::RequestTable()
+{
+
+}
+
+// ============================================================ //
+
+void RequestTable::add(REQUEST request)
+{
+    Shard &s = shard(request->id());
+
+    MutexLocker locker(s.mutex);
+
+    s.requests[request->id()] = request;
+}
+
+// ============================================================ //
+
+REQUEST RequestTable::find(uint32_t requestId)
+{
+    Shard &s = shard(requestId);
+
+    MutexLocker locker(s.mutex);
+
+    auto it = s.requests.find(requestId);
+
+    if (it == s.requests.end()) {
+
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+// ============================================================ //
+
+bool RequestTable::remove(uint32_t requestId)
+{
+    Shard &s = shard(requestId);
+
+    MutexLocker locker(s.mutex);
+
+    return s.requests.erase(requestId) > 0;
+}
+
+// ============================================================ //
+
+void RequestTable::clear()
+{
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        s.requests.clear();
+    }
+}
+
+// ============================================================ //
+
+//! Snapshot of all pending requests
+/*!
+ *  Shards are locked one after the other, so the snapshot is
+ *  not atomic across the table
+ */
+
+REQUEST_LIST RequestTable::requests()
+{
+    REQUEST_LIST res;
+
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        for (auto &it : s.requests) {
+
+            res.push_back(it.second);
+        }
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+uint32_t RequestTable::size()
+{
+    uint32_t res = 0;
+
+    for (auto &s : m_shards) {
+
+        MutexLocker locker(s.mutex);
+
+        res += s.requests.size();
+    }
+
+    return res;
+}
+
+// ============================================================ //
+
+RequestTable::Shard &RequestTable::shard(uint32_t requestId)
+{
+    return m_shards[(requestId ^ (requestId >> 16)) % NUM_SHARDS];
+}
+
+// ============================================================ //
+
+}
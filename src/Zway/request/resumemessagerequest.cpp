@@ -0,0 +1,128 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/request/resumemessagerequest.h"
+#include "Zway/client.h"
+
+namespace Zway {
+
+// ============================================================ //
+
+RESUME_MESSAGE_REQUEST ResumeMessageRequest::create(
+        uint32_t messageId,
+        uint32_t messagePart,
+        bool incoming,
+        Callback callback)
+{
+    return RESUME_MESSAGE_REQUEST(new ResumeMessageRequest(messageId, messagePart, incoming, callback));
+}
+
+// ============================================================ //
+
+ResumeMessageRequest::ResumeMessageRequest(
+        uint32_t messageId,
+        uint32_t messagePart,
+        bool incoming,
+        Callback callback)
+    : Request(ResumeMessage, DEFAULT_TIMEOUT, 0),
+      m_messageId(messageId),
+      m_messagePart(messagePart),
+      m_callback(callback)
+{
+    m_head["messageId"] = messageId;
+
+    m_head["messagePart"] = messagePart;
+
+    m_head["incoming"] = incoming ? 1 : 0;
+}
+
+// ============================================================ //
+
+bool ResumeMessageRequest::processRecv(PACKET /*pkt*/, const UBJ::Value &head)
+{
+    uint32_t status = head["status"].toInt();
+
+    if (status == 1) {
+
+        finish();
+
+        m_messagePart = head["messagePart"].toInt();
+
+        m_client->postEvent(RequestEvent::create(
+                0,
+                shared_from_this(),
+                head,
+                UBJ::Object(),
+                [this] (EVENT event) {
+                    invokeCallback(event);
+                }));
+    }
+    else
+    if (status == 0) {
+
+        finish();
+
+        m_client->postEvent(RequestEvent::create(
+                0,
+                shared_from_this(),
+                UBJ::Object(),
+                ERROR_INFO(head["message"]),
+                [this] (EVENT event) {
+                    invokeCallback(event);
+                }));
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+void ResumeMessageRequest::invokeCallback(EVENT event)
+{
+    if (m_callback) {
+        m_callback(
+            RequestEvent::cast(event),
+            std::dynamic_pointer_cast<ResumeMessageRequest>(shared_from_this()));
+    }
+}
+
+// ============================================================ //
+
+uint32_t ResumeMessageRequest::messageId()
+{
+    return m_messageId;
+}
+
+// ============================================================ //
+
+uint32_t ResumeMessageRequest::messagePart()
+{
+    return m_messagePart;
+}
+
+// ============================================================ //
+
+}
@@ -0,0 +1,250 @@
+
+// ============================================================ //
+//
+//   d88888D db   d8b   db  .d8b.  db    db
+//   YP  d8' 88   I8I   88 d8' `8b `8b  d8'
+//      d8'  88   I8I   88 88ooo88  `8bd8'
+//     d8'   Y8   I8I   88 88~~~88    88
+//    d8' db `8b d8'8b d8' 88   88    88
+//   d88888P  `8b8' `8d8'  YP   YP    YP
+//
+//   open-source, cross-platform, crypto-messenger
+//
+//   Copyright (C) 2016 Marc Weiler
+//
+//   This library is free software; you can redistribute it and/or
+//   modify it under the terms of the GNU Lesser General Public
+//   License as published by the Free Software Foundation; either
+//   version 2.1 of the License, or (at your option) any later version.
+//
+//   This library is distributed in the hope that it will be useful,
+//   but WITHOUT ANY WARRANTY; without even the implied warranty of
+//   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//   Lesser General Public License for more details.
+//
+// ============================================================ //
+
+#include "Zway/timer.h"
+
+namespace Zway {
+
+// ============================================================ //
+// Timer
+// ============================================================ //
+
+Timer::Timer()
+    : Thread(),
+      m_nextId(0),
+      m_running(false)
+{
+
+}
+
+// ============================================================ //
+
+//! Call back once ms milliseconds have passed
+/*!
+ *  Returns the id of the new timer, which is never 0
+ */
+
+uint32_t Timer::start(uint32_t ms, Callback callback)
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    do {
+
+        ++m_nextId;
+    }
+    while (!m_nextId || m_callbacks.find(m_nextId) != m_callbacks.end());
+
+    Entry entry;
+
+    entry.deadline = Clock::now() + std::chrono::milliseconds(ms);
+
+    entry.id = m_nextId;
+
+    // the thread only needs to wake up if the new timer is the earliest one
+
+    bool earliest = m_heap.empty() || entry.deadline < m_heap.top().deadline;
+
+    m_heap.push(entry);
+
+    m_callbacks[entry.id] = callback;
+
+    if (earliest) {
+
+        m_cond.notify_one();
+    }
+
+    return entry.id;
+}
+
+// ============================================================ //
+
+//! Stop a pending timer
+/*!
+ *  Returns false if the timer has fired already or never existed
+ */
+
+bool Timer::stop(uint32_t id)
+{
+    MutexLocker locker(m_mutex);
+
+    if (!m_callbacks.erase(id)) {
+
+        return false;
+    }
+
+    // drop stopped entries once they outnumber the pending ones
+
+    if (m_heap.size() > 2 * m_callbacks.size() + 64) {
+
+        compact();
+    }
+
+    return true;
+}
+
+// ============================================================ //
+
+uint32_t Timer::numPending()
+{
+    MutexLocker locker(m_mutex);
+
+    return m_callbacks.size();
+}
+
+// ============================================================ //
+
+void Timer::clear()
+{
+    MutexLocker locker(m_mutex);
+
+    m_heap = decltype(m_heap)();
+
+    m_callbacks.clear();
+}
+
+// ============================================================ //
+
+//! Wait for a callback being run
+/*!
+ *  Once a timer is stopped, its callback may still be running.
+ *  After sync() it has returned. Does not wait when called from
+ *  a callback.
+ */
+
+void Timer::sync()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    if (std::this_thread::get_id() == m_thread.get_id()) {
+
+        return;
+    }
+
+    m_idle.wait(locker, [this] () {
+        return !m_running;
+    });
+}
+
+// ============================================================ //
+
+void Timer::cancel()
+{
+    Thread::cancel();
+
+    MutexLocker locker(m_mutex);
+
+    m_cond.notify_one();
+}
+
+// ============================================================ //
+
+void Timer::onRun()
+{
+    std::unique_lock<std::mutex> locker(m_mutex);
+
+    for (;;) {
+
+        if (testCancel()) {
+
+            break;
+        }
+
+        if (m_heap.empty()) {
+
+            m_cond.wait(locker);
+
+            continue;
+        }
+
+        Entry entry = m_heap.top();
+
+        auto it = m_callbacks.find(entry.id);
+
+        if (it == m_callbacks.end()) {
+
+            // stopped
+
+            m_heap.pop();
+
+            continue;
+        }
+
+        if (Clock::now() < entry.deadline) {
+
+            m_cond.wait_until(locker, entry.deadline);
+
+            continue;
+        }
+
+        m_heap.pop();
+
+        Callback callback = std::move(it->second);
+
+        m_callbacks.erase(it);
+
+        // run callback unlocked, so it may start and stop timers
+
+        m_running = true;
+
+        locker.unlock();
+
+        callback(entry.id);
+
+        locker.lock();
+
+        m_running = false;
+
+        m_idle.notify_all();
+    }
+}
+
+// ============================================================ //
+
+void Timer::compact()
+{
+    std::vector<Entry> entries;
+
+    entries.reserve(m_callbacks.size());
+
+    while (!m_heap.empty()) {
+
+        if (m_callbacks.find(m_heap.top().id) != m_callbacks.end()) {
+
+            entries.push_back(m_heap.top());
+        }
+
+        m_heap.pop();
+    }
+
+    for (auto &entry : entries) {
+
+        m_heap.push(entry);
+    }
+}
+
+// ============================================================ //
+
+}